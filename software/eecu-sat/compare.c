@@ -0,0 +1,657 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <limits.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "input.h"
+#include "parsers.h"
+#include "fail_range.h"
+#include "compare.h"
+
+/*
+ * comparison of a capture under test against a known good reference.
+ *
+ * channels are paired in input order. the time offset between the two
+ * captures is found by cross-correlating the first window + max_lag
+ * samples of every channel pair with an fft, so any offset up to max_lag
+ * still overlaps by a full window. the correlations are either used for
+ * every channel on its own or summed over all of them for a single global
+ * offset. the aligned channels are then streamed
+ * block by block from both inputs, so captures do not need to fit in
+ * memory, and the pairs are spread over a pool of threads.
+ *
+ * a batch run compares many captures against the same reference. the
+ * reference is read into memory once and shared read-only, every capture
+ * is aligned and compared on its own thread of a pool, one after the
+ * other channel, so the captures and not the channels are spread over
+ * the cpus.
+ */
+
+#define  COMPARE_BLOCK  65536
+
+#define  ALIGN_NONE     0
+#define  ALIGN_GLOBAL   1
+#define  ALIGN_CHANNEL  2
+
+struct compare_opt {
+    uint8_t align;
+    uint32_t window;
+    uint32_t max_lag;
+    float tolerance;
+    uint32_t min_fail;
+    uint32_t gap;
+    uint32_t ranges;
+};
+
+struct compare_channel {
+    const ch_data_t *ref;
+    const ch_data_t *dut;
+    const struct compare_opt *copt;
+    double *xcorr;              // normalized cross-correlation, 2 * max_lag + 1 values
+    ssize_t lag;                // the dut sample that matches reference sample s is s + lag
+    int ret;
+
+    ssize_t samples;
+    double mean_err;
+    double rms_err;
+    float max_err;
+    ssize_t max_at;
+    double corr;
+    struct sat_fail_tracker fails;  // in reference samples, at most copt->ranges ranges are listed
+};
+
+static struct sr_option options[] = {
+    {"align", "align", "'global', 'channel' or 'none'", NULL, NULL},
+    {"window", "window", "samples at the start of every channel used for the alignment", NULL, NULL},
+    {"max_lag", "max_lag", "largest offset in samples that is searched, 0 means the length of the window", NULL, NULL},
+    {"tolerance", "tolerance", "largest deviation in volts that still passes", NULL, NULL},
+    {"min_fail", "min_fail", "samples a deviation has to last before it counts as a failure", NULL, NULL},
+    {"gap", "gap", "failures closer than this many samples are joined into one range", NULL, NULL},
+    {"ranges", "ranges", "number of failing ranges listed for every channel", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string("global"));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(65536));
+        options[2].def = g_variant_ref_sink(g_variant_new_uint32(0));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0.25));
+        options[4].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[5].def = g_variant_ref_sink(g_variant_new_uint32(0));
+        options[6].def = g_variant_ref_sink(g_variant_new_uint32(10));
+    }
+
+    return options;
+}
+
+static GVariant *option_get(GHashTable *given, const struct sr_option *opt)
+{
+    GVariant *v;
+
+    if (given && (v = g_hash_table_lookup(given, opt->id)))
+        return v;
+
+    return opt->def;
+}
+
+static int parse_compare_opt(const char *arg, struct compare_opt *copt)
+{
+    const struct sr_option *opts = get_options();
+    const struct sr_option **optp;
+    GHashTable *args, *given = NULL;
+    const char *align;
+    int i, ret = SR_OK;
+
+    if ((args = parse_generic_arg(arg, FALSE, NULL))) {
+        optp = g_malloc0(sizeof(options) / sizeof(options[0]) * sizeof(struct sr_option *));
+        for (i = 0; opts[i].id; i++)
+            optp[i] = &opts[i];
+        given = generic_arg_to_opt(optp, args);
+        if (warn_unknown_keys(optp, args, "Unknown compare option"))
+            ret = SR_ERR_ARG;
+        g_free(optp);
+        g_hash_table_destroy(args);
+    }
+
+    align = g_variant_get_string(option_get(given, &opts[0]), NULL);
+    if (!strcmp(align, "global"))
+        copt->align = ALIGN_GLOBAL;
+    else if (!strcmp(align, "channel"))
+        copt->align = ALIGN_CHANNEL;
+    else if (!strcmp(align, "none"))
+        copt->align = ALIGN_NONE;
+    else {
+        err_msg("%s:%d the alignment must be 'global', 'channel' or 'none'", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+    }
+    copt->window = g_variant_get_uint32(option_get(given, &opts[1]));
+    copt->max_lag = g_variant_get_uint32(option_get(given, &opts[2]));
+    copt->tolerance = g_variant_get_double(option_get(given, &opts[3]));
+    copt->min_fail = MAX(1, g_variant_get_uint32(option_get(given, &opts[4])));
+    copt->gap = g_variant_get_uint32(option_get(given, &opts[5]));
+    copt->ranges = g_variant_get_uint32(option_get(given, &opts[6]));
+
+    if (copt->window < 16) {
+        err_msg("%s:%d the alignment window must hold at least 16 samples", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+    }
+    if (!(copt->tolerance >= 0)) {
+        err_msg("%s:%d the tolerance can't be negative", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+    }
+
+    if (given)
+        g_hash_table_destroy(given);
+
+    return ret;
+}
+
+static ssize_t read_samples(const ch_data_t *ch, const ssize_t start, float *buf, const ssize_t n)
+{
+    struct sat_input *in;
+    ssize_t len, got = 0;
+
+    if (!(in = sat_input_open(ch)))
+        return SR_ERR_IO;
+    if (start && (sat_input_seek(in, start) != SR_OK)) {
+        sat_input_close(in);
+        return SR_ERR_IO;
+    }
+    while ((got < n) && ((len = sat_input_read(in, buf + got, n - got)) > 0))
+        got += len;
+    sat_input_close(in);
+
+    return got;
+}
+
+// remove the mean, returns the energy that is left
+static double center(float *x, const ssize_t n)
+{
+    double sum = 0, energy = 0;
+    ssize_t i;
+    float m;
+
+    for (i = 0; i < n; i++)
+        sum += x[i];
+    m = sum / n;
+    for (i = 0; i < n; i++) {
+        x[i] -= m;
+        energy += (double) x[i] * x[i];
+    }
+
+    return energy;
+}
+
+static void align_channel(struct compare_channel *c, const uint32_t window)
+{
+    const uint32_t max_lag = c->copt->max_lag;
+    const uint32_t span = window + max_lag;
+    ssize_t xlen, ylen;
+    float *x, *y;
+    double ex, ey;
+    uint32_t k;
+
+    // the captures are zero padded if they are shorter than the span
+    x = g_malloc0(span * sizeof(float));
+    y = g_malloc0(span * sizeof(float));
+    c->xcorr = g_malloc0((2 * max_lag + 1) * sizeof(double));
+
+    xlen = read_samples(c->ref, 0, x, MIN(span, c->ref->sample_count));
+    ylen = read_samples(c->dut, 0, y, MIN(span, c->dut->sample_count));
+    if ((xlen < window) || (ylen < window)) {
+        err_msg("%s:%d unable to read %s or %s", __FILE__, __LINE__, c->ref->input_file_name, c->dut->input_file_name);
+        c->ret = SR_ERR_IO;
+        goto cleanup;
+    }
+
+    ex = center(x, xlen);
+    ey = center(y, ylen);
+    // a flat channel carries no timing information
+    if ((ex == 0) || (ey == 0))
+        goto cleanup;
+
+    dsp_xcorr(x, y, span, max_lag, c->xcorr);
+    for (k = 0; k < 2 * max_lag + 1; k++)
+        c->xcorr[k] /= sqrt(ex * ey);
+
+ cleanup:
+    g_free(x);
+    g_free(y);
+}
+
+static ssize_t best_lag(const double *xcorr, const uint32_t max_lag)
+{
+    uint32_t k, best = max_lag;
+
+    for (k = 0; k < 2 * max_lag + 1; k++) {
+        // on a tie the smaller offset wins
+        if ((xcorr[k] > xcorr[best]) || ((xcorr[k] == xcorr[best]) && (labs((ssize_t) k - max_lag) < labs((ssize_t) best - max_lag))))
+            best = k;
+    }
+
+    return (ssize_t) best - max_lag;
+}
+
+static void fail_group(struct compare_channel *c, const ssize_t s, const float *x, const float *y, const ssize_t n)
+{
+    ssize_t i;
+    float ae;
+
+    for (i = 0; i < n; i++) {
+        ae = fabsf(y[i] - x[i]);
+        // NaN fails as well
+        if (!(ae <= c->copt->tolerance))
+            sat_fail_add(&c->fails, s + i, ae);
+    }
+}
+
+static void compare_channel(struct compare_channel *c)
+{
+    const v4sf vtol = v4sf_set1(c->copt->tolerance);
+    const ssize_t r0 = MAX(0, -c->lag);
+    const ssize_t d0 = MAX(0, c->lag);
+    struct sat_input *ref = NULL, *dut = NULL;
+    float *x, *y;
+    ssize_t len, rlen, dlen, i, j, s = r0;
+    double kx = 0, ky = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0, se = 0, see = 0;
+    double dx, dy, vx, vy;
+    float e, blk_max;
+    v4sf vd, vmax;
+
+    sat_fail_init(&c->fails, c->copt->ranges, c->copt->gap, c->copt->min_fail);
+    c->max_at = -1;
+
+    x = g_malloc(COMPARE_BLOCK * sizeof(float));
+    y = g_malloc(COMPARE_BLOCK * sizeof(float));
+
+    if (!(ref = sat_input_open(c->ref)) || (r0 && (sat_input_seek(ref, r0) != SR_OK)) ||
+        !(dut = sat_input_open(c->dut)) || (d0 && (sat_input_seek(dut, d0) != SR_OK))) {
+        c->ret = SR_ERR_IO;
+        goto cleanup;
+    }
+
+    len = MIN(c->ref->sample_count - r0, c->dut->sample_count - d0);
+    while (c->samples < len) {
+        rlen = sat_input_read(ref, x, MIN(COMPARE_BLOCK, len - c->samples));
+        dlen = sat_input_read(dut, y, rlen > 0 ? rlen : 0);
+        if ((rlen <= 0) || (dlen != rlen)) {
+            err_msg("%s:%d short read in %s or %s", __FILE__, __LINE__, c->ref->input_file_name, c->dut->input_file_name);
+            c->ret = SR_ERR_IO;
+            goto cleanup;
+        }
+
+        // sums of values shifted by the first sample keep the variance accurate
+        if (!c->samples) {
+            kx = x[0];
+            ky = y[0];
+        }
+
+        // groups of four samples within the tolerance are the common case
+        vmax = v4sf_set1(0);
+        for (i = 0; i + V4SF_LANES <= rlen; i += V4SF_LANES) {
+            vd = v4sf_abs(v4sf_load(y + i) - v4sf_load(x + i));
+            vmax = v4sf_max(vmax, vd);
+            if (v4si_any(~(vd <= vtol)))
+                fail_group(c, s + i, x + i, y + i, V4SF_LANES);
+        }
+        blk_max = v4sf_hmax(vmax);
+        if (i < rlen) {
+            for (j = i; j < rlen; j++)
+                blk_max = MAX(blk_max, fabsf(y[j] - x[j]));
+            fail_group(c, s + i, x + i, y + i, rlen - i);
+        }
+        if ((blk_max > c->max_err) || (c->max_at < 0)) {
+            for (j = 0; (j < rlen) && (fabsf(y[j] - x[j]) != blk_max); j++);
+            if (j < rlen) {
+                c->max_err = blk_max;
+                c->max_at = s + j;
+            }
+        }
+        s += rlen;
+
+        for (i = 0; i < rlen; i++) {
+            dx = x[i] - kx;
+            dy = y[i] - ky;
+            sx += dx;
+            sy += dy;
+            sxx += dx * dx;
+            syy += dy * dy;
+            sxy += dx * dy;
+            e = y[i] - x[i];
+            se += e;
+            see += (double) e * e;
+        }
+        c->samples += rlen;
+    }
+    sat_fail_close(&c->fails);
+
+    if (c->samples) {
+        c->mean_err = se / c->samples;
+        c->rms_err = sqrt(see / c->samples);
+        vx = sxx - sx * sx / c->samples;
+        vy = syy - sy * sy / c->samples;
+        c->corr = ((vx > 0) && (vy > 0)) ? (sxy - sx * sy / c->samples) / sqrt(vx * vy) : NAN;
+    }
+
+ cleanup:
+    if (ref)
+        sat_input_close(ref);
+    if (dut)
+        sat_input_close(dut);
+    g_free(x);
+    g_free(y);
+}
+
+// one capture under test
+struct compare_run {
+    const struct sr_dev_inst *sdi;
+    const char *name;
+    struct compare_opt copt;    // max_lag depends on the length of the capture
+    struct compare_channel *ch;
+    uint32_t cnt;
+    uint32_t window;
+    ssize_t lag;                // of a global alignment
+    uint32_t failed;
+    int ret;
+};
+
+static void align_task(gpointer data, gpointer user_data)
+{
+    align_channel(data, GPOINTER_TO_UINT(user_data));
+}
+
+static void compare_task(gpointer data, gpointer user_data)
+{
+    UNUSED(user_data);
+    compare_channel(data);
+}
+
+static void run_pool(GFunc func, gpointer user_data, struct compare_channel *ch, const uint32_t cnt)
+{
+    GThreadPool *pool;
+    uint32_t i;
+
+    pool = g_thread_pool_new(func, user_data, MIN(cnt, g_get_num_processors()), TRUE, NULL);
+    for (i = 0; i < cnt; i++)
+        g_thread_pool_push(pool, &ch[i], NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+static const char *channel_name(const ch_data_t *ch, char *buf)
+{
+    char *base;
+
+    if (ch->channel_name)
+        return ch->channel_name;
+    base = g_path_get_basename(ch->input_file_name);
+    g_strlcpy(buf, base, PATH_MAX);
+    g_free(base);
+
+    return buf;
+}
+
+static void report(const struct compare_channel *ch, const uint32_t cnt)
+{
+    const struct compare_channel *c;
+    char name[PATH_MAX];
+    double rate;
+    uint32_t i;
+
+    fprintf(stdout, "%3s %-16s %8s %10s %11s %11s %11s %12s %9s %10s %s\n", "ch", "name", "offset", "samples",
+            "mean_err", "rms_err", "max_err", "max_at_s", "corr", "fail", "result");
+    for (i = 0; i < cnt; i++) {
+        c = &ch[i];
+        rate = c->ref->samplerate;
+        fprintf(stdout, "%3d %-16s %8ld %10ld %11.6f %11.6f %11.6f %12.6f %9.6f %10lu %s\n", c->ref->id, channel_name(c->ref, name), c->lag,
+                c->samples, c->mean_err, c->rms_err, c->max_err, c->max_at / rate, c->corr, c->fails.samples,
+                c->fails.ranges ? "FAIL" : "pass");
+        sat_fail_print(stdout, &c->fails, rate, "peak ", "", 6);
+    }
+}
+
+// pair the channels of a capture with the ones of the reference
+static int run_setup(struct compare_run *run, const struct sr_dev_inst *ref_sdi)
+{
+    const struct sr_dev_inst *sdi = run->sdi;
+    GSList *r, *d;
+    uint32_t i;
+
+    run->cnt = MIN(g_slist_length(ref_sdi->channels), g_slist_length(sdi->channels));
+    if (g_slist_length(ref_sdi->channels) != g_slist_length(sdi->channels))
+        err_msg("warning: the reference has %u channels and the capture under test %u, only the first %u are compared\n",
+                g_slist_length(ref_sdi->channels), g_slist_length(sdi->channels), run->cnt);
+
+    run->ch = g_malloc0(run->cnt * sizeof(struct compare_channel));
+    run->window = run->copt.window;
+    for (i = 0, r = ref_sdi->channels, d = sdi->channels; i < run->cnt; i++, r = r->next, d = d->next) {
+        run->ch[i].ref = r->data;
+        run->ch[i].dut = d->data;
+        run->ch[i].copt = &run->copt;
+        if (run->ch[i].ref->samplerate != run->ch[i].dut->samplerate) {
+            err_msg("%s:%d %s is sampled at %lu Hz but the reference %s at %lu Hz", __FILE__, __LINE__, run->ch[i].dut->input_file_name,
+                    run->ch[i].dut->samplerate, run->ch[i].ref->input_file_name, run->ch[i].ref->samplerate);
+            return SR_ERR_ARG;
+        }
+        run->window = MIN(run->window, MIN(run->ch[i].ref->sample_count, run->ch[i].dut->sample_count));
+    }
+
+    return SR_OK;
+}
+
+// align and compare every channel pair, either on a pool of threads or one after the other
+static int run_channels(struct compare_run *run, const bool threaded)
+{
+    struct compare_opt *copt = &run->copt;
+    struct compare_channel *ch = run->ch;
+    double *sum = NULL;
+    uint32_t i, k;
+    int ret = SR_OK;
+
+    if (copt->align != ALIGN_NONE) {
+        if (run->window < 16) {
+            err_msg("%s:%d the captures are too short to be aligned", __FILE__, __LINE__);
+            return SR_ERR_ARG;
+        }
+        if (!copt->max_lag)
+            copt->max_lag = run->window;
+        if (threaded)
+            run_pool(align_task, GUINT_TO_POINTER(run->window), ch, run->cnt);
+        else
+            for (i = 0; i < run->cnt; i++)
+                align_channel(&ch[i], run->window);
+
+        sum = g_malloc0((2 * copt->max_lag + 1) * sizeof(double));
+        for (i = 0; i < run->cnt; i++) {
+            if ((ret = ch[i].ret) != SR_OK)
+                goto cleanup;
+            for (k = 0; k < 2 * copt->max_lag + 1; k++)
+                sum[k] += ch[i].xcorr[k];
+            ch[i].lag = best_lag(ch[i].xcorr, copt->max_lag);
+        }
+        if (copt->align == ALIGN_GLOBAL) {
+            run->lag = best_lag(sum, copt->max_lag);
+            for (i = 0; i < run->cnt; i++)
+                ch[i].lag = run->lag;
+        }
+    }
+
+    if (threaded)
+        run_pool(compare_task, NULL, ch, run->cnt);
+    else
+        for (i = 0; i < run->cnt; i++)
+            compare_channel(&ch[i]);
+    for (i = 0; i < run->cnt; i++) {
+        if ((ret = ch[i].ret) != SR_OK)
+            goto cleanup;
+        run->failed += ch[i].fails.ranges ? 1 : 0;
+    }
+
+ cleanup:
+    g_free(sum);
+
+    return ret;
+}
+
+static void run_free(struct compare_run *run)
+{
+    uint32_t i;
+
+    for (i = 0; i < run->cnt; i++) {
+        g_free(run->ch[i].xcorr);
+        sat_fail_free(&run->ch[i].fails);
+    }
+    g_free(run->ch);
+}
+
+int run_compare(const struct sr_dev_inst *ref_sdi, const struct sr_dev_inst *sdi, const struct cmdline_opt *opt)
+{
+    struct compare_run run = { 0 };
+    int ret;
+
+    if ((ret = parse_compare_opt(opt->compare, &run.copt)) != SR_OK)
+        return ret;
+
+    if (opt->transform_modules || opt->triggers)
+        err_msg("warning: transforms and triggers are not applied when comparing captures\n");
+
+    run.sdi = sdi;
+    if ((ret = run_setup(&run, ref_sdi)) != SR_OK)
+        goto cleanup;
+    if ((ret = run_channels(&run, true)) != SR_OK)
+        goto cleanup;
+
+    if (run.cnt) {
+        if (run.copt.align == ALIGN_GLOBAL)
+            fprintf(stdout, "global alignment, offset %ld samples (%.6f s)\n", run.lag,
+                    run.lag / (double) run.ch[0].ref->samplerate);
+        else
+            fprintf(stdout, "%s alignment\n", run.copt.align == ALIGN_CHANNEL ? "per channel" : "no");
+    }
+    report(run.ch, run.cnt);
+    fprintf(stdout, "%u of %u channels failed\n", run.failed, run.cnt);
+    ret = run.failed ? SR_ERR_DATA : SR_OK;
+
+ cleanup:
+    run_free(&run);
+
+    return ret;
+}
+
+static void batch_task(gpointer data, gpointer user_data)
+{
+    struct compare_run *run = data;
+
+    UNUSED(user_data);
+    run->ret = run_channels(run, false);
+}
+
+static void batch_report(const struct compare_run *runs, const uint32_t cnt)
+{
+    const struct compare_run *run;
+    const struct compare_channel *c, *worst;
+    char name[PATH_MAX];
+    char offset[24];
+    double rate;
+    uint32_t i, k;
+
+    fprintf(stdout, "%4s %8s %8s %6s %11s %12s %-16s %-6s %s\n", "#", "offset", "channels", "failed", "max_err",
+            "max_at_s", "worst", "result", "capture");
+    for (i = 0; i < cnt; i++) {
+        run = &runs[i];
+        if ((run->ret != SR_OK) || !run->cnt) {
+            fprintf(stdout, "%4u %8s %8u %6s %11s %12s %-16s %-6s %s\n", i + 1, "-", run->cnt, "-", "-", "-", "-",
+                    "error", run->name);
+            continue;
+        }
+        worst = &run->ch[0];
+        for (k = 1; k < run->cnt; k++) {
+            if (run->ch[k].max_err > worst->max_err)
+                worst = &run->ch[k];
+        }
+        rate = worst->ref->samplerate;
+        // channels that are aligned on their own have no common offset
+        if (run->copt.align == ALIGN_GLOBAL)
+            snprintf(offset, sizeof(offset), "%ld", run->lag);
+        else
+            g_strlcpy(offset, "-", sizeof(offset));
+        fprintf(stdout, "%4u %8s %8u %6u %11.6f %12.6f %-16s %-6s %s\n", i + 1, offset, run->cnt, run->failed, worst->max_err, worst->max_at / rate, channel_name(worst->ref, name),
+                run->failed ? "FAIL" : "pass", run->name);
+        for (k = 0; k < run->cnt; k++) {
+            c = &run->ch[k];
+            if (!c->fails.ranges)
+                continue;
+            fprintf(stdout, "    ch %d %s: %lu samples out of tolerance in %lu ranges", c->ref->id, channel_name(c->ref, name),
+                    c->fails.samples, c->fails.ranges);
+            if (c->fails.list->len)
+                fprintf(stdout, ", first at %.6f s", g_array_index(c->fails.list, struct sat_fail_range, 0).start / rate);
+            fprintf(stdout, "\n");
+        }
+    }
+}
+
+int run_batch(const struct sr_dev_inst *ref_sdi, const struct sr_dev_inst *captures, char **names, const uint32_t cap_cnt,
+              const struct cmdline_opt *opt)
+{
+    struct compare_opt copt = { 0 };
+    struct compare_run *runs;
+    uint32_t i, failed = 0;
+    GThreadPool *pool;
+    int ret;
+
+    if ((ret = parse_compare_opt(opt->compare, &copt)) != SR_OK)
+        return ret;
+
+    if (opt->transform_modules || opt->triggers)
+        err_msg("warning: transforms and triggers are not applied when comparing captures\n");
+
+    // every capture streams the reference block by block next to its own channels
+    runs = g_malloc0(cap_cnt * sizeof(struct compare_run));
+    pool = g_thread_pool_new(batch_task, NULL, MIN(cap_cnt, g_get_num_processors()), TRUE, NULL);
+    for (i = 0; i < cap_cnt; i++) {
+        runs[i].sdi = &captures[i];
+        runs[i].name = names[i];
+        runs[i].copt = copt;
+        if ((runs[i].ret = run_setup(&runs[i], ref_sdi)) == SR_OK)
+            g_thread_pool_push(pool, &runs[i], NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    fprintf(stdout, "%u captures compared against %u reference channels\n", cap_cnt, g_slist_length(ref_sdi->channels));
+    batch_report(runs, cap_cnt);
+    for (i = 0; i < cap_cnt; i++) {
+        failed += ((runs[i].ret != SR_OK) || runs[i].failed) ? 1 : 0;
+        run_free(&runs[i]);
+    }
+    g_free(runs);
+    fprintf(stdout, "%u of %u captures failed\n", failed, cap_cnt);
+
+    return failed ? SR_ERR_DATA : SR_OK;
+}
@@ -0,0 +1,8 @@
+#ifndef __SAT_COMPARE_H__
+#define __SAT_COMPARE_H__
+
+int run_compare(const struct sr_dev_inst *ref_sdi, const struct sr_dev_inst *sdi, const struct cmdline_opt *opt);
+int run_batch(const struct sr_dev_inst *ref_sdi, const struct sr_dev_inst *captures, char **names, const uint32_t cap_cnt,
+              const struct cmdline_opt *opt);
+
+#endif
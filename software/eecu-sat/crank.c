@@ -0,0 +1,507 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "dsp.h"
+#include "simd.h"
+#include "input.h"
+#include "crank.h"
+
+/**
+ * Parse a wheel like 60-2 into the number of teeth, counting the missing
+ * ones, and the number of missing teeth. A plain number is a wheel without
+ * a gap.
+ */
+int sat_crank_parse_wheel(const char *spec, uint32_t *teeth, uint32_t *missing)
+{
+    char *end;
+
+    *teeth = strtoul(spec, &end, 10);
+    *missing = 0;
+    if (*end == '-')
+        *missing = strtoul(end + 1, &end, 10);
+
+    if (*end || (*teeth < 2) || (*missing + 1 >= *teeth)) {
+        err_msg("%s:%d invalid trigger wheel '%s', expected TEETH-MISSING like 60-2", __FILE__, __LINE__, spec);
+        return SR_ERR_ARG;
+    }
+
+    return SR_OK;
+}
+
+/**
+ * Read the wheel, level, hyst, cycle and step options shared by the crank
+ * angle transform and the ensemble output, plus cam_level where the module
+ * has it, and check that they describe a wheel the angle can be found on.
+ */
+int sat_crank_opt_get(GHashTable *options, struct sat_crank_opt *opt, double *step)
+{
+    GVariant *cam_level;
+
+    opt->level = g_variant_get_double(g_hash_table_lookup(options, "level"));
+    opt->hyst = g_variant_get_double(g_hash_table_lookup(options, "hyst"));
+    opt->cycle = g_variant_get_uint32(g_hash_table_lookup(options, "cycle"));
+    if ((cam_level = g_hash_table_lookup(options, "cam_level")))
+        opt->cam_level = g_variant_get_double(cam_level);
+    *step = g_variant_get_double(g_hash_table_lookup(options, "step"));
+
+    if ((opt->cycle != 360) && (opt->cycle != 720)) {
+        err_msg("%s:%d the cycle is either 360 or 720 degrees", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(*step > 0) || (*step > opt->cycle) || (fabs(opt->cycle / *step - round(opt->cycle / *step)) > 1e-6)) {
+        err_msg("%s:%d the step has to divide the cycle into a whole number of points", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(opt->hyst >= 0)) {
+        err_msg("%s:%d the hysteresis can't be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (sat_crank_parse_wheel(g_variant_get_string(g_hash_table_lookup(options, "wheel"), NULL), &opt->teeth, &opt->missing) != SR_OK)
+        return SR_ERR_ARG;
+    if (!opt->missing) {
+        err_msg("%s:%d the wheel needs missing teeth to find the angle", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    return SR_OK;
+}
+
+struct sat_crank *sat_crank_new(const uint32_t teeth, const uint32_t missing, const float level, const float hyst)
+{
+    struct sat_crank *c;
+
+    c = g_malloc0(sizeof(struct sat_crank));
+    c->teeth = teeth;
+    c->missing = missing;
+    c->level = level;
+    c->low = level - hyst / 2;
+    c->high = level + hyst / 2;
+    // one revolution holds teeth - missing edges
+    c->ring_len = teeth - missing;
+    c->ring = g_malloc0(c->ring_len * sizeof(double));
+    c->events = g_array_new(FALSE, FALSE, sizeof(struct sat_crank_tooth));
+    sat_crank_reset(c, 0);
+
+    return c;
+}
+
+// get ready for a new channel
+void sat_crank_reset(struct sat_crank *c, const uint64_t samplerate)
+{
+    c->samplerate = samplerate;
+    c->state = 0;
+    c->samples = 0;
+    c->last = 0;
+    c->last_at = -1;
+    c->period = 0;
+    c->ring_pos = 0;
+    c->ring_cnt = 0;
+    c->tooth = -1;
+    c->revs = 0;
+    c->sync_lost = 0;
+    g_array_set_size(c->events, 0);
+}
+
+static void tooth_add(struct sat_crank *c, const double at)
+{
+    struct sat_crank_tooth t = { 0 };
+    const double rate = c->samplerate ? c->samplerate : 1;
+    double p = at - c->last_at;
+    uint32_t pitch = 1;
+
+    t.at = at;
+    t.tooth = -1;
+    t.rpm = NAN;
+    t.rpm_avg = NAN;
+
+    if (c->last_at >= 0) {
+        // the gap spans missing + 1 pitches, the split lies half way
+        if (c->missing && c->period && (p > c->period * (c->missing + 2) / 2)) {
+            t.gap = true;
+            pitch = c->missing + 1;
+            if ((c->tooth >= 0) && ((uint32_t) c->tooth != c->teeth - c->missing - 1)) {
+                c->sync_lost++;
+                t.lost = true;
+            }
+            c->tooth = 0;
+            c->revs++;
+        } else {
+            c->period = p;
+            if (c->tooth >= 0)
+                c->tooth++;
+            // a gap went by unnoticed
+            if (c->tooth >= (int32_t) (c->teeth - c->missing)) {
+                c->sync_lost++;
+                t.lost = true;
+                c->tooth = -1;
+            }
+        }
+        t.rpm = 60.0 * rate * pitch / (p * c->teeth);
+    }
+    t.tooth = c->tooth;
+    t.rev = c->revs;
+
+    if (c->ring_cnt == c->ring_len)
+        t.rpm_avg = 60.0 * rate / (at - c->ring[c->ring_pos]);
+    c->ring[c->ring_pos] = at;
+    c->ring_pos = (c->ring_pos + 1) % c->ring_len;
+    c->ring_cnt = MIN(c->ring_cnt + 1, c->ring_len);
+
+    c->last_at = at;
+    g_array_append_val(c->events, t);
+}
+
+/**
+ * Find the teeth in the next n samples of the channel. They are appended to
+ * c->events, which only holds the ones of this call. Returns their number.
+ */
+uint32_t sat_crank_receive(struct sat_crank *c, const float *x, const ssize_t n)
+{
+    uint64_t word, prev, rising, mask;
+    float before, frac;
+    uint32_t k, len;
+    ssize_t i;
+
+    g_array_set_size(c->events, 0);
+
+    for (i = 0; i < n; i += len) {
+        len = MIN(64, n - i);
+        mask = len < 64 ? (UINT64_C(1) << len) - 1 : UINT64_MAX;
+        prev = c->state;
+        word = dsp_threshold_word(x + i, len, c->low, c->high, &c->state);
+        // a channel that starts high has no edge at its first sample
+        if (!c->samples && !i)
+            prev = word & 1;
+        rising = word & ~((word << 1) | prev) & mask;
+
+        // the crossing of the level is interpolated between the samples around the edge
+        while (rising) {
+            k = __builtin_ctzll(rising);
+            rising &= rising - 1;
+            before = (i + k) ? x[i + k - 1] : c->last;
+            frac = (x[i + k] > before) ? (c->level - before) / (x[i + k] - before) : 1;
+            frac = isfinite(frac) ? MAX(0, MIN(1, frac)) : 1;
+            tooth_add(c, c->samples + i + k - 1 + frac);
+        }
+    }
+    if (n > 0)
+        c->last = x[n - 1];
+    c->samples += n;
+
+    return c->events->len;
+}
+
+void sat_crank_free(struct sat_crank *c)
+{
+    if (!c)
+        return;
+
+    g_array_free(c->events, TRUE);
+    g_free(c->ring);
+    g_free(c);
+}
+
+static void map_add(struct sat_crank_map *m, const struct sat_crank *c, const float *cam, const ssize_t n, bool *resync)
+{
+    const struct sat_crank_tooth *t;
+    struct sat_crank_edge e;
+    ssize_t k;
+    uint32_t i;
+
+    for (i = 0; i < c->events->len; i++) {
+        t = &g_array_index(c->events, struct sat_crank_tooth, i);
+        if (t->tooth < 0) {
+            *resync = m->edges->len > 0;
+            continue;
+        }
+        e.at = t->at;
+        e.angle = t->rev * 360.0 + t->tooth * 360.0 / c->teeth;
+        e.resync = *resync || t->lost;
+        // the cam level right after the edge, which lies in this block or just before it
+        e.cam = false;
+        if (cam) {
+            k = MAX(0, MIN(n - 1, (ssize_t) ceil(t->at) - (ssize_t) (c->samples - n)));
+            e.cam = cam[k] > m->cam_level;
+        }
+        *resync = false;
+        g_array_append_val(m->edges, e);
+    }
+}
+
+// the first revolution of a cycle starts at a gap, with a cam signal the cam has to be high there
+static bool map_cycle_start(const struct sat_crank_map *m, const struct sat_crank_edge *e)
+{
+    if (m->cam)
+        return !fmod(e->angle, 360) && e->cam;
+
+    return !fmod(e->angle, m->cycle);
+}
+
+/**
+ * Decode the whole crank channel into a map of its teeth. The cam channel
+ * is optional, it tells the two revolutions of a 720 degree cycle apart.
+ * Returns NULL if the channels can not be read.
+ */
+struct sat_crank_map *sat_crank_map_build(const ch_data_t *crank, const ch_data_t *cam, const struct sat_crank_opt *opt)
+{
+    const ch_data_t *ch[2] = { crank, cam };
+    const ssize_t seek[2] = { 0, 0 };
+    const struct sat_crank_edge *e;
+    struct sat_block_reader *br;
+    struct sat_crank_map *m;
+    struct sat_crank *c;
+    float *buf;
+    ssize_t len;
+    double origin = NAN;
+    bool resync = false;
+    uint32_t i, j, start;
+
+    if (cam && (cam->samplerate != crank->samplerate)) {
+        err_msg("%s:%d the crank and cam channels need the same sample rate", __FILE__, __LINE__);
+        return NULL;
+    }
+    if (!(br = sat_block_open(ch, cam ? 2 : 1, seek, cam ? MIN(crank->sample_count, cam->sample_count) : crank->sample_count,
+                              TRANSFORM_BLOCK_SIZE)))
+        return NULL;
+
+    m = g_malloc0(sizeof(struct sat_crank_map));
+    m->samplerate = crank->samplerate;
+    m->cycle = opt->cycle;
+    m->cam = cam != NULL;
+    m->cam_level = opt->cam_level;
+    m->edges = g_array_new(FALSE, FALSE, sizeof(struct sat_crank_edge));
+    m->cycles = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+
+    c = sat_crank_new(opt->teeth, opt->missing, opt->level, opt->hyst);
+    sat_crank_reset(c, crank->samplerate);
+    buf = g_malloc((cam ? 2 : 1) * TRANSFORM_BLOCK_SIZE * sizeof(float));
+    while ((len = sat_block_read(br, buf)) > 0) {
+        sat_crank_receive(c, buf, len);
+        map_add(m, c, cam ? buf + len : NULL, len, &resync);
+    }
+    m->revs = c->revs;
+    m->sync_lost = c->sync_lost;
+    g_free(buf);
+    sat_crank_free(c);
+    sat_block_close(br);
+
+    if (len < 0) {
+        sat_crank_map_free(m);
+        return NULL;
+    }
+
+    // angle 0 is the first gap a cycle can start at
+    for (i = 0; (i < m->edges->len) && isnan(origin); i++) {
+        e = &g_array_index(m->edges, struct sat_crank_edge, i);
+        if (!fmod(e->angle, 360) && (!m->cam || e->cam))
+            origin = e->angle;
+    }
+    for (i = 0; (i < m->edges->len) && !isnan(origin); i++)
+        g_array_index(m->edges, struct sat_crank_edge, i).angle -= origin;
+
+    // a cycle needs an edge at either end and no resync in between
+    for (i = 0; i < m->edges->len; i++) {
+        e = &g_array_index(m->edges, struct sat_crank_edge, i);
+        if (!map_cycle_start(m, e))
+            continue;
+        start = i;
+        for (j = i + 1; j < m->edges->len; j++) {
+            e = &g_array_index(m->edges, struct sat_crank_edge, j);
+            if (e->resync || (e->angle >= g_array_index(m->edges, struct sat_crank_edge, start).angle + m->cycle))
+                break;
+        }
+        if ((j < m->edges->len) && !e->resync && (e->angle == g_array_index(m->edges, struct sat_crank_edge, start).angle + m->cycle))
+            g_array_append_val(m->cycles, start);
+        i = j - 1;
+    }
+
+    return m;
+}
+
+// angle the n-th cycle of the map starts at
+double sat_crank_map_start(const struct sat_crank_map *m, const uint32_t cycle)
+{
+    return g_array_index(m->edges, struct sat_crank_edge, g_array_index(m->cycles, uint32_t, cycle)).angle;
+}
+
+/**
+ * Time of an angle in samples of the crank channel. *edge is an edge at or
+ * before the angle, it is moved forward so that ascending angles are found
+ * in a single walk over the map.
+ */
+double sat_crank_map_at(const struct sat_crank_map *m, uint32_t *edge, const double angle)
+{
+    const struct sat_crank_edge *a, *b;
+
+    while ((*edge + 2 < m->edges->len) && (g_array_index(m->edges, struct sat_crank_edge, *edge + 1).angle <= angle))
+        (*edge)++;
+    a = &g_array_index(m->edges, struct sat_crank_edge, *edge);
+    b = a + 1;
+
+    return a->at + (angle - a->angle) / (b->angle - a->angle) * (b->at - a->at);
+}
+
+void sat_crank_map_free(struct sat_crank_map *m)
+{
+    if (!m)
+        return;
+
+    g_array_free(m->edges, TRUE);
+    g_array_free(m->cycles, TRUE);
+    g_free(m);
+}
+
+/**
+ * Get ready for a channel. in_rate is the rate its samples arrive at,
+ * ch_rate the one of its input file and seek the input sample the
+ * channel starts at. Cycles that began before it are left out.
+ */
+int sat_crank_grid_channel(struct sat_crank_grid *g, const uint64_t in_rate, const uint64_t ch_rate, const ssize_t seek)
+{
+    const struct sat_crank_map *m = g->map;
+
+    if (!in_rate || !ch_rate || !m->samplerate)
+        return SR_ERR_ARG;
+
+    g->scale = (double) in_rate / m->samplerate;
+    g->offset = (double) seek * m->samplerate / ch_rate;
+    g->point = 0;
+    g->base = 0;
+
+    for (g->cycle = 0; g->cycle < m->cycles->len; g->cycle++) {
+        g->edge = g_array_index(m->cycles, uint32_t, g->cycle);
+        if (g_array_index(m->edges, struct sat_crank_edge, g->edge).at >= g->offset)
+            break;
+    }
+
+    return SR_OK;
+}
+
+// position of an angle in samples of the current channel
+double sat_crank_grid_pos(const struct sat_crank_grid *g, uint32_t *edge, const double angle)
+{
+    return (sat_crank_map_at(g->map, edge, angle) - g->offset) * g->scale;
+}
+
+static void grid_blend(const float *w, const ssize_t *idx, const float *frac, float *out, const uint32_t n)
+{
+    v4sf a, b;
+    uint32_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        a = (v4sf) { w[idx[i]], w[idx[i + 1]], w[idx[i + 2]], w[idx[i + 3]] };
+        b = (v4sf) { w[idx[i] + 1], w[idx[i + 1] + 1], w[idx[i + 2] + 1], w[idx[i + 3] + 1] };
+        v4sf_store(out + i, a + (b - a) * v4sf_load(frac + i));
+    }
+    for (; i < n; i++)
+        out[i] = w[idx[i]] + (w[idx[i] + 1] - w[idx[i]]) * frac[i];
+}
+
+static void grid_flush(struct sat_crank_grid *g, ssize_t *out, const uint32_t n)
+{
+    if (*out + n > g->out_sz) {
+        g->out_sz = 2 * (*out + n);
+        g->out = g_realloc(g->out, g->out_sz * sizeof(float));
+    }
+    grid_blend(g->work, g->idx, g->frac, g->out + *out, n);
+    *out += n;
+}
+
+/**
+ * Resample the next chunk of the current channel onto the grid. The points
+ * of consecutive cycles end up in g->out, their number is returned. The
+ * positions of a batch of grid points are found first, the samples around
+ * them are then gathered and blended four at a time.
+ */
+ssize_t sat_crank_grid_resample(struct sat_crank_grid *g, const float *samples, const ssize_t num_samples)
+{
+    const struct sat_crank_map *m = g->map;
+    ssize_t out = 0;
+    uint32_t n = 0;
+    double pos;
+    ssize_t i;
+
+    if (num_samples <= 0)
+        return 0;
+
+    if (g->work_sz < num_samples + 1) {
+        g->work = g_realloc(g->work, (num_samples + 1) * sizeof(float));
+        g->work_sz = num_samples + 1;
+    }
+    // the first sample has no predecessor, no grid point falls before it
+    if (!g->base)
+        g->work[0] = samples[0];
+    memcpy(g->work + 1, samples, num_samples * sizeof(float));
+
+    while (g->cycle < m->cycles->len) {
+        pos = sat_crank_grid_pos(g, &g->edge, sat_crank_map_start(m, g->cycle) + g->point * g->step);
+        // position within the work buffer, the next sample is needed as well
+        i = (ssize_t) floor(pos) - g->base + 1;
+        if (i + 1 > num_samples)
+            break;
+        g->idx[n] = MAX(0, i);
+        g->frac[n] = i < 0 ? 0 : pos - floor(pos);
+        if (++n == SAT_CRANK_BATCH) {
+            grid_flush(g, &out, n);
+            n = 0;
+        }
+        if (++g->point == g->points) {
+            g->point = 0;
+            if (++g->cycle < m->cycles->len)
+                g->edge = g_array_index(m->cycles, uint32_t, g->cycle);
+        }
+    }
+    grid_flush(g, &out, n);
+
+    g->work[0] = samples[num_samples - 1];
+    g->base += num_samples;
+
+    return out;
+}
+
+struct sat_crank_grid *sat_crank_grid_new(struct sat_crank_map *m, const double step)
+{
+    struct sat_crank_grid *g;
+
+    g = g_malloc0(sizeof(struct sat_crank_grid));
+    g->map = m;
+    g->step = step;
+    g->points = lround(m->cycle / step);
+
+    return g;
+}
+
+// the map is freed as well
+void sat_crank_grid_free(struct sat_crank_grid *g)
+{
+    if (!g)
+        return;
+
+    sat_crank_map_free(g->map);
+    g_free(g->work);
+    g_free(g->out);
+    g_free(g);
+}
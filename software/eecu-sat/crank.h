@@ -0,0 +1,122 @@
+#ifndef __SAT_CRANK_H__
+#define __SAT_CRANK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <glib.h>
+#include "proj.h"
+
+/*
+ * decoder of a crank trigger wheel with a number of equally spaced teeth of
+ * which a few are left out to mark the reference position, like 60-2. the
+ * rising edges of the thresholded signal are the teeth, the longer period
+ * across the missing teeth is the gap.
+ */
+
+struct sat_crank_tooth {
+    double at;                  // rising edge in samples from the start of the channel, interpolated
+    float rpm;                  // from the period that ends at this edge
+    float rpm_avg;              // over the last revolution, NaN until a whole revolution was seen
+    int32_t tooth;              // 0 for the edge that ends the gap, -1 while not synchronized
+    uint64_t rev;               // gaps seen up to and including this edge
+    bool gap;
+    bool lost;                  // the number of teeth since the previous gap did not match the wheel
+};
+
+struct sat_crank {
+    uint32_t teeth;
+    uint32_t missing;
+    float level;
+    float low;
+    float high;
+    uint64_t samplerate;
+
+    uint64_t state;             // of the threshold
+    uint64_t samples;
+    float last;                 // last sample of the previous chunk
+    double last_at;             // previous edge, negative before the first one
+    double period;              // last period between two neighbouring teeth
+    double *ring;               // the edges of the last revolution
+    uint32_t ring_len;
+    uint32_t ring_pos;
+    uint32_t ring_cnt;
+    int32_t tooth;
+    uint64_t revs;              // gaps found
+    uint64_t sync_lost;
+    GArray *events;             // struct sat_crank_tooth found by the last sat_crank_receive()
+};
+
+#define  SAT_CRANK_BATCH  1024
+
+struct sat_crank_opt {
+    uint32_t teeth;
+    uint32_t missing;
+    float level;
+    float hyst;
+    float cam_level;
+    uint32_t cycle;             // degrees, 360 or 720
+};
+
+/*
+ * all synchronized teeth of a crank channel with their unwrapped angle, 0
+ * being the first gap a cycle can start at. the angle is linear in time
+ * between two teeth. cycles are the parts of the map that are cycle degrees
+ * long and have no loss of sync inside them. they start at a multiple of
+ * cycle, or with a cam channel at a gap where the cam is high.
+ */
+struct sat_crank_edge {
+    double at;                  // in samples of the crank channel
+    double angle;               // in degrees
+    bool resync;                // sync was lost between the previous edge and this one
+    bool cam;                   // the cam signal was high at this edge
+};
+
+struct sat_crank_map {
+    uint64_t samplerate;        // of the crank channel
+    uint32_t cycle;             // degrees
+    bool cam;
+    float cam_level;
+    uint64_t revs;
+    uint64_t sync_lost;
+    GArray *edges;              // struct sat_crank_edge
+    GArray *cycles;             // uint32_t, index of the edge a cycle starts at
+};
+
+// walk over the cycles of a map in steps of a fixed angle, one channel at a time
+struct sat_crank_grid {
+    struct sat_crank_map *map;
+    double step;                // degrees
+    uint32_t points;            // per cycle
+    // current channel
+    double scale;               // channel samples per crank sample
+    double offset;              // crank samples the channel starts at
+    uint32_t cycle;             // next grid point
+    uint32_t point;
+    uint32_t edge;
+    ssize_t base;               // channel samples received before the current chunk
+    float *work;                // last sample of the previous chunk followed by the current one
+    ssize_t work_sz;
+    ssize_t idx[SAT_CRANK_BATCH];
+    float frac[SAT_CRANK_BATCH];
+    float *out;
+    ssize_t out_sz;
+};
+
+int sat_crank_parse_wheel(const char *spec, uint32_t *teeth, uint32_t *missing);
+int sat_crank_opt_get(GHashTable *options, struct sat_crank_opt *opt, double *step);
+struct sat_crank *sat_crank_new(const uint32_t teeth, const uint32_t missing, const float level, const float hyst);
+void sat_crank_reset(struct sat_crank *c, const uint64_t samplerate);
+uint32_t sat_crank_receive(struct sat_crank *c, const float *x, const ssize_t n);
+void sat_crank_free(struct sat_crank *c);
+struct sat_crank_map *sat_crank_map_build(const ch_data_t *crank, const ch_data_t *cam, const struct sat_crank_opt *opt);
+double sat_crank_map_start(const struct sat_crank_map *m, const uint32_t cycle);
+double sat_crank_map_at(const struct sat_crank_map *m, uint32_t *edge, const double angle);
+void sat_crank_map_free(struct sat_crank_map *m);
+struct sat_crank_grid *sat_crank_grid_new(struct sat_crank_map *m, const double step);
+int sat_crank_grid_channel(struct sat_crank_grid *g, const uint64_t in_rate, const uint64_t ch_rate, const ssize_t seek);
+double sat_crank_grid_pos(const struct sat_crank_grid *g, uint32_t *edge, const double angle);
+ssize_t sat_crank_grid_resample(struct sat_crank_grid *g, const float *samples, const ssize_t num_samples);
+void sat_crank_grid_free(struct sat_crank_grid *g);
+
+#endif
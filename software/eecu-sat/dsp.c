@@ -0,0 +1,289 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <glib.h>
+#include "simd.h"
+#include "dsp.h"
+
+/**
+ * Ideal lowpass impulse response centered on the middle tap.
+ *
+ * @param fc cutoff frequency normalized to the sample rate (0 - 0.5)
+ */
+void dsp_sinc_lowpass(double *h, uint32_t taps, double fc)
+{
+    uint32_t i;
+    double m = (taps - 1) / 2.0;
+    double x;
+
+    for (i = 0; i < taps; i++) {
+        x = i - m;
+        if (x == 0)
+            h[i] = 2.0 * fc;
+        else
+            h[i] = sin(2.0 * M_PI * fc * x) / (M_PI * x);
+    }
+}
+
+/**
+ * Apply a hamming window over the taps.
+ */
+void dsp_hamming(double *h, uint32_t taps)
+{
+    uint32_t i;
+
+    if (taps < 2)
+        return;
+
+    for (i = 0; i < taps; i++)
+        h[i] *= 0.54 - 0.46 * cos(2.0 * M_PI * i / (taps - 1));
+}
+
+/**
+ * Scale the taps so that their sum (the gain at DC) becomes gain.
+ */
+void dsp_normalize(double *h, uint32_t taps, double gain)
+{
+    uint32_t i;
+    double sum = 0;
+
+    for (i = 0; i < taps; i++)
+        sum += h[i];
+
+    if (sum == 0)
+        return;
+
+    for (i = 0; i < taps; i++)
+        h[i] *= gain / sum;
+}
+
+/**
+ * Dot product of two float arrays, four lanes at a time.
+ */
+float dsp_dot(const float *a, const float *b, ssize_t n)
+{
+    v4sf acc = v4sf_set1(0);
+    float sacc;
+    ssize_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES)
+        acc += v4sf_load(a + i) * v4sf_load(b + i);
+
+    sacc = v4sf_hsum(acc);
+    for (; i < n; i++)
+        sacc += a[i] * b[i];
+
+    return sacc;
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+    const float fa = *(const float *)a;
+    const float fb = *(const float *)b;
+
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Find the quantization step behind a list of positive steps, like the
+ * differences between consecutive ADC samples.
+ *
+ * The smallest step alone is not reliable since a single value that is off
+ * the grid (like the 0.0 that starts some captures) produces odd steps, so
+ * look for the smallest step that is seen often enough and average all its
+ * occurrences. steps is sorted in place. Returns 0 for an empty list.
+ */
+float dsp_common_step(float *steps, ssize_t n)
+{
+    float sum;
+    ssize_t i, j, e, min_cnt;
+
+    qsort(steps, n, sizeof(float), cmp_float);
+
+    min_cnt = MAX(3, n / 100);
+    for (j = 0, e = 0; j < n; j++) {
+        // steps within 10% of steps[j] are the same step plus float rounding
+        for (e = MAX(e, j); (e < n) && (steps[e] <= steps[j] * 1.1f); e++) ;
+        if (e - j >= min_cnt) {
+            for (i = j, sum = 0; i < e; i++)
+                sum += steps[i];
+            return sum / (e - j);
+        }
+    }
+
+    return n ? steps[0] : 0;
+}
+
+/**
+ * Estimate the ADC step of a signal from the differences between its
+ * consecutive samples. Returns 0 if the signal is constant.
+ */
+float dsp_adc_step(const float *x, const ssize_t n)
+{
+    float *d;
+    float step;
+    ssize_t i, cnt = 0;
+
+    if (n < 2)
+        return 0;
+
+    d = g_malloc((n - 1) * sizeof(float));
+    for (i = 1; i < n; i++) {
+        if (x[i] != x[i - 1])
+            d[cnt++] = fabsf(x[i] - x[i - 1]);
+    }
+    step = dsp_common_step(d, cnt);
+    g_free(d);
+
+    return step;
+}
+
+/**
+ * Threshold up to 64 samples with hysteresis into a word, bit i is sample i.
+ *
+ * A sample above high sets the state, one below low clears it and anything
+ * in between holds the previous state. With s the set and m the not-cleared
+ * bits, adding s to m carries every set bit through the run of m bits it
+ * sits in, which is exactly the span over which the state stays set.
+ */
+uint64_t dsp_threshold_word(const float *x, const int n, const float low, const float high, uint64_t *state)
+{
+    const v4si lane_bit = { 1, 2, 4, 8 };
+    const v4sf vh = v4sf_set1(high);
+    const v4sf vl = v4sf_set1(low);
+    uint64_t s = 0, c = 0, m, word;
+    v4si ms, mc;
+    v4sf v;
+    int i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        ms = (v > vh) & lane_bit;
+        mc = (v < vl) & lane_bit;
+        s |= (uint64_t) (ms[0] | ms[1] | ms[2] | ms[3]) << i;
+        c |= (uint64_t) (mc[0] | mc[1] | mc[2] | mc[3]) << i;
+    }
+    for (; i < n; i++) {
+        s |= (uint64_t) (x[i] > high) << i;
+        c |= (uint64_t) (x[i] < low) << i;
+    }
+
+    m = ~c;
+    // the state from the previous word acts as a set bit in front of this one
+    s |= *state & m & 1;
+    word = (((m + s) ^ m) | s) & m;
+    if (n < 64)
+        word &= (UINT64_C(1) << n) - 1;
+    *state = (word >> (n - 1)) & 1;
+
+    return word;
+}
+
+/**
+ * In-place radix-2 complex FFT, n must be a power of two. The inverse
+ * transform is not scaled by 1/n.
+ */
+void dsp_fft(double *re, double *im, const uint32_t n, const bool inverse)
+{
+    uint32_t i, j, k, len, half;
+    double ang, wr, wi, vr, vi, t;
+
+    // bit reversed order
+    for (i = 1, j = 0; i < n; i++) {
+        for (k = n >> 1; j & k; k >>= 1)
+            j ^= k;
+        j |= k;
+        if (i < j) {
+            t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (len = 2; len <= n; len <<= 1) {
+        half = len >> 1;
+        ang = (inverse ? 2.0 : -2.0) * M_PI / len;
+        for (k = 0; k < half; k++) {
+            wr = cos(ang * k);
+            wi = sin(ang * k);
+            for (i = k; i < n; i += len) {
+                j = i + half;
+                vr = re[j] * wr - im[j] * wi;
+                vi = re[j] * wi + im[j] * wr;
+                re[j] = re[i] - vr;
+                im[j] = im[i] - vi;
+                re[i] += vr;
+                im[i] += vi;
+            }
+        }
+    }
+}
+
+/**
+ * Cross-correlation r[k] = sum x[i] * y[i + k] of two real signals for
+ * lags -max_lag .. max_lag, stored in r[max_lag + k]. Both signals are
+ * zero padded so the correlation does not wrap around, and are packed into
+ * a single complex transform as its real and imaginary part.
+ */
+void dsp_xcorr(const float *x, const float *y, const uint32_t n, const uint32_t max_lag, double *r)
+{
+    uint32_t fft_n = 1, i, k;
+    double *re, *im;
+    double xr, xi, yr, yi;
+
+    while (fft_n < n + max_lag)
+        fft_n <<= 1;
+
+    re = g_malloc0(fft_n * sizeof(double));
+    im = g_malloc0(fft_n * sizeof(double));
+    for (i = 0; i < n; i++) {
+        re[i] = x[i];
+        im[i] = y[i];
+    }
+    dsp_fft(re, im, fft_n, false);
+
+    // X[k] = (Z[k] + conj(Z[-k])) / 2, Y[k] = (Z[k] - conj(Z[-k])) / 2i, then conj(X) * Y
+    for (k = 0; k <= fft_n / 2; k++) {
+        i = (fft_n - k) & (fft_n - 1);
+        xr = (re[k] + re[i]) / 2;
+        xi = (im[k] - im[i]) / 2;
+        yr = (im[k] + im[i]) / 2;
+        yi = (re[i] - re[k]) / 2;
+        re[k] = xr * yr + xi * yi;
+        im[k] = xr * yi - xi * yr;
+        // the spectrum of a real correlation is hermitian
+        re[i] = re[k];
+        im[i] = -im[k];
+    }
+    dsp_fft(re, im, fft_n, true);
+
+    for (k = 0; k <= max_lag; k++) {
+        r[max_lag + k] = re[k] / fft_n;
+        r[max_lag - k] = re[(fft_n - k) & (fft_n - 1)] / fft_n;
+    }
+
+    g_free(re);
+    g_free(im);
+}
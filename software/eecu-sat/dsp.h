@@ -0,0 +1,18 @@
+#ifndef __SAT_DSP_H__
+#define __SAT_DSP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+void dsp_sinc_lowpass(double *h, uint32_t taps, double fc);
+void dsp_hamming(double *h, uint32_t taps);
+void dsp_normalize(double *h, uint32_t taps, double gain);
+float dsp_dot(const float *a, const float *b, ssize_t n);
+float dsp_common_step(float *steps, ssize_t n);
+float dsp_adc_step(const float *x, const ssize_t n);
+uint64_t dsp_threshold_word(const float *x, const int n, const float low, const float high, uint64_t *state);
+void dsp_fft(double *re, double *im, const uint32_t n, const bool inverse);
+void dsp_xcorr(const float *x, const float *y, const uint32_t n, const uint32_t max_lag, double *r);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "proj.h"
+#include "fail_range.h"
+
+/**
+ * Set up a tracker that keeps the first max_ranges ranges. Failing samples
+ * that are at most gap samples apart are joined into one range and ranges
+ * shorter than min_fail samples are not counted.
+ */
+void sat_fail_init(struct sat_fail_tracker *f, const uint32_t max_ranges, const ssize_t gap, const ssize_t min_fail)
+{
+    f->max_ranges = max_ranges;
+    f->gap = gap;
+    f->min_fail = min_fail;
+    f->samples = 0;
+    f->ranges = 0;
+    f->first = -1;
+    f->list = g_array_new(FALSE, FALSE, sizeof(struct sat_fail_range));
+    f->run.start = 0;
+    f->run.end = -1;
+}
+
+// end the range that is being extended
+void sat_fail_close(struct sat_fail_tracker *f)
+{
+    if (f->run.end < f->run.start)
+        return;
+    if (f->run.end - f->run.start + 1 >= f->min_fail) {
+        f->ranges++;
+        if (f->list->len < f->max_ranges)
+            g_array_append_val(f->list, f->run);
+    }
+    f->run.end = f->run.start - 1;
+}
+
+// sample s failed, peak is how far it is off
+void sat_fail_add(struct sat_fail_tracker *f, const ssize_t s, const float peak)
+{
+    if ((f->run.end >= f->run.start) && (s - f->run.end > f->gap + 1))
+        sat_fail_close(f);
+    if (f->first < 0)
+        f->first = s;
+    if (f->run.end < f->run.start) {
+        f->run.start = s;
+        f->run.peak = 0;
+    }
+    f->run.end = s;
+    f->run.peak = MAX(f->run.peak, peak);
+    f->samples++;
+}
+
+/**
+ * List the ranges that were kept, one line each, with the peak printed as
+ * peak_name, the value with the given number of decimals and peak_unit.
+ */
+void sat_fail_print(FILE *fp, const struct sat_fail_tracker *f, const double rate, const char *peak_name,
+                    const char *peak_unit, const int decimals)
+{
+    const struct sat_fail_range *r;
+    uint32_t k;
+
+    for (k = 0; k < f->list->len; k++) {
+        r = &g_array_index(f->list, struct sat_fail_range, k);
+        fprintf(fp, "    fail %.6f - %.6f s, %ld samples, %s%.*f%s\n", r->start / rate, (r->end + 1) / rate,
+                r->end - r->start + 1, peak_name, decimals, r->peak, peak_unit);
+    }
+    if (f->ranges > f->list->len)
+        fprintf(fp, "    %lu more not listed\n", f->ranges - f->list->len);
+}
+
+void sat_fail_free(struct sat_fail_tracker *f)
+{
+    if (f->list)
+        g_array_free(f->list, TRUE);
+    f->list = NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef __SAT_FAIL_RANGE_H__
+#define __SAT_FAIL_RANGE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <glib.h>
+
+/*
+ * failing samples of a channel grouped into ranges, used by the checks that
+ * report where a capture leaves its limits.
+ */
+
+struct sat_fail_range {
+    ssize_t start;
+    ssize_t end;                // last failing sample
+    float peak;                 // largest deviation inside the range
+};
+
+struct sat_fail_tracker {
+    uint32_t max_ranges;
+    ssize_t gap;                // failures closer than this are joined into one range
+    ssize_t min_fail;           // samples a range has to last before it counts
+    uint64_t samples;           // failing samples
+    uint64_t ranges;            // ranges that were counted
+    ssize_t first;              // first failing sample, -1 if there is none
+    GArray *list;               // struct sat_fail_range, the first max_ranges ranges
+    struct sat_fail_range run;  // range being extended, end < start if there is none
+};
+
+void sat_fail_init(struct sat_fail_tracker *f, const uint32_t max_ranges, const ssize_t gap, const ssize_t min_fail);
+void sat_fail_add(struct sat_fail_tracker *f, const ssize_t s, const float peak);
+void sat_fail_close(struct sat_fail_tracker *f);
+void sat_fail_print(FILE *fp, const struct sat_fail_tracker *f, const double rate, const char *peak_name,
+                    const char *peak_unit, const int decimals);
+void sat_fail_free(struct sat_fail_tracker *f);
+
+#endif
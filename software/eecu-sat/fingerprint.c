@@ -0,0 +1,189 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "fingerprint.h"
+
+void sat_fp_free(struct sat_fp *fp)
+{
+    uint32_t i;
+
+    if (!fp)
+        return;
+
+    for (i = 0; i < fp->num_channels; i++) {
+        g_free(fp->ch[i].bands);
+        g_free(fp->ch[i].duty);
+    }
+    g_free(fp->ch);
+    g_free(fp);
+}
+
+struct sat_fp *sat_fp_load(const char *file_name)
+{
+    struct sat_fp *fp = NULL;
+    struct sat_fp_channel *ch;
+    struct fp_hdr hdr;
+    struct fp_channel fc;
+    uint32_t i;
+    FILE *f;
+
+    if (!(f = fopen(file_name, "rb"))) {
+        err_msg("%s:%d unable to open fingerprint file %s", __FILE__, __LINE__, file_name);
+        return NULL;
+    }
+
+    if ((fread(&hdr, 1, FP_HDR_SIZE, f) != FP_HDR_SIZE) || memcmp(hdr.identifier, FP_MAGIC, 8)) {
+        err_msg("%s:%d %s is not a fingerprint file", __FILE__, __LINE__, file_name);
+        goto error;
+    }
+    if (hdr.version != 0) {
+        err_msg("%s:%d unsupported fingerprint version %d", __FILE__, __LINE__, hdr.version);
+        goto error;
+    }
+
+    fp = g_malloc0(sizeof(struct sat_fp));
+    fp->num_bands = hdr.num_bands;
+    fp->num_segments = hdr.num_segments;
+    fp->sample_rate = hdr.sample_rate;
+    fp->ch = g_malloc0(hdr.num_channels * sizeof(struct sat_fp_channel));
+
+    for (i = 0; i < hdr.num_channels; i++) {
+        if (fread(&fc, 1, FP_CHANNEL_SIZE, f) != FP_CHANNEL_SIZE)
+            goto damaged;
+        ch = &fp->ch[i];
+        fp->num_channels++;
+        ch->id = fc.id;
+        memcpy(ch->name, fc.name, sizeof(ch->name));
+        ch->name[sizeof(ch->name) - 1] = 0;
+        ch->num_samples = fc.num_samples;
+        memcpy(ch->level, fc.level, sizeof(ch->level));
+        ch->bands = g_malloc(fp->num_bands * sizeof(float));
+        ch->duty = g_malloc(fp->num_segments * sizeof(float));
+        if ((fread(ch->bands, sizeof(float), fp->num_bands, f) != fp->num_bands) ||
+            (fread(ch->duty, sizeof(float), fp->num_segments, f) != fp->num_segments))
+            goto damaged;
+    }
+
+    fclose(f);
+
+    return fp;
+
+ damaged:
+    err_msg("%s:%d incomplete or damaged fingerprint file %s", __FILE__, __LINE__, file_name);
+ error:
+    sat_fp_free(fp);
+    fclose(f);
+
+    return NULL;
+}
+
+int sat_fp_save(const struct sat_fp *fp, const char *file_name)
+{
+    const struct sat_fp_channel *ch;
+    struct fp_hdr hdr = { 0 };
+    struct fp_channel fc;
+    uint32_t i;
+    int ret = SR_OK;
+    FILE *f;
+
+    if (!(f = fopen(file_name, "wb"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    memcpy(hdr.identifier, FP_MAGIC, 8);
+    hdr.num_channels = fp->num_channels;
+    hdr.num_bands = fp->num_bands;
+    hdr.num_segments = fp->num_segments;
+    hdr.sample_rate = fp->sample_rate;
+    if (fwrite(&hdr, 1, FP_HDR_SIZE, f) != FP_HDR_SIZE)
+        goto io_error;
+
+    for (i = 0; i < fp->num_channels; i++) {
+        ch = &fp->ch[i];
+
+        memset(&fc, 0, sizeof(fc));
+        g_strlcpy(fc.name, ch->name, sizeof(fc.name));
+        fc.id = ch->id;
+        fc.num_samples = ch->num_samples;
+        memcpy(fc.level, ch->level, sizeof(fc.level));
+        if ((fwrite(&fc, 1, FP_CHANNEL_SIZE, f) != FP_CHANNEL_SIZE) ||
+            (fwrite(ch->bands, sizeof(float), fp->num_bands, f) != fp->num_bands) ||
+            (fwrite(ch->duty, sizeof(float), fp->num_segments, f) != fp->num_segments))
+            goto io_error;
+    }
+
+ cleanup:
+    if (fclose(f)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    return ret;
+
+ io_error:
+    err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+    ret = SR_ERR_IO;
+    goto cleanup;
+}
+
+// a missing value is as far away as it gets
+static float clip(const float d)
+{
+    return isnan(d) ? 1 : MIN(1, d);
+}
+
+/**
+ * Distance between two channel fingerprints, 0 for identical ones up to 1.
+ *
+ * The spectral shape, the duty cycle profile and the levels count for a
+ * third each. Levels are measured against the larger swing of the two
+ * channels, so the distance does not depend on the signal amplitude.
+ */
+float sat_fp_distance(const struct sat_fp_channel *a, const struct sat_fp_channel *b, const uint32_t num_bands, const uint32_t num_segments)
+{
+    float spec = 0, duty = 0, level, scale, edges;
+    uint32_t i;
+
+    for (i = 0; i < num_bands; i++)
+        spec += fabsf(a->bands[i] - b->bands[i]);
+    spec = clip(spec / 2);
+
+    for (i = 0; i < num_segments; i++)
+        duty += clip(fabsf(a->duty[i] - b->duty[i]));
+    duty = num_segments ? duty / num_segments : 0;
+
+    scale = MAX(0.1f, MAX(a->level[FP_MAX] - a->level[FP_MIN], b->level[FP_MAX] - b->level[FP_MIN]));
+    edges = MAX(1.0f, MAX(a->level[FP_EDGES], b->level[FP_EDGES]));
+    level = clip(fabsf(a->level[FP_MEAN] - b->level[FP_MEAN]) / scale) +
+            clip(fabsf(a->level[FP_STD] - b->level[FP_STD]) / scale) +
+            clip(fabsf(a->level[FP_MIN] - b->level[FP_MIN]) / scale) +
+            clip(fabsf(a->level[FP_MAX] - b->level[FP_MAX]) / scale) +
+            clip(fabsf(a->level[FP_EDGES] - b->level[FP_EDGES]) / edges);
+
+    return (spec + duty + level / 5) / 3;
+}
@@ -0,0 +1,68 @@
+#ifndef __SAT_FINGERPRINT_H__
+#define __SAT_FINGERPRINT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * compact signature of every channel of a capture. the file holds a struct
+ * fp_hdr followed by one struct fp_channel per channel, each one followed
+ * by num_bands little endian float band energies and num_segments float
+ * duty cycles.
+ */
+
+// level statistics of a channel
+#define     FP_MEAN  0
+#define      FP_STD  1
+#define      FP_MIN  2
+#define      FP_MAX  3
+#define     FP_DUTY  4          // share of samples above the threshold
+#define    FP_EDGES  5          // threshold crossings per second
+#define   FP_LEVELS  6
+
+struct __attribute__((packed)) fp_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    uint32_t num_channels;
+    uint32_t num_bands;
+    uint32_t num_segments;
+    uint64_t sample_rate;
+    uint8_t reserved[32];
+}; // 64bytes
+
+struct __attribute__((packed)) fp_channel {
+    char name[24];
+    uint16_t id;
+    uint16_t reserved0;
+    uint64_t num_samples;
+    float level[FP_LEVELS];
+    uint8_t reserved[4];
+}; // 64bytes
+
+#define           FP_HDR_SIZE  0x40
+#define       FP_CHANNEL_SIZE  0x40
+#define              FP_MAGIC  "<SATFPR>"
+
+struct sat_fp_channel {
+    uint16_t id;
+    char name[24];
+    uint64_t num_samples;
+    float level[FP_LEVELS];
+    float *bands;               // share of the signal energy in every band, low to high
+    float *duty;                // duty cycle of every segment of the channel
+};
+
+struct sat_fp {
+    uint32_t num_bands;
+    uint32_t num_segments;
+    uint64_t sample_rate;
+    uint32_t num_channels;
+    struct sat_fp_channel *ch;
+};
+
+struct sat_fp *sat_fp_load(const char *file_name);
+int sat_fp_save(const struct sat_fp *fp, const char *file_name);
+void sat_fp_free(struct sat_fp *fp);
+float sat_fp_distance(const struct sat_fp_channel *a, const struct sat_fp_channel *b, const uint32_t num_bands, const uint32_t num_segments);
+
+#endif
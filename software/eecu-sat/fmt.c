@@ -0,0 +1,425 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "fmt.h"
+
+/*
+ * shortest float to decimal conversion after Ulf Adams, "Ryu: fast
+ * float-to-string conversion" (PLDI 2018). the result is the shortest digit
+ * string that reads back as the same float, the one closest to the exact
+ * value if there are several.
+ */
+
+#define  FLOAT_MANTISSA_BITS  23
+#define          FLOAT_BIAS  127
+#define  FLOAT_POW5_INV_BITCOUNT  59
+#define  FLOAT_POW5_BITCOUNT  61
+
+// ceil(2^(pow5bits(q) - 1 + FLOAT_POW5_INV_BITCOUNT) / 5^q)
+static const uint64_t FLOAT_POW5_INV_SPLIT[32] = {
+    576460752303423489u, 461168601842738791u, 368934881474191033u,
+    295147905179352826u, 472236648286964522u, 377789318629571618u,
+    302231454903657294u, 483570327845851670u, 386856262276681336u,
+    309485009821345069u, 495176015714152110u, 396140812571321688u,
+    316912650057057351u, 507060240091291761u, 405648192073033409u,
+    324518553658426727u, 519229685853482763u, 415383748682786211u,
+    332306998946228969u, 531691198313966350u, 425352958651173080u,
+    340282366920938464u, 544451787073501542u, 435561429658801234u,
+    348449143727040987u, 557518629963265579u, 446014903970612463u,
+    356811923176489971u, 570899077082383953u, 456719261665907162u,
+    365375409332725730u, 292300327466180584u,
+};
+
+// 5^i normalized to FLOAT_POW5_BITCOUNT bits
+static const uint64_t FLOAT_POW5_SPLIT[48] = {
+    1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+    2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+    2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+    2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+    2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+    2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+    2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+    1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+    1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+    1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+    1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+    1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+    1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+    1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+    1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+    1615587133892632177u, 2019483917365790221u, 1262177448353618888u,
+};
+
+static const char DIGIT_PAIRS[200] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+static const uint32_t POW10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static uint32_t pow5_factor(uint32_t v)
+{
+    uint32_t count = 0;
+
+    while (!(v % 5)) {
+        v /= 5;
+        count++;
+    }
+
+    return count;
+}
+
+static bool multiple_of_pow5(const uint32_t v, const uint32_t p)
+{
+    return pow5_factor(v) >= p;
+}
+
+static bool multiple_of_pow2(const uint32_t v, const uint32_t p)
+{
+    return !(v & ((1u << p) - 1));
+}
+
+// ceil(log2(5^e)), 1 for e == 0
+static int32_t pow5bits(const int32_t e)
+{
+    return (int32_t) ((((uint32_t) e * 1217359) >> 19) + 1);
+}
+
+// floor(log10(2^e))
+static uint32_t log10_pow2(const int32_t e)
+{
+    return ((uint32_t) e * 78913) >> 18;
+}
+
+// floor(log10(5^e))
+static uint32_t log10_pow5(const int32_t e)
+{
+    return ((uint32_t) e * 732923) >> 20;
+}
+
+static uint32_t mul_shift(const uint32_t m, const uint64_t factor, const int32_t shift)
+{
+    const uint64_t lo = (uint64_t) m * (uint32_t) factor;
+    const uint64_t hi = (uint64_t) m * (uint32_t) (factor >> 32);
+
+    return (uint32_t) (((lo >> 32) + hi) >> (shift - 32));
+}
+
+// decimal digits of a float as mantissa * 10^exponent, x must be finite and positive
+static void float_to_decimal(const uint32_t ieee_mantissa, const uint32_t ieee_exponent, uint32_t *mantissa, int32_t *exponent)
+{
+    uint32_t m2, mv, mp, mm, mm_shift, vr, vp, vm, q;
+    int32_t e2, e10, i, j, k, removed = 0;
+    bool even, vm_trailing_zeros = false, vr_trailing_zeros = false;
+    uint8_t last_removed_digit = 0;
+
+    if (ieee_exponent == 0) {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int32_t) ieee_exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | ieee_mantissa;
+    }
+    // the bounds of the rounding interval are part of it for even mantissas
+    even = !(m2 & 1);
+
+    // the float and the bounds of its rounding interval, scaled by 4
+    mv = 4 * m2;
+    mp = 4 * m2 + 2;
+    mm_shift = (ieee_mantissa != 0) || (ieee_exponent <= 1);
+    mm = 4 * m2 - 1 - mm_shift;
+
+    if (e2 >= 0) {
+        q = log10_pow2(e2);
+        e10 = q;
+        k = FLOAT_POW5_INV_BITCOUNT + pow5bits(q) - 1;
+        i = -e2 + (int32_t) q + k;
+        vr = mul_shift(mv, FLOAT_POW5_INV_SPLIT[q], i);
+        vp = mul_shift(mp, FLOAT_POW5_INV_SPLIT[q], i);
+        vm = mul_shift(mm, FLOAT_POW5_INV_SPLIT[q], i);
+        if (q && ((vp - 1) / 10 <= vm / 10)) {
+            // the loop below might not run, the digit after vr is still needed for rounding
+            k = FLOAT_POW5_INV_BITCOUNT + pow5bits(q - 1) - 1;
+            last_removed_digit = mul_shift(mv, FLOAT_POW5_INV_SPLIT[q - 1], -e2 + (int32_t) q - 1 + k) % 10;
+        }
+        if (q <= 9) {
+            // at most one of mp, mv and mm is a multiple of 5
+            if (!(mv % 5))
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            else if (even)
+                vm_trailing_zeros = multiple_of_pow5(mm, q);
+            else
+                vp -= multiple_of_pow5(mp, q);
+        }
+    } else {
+        q = log10_pow5(-e2);
+        e10 = (int32_t) q + e2;
+        i = -e2 - (int32_t) q;
+        k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+        j = (int32_t) q - k;
+        vr = mul_shift(mv, FLOAT_POW5_SPLIT[i], j);
+        vp = mul_shift(mp, FLOAT_POW5_SPLIT[i], j);
+        vm = mul_shift(mm, FLOAT_POW5_SPLIT[i], j);
+        if (q && ((vp - 1) / 10 <= vm / 10)) {
+            j = (int32_t) q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed_digit = mul_shift(mv, FLOAT_POW5_SPLIT[i + 1], j) % 10;
+        }
+        if (q <= 1) {
+            // mv has at least q trailing zero bits
+            vr_trailing_zeros = true;
+            if (even)
+                vm_trailing_zeros = (mm_shift == 1);
+            else
+                vp--;
+        } else if (q < 31) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+        }
+    }
+
+    // remove digits as long as the bounds still differ
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= !(vm % 10);
+            vr_trailing_zeros &= !last_removed_digit;
+            last_removed_digit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros) {
+            while (!(vm % 10)) {
+                vr_trailing_zeros &= !last_removed_digit;
+                last_removed_digit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        // exact ties are rounded to even
+        if (vr_trailing_zeros && (last_removed_digit == 5) && !(vr % 2))
+            last_removed_digit = 4;
+        *mantissa = vr + (((vr == vm) && (!even || !vm_trailing_zeros)) || (last_removed_digit >= 5));
+    } else {
+        while (vp / 10 > vm / 10) {
+            last_removed_digit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        *mantissa = vr + ((vr == vm) || (last_removed_digit >= 5));
+    }
+    *exponent = e10 + removed;
+}
+
+static uint32_t decimal_length(const uint64_t v)
+{
+    uint64_t p = 10;
+    uint32_t len = 1;
+
+    while ((len < 20) && (v >= p)) {
+        len++;
+        p *= 10;
+    }
+
+    return len;
+}
+
+// write the len digits of v, right to left
+static void put_digits(char *dst, uint64_t v, uint32_t len)
+{
+    while (len >= 2) {
+        len -= 2;
+        memcpy(dst + len, DIGIT_PAIRS + 2 * (v % 100), 2);
+        v /= 100;
+    }
+    if (len)
+        dst[0] = '0' + v;
+}
+
+static size_t put_special(char *dst, const float x)
+{
+    if (isnan(x)) {
+        memcpy(dst, "nan", 3);
+        return 3;
+    }
+    if (signbit(x)) {
+        memcpy(dst, "-inf", 4);
+        return 4;
+    }
+    memcpy(dst, "inf", 3);
+
+    return 3;
+}
+
+size_t fmt_uint(char *dst, uint64_t v)
+{
+    uint32_t len = decimal_length(v);
+
+    put_digits(dst, v, len);
+
+    return len;
+}
+
+// v with leading zeroes up to width digits
+size_t fmt_uint_pad(char *dst, uint64_t v, const uint32_t width)
+{
+    uint32_t len = MAX(decimal_length(v), width);
+
+    put_digits(dst, v, len);
+
+    return len;
+}
+
+size_t fmt_int(char *dst, int64_t v)
+{
+    if (v < 0) {
+        dst[0] = '-';
+        return fmt_uint(dst + 1, -(uint64_t) v) + 1;
+    }
+
+    return fmt_uint(dst, v);
+}
+
+/**
+ * Shortest decimal representation of a float that reads back unchanged.
+ *
+ * plain notation is used for magnitudes between 1e-5 and 1e9, scientific
+ * notation otherwise.
+ */
+size_t fmt_float_shortest(char *dst, const float x)
+{
+    uint32_t bits, mantissa, olength;
+    int32_t exponent, point;
+    size_t n = 0;
+
+    if (!isfinite(x))
+        return put_special(dst, x);
+
+    memcpy(&bits, &x, sizeof(bits));
+    if (bits >> 31)
+        dst[n++] = '-';
+    bits &= 0x7fffffff;
+    if (!bits) {
+        dst[n++] = '0';
+        return n;
+    }
+
+    float_to_decimal(bits & ((1u << FLOAT_MANTISSA_BITS) - 1), bits >> FLOAT_MANTISSA_BITS, &mantissa, &exponent);
+    olength = decimal_length(mantissa);
+    // number of digits in front of the decimal point
+    point = (int32_t) olength + exponent;
+
+    if ((point > 9) || (point < -4)) {
+        // d.ddde-xx
+        put_digits(dst + n + 1, mantissa, olength);
+        dst[n] = dst[n + 1];
+        n++;
+        if (olength > 1) {
+            dst[n] = '.';
+            n += olength;
+        }
+        dst[n++] = 'e';
+        exponent = point - 1;
+        if (exponent < 0) {
+            dst[n++] = '-';
+            exponent = -exponent;
+        }
+        n += fmt_uint(dst + n, exponent);
+    } else if (point <= 0) {
+        // 0.000ddd
+        dst[n++] = '0';
+        dst[n++] = '.';
+        memset(dst + n, '0', -point);
+        n += -point;
+        put_digits(dst + n, mantissa, olength);
+        n += olength;
+    } else if (exponent >= 0) {
+        // ddd000
+        put_digits(dst + n, mantissa, olength);
+        n += olength;
+        memset(dst + n, '0', exponent);
+        n += exponent;
+    } else {
+        // ddd.ddd
+        put_digits(dst + n, mantissa / POW10[-exponent], point);
+        n += point;
+        dst[n++] = '.';
+        put_digits(dst + n, mantissa % POW10[-exponent], -exponent);
+        n += -exponent;
+    }
+
+    return n;
+}
+
+/**
+ * A float with prec digits after the decimal point, same as printf("%.*f").
+ *
+ * @param prec 0 - FMT_MAX_PRECISION
+ */
+size_t fmt_float_fixed(char *dst, const float x, const int prec)
+{
+    static const double scale[FMT_MAX_PRECISION + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    char buf[FMT_FLOAT_MAX + 1];
+    uint64_t v;
+    uint32_t len;
+    double s;
+    size_t n = 0;
+
+    if (!isfinite(x))
+        return put_special(dst, x);
+
+    // a float has 24 significant bits and 10^9 = 2^9 * 5^9 has 21 bits besides the
+    // power of two, the product is exact in a double so rint() rounds just like printf
+    s = fabs((double) x) * scale[prec];
+    if (s >= 1e18) {
+        n = snprintf(buf, sizeof(buf), "%.*f", prec, x);
+        memcpy(dst, buf, n);
+        return n;
+    }
+
+    v = (uint64_t) rint(s);
+    if (signbit(x))
+        dst[n++] = '-';
+    len = decimal_length(v);
+    if (len <= (uint32_t) prec) {
+        // zero padding up to the first significant digit
+        len = prec + 1;
+    }
+    put_digits(dst + n, v, len);
+    n += len;
+    if (prec) {
+        memmove(dst + n - prec + 1, dst + n - prec, prec);
+        dst[n - prec] = '.';
+        n++;
+    }
+
+    return n;
+}
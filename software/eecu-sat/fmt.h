@@ -0,0 +1,25 @@
+#ifndef __SAT_FMT_H__
+#define __SAT_FMT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * fast number to text conversion for the text outputs. none of the functions
+ * terminate the string, they return the number of characters written.
+ */
+
+// enough for any float, %.9f of FLT_MAX is the longest one
+#define  FMT_FLOAT_MAX  56
+// enough for any int64_t
+#define  FMT_INT_MAX    20
+// largest precision accepted by fmt_float_fixed()
+#define  FMT_MAX_PRECISION  9
+
+size_t fmt_uint(char *dst, uint64_t v);
+size_t fmt_uint_pad(char *dst, uint64_t v, const uint32_t width);
+size_t fmt_int(char *dst, int64_t v);
+size_t fmt_float_shortest(char *dst, const float x);
+size_t fmt_float_fixed(char *dst, const float x, const int prec);
+
+#endif
@@ -0,0 +1,369 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "input.h"
+#include "parsers.h"
+#include "session.h"
+#include "model.h"
+#include "golden.h"
+
+/*
+ * statistical model built from a number of known good captures.
+ *
+ * channels are paired in input order. every capture is lined up on the
+ * trigger given via --triggers, or starts at its first sample. every
+ * channel of every capture is streamed on its own thread of a pool and
+ * reduced to the sample count, mean and sum of squared deviations of each
+ * bin, computed in two passes over the bin while it is in the cache. the
+ * partial results are then merged capture by capture in command line order
+ * (Chan et al.), which keeps the model independent of the thread schedule.
+ */
+
+// samples read at once, a multiple of every resolution up to 64k
+#define  GOLDEN_BLOCK  (1024 * 1024)
+
+struct golden_opt {
+    uint32_t resolution;
+};
+
+struct golden_capture {
+    const struct sr_dev_inst *sdi;
+    struct sat_trigger *trigger;
+    uint64_t trigger_rate;
+    int ret;
+};
+
+// one channel of one capture
+struct golden_part {
+    const struct golden_capture *cap;
+    const ch_data_t *ch;
+    uint32_t resolution;
+    uint64_t samples;
+    uint32_t num_bins;
+    uint64_t *n;
+    double *mean;
+    double *m2;                 // sum of squared deviations from the mean
+    int ret;
+};
+
+static struct sr_option options[] = {
+    {"resolution", "resolution", "samples per model bin", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(64));
+    }
+
+    return options;
+}
+
+static int parse_golden_opt(const char *arg, struct golden_opt *gopt)
+{
+    const struct sr_option *opts = get_options();
+    const struct sr_option **optp;
+    GHashTable *args, *given = NULL;
+    GVariant *v;
+    int i, ret = SR_OK;
+
+    if ((args = parse_generic_arg(arg, FALSE, NULL))) {
+        optp = g_malloc0(sizeof(options) / sizeof(options[0]) * sizeof(struct sr_option *));
+        for (i = 0; opts[i].id; i++)
+            optp[i] = &opts[i];
+        given = generic_arg_to_opt(optp, args);
+        if (warn_unknown_keys(optp, args, "Unknown model option"))
+            ret = SR_ERR_ARG;
+        g_free(optp);
+        g_hash_table_destroy(args);
+    }
+
+    v = given ? g_hash_table_lookup(given, opts[0].id) : NULL;
+    gopt->resolution = g_variant_get_uint32(v ? v : opts[0].def);
+    if (!gopt->resolution || (gopt->resolution > 65536) || (GOLDEN_BLOCK % gopt->resolution)) {
+        err_msg("%s:%d the resolution must be a power of two of at most 65536 samples", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+    }
+
+    if (given)
+        g_hash_table_destroy(given);
+
+    return ret;
+}
+
+static void bin_add(struct golden_part *p, const float *x, const uint32_t len)
+{
+    double sum = 0, m2 = 0, mean, d;
+    uint64_t n = 0;
+    uint32_t i;
+
+    if (p->num_bins % 1024 == 0) {
+        p->n = g_realloc(p->n, (p->num_bins + 1024) * sizeof(uint64_t));
+        p->mean = g_realloc(p->mean, (p->num_bins + 1024) * sizeof(double));
+        p->m2 = g_realloc(p->m2, (p->num_bins + 1024) * sizeof(double));
+    }
+
+    // NaN and infinite samples are left out
+    for (i = 0; i < len; i++) {
+        if (isfinite(x[i])) {
+            sum += x[i];
+            n++;
+        }
+    }
+    mean = n ? sum / n : 0;
+    for (i = 0; i < len; i++) {
+        if (isfinite(x[i])) {
+            d = x[i] - mean;
+            m2 += d * d;
+        }
+    }
+
+    p->n[p->num_bins] = n;
+    p->mean[p->num_bins] = mean;
+    p->m2[p->num_bins] = m2;
+    p->num_bins++;
+}
+
+static void part_task(gpointer data, gpointer user_data)
+{
+    struct golden_part *p = data;
+    struct sat_input *in;
+    ssize_t seek, remaining, len = 0, got;
+    uint32_t i;
+    float *buf;
+
+    UNUSED(user_data);
+
+    trigger_crop(p->ch, p->cap->trigger, p->cap->trigger_rate, &seek, &remaining);
+
+    if (!(in = sat_input_open(p->ch))) {
+        p->ret = SR_ERR_IO;
+        return;
+    }
+    if (seek && (sat_input_seek(in, seek) != SR_OK)) {
+        sat_input_close(in);
+        p->ret = SR_ERR_IO;
+        return;
+    }
+
+    buf = g_malloc(GOLDEN_BLOCK * sizeof(float));
+    while (remaining > 0) {
+        // blocks are filled up completely, so bins never straddle two of them
+        got = 0;
+        while ((got < MIN(GOLDEN_BLOCK, remaining)) && ((len = sat_input_read(in, buf + got, MIN(GOLDEN_BLOCK, remaining) - got)) > 0))
+            got += len;
+        // a damaged part fails the model instead of leaving a gap in it
+        if (len < 0) {
+            err_msg("%s:%d failed to read %s", __FILE__, __LINE__, p->ch->input_file_name);
+            p->ret = len;
+            break;
+        }
+        if (!got)
+            break;
+        for (i = 0; i < got; i += p->resolution)
+            bin_add(p, buf + i, MIN(p->resolution, got - i));
+        p->samples += got;
+        remaining -= got;
+        if (got < GOLDEN_BLOCK)
+            break;
+    }
+    g_free(buf);
+    sat_input_close(in);
+}
+
+static void trigger_task(gpointer data, gpointer user_data)
+{
+    struct golden_capture *cap = data;
+    float *buf;
+
+    UNUSED(user_data);
+
+    buf = g_malloc(CHUNK_SIZE);
+    cap->ret = scan_trigger(cap->sdi, cap->trigger, buf, &cap->trigger_rate);
+    g_free(buf);
+}
+
+static void run_pool(GFunc func, gpointer items, const size_t size, const uint32_t cnt)
+{
+    GThreadPool *pool;
+    uint32_t i;
+
+    pool = g_thread_pool_new(func, NULL, MIN(cnt, g_get_num_processors()), TRUE, NULL);
+    for (i = 0; i < cnt; i++)
+        g_thread_pool_push(pool, (char *)items + i * size, NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+// add the bins of part b to the ones of part a
+static void part_merge(struct golden_part *a, const struct golden_part *b)
+{
+    uint64_t n;
+    uint32_t i;
+    double d;
+
+    if (b->num_bins > a->num_bins) {
+        a->n = g_realloc(a->n, b->num_bins * sizeof(uint64_t));
+        a->mean = g_realloc(a->mean, b->num_bins * sizeof(double));
+        a->m2 = g_realloc(a->m2, b->num_bins * sizeof(double));
+        for (i = a->num_bins; i < b->num_bins; i++) {
+            a->n[i] = 0;
+            a->mean[i] = 0;
+            a->m2[i] = 0;
+        }
+        a->num_bins = b->num_bins;
+    }
+
+    for (i = 0; i < b->num_bins; i++) {
+        if (!b->n[i])
+            continue;
+        n = a->n[i] + b->n[i];
+        d = b->mean[i] - a->mean[i];
+        a->mean[i] += d * b->n[i] / n;
+        a->m2[i] += b->m2[i] + d * d * a->n[i] * b->n[i] / n;
+        a->n[i] = n;
+    }
+    a->samples = MAX(a->samples, b->samples);
+}
+
+static void channel_fill(struct sat_model_channel *mch, const struct golden_part *p)
+{
+    char *name;
+    uint32_t i;
+
+    mch->id = p->ch->id;
+    name = p->ch->channel_name ? g_strdup(p->ch->channel_name) : g_path_get_basename(p->ch->input_file_name);
+    g_strlcpy(mch->name, name, sizeof(mch->name));
+    g_free(name);
+    mch->num_samples = p->samples;
+    mch->num_bins = p->num_bins;
+    mch->mean = g_malloc(p->num_bins * sizeof(float));
+    mch->std = g_malloc(p->num_bins * sizeof(float));
+    mch->count = g_malloc(p->num_bins * sizeof(uint32_t));
+    for (i = 0; i < p->num_bins; i++) {
+        mch->mean[i] = p->mean[i];
+        mch->std[i] = p->n[i] ? sqrt(p->m2[i] / p->n[i]) : 0;
+        mch->count[i] = MIN(p->n[i], UINT32_MAX);
+    }
+}
+
+int run_golden(const struct sr_dev_inst *captures, const uint32_t cap_cnt, const struct cmdline_opt *opt)
+{
+    struct golden_opt gopt = { 0 };
+    struct golden_capture *cap;
+    struct golden_part *part, *p;
+    struct sat_model *model = NULL;
+    uint32_t ch_cnt, i, k;
+    ch_data_t *ch_data_ptr;
+    GSList *l;
+    int ret;
+
+    if ((ret = parse_golden_opt(opt->model, &gopt)) != SR_OK)
+        return ret;
+
+    if (!opt->output_files || opt->output_files->next) {
+        err_msg("%s:%d the model needs exactly one output file", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (opt->transform_modules || opt->output_formats)
+        err_msg("warning: transforms and output formats are not used when building a model\n");
+
+    ch_cnt = g_slist_length(captures[0].channels);
+    for (i = 1; i < cap_cnt; i++)
+        ch_cnt = MIN(ch_cnt, g_slist_length(captures[i].channels));
+
+    cap = g_malloc0(cap_cnt * sizeof(struct golden_capture));
+    part = g_malloc0(cap_cnt * ch_cnt * sizeof(struct golden_part));
+
+    for (i = 0; i < cap_cnt; i++) {
+        cap[i].sdi = &captures[i];
+        if (g_slist_length(captures[i].channels) != ch_cnt)
+            err_msg("warning: capture %u has %u channels, only the first %u are used\n", i + 1,
+                    g_slist_length(captures[i].channels), ch_cnt);
+        if (opt->triggers && !parse_triggerstring(&captures[i], opt->triggers, &cap[i].trigger)) {
+            err_msg("%s:%d Failed to initialize trigger module", __FILE__, __LINE__);
+            ret = SR_ERR_ARG;
+            goto cleanup;
+        }
+        for (k = 0, l = captures[i].channels; k < ch_cnt; k++, l = l->next) {
+            ch_data_ptr = l->data;
+            p = &part[i * ch_cnt + k];
+            p->cap = &cap[i];
+            p->ch = ch_data_ptr;
+            p->resolution = gopt.resolution;
+            if (ch_data_ptr->samplerate != ((ch_data_t *) captures[0].channels->data)->samplerate) {
+                err_msg("%s:%d %s is sampled at %lu Hz, the first capture at %lu Hz", __FILE__, __LINE__,
+                        ch_data_ptr->input_file_name, ch_data_ptr->samplerate,
+                        ((ch_data_t *) captures[0].channels->data)->samplerate);
+                ret = SR_ERR_ARG;
+                goto cleanup;
+            }
+        }
+    }
+
+    if (opt->triggers) {
+        run_pool(trigger_task, cap, sizeof(struct golden_capture), cap_cnt);
+        for (i = 0; i < cap_cnt; i++) {
+            if ((ret = cap[i].ret) != SR_OK)
+                goto cleanup;
+        }
+    }
+
+    run_pool(part_task, part, sizeof(struct golden_part), cap_cnt * ch_cnt);
+    for (i = 0; i < cap_cnt * ch_cnt; i++) {
+        if ((ret = part[i].ret) != SR_OK)
+            goto cleanup;
+    }
+
+    model = g_malloc0(sizeof(struct sat_model));
+    model->resolution = gopt.resolution;
+    model->num_captures = cap_cnt;
+    model->sample_rate = ((ch_data_t *) captures[0].channels->data)->samplerate;
+    model->num_channels = ch_cnt;
+    model->ch = g_malloc0(ch_cnt * sizeof(struct sat_model_channel));
+    for (k = 0; k < ch_cnt; k++) {
+        for (i = 1; i < cap_cnt; i++)
+            part_merge(&part[k], &part[i * ch_cnt + k]);
+        channel_fill(&model->ch[k], &part[k]);
+    }
+
+    if ((ret = sat_model_save(model, opt->output_files->data)) == SR_OK)
+        fprintf(stdout, "model of %u captures, %u channels, %u samples per bin\n", cap_cnt, ch_cnt, gopt.resolution);
+
+ cleanup:
+    for (i = 0; i < cap_cnt * ch_cnt; i++) {
+        g_free(part[i].n);
+        g_free(part[i].mean);
+        g_free(part[i].m2);
+    }
+    g_free(part);
+    g_free(cap);
+    sat_model_free(model);
+
+    return ret;
+}
@@ -0,0 +1,6 @@
+#ifndef __SAT_GOLDEN_H__
+#define __SAT_GOLDEN_H__
+
+int run_golden(const struct sr_dev_inst *captures, const uint32_t cap_cnt, const struct cmdline_opt *opt);
+
+#endif
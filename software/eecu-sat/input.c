@@ -0,0 +1,376 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "saleae.h"
+#include "input.h"
+#include "input_q16.h"
+#include "input_tsc.h"
+#include "input_store.h"
+
+// size of the file header that is handed to the formats for identification
+#define  INPUT_HDR_SIZE  64
+
+static bool saleae_match(const uint8_t *hdr, const ssize_t len)
+{
+    if (len < SALEAE_ANALOG_HDR_SIZE)
+        return false;
+
+    return saleae_get_hdr_type((uint8_t *) hdr) != SALEAE_UNKNOWN;
+}
+
+static int saleae_scan(ch_data_t *ch, const uint8_t *hdr, const ssize_t len)
+{
+    UNUSED(len);
+
+    ch->file_type = saleae_get_hdr_type((uint8_t *) hdr);
+
+    if (ch->file_type == SALEAE_DIGITAL) {
+        err_msg("%s:%d cannot use digital input files", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    } else if (ch->file_type != SALEAE_ANALOG) {
+        err_msg("%s:%d unsupported saleae file version", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    ch->sample_count = (ch->input_file_size - SALEAE_ANALOG_HDR_SIZE) / ch->sample_size;
+    memcpy(&ch->header, hdr, SALEAE_ANALOG_HDR_SIZE);
+    if (ch->header.downsample)
+        ch->samplerate = ch->header.sample_rate / ch->header.downsample;
+
+    return SR_OK;
+}
+
+static int saleae_seek(struct sat_input *in, const ssize_t sample)
+{
+    if (lseek(in->fd, SALEAE_ANALOG_HDR_SIZE + sample * sizeof(float), SEEK_SET) < 0)
+        return SR_ERR_IO;
+
+    return SR_OK;
+}
+
+// raw little endian floats without any header
+static bool raw_match(const uint8_t *hdr, const ssize_t len)
+{
+    UNUSED(hdr);
+    UNUSED(len);
+
+    return true;
+}
+
+static int raw_scan(ch_data_t *ch, const uint8_t *hdr, const ssize_t len)
+{
+    UNUSED(hdr);
+    UNUSED(len);
+
+    ch->file_type = SALEAE_UNKNOWN;
+    ch->sample_count = ch->input_file_size / ch->sample_size;
+
+    return SR_OK;
+}
+
+static int raw_seek(struct sat_input *in, const ssize_t sample)
+{
+    if (lseek(in->fd, sample * sizeof(float), SEEK_SET) < 0)
+        return SR_ERR_IO;
+
+    return SR_OK;
+}
+
+static ssize_t float_read(struct sat_input *in, float *samples, const ssize_t max_samples)
+{
+    ssize_t read_len;
+
+    if ((read_len = read(in->fd, samples, max_samples * sizeof(float))) < 0)
+        return SR_ERR_IO;
+
+    return read_len / sizeof(float);
+}
+
+static const struct sat_input_format input_saleae = {
+    .id = "saleae",
+    .file_type = SALEAE_ANALOG,
+    .has_header = true,
+    .match = saleae_match,
+    .scan = saleae_scan,
+    .seek = saleae_seek,
+    .read = float_read,
+};
+
+static const struct sat_input_format input_raw = {
+    .id = "raw",
+    .file_type = SALEAE_UNKNOWN,
+    .has_header = false,
+    .match = raw_match,
+    .scan = raw_scan,
+    .seek = raw_seek,
+    .read = float_read,
+};
+
+// the raw format accepts anything, so it must stay last
+static const struct sat_input_format *input_format_list[] = {
+    &input_saleae,
+    &input_q16,
+    &input_tsc,
+    &input_store,
+    &input_raw,
+    NULL,
+};
+
+static const struct sat_input_format *input_format_find(const uint8_t file_type)
+{
+    int i;
+
+    for (i = 0; input_format_list[i]; i++) {
+        if (input_format_list[i]->file_type == file_type)
+            return input_format_list[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Identify the format of a channel's input file and fill in the
+ * file_type, input_file_size, sample_count, samplerate and header fields.
+ */
+int sat_input_scan(ch_data_t *ch)
+{
+    uint8_t hdr[INPUT_HDR_SIZE];
+    struct stat st;
+    ssize_t len;
+    int fd;
+    int i;
+
+    if ((fd = open(ch->input_file_name, O_RDONLY)) < 0) {
+        err_msg("%s:%d opening input file", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        err_msg("%s:%d during fstat()", __FILE__, __LINE__);
+        close(fd);
+        return SR_ERR_IO;
+    }
+    ch->input_file_size = st.st_size;
+
+    len = read(fd, hdr, INPUT_HDR_SIZE);
+    close(fd);
+    if (len < SALEAE_ANALOG_HDR_SIZE) {
+        err_msg("%s:%d during read()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    for (i = 0; input_format_list[i]; i++) {
+        if (input_format_list[i]->match(hdr, len))
+            return input_format_list[i]->scan(ch, hdr, len);
+    }
+
+    return SR_ERR_BUG;
+}
+
+/**
+ * Fill the <SALEAE> analog header of a channel read from another format, so
+ * that outputs can restore it.
+ */
+void sat_input_set_header(ch_data_t *ch, const double begin_time, const uint64_t sample_rate, const uint64_t downsample)
+{
+    const char saleae_magic[8] = { 0x3c, 0x53, 0x41, 0x4c, 0x45, 0x41, 0x45, 0x3e };
+
+    memcpy(ch->header.identifier, saleae_magic, 8);
+    ch->header.version = 0;
+    ch->header.type = SALEAE_TYPE_ANALOG;
+    ch->header.begin_time = begin_time;
+    ch->header.sample_rate = sample_rate;
+    ch->header.downsample = downsample;
+    ch->header.num_samples = ch->sample_count;
+    if (downsample)
+        ch->samplerate = sample_rate / downsample;
+}
+
+/**
+ * Returns true if the channel header holds a valid <SALEAE> analog header.
+ */
+bool sat_input_has_header(const ch_data_t *ch)
+{
+    const struct sat_input_format *format;
+
+    if (!(format = input_format_find(ch->file_type)))
+        return false;
+
+    return format->has_header;
+}
+
+/**
+ * Open the input file of a scanned channel, positioned at the first sample.
+ */
+struct sat_input *sat_input_open(const ch_data_t *ch)
+{
+    struct sat_input *in;
+
+    in = g_malloc0(sizeof(struct sat_input));
+    in->ch = ch;
+
+    if (!(in->format = input_format_find(ch->file_type))) {
+        err_msg("%s:%d unknown file type of %s", __FILE__, __LINE__, ch->input_file_name);
+        g_free(in);
+        return NULL;
+    }
+
+    if ((in->fd = open(ch->input_file_name, O_RDONLY)) < 0) {
+        err_msg("%s:%d failed to open input file %s", __FILE__, __LINE__, ch->input_file_name);
+        g_free(in);
+        return NULL;
+    }
+
+    if ((in->format->open && (in->format->open(in) != SR_OK)) || (sat_input_seek(in, 0) != SR_OK)) {
+        sat_input_close(in);
+        return NULL;
+    }
+
+    return in;
+}
+
+int sat_input_seek(struct sat_input *in, const ssize_t sample)
+{
+    if (!in)
+        return SR_ERR_ARG;
+
+    if (in->format->seek(in, sample) != SR_OK) {
+        err_msg("%s:%d failed to seek to sample %ld of %s", __FILE__, __LINE__, sample, in->ch->input_file_name);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+ssize_t sat_input_read(struct sat_input *in, float *samples, const ssize_t max_samples)
+{
+    if (!in || !samples)
+        return SR_ERR_ARG;
+
+    return in->format->read(in, samples, max_samples);
+}
+
+/**
+ * Get the min and max of the samples that follow, as far as the format
+ * indexes them. Returns the number of samples they cover, 0 if the format
+ * keeps no such index.
+ */
+ssize_t sat_input_range(struct sat_input *in, float *min, float *max)
+{
+    if (!in || !min || !max)
+        return SR_ERR_ARG;
+
+    if (!in->format->range)
+        return 0;
+
+    return in->format->range(in, min, max);
+}
+
+void sat_input_close(struct sat_input *in)
+{
+    if (!in)
+        return;
+
+    if (in->format->close)
+        in->format->close(in);
+    if (in->fd >= 0)
+        close(in->fd);
+    g_free(in);
+}
+
+/**
+ * Open the input files of cnt channels at once, every one positioned at its
+ * own seek offset. samples is the number of samples read from every channel,
+ * at most block_len at a time.
+ */
+struct sat_block_reader *sat_block_open(const ch_data_t **ch, const uint32_t cnt, const ssize_t *seek, const ssize_t samples,
+                                        const ssize_t block_len)
+{
+    struct sat_block_reader *br;
+    uint32_t i;
+
+    if (!ch || !cnt || !seek || (block_len < 1))
+        return NULL;
+
+    br = g_malloc0(sizeof(struct sat_block_reader));
+    br->in = g_malloc0(cnt * sizeof(struct sat_input *));
+    br->cnt = cnt;
+    br->block_len = block_len;
+    br->remaining = MAX(0, samples);
+
+    for (i = 0; i < cnt; i++) {
+        if (!(br->in[i] = sat_input_open(ch[i])) || (seek[i] && (sat_input_seek(br->in[i], seek[i]) != SR_OK))) {
+            sat_block_close(br);
+            return NULL;
+        }
+    }
+
+    return br;
+}
+
+/**
+ * Read the next block into buf, which has to hold cnt * block_len samples.
+ * The n samples of channel i end up at buf + i * n. Returns n, 0 once all
+ * samples were read or a negative error code.
+ */
+ssize_t sat_block_read(struct sat_block_reader *br, float *buf)
+{
+    ssize_t n, done, read_len;
+    uint32_t i;
+
+    if (!br || !buf)
+        return SR_ERR_ARG;
+
+    n = MIN(br->block_len, br->remaining);
+    for (i = 0; i < br->cnt; i++) {
+        // a channel that falls short would put the rest out of step
+        for (done = 0; done < n; done += read_len) {
+            if ((read_len = sat_input_read(br->in[i], buf + i * n + done, n - done)) <= 0) {
+                err_msg("%s:%d %s ended before the other channels", __FILE__, __LINE__, br->in[i]->ch->input_file_name);
+                return SR_ERR_IO;
+            }
+        }
+    }
+    br->remaining -= n;
+
+    return n;
+}
+
+void sat_block_close(struct sat_block_reader *br)
+{
+    uint32_t i;
+
+    if (!br)
+        return;
+
+    for (i = 0; i < br->cnt; i++)
+        sat_input_close(br->in[i]);
+    g_free(br->in);
+    g_free(br);
+}
@@ -0,0 +1,93 @@
+#ifndef __SAT_INPUT_H__
+#define __SAT_INPUT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "proj.h"
+
+// file types besides the ones defined in saleae.h
+#define        SAT_FILE_Q16  0x10
+#define        SAT_FILE_TSC  0x11
+#define      SAT_FILE_STORE  0x12
+
+/** Open input file. */
+struct sat_input {
+    const struct sat_input_format *format;
+    const ch_data_t *ch;
+    int fd;
+    void *priv;
+};
+
+/** Reader for one file format, every format delivers float samples. */
+struct sat_input_format {
+    /** Short format name, used in messages. */
+    const char *id;
+
+    /** The file_type this format assigns to the channels it recognizes. */
+    uint8_t file_type;
+
+    /** True if the format carries a <SALEAE> analog header in ch_data. */
+    bool has_header;
+
+    /**
+     * Check the first bytes of a file, return true if the format can read it.
+     * The last format of the list is used if no other one matches.
+     */
+    bool (*match)(const uint8_t *hdr, const ssize_t len);
+
+    /**
+     * Fill file_type, sample_count, samplerate and header of a channel.
+     * hdr holds the first bytes of the file.
+     */
+    int (*scan)(ch_data_t *ch, const uint8_t *hdr, const ssize_t len);
+
+    /** Optional, set up in->priv once the file was opened. */
+    int (*open)(struct sat_input *in);
+
+    /** Position the input at the given sample. */
+    int (*seek)(struct sat_input *in, const ssize_t sample);
+
+    /**
+     * Read up to max_samples samples, returns the number of samples
+     * read, 0 at the end of the file or a negative error code.
+     */
+    ssize_t (*read)(struct sat_input *in, float *samples, const ssize_t max_samples);
+
+    /**
+     * Optional, min and max of the samples in the block that holds the
+     * next sample. Returns the number of samples left in that block, or 0
+     * at the end of the file.
+     */
+    ssize_t (*range)(struct sat_input *in, float *min, float *max);
+
+    /** Optional, free in->priv. */
+    void (*close)(struct sat_input *in);
+};
+
+/**
+ * Reader of aligned windows across several channels. Every block holds the
+ * same number of samples of every channel, one channel after the other.
+ */
+struct sat_block_reader {
+    struct sat_input **in;
+    uint32_t cnt;
+    ssize_t block_len;          // largest number of samples per channel in a block
+    ssize_t remaining;          // samples per channel still to be read
+};
+
+int sat_input_scan(ch_data_t *ch);
+bool sat_input_has_header(const ch_data_t *ch);
+void sat_input_set_header(ch_data_t *ch, const double begin_time, const uint64_t sample_rate, const uint64_t downsample);
+struct sat_input *sat_input_open(const ch_data_t *ch);
+int sat_input_seek(struct sat_input *in, const ssize_t sample);
+ssize_t sat_input_read(struct sat_input *in, float *samples, const ssize_t max_samples);
+ssize_t sat_input_range(struct sat_input *in, float *min, float *max);
+void sat_input_close(struct sat_input *in);
+struct sat_block_reader *sat_block_open(const ch_data_t **ch, const uint32_t cnt, const ssize_t *seek, const ssize_t samples,
+                                        const ssize_t block_len);
+ssize_t sat_block_read(struct sat_block_reader *br, float *buf);
+void sat_block_close(struct sat_block_reader *br);
+
+#endif
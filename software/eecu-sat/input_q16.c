@@ -0,0 +1,131 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "saleae.h"
+#include "input.h"
+#include "input_q16.h"
+
+struct q16_context {
+    float scale;
+    float offset;
+    int16_t *codes;
+    ssize_t codes_sz;
+};
+
+static bool q16_match(const uint8_t *hdr, const ssize_t len)
+{
+    if (len < Q16_HDR_SIZE)
+        return false;
+
+    return !memcmp(hdr, Q16_MAGIC, 8);
+}
+
+static int q16_scan(ch_data_t *ch, const uint8_t *buf, const ssize_t len)
+{
+    struct q16_hdr hdr;
+
+    UNUSED(len);
+
+    memcpy(&hdr, buf, Q16_HDR_SIZE);
+    if (hdr.version != 0) {
+        err_msg("%s:%d unsupported q16 file version %d", __FILE__, __LINE__, hdr.version);
+        return SR_ERR_ARG;
+    }
+
+    ch->file_type = SAT_FILE_Q16;
+    ch->sample_count = (ch->input_file_size - Q16_HDR_SIZE) / sizeof(int16_t);
+    // present the channel like a saleae capture so outputs can restore its header
+    sat_input_set_header(ch, hdr.begin_time, hdr.sample_rate, hdr.downsample);
+
+    return SR_OK;
+}
+
+static int q16_open(struct sat_input *in)
+{
+    struct q16_context *ctx;
+    struct q16_hdr hdr;
+
+    if (pread(in->fd, &hdr, Q16_HDR_SIZE, 0) != Q16_HDR_SIZE)
+        return SR_ERR_IO;
+
+    in->priv = ctx = g_malloc0(sizeof(struct q16_context));
+    ctx->scale = hdr.scale;
+    ctx->offset = hdr.offset;
+
+    return SR_OK;
+}
+
+static int q16_seek(struct sat_input *in, const ssize_t sample)
+{
+    if (lseek(in->fd, Q16_HDR_SIZE + sample * sizeof(int16_t), SEEK_SET) < 0)
+        return SR_ERR_IO;
+
+    return SR_OK;
+}
+
+static ssize_t q16_read(struct sat_input *in, float *samples, const ssize_t max_samples)
+{
+    struct q16_context *ctx = in->priv;
+    ssize_t read_len, i, n;
+
+    if (ctx->codes_sz < max_samples) {
+        ctx->codes = g_realloc(ctx->codes, max_samples * sizeof(int16_t));
+        ctx->codes_sz = max_samples;
+    }
+
+    if ((read_len = read(in->fd, ctx->codes, max_samples * sizeof(int16_t))) < 0)
+        return SR_ERR_IO;
+
+    n = read_len / sizeof(int16_t);
+    for (i = 0; i < n; i++)
+        samples[i] = q16_decode(ctx->codes[i], ctx->scale, ctx->offset);
+
+    return n;
+}
+
+static void q16_close(struct sat_input *in)
+{
+    struct q16_context *ctx = in->priv;
+
+    if (ctx) {
+        g_free(ctx->codes);
+        g_free(ctx);
+        in->priv = NULL;
+    }
+}
+
+const struct sat_input_format input_q16 = {
+    .id = "q16",
+    .file_type = SAT_FILE_Q16,
+    .has_header = true,
+    .match = q16_match,
+    .scan = q16_scan,
+    .open = q16_open,
+    .seek = q16_seek,
+    .read = q16_read,
+    .close = q16_close,
+};
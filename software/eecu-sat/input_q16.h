@@ -0,0 +1,34 @@
+#ifndef __INPUT_Q16_H__
+#define __INPUT_Q16_H__
+
+#include <stdint.h>
+
+/*
+ * quantized analog file, a header followed by little endian int16 codes.
+ * sample = code * scale + offset
+ */
+struct __attribute__((packed)) q16_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    int32_t reserved;
+    double begin_time;
+    uint64_t sample_rate;
+    uint64_t downsample;
+    uint64_t num_samples;
+    double scale;
+    double offset;
+}; // 64bytes
+
+#define          Q16_HDR_SIZE  0x40
+#define        Q16_HDR_SC_POS  0x28
+#define             Q16_MAGIC  "<SATQ16>"
+
+// writer and reader must reconstruct samples in exactly the same way
+static inline float q16_decode(const int16_t code, const float scale, const float offset)
+{
+    return code * scale + offset;
+}
+
+extern const struct sat_input_format input_q16;
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "input.h"
+#include "store.h"
+#include "input_store.h"
+
+struct store_context {
+    uint8_t *map;               // the whole file
+    size_t map_len;
+    const struct store_block *blocks;   // blocks of the channel
+    uint32_t num_blocks;
+    uint32_t block_samples;
+    ssize_t num_samples;
+    ssize_t pos;                // next sample
+};
+
+static bool store_match(const uint8_t *hdr, const ssize_t len)
+{
+    if (len < STORE_HDR_SIZE)
+        return false;
+
+    return !memcmp(hdr, STORE_MAGIC, 8);
+}
+
+// check that the index of a store lies within the file
+static int check_hdr(const struct store_hdr *hdr, const ssize_t file_size)
+{
+    if (hdr->version != 0) {
+        err_msg("%s:%d unsupported store version %d", __FILE__, __LINE__, hdr->version);
+        return SR_ERR_ARG;
+    }
+
+    if (!hdr->index_offset || !hdr->block_samples ||
+        (hdr->index_offset + (uint64_t) hdr->num_channels * STORE_CHANNEL_SIZE +
+         (uint64_t) hdr->num_blocks * STORE_BLOCK_SIZE > (uint64_t) file_size)) {
+        err_msg("%s:%d incomplete or damaged store", __FILE__, __LINE__);
+        return SR_ERR_DATA;
+    }
+
+    return SR_OK;
+}
+
+static int store_scan(ch_data_t *ch, const uint8_t *buf, const ssize_t len)
+{
+    struct store_hdr hdr;
+    struct store_channel sc;
+    ssize_t ret;
+    int fd;
+
+    UNUSED(len);
+
+    memcpy(&hdr, buf, STORE_HDR_SIZE);
+    if ((ret = check_hdr(&hdr, ch->input_file_size)) != SR_OK)
+        return ret;
+    if (ch->column >= hdr.num_channels) {
+        err_msg("%s:%d store %s has no channel %d", __FILE__, __LINE__, ch->input_file_name, ch->column);
+        return SR_ERR_ARG;
+    }
+
+    if ((fd = open(ch->input_file_name, O_RDONLY)) < 0) {
+        err_msg("%s:%d opening input file", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    ret = pread(fd, &sc, STORE_CHANNEL_SIZE, hdr.index_offset + ch->column * STORE_CHANNEL_SIZE);
+    close(fd);
+    if (ret != STORE_CHANNEL_SIZE) {
+        err_msg("%s:%d during pread()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    ch->file_type = SAT_FILE_STORE;
+    ch->column_count = hdr.num_channels;
+    ch->sample_count = sc.num_samples;
+    ch->channel_name = g_strndup(sc.name, sizeof(sc.name));
+    sat_input_set_header(ch, sc.begin_time, sc.sample_rate, sc.downsample);
+
+    return SR_OK;
+}
+
+static int store_open(struct sat_input *in)
+{
+    struct store_context *ctx;
+    struct store_hdr hdr;
+    struct store_channel sc;
+    const struct store_block *b;
+    uint32_t i;
+
+    in->priv = ctx = g_malloc0(sizeof(struct store_context));
+
+    ctx->map_len = in->ch->input_file_size;
+    if ((ctx->map = mmap(NULL, ctx->map_len, PROT_READ, MAP_PRIVATE, in->fd, 0)) == MAP_FAILED) {
+        ctx->map = NULL;
+        err_msg("%s:%d during mmap()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    memcpy(&hdr, ctx->map, STORE_HDR_SIZE);
+    if (check_hdr(&hdr, ctx->map_len) != SR_OK)
+        return SR_ERR_DATA;
+    memcpy(&sc, ctx->map + hdr.index_offset + in->ch->column * STORE_CHANNEL_SIZE, STORE_CHANNEL_SIZE);
+    if ((uint64_t) sc.first_block + sc.num_blocks > hdr.num_blocks) {
+        err_msg("%s:%d damaged index in %s", __FILE__, __LINE__, in->ch->input_file_name);
+        return SR_ERR_DATA;
+    }
+
+    ctx->blocks = (const struct store_block *)(ctx->map + hdr.index_offset + (uint64_t) hdr.num_channels * STORE_CHANNEL_SIZE) + sc.first_block;
+    ctx->num_blocks = sc.num_blocks;
+    ctx->block_samples = hdr.block_samples;
+    ctx->num_samples = sc.num_samples;
+
+    // all blocks but the last one are full, so the block of a sample is found by a division
+    for (i = 0, b = ctx->blocks; i < ctx->num_blocks; i++, b++) {
+        if ((b->first_sample != (uint64_t) i * ctx->block_samples) || (b->num_samples > ctx->block_samples) ||
+            ((b->num_samples < ctx->block_samples) && (i != ctx->num_blocks - 1)) ||
+            (b->offset + (uint64_t) b->num_samples * sizeof(float) > ctx->map_len))
+            break;
+    }
+    if ((i != ctx->num_blocks) || ((uint64_t) ctx->num_blocks * ctx->block_samples < ctx->num_samples) ||
+        (ctx->num_blocks && (b[-1].first_sample + b[-1].num_samples != ctx->num_samples))) {
+        err_msg("%s:%d damaged index in %s", __FILE__, __LINE__, in->ch->input_file_name);
+        return SR_ERR_DATA;
+    }
+
+    return SR_OK;
+}
+
+static int store_seek(struct sat_input *in, const ssize_t sample)
+{
+    struct store_context *ctx = in->priv;
+
+    if ((sample < 0) || (sample > ctx->num_samples))
+        return SR_ERR_ARG;
+    ctx->pos = sample;
+
+    return SR_OK;
+}
+
+static ssize_t store_read(struct sat_input *in, float *samples, const ssize_t max_samples)
+{
+    struct store_context *ctx = in->priv;
+    const struct store_block *b;
+    ssize_t n, done = 0;
+
+    while ((done < max_samples) && (ctx->pos < ctx->num_samples)) {
+        b = ctx->blocks + ctx->pos / ctx->block_samples;
+        n = MIN(b->first_sample + b->num_samples - ctx->pos, max_samples - done);
+        memcpy(samples + done, ctx->map + b->offset + (ctx->pos - b->first_sample) * sizeof(float), n * sizeof(float));
+        ctx->pos += n;
+        done += n;
+    }
+
+    return done;
+}
+
+static ssize_t store_range(struct sat_input *in, float *min, float *max)
+{
+    struct store_context *ctx = in->priv;
+    const struct store_block *b;
+
+    if (ctx->pos >= ctx->num_samples)
+        return 0;
+
+    b = ctx->blocks + ctx->pos / ctx->block_samples;
+    *min = b->min;
+    *max = b->max;
+
+    return b->first_sample + b->num_samples - ctx->pos;
+}
+
+static void store_close(struct sat_input *in)
+{
+    struct store_context *ctx = in->priv;
+
+    if (ctx) {
+        if (ctx->map)
+            munmap(ctx->map, ctx->map_len);
+        g_free(ctx);
+        in->priv = NULL;
+    }
+}
+
+const struct sat_input_format input_store = {
+    .id = "store",
+    .file_type = SAT_FILE_STORE,
+    .has_header = true,
+    .match = store_match,
+    .scan = store_scan,
+    .open = store_open,
+    .seek = store_seek,
+    .read = store_read,
+    .range = store_range,
+    .close = store_close,
+};
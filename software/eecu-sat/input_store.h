@@ -0,0 +1,6 @@
+#ifndef __INPUT_STORE_H__
+#define __INPUT_STORE_H__
+
+extern const struct sat_input_format input_store;
+
+#endif
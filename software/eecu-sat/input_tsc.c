@@ -0,0 +1,195 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "input.h"
+#include "tsc.h"
+#include "input_tsc.h"
+
+struct tsc_context {
+    struct tsc_coder *coder;
+    ssize_t block_samples;
+    off_t next_block;           // file offset of the next block header
+    uint8_t *coded;
+    float *samples;             // current decoded block
+    ssize_t pos;
+    ssize_t cnt;
+};
+
+static bool tsc_match(const uint8_t *hdr, const ssize_t len)
+{
+    if (len < TSC_HDR_SIZE)
+        return false;
+
+    return !memcmp(hdr, TSC_MAGIC, 8);
+}
+
+static int tsc_scan(ch_data_t *ch, const uint8_t *buf, const ssize_t len)
+{
+    struct tsc_hdr hdr;
+
+    UNUSED(len);
+
+    memcpy(&hdr, buf, TSC_HDR_SIZE);
+    if (hdr.version != 0) {
+        err_msg("%s:%d unsupported tsc file version %d", __FILE__, __LINE__, hdr.version);
+        return SR_ERR_ARG;
+    }
+
+    ch->file_type = SAT_FILE_TSC;
+    ch->sample_count = hdr.num_samples;
+    sat_input_set_header(ch, hdr.begin_time, hdr.sample_rate, hdr.downsample);
+
+    return SR_OK;
+}
+
+static int tsc_open(struct sat_input *in)
+{
+    struct tsc_context *ctx;
+    struct tsc_hdr hdr;
+
+    if (pread(in->fd, &hdr, TSC_HDR_SIZE, 0) != TSC_HDR_SIZE)
+        return SR_ERR_IO;
+
+    in->priv = ctx = g_malloc0(sizeof(struct tsc_context));
+    if (!(ctx->coder = tsc_coder_new(hdr.block_samples))) {
+        err_msg("%s:%d invalid block size %u", __FILE__, __LINE__, hdr.block_samples);
+        return SR_ERR_DATA;
+    }
+    ctx->block_samples = hdr.block_samples;
+    ctx->coded = g_malloc(TSC_MAX_BYTES(hdr.block_samples));
+    ctx->samples = g_malloc(hdr.block_samples * sizeof(float));
+
+    return SR_OK;
+}
+
+// read the header of the next block, returns 0 at the end of the file
+static int next_block(struct sat_input *in, struct tsc_block_hdr *bh)
+{
+    struct tsc_context *ctx = in->priv;
+    ssize_t ret;
+
+    if ((ret = pread(in->fd, bh, TSC_BLOCK_HDR_SIZE, ctx->next_block)) == 0)
+        return 0;
+    if ((ret != TSC_BLOCK_HDR_SIZE) || (bh->num_samples < 1) || (bh->num_samples > ctx->block_samples)
+        || (bh->byte_len > TSC_MAX_BYTES(bh->num_samples)))
+        return SR_ERR_DATA;
+
+    return 1;
+}
+
+static int decode_block(struct sat_input *in, const struct tsc_block_hdr *bh)
+{
+    struct tsc_context *ctx = in->priv;
+
+    if (pread(in->fd, ctx->coded, bh->byte_len, ctx->next_block + TSC_BLOCK_HDR_SIZE) != bh->byte_len)
+        return SR_ERR_IO;
+    ctx->next_block += TSC_BLOCK_HDR_SIZE + bh->byte_len;
+    ctx->pos = 0;
+    ctx->cnt = bh->num_samples;
+
+    return tsc_decode(ctx->coder, ctx->coded, bh->byte_len, ctx->samples, bh->num_samples);
+}
+
+// blocks are independent, so only the block that holds the sample is decoded
+static int tsc_seek(struct sat_input *in, const ssize_t sample)
+{
+    struct tsc_context *ctx = in->priv;
+    struct tsc_block_hdr bh;
+    ssize_t skipped = 0;
+    int ret;
+
+    ctx->next_block = TSC_HDR_SIZE;
+    ctx->pos = ctx->cnt = 0;
+
+    while ((ret = next_block(in, &bh)) > 0) {
+        if (skipped + bh.num_samples > sample) {
+            if ((ret = decode_block(in, &bh)) != SR_OK)
+                return ret;
+            ctx->pos = sample - skipped;
+            return SR_OK;
+        }
+        skipped += bh.num_samples;
+        ctx->next_block += TSC_BLOCK_HDR_SIZE + bh.byte_len;
+    }
+
+    return (ret < 0) ? ret : (skipped == sample) ? SR_OK : SR_ERR_ARG;
+}
+
+static ssize_t tsc_read(struct sat_input *in, float *samples, const ssize_t max_samples)
+{
+    struct tsc_context *ctx = in->priv;
+    struct tsc_block_hdr bh;
+    ssize_t n, done = 0;
+    int ret;
+
+    while (done < max_samples) {
+        if (ctx->pos == ctx->cnt) {
+            if ((ret = next_block(in, &bh)) <= 0) {
+                if (ret < 0) {
+                    err_msg("%s:%d damaged block in %s", __FILE__, __LINE__, in->ch->input_file_name);
+                    return ret;
+                }
+                break;
+            }
+            if ((ret = decode_block(in, &bh)) != SR_OK) {
+                err_msg("%s:%d damaged block in %s", __FILE__, __LINE__, in->ch->input_file_name);
+                return ret;
+            }
+        }
+        n = MIN(ctx->cnt - ctx->pos, max_samples - done);
+        memcpy(samples + done, ctx->samples + ctx->pos, n * sizeof(float));
+        ctx->pos += n;
+        done += n;
+    }
+
+    return done;
+}
+
+static void tsc_close(struct sat_input *in)
+{
+    struct tsc_context *ctx = in->priv;
+
+    if (ctx) {
+        tsc_coder_free(ctx->coder);
+        g_free(ctx->coded);
+        g_free(ctx->samples);
+        g_free(ctx);
+        in->priv = NULL;
+    }
+}
+
+const struct sat_input_format input_tsc = {
+    .id = "tsc",
+    .file_type = SAT_FILE_TSC,
+    .has_header = true,
+    .match = tsc_match,
+    .scan = tsc_scan,
+    .open = tsc_open,
+    .seek = tsc_seek,
+    .read = tsc_read,
+    .close = tsc_close,
+};
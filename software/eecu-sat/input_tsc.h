@@ -0,0 +1,6 @@
+#ifndef __INPUT_TSC_H__
+#define __INPUT_TSC_H__
+
+extern const struct sat_input_format input_tsc;
+
+#endif
@@ -27,6 +27,7 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <glob.h>
 #include <libgen.h>
 #include <string.h>
 #include <unistd.h>
@@ -38,6 +39,7 @@
 #include "proj.h"
 #include "version.h"
 #include "saleae.h"
+#include "input.h"
 #include "output.h"
 #include "output_analog.h"
 #include "output_srzip.h"
@@ -46,6 +48,9 @@
 #include "parsers.h"
 #include "trigger.h"
 #include "session.h"
+#include "compare.h"
+#include "golden.h"
+#include "search.h"
 #include "strnatcmp.h"
 
 // program arguments
@@ -61,12 +66,35 @@ static void show_usage(void)
     fprintf(stdout, "\t\tinput data format to use, see -L for list\n");
     fprintf(stdout, "\t-o, --output=FILE\n");
     fprintf(stdout, "\t\toutput file to be generated\n");
+    fprintf(stdout, "\t\tcan be repeated, once for every output format\n");
     fprintf(stdout, "\t-O, --output-format OUTPUT\n");
     fprintf(stdout, "\t\toutput data format to use, see -L for list\n");
+    fprintf(stdout, "\t\tcan be repeated, all outputs are fed from a single pass over the input\n");
     fprintf(stdout, "\t-t, --triggers TRIGGERS\n");
     fprintf(stdout, "\t\ttrigger configuration\n");
     fprintf(stdout, "\t-T, --transform-module TRANSFORM\n");
     fprintf(stdout, "\t\tprocess data via a function, see -L for list\n");
+    fprintf(stdout, "\t\tcan be repeated, modules are applied in the given order\n");
+    fprintf(stdout, "\t-s, --side-output OUTPUT@FILE\n");
+    fprintf(stdout, "\t\tthe same as an extra -O OUTPUT -o FILE pair\n");
+    fprintf(stdout, "\t\tcan be repeated\n");
+    fprintf(stdout, "\t-r, --reference FILENAME_MATCH\n");
+    fprintf(stdout, "\t\tcompare the input against this known good capture instead of exporting it\n");
+    fprintf(stdout, "\t-C, --compare OPTIONS\n");
+    fprintf(stdout, "\t\tcomparison settings like align=global:tolerance=0.25\n");
+    fprintf(stdout, "\t-b, --batch FILENAME_MATCH\n");
+    fprintf(stdout, "\t\tcompare many captures against the reference, the directory part can hold wildcards\n");
+    fprintf(stdout, "\t\tcan be repeated\n");
+    fprintf(stdout, "\t-g, --golden FILENAME_MATCH\n");
+    fprintf(stdout, "\t\tknown good capture, builds a statistical model written to --output instead of exporting\n");
+    fprintf(stdout, "\t\tcan be repeated, once for every capture\n");
+    fprintf(stdout, "\t-M, --model OPTIONS\n");
+    fprintf(stdout, "\t\tmodel settings like resolution=64\n");
+    fprintf(stdout, "\t-q, --query FILE\n");
+    fprintf(stdout, "\t\tfingerprint of a capture, ranks the --search fingerprints by similarity instead of exporting\n");
+    fprintf(stdout, "\t-S, --search FILENAME_MATCH\n");
+    fprintf(stdout, "\t\tarchived fingerprints to search, can hold wildcards\n");
+    fprintf(stdout, "\t\tcan be repeated\n");
     fprintf(stdout, "\t-L, --list\n");
     fprintf(stdout, "\t\tlist known output formats and transform modules\n");
     fprintf(stdout, "\t-h, --help\n");
@@ -98,9 +126,34 @@ static void show_capabilities(void)
 
 }
 
+/*
+ * a side output is the same as an extra -O and -o pair, given as OUTPUT@FILE
+ * where the output format might contain an '@' itself. they are appended
+ * after the other outputs so the pairs given via -O and -o stay in order.
+ */
+static int add_side_outputs(GSList *side_outputs)
+{
+    char *file;
+    GSList *l;
+
+    for (l = side_outputs; l; l = l->next) {
+        file = strrchr(l->data, '@');
+        if (!file || !file[1] || (file == l->data)) {
+            err_msg("%s:%d side output '%s' is not in the OUTPUT@FILE form", __FILE__, __LINE__, (char *)l->data);
+            return SR_ERR_ARG;
+        }
+        *file++ = 0;
+        opt.output_formats = g_slist_append(opt.output_formats, l->data);
+        opt.output_files = g_slist_append(opt.output_files, file);
+    }
+
+    return SR_OK;
+}
+
 static int parse_options(int argc, char **argv)
 {
-    int q, opt_idx;
+    GSList *side_outputs = NULL;
+    int q, opt_idx, ret;
 
     while (1) {
         opt_idx = 0;
@@ -111,13 +164,21 @@ static int parse_options(int argc, char **argv)
             {"output-format", 1, 0, 'O'},
             {"triggers", 1, 0, 't'},
             {"transform-module", 1, 0, 'T'},
+            {"side-output", 1, 0, 's'},
+            {"reference", 1, 0, 'r'},
+            {"compare", 1, 0, 'C'},
+            {"batch", 1, 0, 'b'},
+            {"golden", 1, 0, 'g'},
+            {"model", 1, 0, 'M'},
+            {"query", 1, 0, 'q'},
+            {"search", 1, 0, 'S'},
             {"list", 0, 0, 'L'},
             {"help", 0, 0, 'h'},
             {"version", 0, 0, 'v'},
             {0, 0, 0, 0}
         };
 
-        q = getopt_long(argc, argv, "i:I:o:O:t:T:Lhv", long_options, &opt_idx);
+        q = getopt_long(argc, argv, "i:I:o:O:t:T:s:r:C:b:g:M:q:S:Lhv", long_options, &opt_idx);
         if (q == -1) {
             break;
         }
@@ -129,16 +190,40 @@ static int parse_options(int argc, char **argv)
             opt.input_format = optarg;
             break;
         case 'o':
-            opt.output_file = optarg;
+            opt.output_files = g_slist_append(opt.output_files, optarg);
             break;
         case 'O':
-            opt.output_format = optarg;
+            opt.output_formats = g_slist_append(opt.output_formats, optarg);
             break;
         case 't':
             opt.triggers = optarg;
             break;
         case 'T':
-            opt.transform_module = optarg;
+            opt.transform_modules = g_slist_append(opt.transform_modules, optarg);
+            break;
+        case 's':
+            side_outputs = g_slist_append(side_outputs, optarg);
+            break;
+        case 'r':
+            opt.reference_prefix = optarg;
+            break;
+        case 'C':
+            opt.compare = optarg;
+            break;
+        case 'b':
+            opt.batch_prefixes = g_slist_append(opt.batch_prefixes, optarg);
+            break;
+        case 'g':
+            opt.golden_prefixes = g_slist_append(opt.golden_prefixes, optarg);
+            break;
+        case 'M':
+            opt.model = optarg;
+            break;
+        case 'q':
+            opt.query = optarg;
+            break;
+        case 'S':
+            opt.search_patterns = g_slist_append(opt.search_patterns, optarg);
             break;
         case 'L':
             show_capabilities();
@@ -158,7 +243,10 @@ static int parse_options(int argc, char **argv)
         opt.input_prefix = opt_default_input_prefix;
     }
 
-    return SR_OK;
+    ret = add_side_outputs(side_outputs);
+    g_slist_free(side_outputs);
+
+    return ret;
 }
 
 static void logger(const gchar *log_domain, GLogLevelFlags log_level,
@@ -188,7 +276,53 @@ static int cmp_channel_names(const void *leftp, const void *rightp)
     return strnatcmp(left->input_file_name, right->input_file_name);
 }
 
-int main(int argc, char **argv)
+/*
+ * scan one channel of an input file and append it to the device. column_count
+ * is set to the number of channels the file holds.
+ */
+static int add_channel(struct sr_dev_inst *sdi, const char *file_name, const uint16_t column, uint16_t *column_count,
+                       ssize_t *sample_count_compare, uint64_t *samplerate_compare)
+{
+    ch_data_t *ch_data_ptr;
+    int ret;
+
+    ch_data_ptr = g_malloc0(sizeof(struct ch_data));
+    ch_data_ptr->input_file_name = g_strdup(file_name);
+    ch_data_ptr->sample_size = sizeof(float);
+    ch_data_ptr->column = column;
+
+    if ((ret = sat_input_scan(ch_data_ptr)) != SR_OK)
+        goto error;
+    *column_count = MAX(1, ch_data_ptr->column_count);
+
+    // channels recorded at a different sample rate can't have the same length
+    if (*sample_count_compare == -1) {
+        *sample_count_compare = ch_data_ptr->sample_count;
+        *samplerate_compare = ch_data_ptr->samplerate;
+    }
+    if ((*samplerate_compare == ch_data_ptr->samplerate) && (*sample_count_compare != ch_data_ptr->sample_count)) {
+        err_msg("%s:%d file %s has %ld samples, but %ld samples were expected", __FILE__, __LINE__, ch_data_ptr->input_file_name,
+                ch_data_ptr->sample_count, *sample_count_compare);
+        ret = SR_ERR_ARG;
+        goto error;
+    }
+    sdi->channels = g_slist_append(sdi->channels, ch_data_ptr);
+
+    return SR_OK;
+
+ error:
+    g_free(ch_data_ptr->input_file_name);
+    g_free(ch_data_ptr->channel_name);
+    g_free(ch_data_ptr);
+    return ret;
+}
+
+/*
+ * add every file that matches prefix (an fnmatch pattern that can be
+ * preceded by a directory) to the device and number the channels in natural
+ * sort order
+ */
+static int load_channels(struct sr_dev_inst *sdi, const char *prefix)
 {
     int res;
     struct dirent **namelist;
@@ -198,37 +332,23 @@ int main(int argc, char **argv)
     char *input_dirname;
     char *_input_basename = NULL;
     char *input_basename;
-    ssize_t file_name_len;
-    FILE *fp;
+    char *file_name;
+    uint16_t column, column_count;
     ch_data_t *ch_data_ptr;
-    ssize_t file_size_compare = -1;
+    ssize_t sample_count_compare = -1;
+    uint64_t samplerate_compare = 0;
     int ret = SR_OK;
-    struct sr_dev_inst sdi = { 0 };
-    struct dev_frame frame = { 0 };
     GSList *l, *channels = NULL;
-    uint8_t buff[SALEAE_ANALOG_HDR_SIZE];
 
-    opt.loglevel = SR_LOG_INFO;
-    g_log_set_default_handler(logger, NULL);
-
-    if (parse_options(argc, argv)) {
-        return SR_ERR_ARG;
-    }
-
-    if (sr_log_loglevel_set(opt.loglevel) != SR_OK)
-        return SR_ERR_ARG;
-
-    _input_dirname = strdup(opt.input_prefix);
-    _input_basename = strdup(opt.input_prefix);
+    _input_dirname = strdup(prefix);
+    _input_basename = strdup(prefix);
 
     input_dirname = dirname(_input_dirname);
     input_basename = basename(_input_basename);
 
-    //printf("input files prefix is %s, dirname %s, basename %s\n", opt.input_prefix, input_dirname, input_basename);
+    //printf("input files prefix is %s, dirname %s, basename %s\n", prefix, input_dirname, input_basename);
     ch_cnt = scandir(input_dirname, &namelist, NULL, versionsort);
 
-    sdi.priv = &frame;
-
     // create a linked list with all files that match the filter defined by the --input option
     if (ch_cnt < 0)
         perror("scandir");
@@ -238,83 +358,27 @@ int main(int argc, char **argv)
             res = fnmatch(input_basename, namelist[i]->d_name, 0);
             if (!res) {
                 //printf("%s matches\n", namelist[i]->d_name);
-                channel_total++;
-                ch_data_ptr = g_malloc0(sizeof(struct ch_data));
-
-                file_name_len = strlen(input_dirname) + strlen(namelist[i]->d_name);
-                ch_data_ptr->input_file_name = (char *)g_malloc0((file_name_len + 3) * sizeof(char));
-                snprintf(ch_data_ptr->input_file_name, file_name_len + 2, "%s/%s", input_dirname, namelist[i]->d_name);
-                ch_data_ptr->sample_size = sizeof(float);
-
-                // get file size
-                if ((fp = fopen(ch_data_ptr->input_file_name, "r")) == NULL) {
-                    err_msg("%s:%d opening input file", __FILE__, __LINE__);
-                    g_free(ch_data_ptr->input_file_name);
-                    g_free(ch_data_ptr);
-                    ret = SR_ERR_ARG;
-                    goto cleanup;
-                }
-                fseek(fp, 0L, SEEK_END);
-                ch_data_ptr->input_file_size = ftell(fp);
-
-                fseek(fp, 0L, SEEK_SET);
-                if (fread(&buff, 1, SALEAE_ANALOG_HDR_SIZE, fp) != SALEAE_ANALOG_HDR_SIZE) {
-                    err_msg("%s:%d during fread()", __FILE__, __LINE__);
-                    g_free(ch_data_ptr->input_file_name);
-                    g_free(ch_data_ptr);
-                    fclose(fp);
-                    ret = SR_ERR_IO;
-                    goto cleanup;
-                }
+                file_name = g_strdup_printf("%s/%s", input_dirname, namelist[i]->d_name);
 
-                ch_data_ptr->file_type = saleae_get_hdr_type(&buff[0]);
-
-                if (ch_data_ptr->file_type == SALEAE_ANALOG) {
-                    ch_data_ptr->sample_count = (ch_data_ptr->input_file_size - SALEAE_ANALOG_HDR_SIZE) / ch_data_ptr->sample_size;
-                    memcpy(&ch_data_ptr->header, buff, SALEAE_ANALOG_HDR_SIZE);
-#if 0
-                    fprintf(stdout, "channel %s\n", ch_data_ptr->input_file_name);
-                    fprintf(stdout, "  version %d\n", ch_data_ptr->header.version);
-                    fprintf(stdout, "  type %d\n", ch_data_ptr->header.type);
-                    fprintf(stdout, "  begin time %lf\n", ch_data_ptr->header.begin_time);
-                    fprintf(stdout, "  sample rate %ld\n", ch_data_ptr->header.sample_rate);
-                    fprintf(stdout, "  downsample %ld\n", ch_data_ptr->header.downsample);
-                    fprintf(stdout, "  sample cnt %ld %ld\n", ch_data_ptr->header.num_samples, ch_data_ptr->sample_count);
-#endif
-                } else if (ch_data_ptr->file_type == SALEAE_DIGITAL) {
-                    err_msg("%s:%d cannot use digital input files", __FILE__, __LINE__);
-                    g_free(ch_data_ptr->input_file_name);
-                    g_free(ch_data_ptr);
-                    fclose(fp);
-                    ret = SR_ERR_ARG;
-                    goto cleanup;
-                } else {
-                    ch_data_ptr->sample_count = ch_data_ptr->input_file_size / ch_data_ptr->sample_size;
+                // a capture store holds several channels in one file
+                column_count = 1;
+                for (column = 0; column < column_count; column++) {
+                    if ((ret = add_channel(sdi, file_name, column, &column_count, &sample_count_compare, &samplerate_compare)) != SR_OK)
+                        break;
                 }
- 
-                fclose(fp);
-
-                if (file_size_compare == -1)
-                    file_size_compare = ch_data_ptr->input_file_size;
-                if (file_size_compare != ch_data_ptr->input_file_size) {
-                    err_msg("%s:%d file %s has %ld bytes, but %ld bytes were expected", __FILE__, __LINE__, ch_data_ptr->input_file_name,
-                            ch_data_ptr->input_file_size, file_size_compare);
-                    g_free(ch_data_ptr->input_file_name);
-                    g_free(ch_data_ptr);
-                    ret = SR_ERR_ARG;
+                g_free(file_name);
+                if (ret != SR_OK)
                     goto cleanup;
-                }
-                sdi.channels = g_slist_append(sdi.channels, ch_data_ptr);
             }
         }
     }
 
     // sort list using a natural sort algorithm
-    sdi.channels = g_slist_sort(sdi.channels, cmp_channel_names);
+    sdi->channels = g_slist_sort(sdi->channels, cmp_channel_names);
 
     // set channel ids on the sorted list
     channel_total = 1;
-    channels = sr_dev_inst_channels_get(&sdi);
+    channels = sr_dev_inst_channels_get(sdi);
     for (l = channels; l; l = l->next) {
         ch_data_ptr = l->data;
         ch_data_ptr->id = channel_total;
@@ -322,34 +386,204 @@ int main(int argc, char **argv)
         //fprintf(stdout, "file id %d in list %s\n", ch_data_ptr->id, ch_data_ptr->input_file_name);
     }
 
-    if (channel_total) {
-        ret = run_session(&sdi, &opt);
-    } else {
-        err_msg("%s:%d no valid input channels found", __FILE__, __LINE__);
-        show_usage();
-        ret = SR_ERR_ARG;
-        goto cleanup;
-    }
-
-cleanup:
+ cleanup:
     for (i = 0; i < ch_cnt; i++) {
         free(namelist[i]);
     }
-    free(namelist);
-    channels = sr_dev_inst_channels_get(&sdi);
+    if (ch_cnt >= 0)
+        free(namelist);
+    free(_input_dirname);
+    free(_input_basename);
+
+    return ret;
+}
+
+static void free_channels(struct sr_dev_inst *sdi)
+{
+    ch_data_t *ch_data_ptr;
+    GSList *l, *channels;
+
+    channels = sr_dev_inst_channels_get(sdi);
     if (channels) {
         for (l = channels; l; l = l->next) {
             ch_data_ptr = l->data;
             if (ch_data_ptr->input_file_name)
                 g_free(ch_data_ptr->input_file_name);
+            g_free(ch_data_ptr->channel_name);
             if (ch_data_ptr->trigger)
                 sat_trigger_free(ch_data_ptr->trigger);
             g_free(l->data);
         }
         g_slist_free(channels);
     }
-    free(_input_dirname);
-    free(_input_basename);
+}
+
+// every --golden capture gets a device of its own
+static int build_model(void)
+{
+    struct sr_dev_inst *captures;
+    uint32_t i, cnt = g_slist_length(opt.golden_prefixes);
+    GSList *l;
+    int ret = SR_OK;
+
+    captures = g_malloc0(cnt * sizeof(struct sr_dev_inst));
+    for (i = 0, l = opt.golden_prefixes; l; i++, l = l->next) {
+        if ((ret = load_channels(&captures[i], l->data)) != SR_OK)
+            goto cleanup;
+        if (!captures[i].channels) {
+            err_msg("%s:%d no valid channels found for %s", __FILE__, __LINE__, (char *)l->data);
+            ret = SR_ERR_ARG;
+            goto cleanup;
+        }
+    }
+
+    ret = run_golden(captures, cnt, &opt);
+
+ cleanup:
+    for (i = 0; i < cnt; i++)
+        free_channels(&captures[i]);
+    g_free(captures);
+
+    return ret;
+}
+
+/*
+ * every directory that matches the directory part of a --batch argument
+ * holds one capture, the files are picked by the part after the last '/'
+ */
+static int batch_compare(void)
+{
+    struct sr_dev_inst ref_sdi = { 0 };
+    struct sr_dev_inst *captures = NULL;
+    GPtrArray *names;
+    char *dir, *base;
+    glob_t g;
+    struct stat st;
+    uint32_t i, cnt;
+    GSList *l;
+    int ret = SR_OK;
+
+    names = g_ptr_array_new_with_free_func(g_free);
+
+    if (!opt.reference_prefix) {
+        err_msg("%s:%d a batch needs a --reference", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+        goto cleanup;
+    }
+    if ((ret = load_channels(&ref_sdi, opt.reference_prefix)) != SR_OK)
+        goto cleanup;
+    if (!ref_sdi.channels) {
+        err_msg("%s:%d no valid reference channels found", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+        goto cleanup;
+    }
+
+    for (l = opt.batch_prefixes; l; l = l->next) {
+        dir = g_path_get_dirname(l->data);
+        base = g_path_get_basename(l->data);
+        if (!glob(dir, GLOB_ONLYDIR, NULL, &g)) {
+            for (i = 0; i < g.gl_pathc; i++) {
+                if (!stat(g.gl_pathv[i], &st) && S_ISDIR(st.st_mode))
+                    g_ptr_array_add(names, g_build_filename(g.gl_pathv[i], base, NULL));
+            }
+            globfree(&g);
+        }
+        g_free(dir);
+        g_free(base);
+    }
+
+    cnt = names->len;
+    if (!cnt) {
+        err_msg("%s:%d no capture directories found", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+        goto cleanup;
+    }
+    captures = g_malloc0(cnt * sizeof(struct sr_dev_inst));
+    for (i = 0; i < cnt; i++) {
+        if ((ret = load_channels(&captures[i], names->pdata[i])) != SR_OK)
+            goto cleanup;
+    }
+
+    ret = run_batch(&ref_sdi, captures, (char **)names->pdata, cnt, &opt);
+
+ cleanup:
+    if (captures) {
+        for (i = 0; i < cnt; i++)
+            free_channels(&captures[i]);
+        g_free(captures);
+    }
+    free_channels(&ref_sdi);
+    g_ptr_array_free(names, TRUE);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = SR_OK;
+    struct sr_dev_inst sdi = { 0 };
+    struct sr_dev_inst ref_sdi = { 0 };
+    struct dev_frame frame = { 0 };
+
+    opt.loglevel = SR_LOG_INFO;
+    g_log_set_default_handler(logger, NULL);
+
+    if (parse_options(argc, argv)) {
+        return SR_ERR_ARG;
+    }
+
+    if (sr_log_loglevel_set(opt.loglevel) != SR_OK)
+        return SR_ERR_ARG;
+
+    sdi.priv = &frame;
+
+    if (opt.query) {
+        ret = run_search(&opt);
+        goto cleanup;
+    }
+
+    if (opt.golden_prefixes) {
+        ret = build_model();
+        goto cleanup;
+    }
+
+    if (opt.batch_prefixes) {
+        ret = batch_compare();
+        goto cleanup;
+    }
+
+    if ((ret = load_channels(&sdi, opt.input_prefix)) != SR_OK)
+        goto cleanup;
+
+    if (!sdi.channels) {
+        err_msg("%s:%d no valid input channels found", __FILE__, __LINE__);
+        show_usage();
+        ret = SR_ERR_ARG;
+        goto cleanup;
+    }
+
+    if (opt.reference_prefix) {
+        if ((ret = load_channels(&ref_sdi, opt.reference_prefix)) != SR_OK)
+            goto cleanup;
+        if (!ref_sdi.channels) {
+            err_msg("%s:%d no valid reference channels found", __FILE__, __LINE__);
+            ret = SR_ERR_ARG;
+            goto cleanup;
+        }
+        ret = run_compare(&ref_sdi, &sdi, &opt);
+    } else {
+        ret = run_session(&sdi, &opt);
+    }
+
+cleanup:
+    free_channels(&sdi);
+    free_channels(&ref_sdi);
+    g_slist_free(opt.transform_modules);
+    g_slist_free(opt.output_files);
+    g_slist_free(opt.output_formats);
+    g_slist_free(opt.golden_prefixes);
+    g_slist_free(opt.batch_prefixes);
+    g_slist_free(opt.search_patterns);
 
     return ret;
 }
@@ -0,0 +1,236 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "mask.h"
+
+// writer and reader must reconstruct the limits in exactly the same way
+static inline float mask_decode(const int16_t code, const float scale, const float offset)
+{
+    return code * scale + offset;
+}
+
+// codes are rounded outwards, so the stored envelope never gets narrower
+static int16_t encode_lower(const float v, const float scale, const float offset)
+{
+    double c = floor((v - offset) / scale);
+    int16_t code = CLAMP(c, INT16_MIN, INT16_MAX);
+
+    while ((code > INT16_MIN) && (mask_decode(code, scale, offset) > v))
+        code--;
+
+    return code;
+}
+
+static int16_t encode_upper(const float v, const float scale, const float offset)
+{
+    double c = ceil((v - offset) / scale);
+    int16_t code = CLAMP(c, INT16_MIN, INT16_MAX);
+
+    while ((code < INT16_MAX) && (mask_decode(code, scale, offset) < v))
+        code++;
+
+    return code;
+}
+
+void sat_mask_free(struct sat_mask *mask)
+{
+    uint32_t i;
+
+    if (!mask)
+        return;
+
+    for (i = 0; i < mask->num_channels; i++) {
+        g_free(mask->ch[i].lower);
+        g_free(mask->ch[i].upper);
+    }
+    g_free(mask->ch);
+    g_free(mask);
+}
+
+struct sat_mask_channel *sat_mask_channel_get(const struct sat_mask *mask, const uint16_t id)
+{
+    uint32_t i;
+
+    for (i = 0; i < mask->num_channels; i++) {
+        if (mask->ch[i].id == id)
+            return &mask->ch[i];
+    }
+
+    return NULL;
+}
+
+struct sat_mask *sat_mask_load(const char *file_name)
+{
+    struct sat_mask *mask = NULL;
+    struct sat_mask_channel *ch;
+    struct mask_hdr hdr;
+    struct mask_channel mc;
+    int16_t *codes = NULL;
+    uint32_t i, j;
+    FILE *fp;
+
+    if (!(fp = fopen(file_name, "rb"))) {
+        err_msg("%s:%d unable to open mask file %s", __FILE__, __LINE__, file_name);
+        return NULL;
+    }
+
+    if ((fread(&hdr, 1, MASK_HDR_SIZE, fp) != MASK_HDR_SIZE) || memcmp(hdr.identifier, MASK_MAGIC, 8)) {
+        err_msg("%s:%d %s is not a mask file", __FILE__, __LINE__, file_name);
+        goto error;
+    }
+    if (hdr.version != 0) {
+        err_msg("%s:%d unsupported mask version %d", __FILE__, __LINE__, hdr.version);
+        goto error;
+    }
+
+    mask = g_malloc0(sizeof(struct sat_mask));
+    mask->resolution = hdr.resolution;
+    mask->sample_rate = hdr.sample_rate;
+    mask->ch = g_malloc0(hdr.num_channels * sizeof(struct sat_mask_channel));
+
+    for (i = 0; i < hdr.num_channels; i++) {
+        if (fread(&mc, 1, MASK_CHANNEL_SIZE, fp) != MASK_CHANNEL_SIZE)
+            goto damaged;
+        ch = &mask->ch[i];
+        mask->num_channels++;
+        ch->id = mc.id;
+        memcpy(ch->name, mc.name, sizeof(ch->name));
+        ch->name[sizeof(ch->name) - 1] = 0;
+        ch->num_samples = mc.num_samples;
+        ch->num_bins = mc.num_bins;
+        ch->lower = g_malloc(ch->num_bins * sizeof(float));
+        ch->upper = g_malloc(ch->num_bins * sizeof(float));
+        codes = g_realloc(codes, ch->num_bins * sizeof(int16_t));
+
+        if (fread(codes, sizeof(int16_t), ch->num_bins, fp) != ch->num_bins)
+            goto damaged;
+        for (j = 0; j < ch->num_bins; j++)
+            ch->lower[j] = mask_decode(codes[j], mc.scale, mc.offset);
+        if (fread(codes, sizeof(int16_t), ch->num_bins, fp) != ch->num_bins)
+            goto damaged;
+        for (j = 0; j < ch->num_bins; j++) {
+            ch->upper[j] = mask_decode(codes[j], mc.scale, mc.offset);
+            // only the empty bin marker has its lower limit above the upper one
+            if (ch->lower[j] > ch->upper[j]) {
+                ch->lower[j] = INFINITY;
+                ch->upper[j] = -INFINITY;
+            }
+        }
+    }
+
+    g_free(codes);
+    fclose(fp);
+
+    return mask;
+
+ damaged:
+    err_msg("%s:%d incomplete or damaged mask file %s", __FILE__, __LINE__, file_name);
+ error:
+    g_free(codes);
+    sat_mask_free(mask);
+    fclose(fp);
+
+    return NULL;
+}
+
+int sat_mask_save(const struct sat_mask *mask, const char *file_name)
+{
+    const struct sat_mask_channel *ch;
+    struct mask_hdr hdr = { 0 };
+    struct mask_channel mc;
+    int16_t *codes = NULL;
+    float lo, hi;
+    uint32_t i, j;
+    int ret = SR_OK;
+    FILE *fp;
+
+    if (!(fp = fopen(file_name, "wb"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    memcpy(hdr.identifier, MASK_MAGIC, 8);
+    hdr.resolution = mask->resolution;
+    hdr.num_channels = mask->num_channels;
+    hdr.sample_rate = mask->sample_rate;
+    if (fwrite(&hdr, 1, MASK_HDR_SIZE, fp) != MASK_HDR_SIZE)
+        goto io_error;
+
+    for (i = 0; i < mask->num_channels; i++) {
+        ch = &mask->ch[i];
+
+        // the codes span the finite limits of the channel, empty bins aside
+        lo = INFINITY;
+        hi = -INFINITY;
+        for (j = 0; j < ch->num_bins; j++) {
+            if (!(ch->lower[j] <= ch->upper[j]))
+                continue;
+            if (isfinite(ch->lower[j]))
+                lo = MIN(lo, ch->lower[j]);
+            if (isfinite(ch->upper[j]))
+                hi = MAX(hi, ch->upper[j]);
+        }
+        if (!isfinite(lo))
+            lo = isfinite(hi) ? hi : 0;
+        if (!isfinite(hi))
+            hi = lo;
+
+        memset(&mc, 0, sizeof(mc));
+        g_strlcpy(mc.name, ch->name, sizeof(mc.name));
+        mc.id = ch->id;
+        mc.num_bins = ch->num_bins;
+        mc.num_samples = ch->num_samples;
+        mc.offset = (float) ((lo + (double) hi) / 2);
+        mc.scale = (float) MAX((hi - (double) lo) / 65000, 1e-6);
+        if (fwrite(&mc, 1, MASK_CHANNEL_SIZE, fp) != MASK_CHANNEL_SIZE)
+            goto io_error;
+
+        codes = g_realloc(codes, ch->num_bins * sizeof(int16_t));
+        for (j = 0; j < ch->num_bins; j++)
+            codes[j] = (ch->lower[j] <= ch->upper[j]) ? encode_lower(ch->lower[j], mc.scale, mc.offset) : INT16_MAX;
+        if (fwrite(codes, sizeof(int16_t), ch->num_bins, fp) != ch->num_bins)
+            goto io_error;
+        for (j = 0; j < ch->num_bins; j++)
+            codes[j] = (ch->lower[j] <= ch->upper[j]) ? encode_upper(ch->upper[j], mc.scale, mc.offset) : INT16_MIN;
+        if (fwrite(codes, sizeof(int16_t), ch->num_bins, fp) != ch->num_bins)
+            goto io_error;
+    }
+
+ cleanup:
+    g_free(codes);
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    return ret;
+
+ io_error:
+    err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+    ret = SR_ERR_IO;
+    goto cleanup;
+}
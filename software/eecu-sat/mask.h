@@ -0,0 +1,62 @@
+#ifndef __SAT_MASK_H__
+#define __SAT_MASK_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * envelope mask, an upper and a lower limit for every bin of resolution
+ * samples of a channel. the file holds a struct mask_hdr followed by one
+ * struct mask_channel per channel, each one followed by num_bins little
+ * endian int16 lower codes and num_bins upper codes.
+ * limit = code * scale + offset
+ * a bin that had no samples other than NaN is stored as INT16_MAX, INT16_MIN
+ * and loaded as INFINITY, -INFINITY, every sample checked against it fails.
+ */
+struct __attribute__((packed)) mask_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    uint32_t resolution;
+    uint32_t num_channels;
+    uint32_t reserved0;
+    uint64_t sample_rate;       // of the reference, 0 if not known
+    uint8_t reserved[32];
+}; // 64bytes
+
+struct __attribute__((packed)) mask_channel {
+    char name[24];
+    uint16_t id;
+    uint16_t reserved0;
+    uint32_t num_bins;
+    uint64_t num_samples;
+    double scale;
+    double offset;
+    uint8_t reserved[8];
+}; // 64bytes
+
+#define          MASK_HDR_SIZE  0x40
+#define      MASK_CHANNEL_SIZE  0x40
+#define             MASK_MAGIC  "<SATMSK>"
+
+struct sat_mask_channel {
+    uint16_t id;
+    char name[24];
+    uint64_t num_samples;
+    uint32_t num_bins;
+    float *lower;
+    float *upper;
+};
+
+struct sat_mask {
+    uint32_t resolution;        // samples per bin
+    uint64_t sample_rate;
+    uint32_t num_channels;
+    struct sat_mask_channel *ch;
+};
+
+struct sat_mask *sat_mask_load(const char *file_name);
+int sat_mask_save(const struct sat_mask *mask, const char *file_name);
+struct sat_mask_channel *sat_mask_channel_get(const struct sat_mask *mask, const uint16_t id);
+void sat_mask_free(struct sat_mask *mask);
+
+#endif
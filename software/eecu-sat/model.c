@@ -0,0 +1,170 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include "proj.h"
+#include "error.h"
+#include "model.h"
+
+void sat_model_free(struct sat_model *model)
+{
+    uint32_t i;
+
+    if (!model)
+        return;
+
+    for (i = 0; i < model->num_channels; i++) {
+        g_free(model->ch[i].mean);
+        g_free(model->ch[i].std);
+        g_free(model->ch[i].count);
+    }
+    g_free(model->ch);
+    g_free(model);
+}
+
+struct sat_model_channel *sat_model_channel_get(const struct sat_model *model, const uint16_t id)
+{
+    uint32_t i;
+
+    for (i = 0; i < model->num_channels; i++) {
+        if (model->ch[i].id == id)
+            return &model->ch[i];
+    }
+
+    return NULL;
+}
+
+struct sat_model *sat_model_load(const char *file_name)
+{
+    struct sat_model *model = NULL;
+    struct sat_model_channel *ch;
+    struct model_hdr hdr;
+    struct model_channel mc;
+    uint32_t i;
+    FILE *fp;
+
+    if (!(fp = fopen(file_name, "rb"))) {
+        err_msg("%s:%d unable to open model file %s", __FILE__, __LINE__, file_name);
+        return NULL;
+    }
+
+    if ((fread(&hdr, 1, MODEL_HDR_SIZE, fp) != MODEL_HDR_SIZE) || memcmp(hdr.identifier, MODEL_MAGIC, 8)) {
+        err_msg("%s:%d %s is not a model file", __FILE__, __LINE__, file_name);
+        goto error;
+    }
+    if (hdr.version != 0) {
+        err_msg("%s:%d unsupported model version %d", __FILE__, __LINE__, hdr.version);
+        goto error;
+    }
+
+    model = g_malloc0(sizeof(struct sat_model));
+    model->resolution = hdr.resolution;
+    model->num_captures = hdr.num_captures;
+    model->sample_rate = hdr.sample_rate;
+    model->ch = g_malloc0(hdr.num_channels * sizeof(struct sat_model_channel));
+
+    for (i = 0; i < hdr.num_channels; i++) {
+        if (fread(&mc, 1, MODEL_CHANNEL_SIZE, fp) != MODEL_CHANNEL_SIZE)
+            goto damaged;
+        ch = &model->ch[i];
+        model->num_channels++;
+        ch->id = mc.id;
+        memcpy(ch->name, mc.name, sizeof(ch->name));
+        ch->name[sizeof(ch->name) - 1] = 0;
+        ch->num_samples = mc.num_samples;
+        ch->num_bins = mc.num_bins;
+        ch->mean = g_malloc(ch->num_bins * sizeof(float));
+        ch->std = g_malloc(ch->num_bins * sizeof(float));
+        ch->count = g_malloc(ch->num_bins * sizeof(uint32_t));
+
+        if ((fread(ch->mean, sizeof(float), ch->num_bins, fp) != ch->num_bins) ||
+            (fread(ch->std, sizeof(float), ch->num_bins, fp) != ch->num_bins) ||
+            (fread(ch->count, sizeof(uint32_t), ch->num_bins, fp) != ch->num_bins))
+            goto damaged;
+    }
+
+    fclose(fp);
+
+    return model;
+
+ damaged:
+    err_msg("%s:%d incomplete or damaged model file %s", __FILE__, __LINE__, file_name);
+ error:
+    sat_model_free(model);
+    fclose(fp);
+
+    return NULL;
+}
+
+int sat_model_save(const struct sat_model *model, const char *file_name)
+{
+    const struct sat_model_channel *ch;
+    struct model_hdr hdr = { 0 };
+    struct model_channel mc;
+    uint32_t i;
+    int ret = SR_OK;
+    FILE *fp;
+
+    if (!(fp = fopen(file_name, "wb"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    memcpy(hdr.identifier, MODEL_MAGIC, 8);
+    hdr.resolution = model->resolution;
+    hdr.num_channels = model->num_channels;
+    hdr.num_captures = model->num_captures;
+    hdr.sample_rate = model->sample_rate;
+    if (fwrite(&hdr, 1, MODEL_HDR_SIZE, fp) != MODEL_HDR_SIZE)
+        goto io_error;
+
+    for (i = 0; i < model->num_channels; i++) {
+        ch = &model->ch[i];
+
+        memset(&mc, 0, sizeof(mc));
+        g_strlcpy(mc.name, ch->name, sizeof(mc.name));
+        mc.id = ch->id;
+        mc.num_bins = ch->num_bins;
+        mc.num_samples = ch->num_samples;
+        if (fwrite(&mc, 1, MODEL_CHANNEL_SIZE, fp) != MODEL_CHANNEL_SIZE)
+            goto io_error;
+
+        if ((fwrite(ch->mean, sizeof(float), ch->num_bins, fp) != ch->num_bins) ||
+            (fwrite(ch->std, sizeof(float), ch->num_bins, fp) != ch->num_bins) ||
+            (fwrite(ch->count, sizeof(uint32_t), ch->num_bins, fp) != ch->num_bins))
+            goto io_error;
+    }
+
+ cleanup:
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    return ret;
+
+ io_error:
+    err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+    ret = SR_ERR_IO;
+    goto cleanup;
+}
@@ -0,0 +1,61 @@
+#ifndef __SAT_MODEL_H__
+#define __SAT_MODEL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * statistical model of a signal, the mean and the standard deviation of
+ * every bin of resolution samples of a channel over a number of good
+ * captures. the file holds a struct model_hdr followed by one struct
+ * model_channel per channel, each one followed by num_bins little endian
+ * float means, num_bins float standard deviations and num_bins uint32
+ * sample counts.
+ */
+struct __attribute__((packed)) model_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    uint32_t resolution;
+    uint32_t num_channels;
+    uint32_t num_captures;
+    uint64_t sample_rate;       // of the captures, 0 if not known
+    uint8_t reserved[32];
+}; // 64bytes
+
+struct __attribute__((packed)) model_channel {
+    char name[24];
+    uint16_t id;
+    uint16_t reserved0;
+    uint32_t num_bins;
+    uint64_t num_samples;
+    uint8_t reserved[24];
+}; // 64bytes
+
+#define         MODEL_HDR_SIZE  0x40
+#define     MODEL_CHANNEL_SIZE  0x40
+#define            MODEL_MAGIC  "<SATMDL>"
+
+struct sat_model_channel {
+    uint16_t id;
+    char name[24];
+    uint64_t num_samples;       // of the longest capture
+    uint32_t num_bins;
+    float *mean;
+    float *std;                 // population standard deviation
+    uint32_t *count;            // samples that went into a bin
+};
+
+struct sat_model {
+    uint32_t resolution;        // samples per bin
+    uint32_t num_captures;
+    uint64_t sample_rate;
+    uint32_t num_channels;
+    struct sat_model_channel *ch;
+};
+
+struct sat_model *sat_model_load(const char *file_name);
+int sat_model_save(const struct sat_model *model, const char *file_name);
+struct sat_model_channel *sat_model_channel_get(const struct sat_model *model, const uint16_t id);
+void sat_model_free(struct sat_model *model);
+
+#endif
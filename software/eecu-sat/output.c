@@ -22,11 +22,43 @@
 #include "output.h"
 #include "output_analog.h"
 #include "output_srzip.h"
+#include "output_q16.h"
+#include "output_tsc.h"
+#include "output_archive.h"
+#include "output_store.h"
+#include "output_csv.h"
+#include "output_vcd.h"
+#include "output_wav.h"
+#include "output_stats.h"
+#include "output_mask.h"
+#include "output_mask_check.h"
+#include "output_model_score.h"
+#include "output_fingerprint.h"
+#include "output_correlation.h"
+#include "output_injector.h"
+#include "output_rpm.h"
+#include "output_ensemble.h"
 #include "output_calibrate_linear_3p.h"
 
 static const struct sr_output_module *output_module_list[] = {
     &output_analog,
     &output_srzip,
+    &output_q16,
+    &output_tsc,
+    &output_archive,
+    &output_store,
+    &output_csv,
+    &output_vcd,
+    &output_wav,
+    &output_stats,
+    &output_mask,
+    &output_mask_check,
+    &output_model_score,
+    &output_fingerprint,
+    &output_correlation,
+    &output_injector,
+    &output_rpm,
+    &output_ensemble,
     &output_calibrate_linear_3p,
     NULL,
 };
@@ -6,6 +6,17 @@
 
 #include "proj.h"
 
+// flags besides the ones of enum sr_output_flag
+enum sat_output_flag {
+    /**
+     * The module is fed all channels at once instead of one after the
+     * other. Every analog packet is a block that holds the same number of
+     * samples of every channel, analog->num_samples per channel, laid out
+     * one channel after the other in the order of sdi->channels.
+     */
+    SAT_OUTPUT_BLOCKS = 0x100,
+};
+
 const struct sr_output_module **sat_output_list(void);
 const char *sat_output_id_get(const struct sr_output_module *omod);
 const char *sat_output_name_get(const struct sr_output_module *omod);
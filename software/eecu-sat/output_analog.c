@@ -20,10 +20,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include "proj.h"
 #include "error.h"
+#include "input.h"
 #include "output.h"
 
 struct out_context {
@@ -56,6 +58,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
     const struct sr_datafeed_analog *analog;
     const struct dev_frame *frame = o->sdi->priv;
     struct out_context *outc = o->priv;
+    struct saleae_ana_bh0 header;
     ch_data_t *ch_data_ptr = NULL;
     GSList *l;
 
@@ -86,8 +89,14 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
         // add header
         for (l = o->sdi->channels; l; l = l->next) {
             ch_data_ptr = l->data;
-            if ((ch_data_ptr->id == frame->ch) && (ch_data_ptr->file_type == SALEAE_ANALOG)) {
-                if (fwrite(&ch_data_ptr->header, 1, SALEAE_ANALOG_HDR_SIZE, fp) != SALEAE_ANALOG_HDR_SIZE) {
+            if ((ch_data_ptr->id == frame->ch) && sat_input_has_header(ch_data_ptr)) {
+                memcpy(&header, &ch_data_ptr->header, SALEAE_ANALOG_HDR_SIZE);
+                // a transform changed the sample rate
+                if (frame->samplerate && (frame->samplerate != ch_data_ptr->samplerate)) {
+                    header.sample_rate = frame->samplerate;
+                    header.downsample = 1;
+                }
+                if (fwrite(&header, 1, SALEAE_ANALOG_HDR_SIZE, fp) != SALEAE_ANALOG_HDR_SIZE) {
                     err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
                     ret = SR_ERR_IO;
                     goto cleanup;
@@ -0,0 +1,416 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "dsp.h"
+#include "input.h"
+#include "tsc.h"
+#include "output.h"
+
+/*
+ * error bounded lossy archive in the tsc container. the session thread only
+ * cuts the channels into blocks, every channel is coded and written by its
+ * own task in a thread pool. since the session delivers one channel after
+ * the other, the next channel is read while the previous ones are still
+ * being coded.
+ */
+
+// error bound used for constant channels that have no visible ADC step
+#define  ARCHIVE_DEFAULT_ERROR  0.001
+// blocks handed to the coding threads that were not written yet
+#define     ARCHIVE_MAX_QUEUED  256
+
+struct archive_block {
+    ssize_t n;                  // 0 ends the stream
+    float x[];
+};
+
+struct archive_stream {
+    uint16_t ch;
+    FILE *fp;
+    struct tsc_hdr hdr;
+    GAsyncQueue *queue;
+    int ret;
+    double max_err;             // largest error seen during verification
+};
+
+struct out_context {
+    double error_opt;
+    uint32_t block_samples;
+    gboolean verify;
+    GThreadPool *pool;
+    GSList *streams;
+    struct archive_stream *cur; // stream of the channel being received
+    struct archive_block *block;        // samples waiting for a full block
+    GMutex lock;
+    GCond cond;
+    uint32_t queued;
+};
+
+static int write_block(struct out_context *outc, struct archive_stream *st, struct tsc_coder *coder,
+                       const struct archive_block *b, uint8_t *coded, float *check)
+{
+    struct tsc_block_hdr bh;
+    ssize_t i, len;
+    double e;
+    int ret;
+
+    if ((len = tsc_encode_lossy(coder, b->x, b->n, st->hdr.error, coded)) < 0) {
+        err_msg("%s:%d cannot code channel %d with an error bound of %g", __FILE__, __LINE__, st->ch, st->hdr.error);
+        return len;
+    }
+
+    bh.num_samples = b->n;
+    bh.byte_len = len;
+    if ((fwrite(&bh, 1, TSC_BLOCK_HDR_SIZE, st->fp) != TSC_BLOCK_HDR_SIZE) ||
+        (fwrite(coded, 1, len, st->fp) != len)) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    st->hdr.num_samples += b->n;
+    st->hdr.num_blocks++;
+
+    if (outc->verify) {
+        if ((ret = tsc_decode(coder, coded, len, check, b->n)) != SR_OK) {
+            err_msg("%s:%d block %lu of channel %d does not decode", __FILE__, __LINE__, st->hdr.num_blocks, st->ch);
+            return ret;
+        }
+        for (i = 0; i < b->n; i++) {
+            e = fabs((double)check[i] - b->x[i]);
+            if (e > st->max_err)
+                st->max_err = e;
+        }
+    }
+
+    return SR_OK;
+}
+
+// thread pool task, codes all blocks of one channel
+static void stream_run(gpointer data, gpointer user_data)
+{
+    struct archive_stream *st = data;
+    struct out_context *outc = user_data;
+    struct archive_block *b;
+    struct tsc_coder *coder;
+    uint8_t *coded;
+    float *check = NULL;
+
+    coder = tsc_coder_new(outc->block_samples);
+    coded = g_malloc(TSC_MAX_BYTES(outc->block_samples));
+    if (outc->verify)
+        check = g_malloc(outc->block_samples * sizeof(float));
+
+    while ((b = g_async_queue_pop(st->queue))->n) {
+        if (st->ret == SR_OK)
+            st->ret = write_block(outc, st, coder, b, coded, check);
+        g_free(b);
+        g_mutex_lock(&outc->lock);
+        outc->queued--;
+        g_cond_signal(&outc->cond);
+        g_mutex_unlock(&outc->lock);
+    }
+    g_free(b);
+
+    if ((st->ret == SR_OK) &&
+        ((fseek(st->fp, TSC_HDR_SC_POS, SEEK_SET) < 0) ||
+         (fwrite(&st->hdr.num_samples, 1, 2 * sizeof(uint64_t), st->fp) != 2 * sizeof(uint64_t)))) {
+        err_msg("%s:%d while updating the header", __FILE__, __LINE__);
+        st->ret = SR_ERR_IO;
+    }
+    fclose(st->fp);
+    st->fp = NULL;
+
+    tsc_coder_free(coder);
+    g_free(coded);
+    g_free(check);
+}
+
+static void free_stream(gpointer data)
+{
+    struct archive_stream *st = data;
+
+    if (st->fp)
+        fclose(st->fp);
+    g_async_queue_unref(st->queue);
+    g_free(st);
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    uint32_t block_samples, threads;
+    double error;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    error = g_variant_get_double(g_hash_table_lookup(options, "error"));
+    if (!(error >= 0) || isinf(error)) {
+        err_msg("%s:%d the error bound must not be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    block_samples = g_variant_get_uint32(g_hash_table_lookup(options, "block"));
+    if ((block_samples < 1) || (block_samples > TSC_BLOCK_SAMPLES_MAX)) {
+        err_msg("%s:%d the block size must be between 1 and %d samples", __FILE__, __LINE__, TSC_BLOCK_SAMPLES_MAX);
+        return SR_ERR_ARG;
+    }
+
+    threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
+    if (!threads)
+        threads = g_get_num_processors();
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->error_opt = error;
+    outc->block_samples = block_samples;
+    outc->verify = g_variant_get_boolean(g_hash_table_lookup(options, "verify"));
+    g_mutex_init(&outc->lock);
+    g_cond_init(&outc->cond);
+    outc->pool = g_thread_pool_new(stream_run, outc, threads, FALSE, NULL);
+
+    return SR_OK;
+}
+
+static void push_block(struct out_context *outc, struct archive_block *b)
+{
+    if (b->n) {
+        g_mutex_lock(&outc->lock);
+        while (outc->queued >= ARCHIVE_MAX_QUEUED)
+            g_cond_wait(&outc->cond, &outc->lock);
+        outc->queued++;
+        g_mutex_unlock(&outc->lock);
+    }
+    g_async_queue_push(outc->cur->queue, b);
+}
+
+// hand the partial block and the end marker of the current stream over
+static void stream_end(struct out_context *outc)
+{
+    if (!outc->cur)
+        return;
+
+    if (outc->block) {
+        push_block(outc, outc->block);
+        outc->block = NULL;
+    }
+    push_block(outc, g_malloc0(sizeof(struct archive_block)));
+    outc->cur = NULL;
+}
+
+static int channel_begin(const struct sr_output *o, const float *x, const ssize_t n)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct archive_stream *st;
+    char *filename;
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    st = g_malloc0(sizeof(struct archive_stream));
+    st->ch = frame->ch;
+    st->queue = g_async_queue_new();
+    outc->streams = g_slist_append(outc->streams, st);
+
+    memcpy(st->hdr.identifier, TSC_MAGIC, 8);
+    st->hdr.block_samples = outc->block_samples;
+    st->hdr.sample_rate = frame->samplerate;
+    st->hdr.downsample = 1;
+    if (l && sat_input_has_header(ch_data_ptr)) {
+        st->hdr.begin_time = ch_data_ptr->header.begin_time;
+        // keep the original rate description unless a transform changed the rate
+        if (frame->samplerate == ch_data_ptr->samplerate) {
+            st->hdr.sample_rate = ch_data_ptr->header.sample_rate;
+            st->hdr.downsample = ch_data_ptr->header.downsample;
+        }
+    }
+
+    // by default allow one ADC step of error
+    st->hdr.error = outc->error_opt;
+    if (st->hdr.error == 0)
+        st->hdr.error = dsp_adc_step(x, n);
+    if (st->hdr.error == 0) {
+        err_msg("warning: no ADC step found in channel %d, using an error bound of %g\n", frame->ch, ARCHIVE_DEFAULT_ERROR);
+        st->hdr.error = ARCHIVE_DEFAULT_ERROR;
+    }
+
+    filename = g_strdup_printf("%s%d.tsa", o->filename, frame->ch);
+    st->fp = fopen(filename, "wb");
+    g_free(filename);
+    if (!st->fp) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    if (fwrite(&st->hdr, 1, TSC_HDR_SIZE, st->fp) != TSC_HDR_SIZE) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    outc->cur = st;
+    g_thread_pool_push(outc->pool, st, NULL);
+
+    return SR_OK;
+}
+
+// wait until all streams are written
+static void stop_threads(struct out_context *outc)
+{
+    stream_end(outc);
+    if (outc->pool) {
+        g_thread_pool_free(outc->pool, FALSE, TRUE);
+        outc->pool = NULL;
+    }
+}
+
+static int finish(struct out_context *outc)
+{
+    struct archive_stream *st;
+    int ret = SR_OK;
+    GSList *l;
+
+    stop_threads(outc);
+    for (l = outc->streams; l; l = l->next) {
+        st = l->data;
+        if (st->ret != SR_OK) {
+            ret = st->ret;
+            continue;
+        }
+        if (!outc->verify)
+            continue;
+        fprintf(stdout, "channel %d: %lu samples, max error %g (bound %g)\n", st->ch, st->hdr.num_samples, st->max_err, st->hdr.error);
+        if (st->max_err > st->hdr.error) {
+            err_msg("%s:%d channel %d exceeds its error bound", __FILE__, __LINE__, st->ch);
+            ret = SR_ERR_DATA;
+        }
+    }
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    const float *data;
+    ssize_t i, n;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        data = analog->data;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o, data, analog->num_samples)) != SR_OK))
+            return ret;
+
+        for (i = 0; i < analog->num_samples; i += n) {
+            if (!outc->block)
+                outc->block = g_malloc0(sizeof(struct archive_block) + outc->block_samples * sizeof(float));
+            n = MIN(analog->num_samples - i, outc->block_samples - outc->block->n);
+            memcpy(outc->block->x + outc->block->n, data + i, n * sizeof(float));
+            outc->block->n += n;
+            if (outc->block->n == outc->block_samples) {
+                push_block(outc, outc->block);
+                outc->block = NULL;
+            }
+        }
+        break;
+    case SR_DF_FRAME_END:
+        stream_end(outc);
+        break;
+    case SR_DF_END:
+        return finish(outc);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"error", "error", "largest absolute error of a sample, 0 for one ADC step", NULL, NULL},
+    {"block", "block", "number of samples in an independently decodable block", NULL, NULL},
+    {"threads", "threads", "number of coding threads, 0 for one per CPU", NULL, NULL},
+    {"verify", "verify", "decode every block and report the largest error", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_double(0));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(8192));
+        options[2].def = g_variant_ref_sink(g_variant_new_uint32(0));
+        options[3].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        // the session can stop early, the threads still need their end markers
+        stop_threads(outc);
+        g_free(outc->block);
+        g_slist_free_full(outc->streams, free_stream);
+        g_mutex_clear(&outc->lock);
+        g_cond_clear(&outc->cond);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_archive = {
+    .id = "archive",
+    .name = "archive",
+    .desc = "one channel per file, error bounded lossy time-series codec",
+    .exts = (const char *[]) {"tsa", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
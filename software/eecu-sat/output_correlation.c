@@ -0,0 +1,399 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "output.h"
+
+/*
+ * correlation coefficient of every pair of channels, read in aligned blocks
+ * of all channels at once. shorts and crosstalk in a harness make channels
+ * track each other that should not, an open circuit makes a pair that
+ * should track each other drift apart.
+ *
+ * every sample is taken relative to the first finite sample of its channel
+ * so the sums stay small, then the products of all pairs are summed tile by
+ * tile in float lanes and every tile is added to the double totals.
+ */
+
+#define    CORR_TILE  1024
+
+struct out_context {
+    uint32_t cnt;               // channels
+    uint16_t *ids;
+    char **names;
+    float threshold;
+    bool derivative;
+    bool *expected;             // cnt * cnt, pairs that are expected to track each other
+
+    uint64_t samples;
+    double *shift;
+    double *sum;
+    double *gram;               // cnt * cnt, only the upper triangle is used
+    uint64_t *invalid;          // non-finite samples of every channel
+    float *prev;                // last sample of every channel, for the derivative
+    float *work;                // cnt * CORR_TILE
+};
+
+// groups of channel ids that track each other, like 1-2,3-4-5
+static int parse_pairs(struct out_context *outc, const char *pairs)
+{
+    char **groups, **ids, *end;
+    uint32_t *idx, i, k, m, n;
+    unsigned long id;
+    int ret = SR_OK;
+
+    if (!pairs[0])
+        return SR_OK;
+
+    idx = g_malloc0(outc->cnt * sizeof(uint32_t));
+    groups = g_strsplit(pairs, ",", 0);
+    for (i = 0; groups[i] && (ret == SR_OK); i++) {
+        ids = g_strsplit(groups[i], "-", 0);
+        for (n = 0; ids[n]; n++) {
+            id = strtoul(ids[n], &end, 10);
+            for (k = 0; (k < outc->cnt) && (outc->ids[k] != id); k++);
+            if (!ids[n][0] || *end || (k == outc->cnt) || (n == outc->cnt)) {
+                n = 0;
+                break;
+            }
+            idx[n] = k;
+        }
+        if (n < 2) {
+            err_msg("%s:%d '%s' is not a group of known channel ids", __FILE__, __LINE__, groups[i]);
+            ret = SR_ERR_ARG;
+        }
+        for (k = 0; k < n; k++) {
+            for (m = 0; m < n; m++) {
+                if (idx[k] != idx[m])
+                    outc->expected[idx[k] * outc->cnt + idx[m]] = true;
+            }
+        }
+        g_strfreev(ids);
+    }
+    g_strfreev(groups);
+    g_free(idx);
+
+    return ret;
+}
+
+static void context_free(struct out_context *outc)
+{
+    uint32_t i;
+
+    for (i = 0; i < outc->cnt; i++)
+        g_free(outc->names[i]);
+    g_free(outc->names);
+    g_free(outc->ids);
+    g_free(outc->expected);
+    g_free(outc->shift);
+    g_free(outc->sum);
+    g_free(outc->gram);
+    g_free(outc->invalid);
+    g_free(outc->prev);
+    g_free(outc->work);
+    g_free(outc);
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    const ch_data_t *ch_data_ptr;
+    const char *pairs;
+    double threshold;
+    uint32_t cnt, i;
+    GSList *l;
+
+    if (!o || !o->sdi || !options)
+        return SR_ERR_ARG;
+
+    threshold = g_variant_get_double(g_hash_table_lookup(options, "threshold"));
+    pairs = g_variant_get_string(g_hash_table_lookup(options, "pairs"), NULL);
+
+    if (!(threshold > 0) || (threshold > 1)) {
+        err_msg("%s:%d the threshold must be above 0 and at most 1", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(cnt = g_slist_length(o->sdi->channels))) {
+        err_msg("%s:%d no channels to correlate", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    outc->cnt = cnt;
+    outc->threshold = threshold;
+    outc->derivative = g_variant_get_boolean(g_hash_table_lookup(options, "derivative"));
+    outc->ids = g_malloc0(cnt * sizeof(uint16_t));
+    outc->names = g_malloc0(cnt * sizeof(char *));
+    for (i = 0, l = o->sdi->channels; l; i++, l = l->next) {
+        ch_data_ptr = l->data;
+        outc->ids[i] = ch_data_ptr->id;
+        outc->names[i] = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    }
+    outc->expected = g_malloc0(cnt * cnt * sizeof(bool));
+    if (parse_pairs(outc, pairs) != SR_OK) {
+        context_free(outc);
+        return SR_ERR_ARG;
+    }
+
+    outc->shift = g_malloc0(cnt * sizeof(double));
+    outc->sum = g_malloc0(cnt * sizeof(double));
+    outc->gram = g_malloc0(cnt * cnt * sizeof(double));
+    outc->invalid = g_malloc0(cnt * sizeof(uint64_t));
+    outc->prev = g_malloc0(cnt * sizeof(float));
+    outc->work = g_malloc0(cnt * CORR_TILE * sizeof(float));
+    o->priv = outc;
+
+    return SR_OK;
+}
+
+static float dot(const float *x, const float *y, const uint32_t n)
+{
+    v4sf acc = v4sf_set1(0);
+    float sum;
+    uint32_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES)
+        acc += v4sf_load(x + i) * v4sf_load(y + i);
+    sum = v4sf_hsum(acc);
+    for (; i < n; i++)
+        sum += x[i] * y[i];
+
+    return sum;
+}
+
+static float total(const float *x, const uint32_t n)
+{
+    v4sf acc = v4sf_set1(0);
+    float sum;
+    uint32_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES)
+        acc += v4sf_load(x + i);
+    sum = v4sf_hsum(acc);
+    for (; i < n; i++)
+        sum += x[i];
+
+    return sum;
+}
+
+/*
+ * turn a tile of every channel into deviations from the shift, or into
+ * differences to the previous sample. non-finite samples become 0 so they
+ * add nothing to any sum.
+ */
+static void tile_prepare(struct out_context *outc, const float *data, const ssize_t stride, const ssize_t start,
+                         const uint32_t n)
+{
+    const float *x;
+    float *w, v;
+    uint32_t c, i;
+
+    for (c = 0; c < outc->cnt; c++) {
+        x = data + c * stride + start;
+        w = outc->work + c * CORR_TILE;
+        if (!outc->samples && !start) {
+            for (i = 0; (i < n) && !isfinite(x[i]); i++);
+            outc->shift[c] = (i < n) ? x[i] : 0;
+            outc->prev[c] = outc->shift[c];
+        }
+        for (i = 0; i < n; i++) {
+            v = x[i];
+            if (!isfinite(v)) {
+                outc->invalid[c]++;
+                w[i] = 0;
+                continue;
+            }
+            if (outc->derivative) {
+                w[i] = v - outc->prev[c];
+                outc->prev[c] = v;
+            } else {
+                w[i] = v - outc->shift[c];
+            }
+        }
+    }
+}
+
+static void receive_block(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    const float *wi;
+    uint32_t i, j, n;
+    ssize_t start;
+
+    for (start = 0; start < num_samples; start += n) {
+        n = MIN(CORR_TILE, num_samples - start);
+        tile_prepare(outc, data, num_samples, start, n);
+        for (i = 0; i < outc->cnt; i++) {
+            wi = outc->work + i * CORR_TILE;
+            outc->sum[i] += total(wi, n);
+            for (j = i; j < outc->cnt; j++)
+                outc->gram[i * outc->cnt + j] += dot(wi, outc->work + j * CORR_TILE, n);
+        }
+        outc->samples += n;
+    }
+}
+
+static double coefficient(const struct out_context *outc, const uint32_t i, const uint32_t j)
+{
+    const double n = outc->samples;
+    double mi, mj, vi, vj;
+
+    mi = outc->sum[i] / n;
+    mj = outc->sum[j] / n;
+    vi = outc->gram[i * outc->cnt + i] / n - mi * mi;
+    vj = outc->gram[j * outc->cnt + j] / n - mj * mj;
+    // a flat channel does not track anything
+    if ((vi <= 0) || (vj <= 0))
+        return NAN;
+
+    return MAX(-1, MIN(1, (outc->gram[i * outc->cnt + j] / n - mi * mj) / sqrt(vi * vj)));
+}
+
+static int write_report(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    double r, std;
+    uint32_t i, j, flagged = 0, pairs = 0;
+    bool tracks;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    fprintf(fp, "correlation of %u channels over %lu samples, %s\n", outc->cnt, outc->samples,
+            outc->derivative ? "derivative" : "level");
+    fprintf(fp, "%3s %-16s %10s %10s %10s\n", "ch", "name", "mean", "std", "invalid");
+    for (i = 0; i < outc->cnt; i++) {
+        std = outc->samples ? sqrt(MAX(0, outc->gram[i * outc->cnt + i] / outc->samples - pow(outc->sum[i] / outc->samples, 2))) : NAN;
+        fprintf(fp, "%3d %-16s %10.4f %10.4f %10lu\n", outc->ids[i], outc->names[i],
+                outc->derivative ? outc->sum[i] / MAX(1, outc->samples) : outc->shift[i] + outc->sum[i] / MAX(1, outc->samples),
+                std, outc->invalid[i]);
+    }
+
+    fprintf(fp, "\n%3s", "");
+    for (j = 0; j < outc->cnt; j++)
+        fprintf(fp, " %7d", outc->ids[j]);
+    fprintf(fp, "\n");
+    for (i = 0; i < outc->cnt; i++) {
+        fprintf(fp, "%3d", outc->ids[i]);
+        for (j = 0; j < outc->cnt; j++)
+            fprintf(fp, " %7.4f", outc->samples ? coefficient(outc, MIN(i, j), MAX(i, j)) : NAN);
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "\n");
+    for (i = 0; i < outc->cnt; i++) {
+        for (j = i + 1; j < outc->cnt; j++) {
+            pairs++;
+            r = outc->samples ? coefficient(outc, i, j) : NAN;
+            tracks = fabs(r) >= outc->threshold;
+            if (tracks == outc->expected[i * outc->cnt + j])
+                continue;
+            flagged++;
+            fprintf(fp, "ch %d %s - ch %d %s: %.4f, %s\n", outc->ids[i], outc->names[i], outc->ids[j], outc->names[j], r,
+                    tracks ? "unexpected" : "expected pair apart");
+        }
+    }
+
+    fprintf(fp, "%u of %u channel pairs flagged\n", flagged, pairs);
+    fprintf(stdout, "correlation: %u of %u channel pairs flagged\n", flagged, pairs);
+
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    if ((ret == SR_OK) && flagged)
+        ret = SR_ERR_DATA;
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        receive_block(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_END:
+        return write_report(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"threshold", "threshold", "smallest absolute correlation coefficient of two channels that track each other", NULL, NULL},
+    {"pairs", "pairs", "groups of channels that are expected to track each other, like 1-2,3-4-5", NULL, NULL},
+    {"derivative", "derivative", "correlate the changes from one sample to the next instead of the levels", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_double(0.9));
+        options[1].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[2].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        context_free(o->priv);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_correlation = {
+    .id = "correlation",
+    .name = "correlation",
+    .desc = "correlation matrix of all channels, flags pairs that track each other unexpectedly",
+    .exts = (const char *[]) {"txt", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING | SAT_OUTPUT_BLOCKS,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_CORRELATION_H__
+#define __OUTPUT_CORRELATION_H__
+
+extern struct sr_output_module output_correlation;
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include "proj.h"
+#include "error.h"
+#include "fmt.h"
+#include "output.h"
+
+/*
+ * the session delivers one channel after the other, while a row of the table
+ * holds one sample of every channel. the samples that are kept after the
+ * decimation are spooled into a temporary file next to the output, the table
+ * is written at the end of the session in passes of CSV_PASS_ROWS rows.
+ */
+
+#define  CSV_PASS_ROWS  16384
+#define  CSV_BUF_SIZE   (1024 * 1024)
+
+struct csv_channel {
+    char *name;
+    uint64_t samplerate;
+    off_t offset;               // first sample in the spool file
+    ssize_t rows;               // samples in the spool file
+    ssize_t samples;            // samples received
+};
+
+struct out_context {
+    int precision;              // -1 for the shortest representation
+    uint32_t decimate;
+    char separator;
+    FILE *spool;
+    off_t spool_len;
+    GArray *channels;           // struct csv_channel
+    float *keep;                // samples waiting to be spooled
+    ssize_t keep_cnt;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    const char *separator;
+    int precision;
+    uint32_t decimate;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    precision = g_variant_get_int32(g_hash_table_lookup(options, "precision"));
+    if ((precision < -1) || (precision > FMT_MAX_PRECISION)) {
+        err_msg("%s:%d the precision must be -1 (shortest) or between 0 and %d", __FILE__, __LINE__, FMT_MAX_PRECISION);
+        return SR_ERR_ARG;
+    }
+
+    decimate = g_variant_get_uint32(g_hash_table_lookup(options, "decimate"));
+    if (decimate < 1) {
+        err_msg("%s:%d decimate must be at least 1", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    separator = g_variant_get_string(g_hash_table_lookup(options, "separator"), NULL);
+    if (strcmp(separator, "auto") && strcmp(separator, "tab") && (strlen(separator) != 1)) {
+        err_msg("%s:%d the separator must be 'auto', 'tab' or a single character", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->precision = precision;
+    outc->decimate = decimate;
+    if (!strcmp(separator, "auto"))
+        outc->separator = g_str_has_suffix(o->filename, ".tsv") ? '\t' : ',';
+    else if (!strcmp(separator, "tab"))
+        outc->separator = '\t';
+    else
+        outc->separator = separator[0];
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct csv_channel));
+    outc->keep = g_malloc(CSV_PASS_ROWS * sizeof(float));
+
+    return SR_OK;
+}
+
+static int spool_flush(struct out_context *outc)
+{
+    struct csv_channel *ch;
+
+    if (!outc->keep_cnt)
+        return SR_OK;
+
+    ch = &g_array_index(outc->channels, struct csv_channel, outc->channels->len - 1);
+    if (fwrite(outc->keep, sizeof(float), outc->keep_cnt, outc->spool) != outc->keep_cnt) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    ch->rows += outc->keep_cnt;
+    outc->spool_len += outc->keep_cnt * sizeof(float);
+    outc->keep_cnt = 0;
+
+    return SR_OK;
+}
+
+static int channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct csv_channel ch = { 0 };
+    char *spool_name;
+    GSList *l;
+
+    if (!outc->spool) {
+        // the spool file is unlinked right away, it goes away together with the descriptor
+        spool_name = g_strdup_printf("%s.spool", o->filename);
+        outc->spool = fopen(spool_name, "w+b");
+        if (outc->spool)
+            unlink(spool_name);
+        g_free(spool_name);
+        if (!outc->spool) {
+            err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    }
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    if (l)
+        ch.name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        ch.name = g_strdup_printf("ch%d", frame->ch);
+    ch.samplerate = frame->samplerate;
+    ch.offset = outc->spool_len;
+
+    if (outc->channels->len && (g_array_index(outc->channels, struct csv_channel, 0).samplerate != ch.samplerate))
+        err_msg("warning: %s has a different sample rate, the time column follows the first channel\n", ch.name);
+
+    g_array_append_val(outc->channels, ch);
+    outc->keep_cnt = 0;
+
+    return SR_OK;
+}
+
+// keep every decimate-th sample of the channel
+static int spool(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct csv_channel *ch = &g_array_index(outc->channels, struct csv_channel, outc->channels->len - 1);
+    ssize_t i;
+    int ret;
+
+    // the first kept sample of the packet
+    i = (outc->decimate - ch->samples % outc->decimate) % outc->decimate;
+    for (; i < num_samples; i += outc->decimate) {
+        outc->keep[outc->keep_cnt++] = data[i];
+        if ((outc->keep_cnt == CSV_PASS_ROWS) && ((ret = spool_flush(outc)) != SR_OK))
+            return ret;
+    }
+    ch->samples += num_samples;
+
+    return SR_OK;
+}
+
+// a header cell, quoted if it holds a separator, a quote or a line break
+static size_t put_name(char *dst, const char *name, const char separator)
+{
+    size_t n = 0;
+
+    if (!strchr(name, separator) && !strpbrk(name, "\"\r\n")) {
+        n = strlen(name);
+        memcpy(dst, name, n);
+        return n;
+    }
+
+    dst[n++] = '"';
+    for (; *name; name++) {
+        if (*name == '"')
+            dst[n++] = '"';
+        dst[n++] = *name;
+    }
+    dst[n++] = '"';
+
+    return n;
+}
+
+static int flush(FILE *fp, const char *buf, size_t *len)
+{
+    if (fwrite(buf, 1, *len, fp) != *len) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    *len = 0;
+
+    return SR_OK;
+}
+
+/*
+ * the time of a row in seconds. sample rates that divide a power of ten
+ * give exact times with as many decimals as needed, all others get
+ * nanosecond resolution.
+ */
+struct csv_time {
+    uint64_t samplerate;
+    uint32_t decimals;
+    uint64_t mul;               // 10^decimals / samplerate, 0 if it does not divide
+};
+
+static void time_init(struct csv_time *t, const uint64_t samplerate)
+{
+    uint64_t p = 1;
+
+    t->samplerate = samplerate;
+    t->decimals = 0;
+    t->mul = 0;
+    if (!samplerate)
+        return;
+
+    while ((p % samplerate) && (t->decimals < 9)) {
+        p *= 10;
+        t->decimals++;
+    }
+    t->mul = p % samplerate ? 0 : p / samplerate;
+    t->decimals = t->mul ? t->decimals : 9;
+}
+
+static size_t put_time(char *dst, const struct csv_time *t, const uint64_t ticks)
+{
+    uint64_t whole, frac;
+    size_t n;
+
+    // without a sample rate the column holds the sample index
+    if (!t->samplerate)
+        return fmt_uint(dst, ticks);
+
+    whole = ticks / t->samplerate;
+    frac = ticks % t->samplerate;
+    if (t->mul) {
+        frac *= t->mul;
+    } else {
+        frac = (frac * 1000000000 + t->samplerate / 2) / t->samplerate;
+        if (frac == 1000000000) {
+            whole++;
+            frac = 0;
+        }
+    }
+
+    n = fmt_uint(dst, whole);
+    if (t->decimals) {
+        dst[n++] = '.';
+        n += fmt_uint_pad(dst + n, frac, t->decimals);
+    }
+
+    return n;
+}
+
+static int write_table(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const uint32_t num_ch = outc->channels->len;
+    struct csv_channel *ch;
+    struct csv_time t;
+    ssize_t rows = 0, row, pass, r, cnt;
+    size_t row_max, buf_size, len = 0;
+    float *cols = NULL;
+    char *buf;
+    uint32_t i;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    // worst case length of a table row
+    row_max = FMT_INT_MAX + 10 + num_ch * (FMT_FLOAT_MAX + 1) + 1;
+    buf_size = MAX(CSV_BUF_SIZE, 2 * row_max);
+    buf = g_malloc(buf_size);
+
+    len = sizeof("time") - 1;
+    memcpy(buf, "time", len);
+    for (i = 0; i < num_ch; i++) {
+        ch = &g_array_index(outc->channels, struct csv_channel, i);
+        if ((buf_size - len < 2 * strlen(ch->name) + 4) && ((ret = flush(fp, buf, &len)) != SR_OK))
+            goto cleanup;
+        buf[len++] = outc->separator;
+        len += put_name(buf + len, ch->name, outc->separator);
+        rows = MAX(rows, ch->rows);
+    }
+    buf[len++] = '\n';
+
+    if (num_ch)
+        time_init(&t, g_array_index(outc->channels, struct csv_channel, 0).samplerate);
+    cols = g_malloc((size_t) num_ch * CSV_PASS_ROWS * sizeof(float));
+
+    for (row = 0; row < rows; row += pass) {
+        pass = MIN(CSV_PASS_ROWS, rows - row);
+        for (i = 0; i < num_ch; i++) {
+            ch = &g_array_index(outc->channels, struct csv_channel, i);
+            cnt = CLAMP(ch->rows - row, 0, pass);
+            if (cnt && ((fseeko(outc->spool, ch->offset + row * sizeof(float), SEEK_SET) < 0) ||
+                        (fread(cols + (size_t) i * CSV_PASS_ROWS, sizeof(float), cnt, outc->spool) != cnt))) {
+                err_msg("%s:%d while reading the spool file", __FILE__, __LINE__);
+                ret = SR_ERR_IO;
+                goto cleanup;
+            }
+        }
+
+        for (r = 0; r < pass; r++) {
+            if ((buf_size - len < row_max) && ((ret = flush(fp, buf, &len)) != SR_OK))
+                goto cleanup;
+            len += put_time(buf + len, &t, (uint64_t) (row + r) * outc->decimate);
+            for (i = 0; i < num_ch; i++) {
+                buf[len++] = outc->separator;
+                // shorter channels leave empty cells
+                if (row + r >= g_array_index(outc->channels, struct csv_channel, i).rows)
+                    continue;
+                if (outc->precision < 0)
+                    len += fmt_float_shortest(buf + len, cols[(size_t) i * CSV_PASS_ROWS + r]);
+                else
+                    len += fmt_float_fixed(buf + len, cols[(size_t) i * CSV_PASS_ROWS + r], outc->precision);
+            }
+            buf[len++] = '\n';
+        }
+    }
+
+    ret = flush(fp, buf, &len);
+
+ cleanup:
+    if (fclose(fp) && (ret == SR_OK)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+    g_free(cols);
+    g_free(buf);
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o)) != SR_OK))
+            return ret;
+        return spool(outc, analog->data, analog->num_samples);
+    case SR_DF_FRAME_END:
+        return spool_flush(outc);
+    case SR_DF_END:
+        if (!outc->spool)
+            return SR_OK;
+        // fwrite() is buffered, a failed write might only show up here
+        if (fflush(outc->spool) || ferror(outc->spool)) {
+            err_msg("%s:%d while writing the spool file", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        return write_table(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"precision", "precision", "digits after the decimal point, -1 for the shortest exact representation", NULL, NULL},
+    {"decimate", "decimate", "only keep every n-th sample", NULL, NULL},
+    {"separator", "separator", "column separator, 'auto' picks a tab for .tsv files and a comma otherwise", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_int32(-1));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[2].def = g_variant_ref_sink(g_variant_new_string("auto"));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->spool)
+            fclose(outc->spool);
+        for (i = 0; i < outc->channels->len; i++)
+            g_free(g_array_index(outc->channels, struct csv_channel, i).name);
+        g_array_free(outc->channels, TRUE);
+        g_free(outc->keep);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_csv = {
+    .id = "csv",
+    .name = "csv",
+    .desc = "comma or tab separated text table, one column per channel",
+    .exts = (const char *[]) {"csv", "tsv", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
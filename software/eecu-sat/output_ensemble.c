@@ -0,0 +1,391 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "crank.h"
+#include "output.h"
+
+/*
+ * ensemble mean and spread of every channel over the engine cycles of the
+ * capture. the crank channel, and the cam channel if there is one, are
+ * decoded into a map of cycles when the output is set up. every channel is
+ * then resampled onto a grid of crank angles while it streams past and each
+ * whole cycle is added to the sums of its grid points.
+ *
+ * the sums are kept relative to the first cycle of the channel, which keeps
+ * the variance from cancelling out on signals with a large offset.
+ */
+
+struct ens_channel {
+    uint16_t id;
+    char *name;
+    uint64_t cycles;
+    float *mean;
+    float *std;
+};
+
+struct out_context {
+    struct sat_crank_grid *grid;
+    FILE *fp;
+    FILE *index;
+    struct ens_channel *ch;
+    uint32_t ch_cnt;
+
+    // current channel
+    struct ens_channel *cur;
+    float *cycle;               // points of the cycle in progress
+    uint32_t fill;
+    float *ref;                 // first cycle
+    double *sum;
+    double *sumsq;
+};
+
+static const ch_data_t *channel_find(const struct sr_dev_inst *sdi, const uint32_t id)
+{
+    ch_data_t *ch_data_ptr;
+    GSList *l;
+
+    for (l = sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == id)
+            return ch_data_ptr;
+    }
+
+    return NULL;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    const ch_data_t *crank, *cam = NULL;
+    struct sat_crank_map *map;
+    struct sat_crank_opt copt = { 0 };
+    const char *index_file;
+    uint32_t crank_id, cam_id, i;
+    ch_data_t *ch_data_ptr;
+    double step;
+    FILE *fp, *index = NULL;
+    GSList *l;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    crank_id = g_variant_get_uint32(g_hash_table_lookup(options, "crank"));
+    cam_id = g_variant_get_uint32(g_hash_table_lookup(options, "cam"));
+    index_file = g_variant_get_string(g_hash_table_lookup(options, "index"), NULL);
+
+    if (!(crank = channel_find(o->sdi, crank_id))) {
+        err_msg("%s:%d crank channel %u does not exist", __FILE__, __LINE__, crank_id);
+        return SR_ERR_ARG;
+    }
+    if (cam_id && !(cam = channel_find(o->sdi, cam_id))) {
+        err_msg("%s:%d cam channel %u does not exist", __FILE__, __LINE__, cam_id);
+        return SR_ERR_ARG;
+    }
+    if (sat_crank_opt_get(options, &copt, &step) != SR_OK)
+        return SR_ERR_ARG;
+
+    if (!(map = sat_crank_map_build(crank, cam, &copt))) {
+        err_msg("%s:%d unable to decode crank channel %u", __FILE__, __LINE__, crank_id);
+        return SR_ERR_IO;
+    }
+    if (!map->cycles->len)
+        err_msg("warning: no whole %u degree cycle was found on crank channel %u\n", copt.cycle, crank_id);
+    else if (map->sync_lost)
+        err_msg("warning: crank channel %u lost sync %lu times, the cycles around it are left out\n", crank_id,
+                map->sync_lost);
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        sat_crank_map_free(map);
+        return SR_ERR_IO;
+    }
+    // the cycle boundaries are written as the channels stream past
+    if (index_file[0]) {
+        if (!(index = fopen(index_file, "w"))) {
+            err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+            fclose(fp);
+            sat_crank_map_free(map);
+            return SR_ERR_IO;
+        }
+        fprintf(index, "ch,cycle,angle_deg,start_sample,end_sample\n");
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->grid = sat_crank_grid_new(map, step);
+    outc->fp = fp;
+    outc->index = index;
+
+    outc->ch_cnt = g_slist_length(o->sdi->channels);
+    outc->ch = g_malloc0(outc->ch_cnt * sizeof(struct ens_channel));
+    for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
+        ch_data_ptr = l->data;
+        outc->ch[i].id = ch_data_ptr->id;
+        outc->ch[i].name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) :
+            g_path_get_basename(ch_data_ptr->input_file_name);
+    }
+
+    outc->cycle = g_malloc(outc->grid->points * sizeof(float));
+    outc->ref = g_malloc(outc->grid->points * sizeof(float));
+    outc->sum = g_malloc(outc->grid->points * sizeof(double));
+    outc->sumsq = g_malloc(outc->grid->points * sizeof(double));
+
+    return SR_OK;
+}
+
+static int channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const ch_data_t *ch_data_ptr;
+    uint32_t i;
+
+    outc->cur = NULL;
+    for (i = 0; i < outc->ch_cnt; i++)
+        if (outc->ch[i].id == frame->ch)
+            outc->cur = &outc->ch[i];
+    if (!outc->cur || !(ch_data_ptr = channel_find(o->sdi, frame->ch)))
+        return SR_ERR_ARG;
+
+    // the rate of the channel as the transforms deliver it
+    if (sat_crank_grid_channel(outc->grid, frame->samplerate, ch_data_ptr->samplerate, frame->seek) != SR_OK)
+        return SR_ERR_ARG;
+
+    outc->cur->cycles = 0;
+    outc->fill = 0;
+    memset(outc->sum, 0, outc->grid->points * sizeof(double));
+    memset(outc->sumsq, 0, outc->grid->points * sizeof(double));
+
+    return SR_OK;
+}
+
+// a whole cycle has been resampled, n is its index in the map
+static void cycle_add(struct out_context *outc, const uint32_t n)
+{
+    const struct sat_crank_grid *g = outc->grid;
+    uint32_t edge, k;
+    double start, d;
+
+    if (!outc->cur->cycles)
+        memcpy(outc->ref, outc->cycle, g->points * sizeof(float));
+
+    for (k = 0; k < g->points; k++) {
+        d = outc->cycle[k] - outc->ref[k];
+        outc->sum[k] += d;
+        outc->sumsq[k] += d * d;
+    }
+    outc->cur->cycles++;
+
+    if (outc->index) {
+        edge = g_array_index(g->map->cycles, uint32_t, n);
+        start = sat_crank_map_start(g->map, n);
+        fprintf(outc->index, "%u,%u,%.1f,%.3f,", outc->cur->id, n, start, sat_crank_grid_pos(g, &edge, start));
+        fprintf(outc->index, "%.3f\n", sat_crank_grid_pos(g, &edge, start + g->map->cycle));
+    }
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    const struct sat_crank_grid *g = outc->grid;
+    uint32_t cycle = g->cycle;
+    ssize_t n, i, len;
+
+    // the points arrive in order, cycle after cycle
+    n = sat_crank_grid_resample(outc->grid, data, num_samples);
+    for (i = 0; i < n; i += len) {
+        len = MIN(n - i, g->points - outc->fill);
+        memcpy(outc->cycle + outc->fill, g->out + i, len * sizeof(float));
+        outc->fill += len;
+        if (outc->fill == g->points) {
+            cycle_add(outc, cycle++);
+            outc->fill = 0;
+        }
+    }
+}
+
+static void channel_end(struct out_context *outc)
+{
+    struct ens_channel *ch = outc->cur;
+    const uint32_t points = outc->grid->points;
+    double mean, var;
+    uint32_t k;
+
+    ch->mean = g_malloc(points * sizeof(float));
+    ch->std = g_malloc(points * sizeof(float));
+    for (k = 0; k < points; k++) {
+        if (!ch->cycles) {
+            ch->mean[k] = NAN;
+            ch->std[k] = NAN;
+            continue;
+        }
+        mean = outc->sum[k] / ch->cycles;
+        var = outc->sumsq[k] / ch->cycles - mean * mean;
+        ch->mean[k] = outc->ref[k] + mean;
+        ch->std[k] = var > 0 ? sqrt(var) : 0;
+    }
+
+    fprintf(stdout, "ensemble ch %d %s: %lu cycles\n", ch->id, ch->name, ch->cycles);
+}
+
+// one row per grid point, a mean and a spread column per channel
+static int table_write(struct out_context *outc)
+{
+    const struct sat_crank_grid *g = outc->grid;
+    uint32_t i, k;
+
+    fprintf(outc->fp, "angle_deg");
+    for (i = 0; i < outc->ch_cnt; i++)
+        if (outc->ch[i].mean)
+            fprintf(outc->fp, ",%s_mean,%s_std", outc->ch[i].name, outc->ch[i].name);
+    fprintf(outc->fp, "\n");
+
+    for (k = 0; k < g->points; k++) {
+        fprintf(outc->fp, "%.3f", k * g->step);
+        for (i = 0; i < outc->ch_cnt; i++)
+            if (outc->ch[i].mean)
+                fprintf(outc->fp, ",%.6f,%.6f", outc->ch[i].mean[k], outc->ch[i].std[k]);
+        fprintf(outc->fp, "\n");
+    }
+
+    if (fflush(outc->fp) || (outc->index && fflush(outc->index))) {
+        err_msg("%s:%d during fflush()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if ((frame->chunk == 1) && (channel_begin(o) != SR_OK)) {
+            err_msg("%s:%d unable to resample channel %d", __FILE__, __LINE__, frame->ch);
+            return SR_ERR_ARG;
+        }
+        if (outc->cur)
+            receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        if (outc->cur)
+            channel_end(outc);
+        outc->cur = NULL;
+        break;
+    case SR_DF_END:
+        return table_write(outc);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"crank", "crank", "id of the crank channel", NULL, NULL},
+    {"cam", "cam", "id of the cam channel, 0 for none", NULL, NULL},
+    {"level", "level", "threshold level of the crank teeth in volts", NULL, NULL},
+    {"hyst", "hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"cam_level", "cam level", "the cam is high above this level in volts", NULL, NULL},
+    {"wheel", "wheel", "crank trigger wheel as TEETH-MISSING", NULL, NULL},
+    {"step", "step", "distance of two grid points in degrees", NULL, NULL},
+    {"cycle", "cycle", "length of a cycle in degrees, 360 or 720", NULL, NULL},
+    {"index", "index", "file the cycle boundaries of every channel are written to", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(0));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0.2));
+        options[4].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[5].def = g_variant_ref_sink(g_variant_new_string("60-2"));
+        options[6].def = g_variant_ref_sink(g_variant_new_double(0.5));
+        options[7].def = g_variant_ref_sink(g_variant_new_uint32(720));
+        options[8].def = g_variant_ref_sink(g_variant_new_string(""));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    int ret = SR_OK;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp && fclose(outc->fp)) {
+            err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+        }
+        if (outc->index && fclose(outc->index)) {
+            err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+        }
+        for (i = 0; i < outc->ch_cnt; i++) {
+            g_free(outc->ch[i].name);
+            g_free(outc->ch[i].mean);
+            g_free(outc->ch[i].std);
+        }
+        g_free(outc->ch);
+        sat_crank_grid_free(outc->grid);
+        g_free(outc->cycle);
+        g_free(outc->ref);
+        g_free(outc->sum);
+        g_free(outc->sumsq);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return ret;
+}
+
+struct sr_output_module output_ensemble = {
+    .id = "ensemble",
+    .name = "ensemble",
+    .desc = "mean and spread of every channel over the engine cycles, indexed by crank angle",
+    .exts = (const char *[]) {"csv", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
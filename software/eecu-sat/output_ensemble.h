@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_ENSEMBLE_H__
+#define __OUTPUT_ENSEMBLE_H__
+
+extern struct sr_output_module output_ensemble;
+
+#endif
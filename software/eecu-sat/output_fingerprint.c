@@ -0,0 +1,387 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "fingerprint.h"
+#include "output.h"
+
+/*
+ * compact fingerprint of every exported channel, used by --search to find
+ * similar captures without going back to the samples.
+ *
+ * the spectrum is the average power of hann windowed frames of FP_FRAME
+ * samples, summed into log spaced bands and scaled to a total of 1. the
+ * duty cycle is taken from the thresholded signal in blocks of FP_BLOCK
+ * samples which are spread over the segments once the length of the
+ * channel is known. the levels are the mean, the deviation and the
+ * extremes of the samples plus the duty cycle and the rate of threshold
+ * crossings of the whole channel.
+ */
+
+#define    FP_FRAME  1024
+#define    FP_BLOCK  1024       // a multiple of 64
+
+struct out_context {
+    struct sat_fp *fp;
+    uint32_t *band_start;       // first fft bin of every band, num_bands + 1 entries
+    float low;                  // threshold with hysteresis
+    float high;
+
+    // state of the current channel
+    uint64_t samples;
+    uint64_t finite;
+    double shift;               // first finite sample, keeps the variance accurate
+    double sum;
+    double sum2;
+    float min;
+    float max;
+    uint64_t state;             // of the threshold
+    uint64_t highs;
+    uint64_t edges;
+    GArray *block_highs;        // uint32_t, samples above the threshold in every block
+    float frame[FP_FRAME];
+    uint32_t frame_len;
+    uint32_t frames;
+    double *power;              // FP_FRAME / 2 bins
+    double *re;
+    double *im;
+    double *window;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    uint32_t bands, segments, i;
+    double level, hyst;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    bands = g_variant_get_uint32(g_hash_table_lookup(options, "bands"));
+    segments = g_variant_get_uint32(g_hash_table_lookup(options, "segments"));
+    level = g_variant_get_double(g_hash_table_lookup(options, "level"));
+    hyst = g_variant_get_double(g_hash_table_lookup(options, "hyst"));
+
+    if (!bands || (bands > 64)) {
+        err_msg("%s:%d the number of bands must be between 1 and 64", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!segments || (segments > 1024)) {
+        err_msg("%s:%d the number of segments must be between 1 and 1024", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(hyst >= 0)) {
+        err_msg("%s:%d the hysteresis can't be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+    outc->fp = g_malloc0(sizeof(struct sat_fp));
+    outc->fp->num_bands = bands;
+    outc->fp->num_segments = segments;
+    outc->low = level - hyst / 2;
+    outc->high = level + hyst / 2;
+    outc->block_highs = g_array_new(FALSE, TRUE, sizeof(uint32_t));
+
+    // bands are spaced logarithmically, but at least one bin wide
+    outc->band_start = g_malloc((bands + 1) * sizeof(uint32_t));
+    outc->band_start[0] = 1;
+    for (i = 1; i <= bands; i++)
+        outc->band_start[i] = MAX(outc->band_start[i - 1] + 1, (uint32_t) pow(FP_FRAME / 2, (double) i / bands));
+    outc->band_start[bands] = FP_FRAME / 2;
+
+    outc->power = g_malloc0(FP_FRAME / 2 * sizeof(double));
+    outc->re = g_malloc(FP_FRAME * sizeof(double));
+    outc->im = g_malloc(FP_FRAME * sizeof(double));
+    outc->window = g_malloc(FP_FRAME * sizeof(double));
+    for (i = 0; i < FP_FRAME; i++)
+        outc->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / FP_FRAME);
+
+    return SR_OK;
+}
+
+static void channel_begin(struct out_context *outc)
+{
+    outc->samples = 0;
+    outc->finite = 0;
+    outc->sum = 0;
+    outc->sum2 = 0;
+    outc->min = INFINITY;
+    outc->max = -INFINITY;
+    outc->state = 0;
+    outc->highs = 0;
+    outc->edges = 0;
+    g_array_set_size(outc->block_highs, 0);
+    outc->frame_len = 0;
+    outc->frames = 0;
+    memset(outc->power, 0, FP_FRAME / 2 * sizeof(double));
+}
+
+// add the power spectrum of a full frame, frames holding NaN or infinite samples are left out
+static void frame_add(struct out_context *outc)
+{
+    double mean = 0;
+    uint32_t i;
+
+    for (i = 0; i < FP_FRAME; i++) {
+        if (!isfinite(outc->frame[i]))
+            return;
+        mean += outc->frame[i];
+    }
+    mean /= FP_FRAME;
+
+    for (i = 0; i < FP_FRAME; i++) {
+        outc->re[i] = (outc->frame[i] - mean) * outc->window[i];
+        outc->im[i] = 0;
+    }
+    dsp_fft(outc->re, outc->im, FP_FRAME, false);
+    for (i = 1; i < FP_FRAME / 2; i++)
+        outc->power[i] += outc->re[i] * outc->re[i] + outc->im[i] * outc->im[i];
+    outc->frames++;
+}
+
+static void levels_add(struct out_context *outc, const float *x, const uint32_t n)
+{
+    v4sf vmin = v4sf_set1(outc->min);
+    v4sf vmax = v4sf_set1(outc->max);
+    v4sf v;
+    double d;
+    uint32_t i;
+
+    // NaN samples are skipped by the comparisons
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        vmin = v4sf_min(v, vmin);
+        vmax = v4sf_max(v, vmax);
+    }
+    outc->min = v4sf_hmin(vmin);
+    outc->max = v4sf_hmax(vmax);
+    for (; i < n; i++) {
+        outc->min = x[i] < outc->min ? x[i] : outc->min;
+        outc->max = x[i] > outc->max ? x[i] : outc->max;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!isfinite(x[i]))
+            continue;
+        if (!outc->finite)
+            outc->shift = x[i];
+        d = x[i] - outc->shift;
+        outc->sum += d;
+        outc->sum2 += d * d;
+        outc->finite++;
+    }
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    uint64_t word, prev, mask;
+    uint32_t zero = 0, fill, len;
+    ssize_t i;
+
+    levels_add(outc, data, num_samples);
+
+    // words never straddle two blocks
+    for (i = 0; i < num_samples; i += len) {
+        fill = outc->samples % FP_BLOCK;
+        len = MIN(64, MIN(FP_BLOCK - fill, num_samples - i));
+        if (!fill)
+            g_array_append_val(outc->block_highs, zero);
+        prev = outc->state;
+        word = dsp_threshold_word(data + i, len, outc->low, outc->high, &outc->state);
+        mask = len < 64 ? (UINT64_C(1) << len) - 1 : UINT64_MAX;
+        // the first sample of the channel has no predecessor to differ from
+        if (!outc->samples)
+            prev = word & 1;
+        outc->edges += __builtin_popcountll((word ^ ((word << 1) | prev)) & mask);
+        outc->highs += __builtin_popcountll(word);
+        g_array_index(outc->block_highs, uint32_t, outc->block_highs->len - 1) += __builtin_popcountll(word);
+        outc->samples += len;
+    }
+
+    for (i = 0; i < num_samples; i += len) {
+        len = MIN(FP_FRAME - outc->frame_len, num_samples - i);
+        memcpy(outc->frame + outc->frame_len, data + i, len * sizeof(float));
+        outc->frame_len += len;
+        if (outc->frame_len == FP_FRAME) {
+            frame_add(outc);
+            outc->frame_len = 0;
+        }
+    }
+}
+
+static void channel_end(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    struct sat_fp *fp = outc->fp;
+    struct sat_fp_channel *ch;
+    ch_data_t *ch_data_ptr = NULL;
+    uint64_t start, end, highs, len, b, first, last;
+    double total = 0, band, mean;
+    uint32_t i, k;
+    char *name;
+    GSList *l;
+
+    fp->ch = g_realloc(fp->ch, (fp->num_channels + 1) * sizeof(struct sat_fp_channel));
+    ch = &fp->ch[fp->num_channels++];
+    memset(ch, 0, sizeof(struct sat_fp_channel));
+    ch->id = frame->ch;
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+    if (l) {
+        name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+        g_strlcpy(ch->name, name, sizeof(ch->name));
+        g_free(name);
+    }
+    ch->num_samples = outc->samples;
+    if (!fp->sample_rate)
+        fp->sample_rate = frame->samplerate;
+
+    mean = outc->finite ? outc->sum / outc->finite : NAN;
+    ch->level[FP_MEAN] = outc->shift + mean;
+    ch->level[FP_STD] = outc->finite ? sqrt(MAX(0, outc->sum2 / outc->finite - mean * mean)) : NAN;
+    ch->level[FP_MIN] = outc->finite ? outc->min : NAN;
+    ch->level[FP_MAX] = outc->finite ? outc->max : NAN;
+    ch->level[FP_DUTY] = outc->samples ? (double) outc->highs / outc->samples : NAN;
+    ch->level[FP_EDGES] = outc->samples ? outc->edges * (double) frame->samplerate / outc->samples : NAN;
+
+    ch->bands = g_malloc0(fp->num_bands * sizeof(float));
+    for (i = 1; i < FP_FRAME / 2; i++)
+        total += outc->power[i];
+    for (k = 0; k < fp->num_bands && total > 0; k++) {
+        band = 0;
+        for (i = outc->band_start[k]; i < outc->band_start[k + 1]; i++)
+            band += outc->power[i];
+        ch->bands[k] = band / total;
+    }
+
+    // every segment takes the blocks that start inside it, or else the one holding its middle
+    ch->duty = g_malloc0(fp->num_segments * sizeof(float));
+    for (k = 0; k < fp->num_segments && outc->samples; k++) {
+        start = outc->samples * k / fp->num_segments;
+        end = outc->samples * (k + 1) / fp->num_segments;
+        first = (start + FP_BLOCK - 1) / FP_BLOCK;
+        last = (end + FP_BLOCK - 1) / FP_BLOCK;
+        if (first >= last) {
+            first = (start + end) / 2 / FP_BLOCK;
+            last = first + 1;
+        }
+        highs = len = 0;
+        for (b = first; b < last; b++) {
+            highs += g_array_index(outc->block_highs, uint32_t, b);
+            len += MIN(FP_BLOCK, outc->samples - b * FP_BLOCK);
+        }
+        ch->duty[k] = (double) highs / len;
+    }
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(outc);
+        receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        channel_end(o);
+        break;
+    case SR_DF_END:
+        return sat_fp_save(outc->fp, o->filename);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"bands", "bands", "number of spectral bands, at most 64", NULL, NULL},
+    {"segments", "segments", "number of segments of the duty cycle profile, at most 1024", NULL, NULL},
+    {"level", "level", "threshold level in volts", NULL, NULL},
+    {"hyst", "hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(16));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(16));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0.2));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        sat_fp_free(outc->fp);
+        g_array_free(outc->block_highs, TRUE);
+        g_free(outc->band_start);
+        g_free(outc->power);
+        g_free(outc->re);
+        g_free(outc->im);
+        g_free(outc->window);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_fingerprint = {
+    .id = "fingerprint",
+    .name = "fingerprint",
+    .desc = "compact per channel fingerprint used by --search",
+    .exts = (const char *[]) {"fp", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
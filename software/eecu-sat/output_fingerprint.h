@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_FINGERPRINT_H__
+#define __OUTPUT_FINGERPRINT_H__
+
+extern struct sr_output_module output_fingerprint;
+
+#endif
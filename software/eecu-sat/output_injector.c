@@ -0,0 +1,378 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "threshold.h"
+#include "output.h"
+
+/*
+ * injector drive pulses as a table with one row per pulse.
+ *
+ * a low side driver pulls the injector pin from the battery voltage to the
+ * ground for as long as the injector is open, when it lets go the coil
+ * kicks the pin well above the battery voltage. the pin is thresholded 64
+ * samples at a time with dsp_threshold_word() and only the edges and the
+ * flyback window after every pulse are looked at sample by sample, so
+ * nothing but the current pulse is kept in memory.
+ *
+ * the energy is the area of the flyback above the idle voltage, the mean of
+ * the last 64 samples without any activity before the pulse.
+ */
+
+#define  INJ_IDLE  64
+
+struct inj_channel {
+    bool active;                // the previous sample was inside a pulse
+    bool valid;                 // the start of the current pulse was seen
+    uint64_t state;             // of the threshold
+    uint64_t samples;
+    uint64_t start;             // of the current pulse
+    uint64_t width;
+    float idle;                 // voltage between pulses
+    uint64_t fly_left;          // samples left in the flyback window
+    float peak;
+    double area;
+    // summary
+    uint64_t pulses;
+    uint64_t glitches;
+    uint64_t width_min;
+    uint64_t width_max;
+    double width_sum;
+};
+
+struct out_context {
+    struct sat_levels lv;
+    uint32_t ch_cnt;
+    bool low_side;
+    double flyback;             // seconds
+    double min_width;           // seconds
+    FILE *fp;
+
+    // current channel
+    bool selected;
+    uint16_t id;
+    char *name;
+    uint64_t samplerate;
+    uint64_t fly_len;
+    uint64_t min_len;
+    float high;
+    float low;
+    struct inj_channel ch;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    struct sat_levels lv;
+    const char *polarity;
+    double hyst, flyback, min_width;
+    FILE *fp;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    polarity = g_variant_get_string(g_hash_table_lookup(options, "polarity"), NULL);
+    hyst = g_variant_get_double(g_hash_table_lookup(options, "hyst"));
+    flyback = g_variant_get_double(g_hash_table_lookup(options, "flyback"));
+    min_width = g_variant_get_double(g_hash_table_lookup(options, "min_width"));
+
+    if (strcmp(polarity, "low") && strcmp(polarity, "high")) {
+        err_msg("%s:%d the polarity must be 'low' or 'high'", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(hyst >= 0) || !(flyback >= 0) || !(min_width >= 0)) {
+        err_msg("%s:%d the hysteresis, flyback and min_width can't be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (sat_levels_parse(&lv, g_slist_length(o->sdi->channels), g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL),
+                     g_variant_get_double(g_hash_table_lookup(options, "level")), hyst) != SR_OK) {
+        sat_levels_free(&lv);
+        return SR_ERR_ARG;
+    }
+
+    // pulses are written as they are found
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        sat_levels_free(&lv);
+        return SR_ERR_IO;
+    }
+    fprintf(fp, "ch,start_sample,start_s,width_s,peak_v,energy_vs\n");
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->lv = lv;
+    outc->ch_cnt = g_slist_length(o->sdi->channels);
+    outc->low_side = !strcmp(polarity, "low");
+    outc->flyback = flyback;
+    outc->min_width = min_width;
+    outc->fp = fp;
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    GSList *l;
+
+    outc->selected = (frame->ch <= outc->ch_cnt) && outc->lv.selected[frame->ch];
+    if (!outc->selected)
+        return;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+    g_free(outc->name);
+    if (l)
+        outc->name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        outc->name = g_strdup_printf("ch%d", frame->ch);
+
+    outc->id = frame->ch;
+    outc->samplerate = frame->samplerate;
+    outc->fly_len = MAX(1, llround(outc->flyback * frame->samplerate));
+    outc->min_len = llround(outc->min_width * frame->samplerate);
+    outc->high = outc->lv.high[frame->ch];
+    outc->low = outc->lv.low[frame->ch];
+    memset(&outc->ch, 0, sizeof(struct inj_channel));
+    outc->ch.idle = NAN;
+    outc->ch.width_min = UINT64_MAX;
+}
+
+static void pulse_emit(struct out_context *outc)
+{
+    struct inj_channel *ch = &outc->ch;
+    const double rate = outc->samplerate ? outc->samplerate : 1;
+
+    fprintf(outc->fp, "%u,%lu,%.9f,%.9f,%.4f,%.9f\n", outc->id, ch->start, ch->start / rate, ch->width / rate, ch->peak,
+            ch->area / rate);
+    ch->fly_left = 0;
+    ch->pulses++;
+    ch->width_sum += ch->width;
+    ch->width_min = MIN(ch->width_min, ch->width);
+    ch->width_max = MAX(ch->width_max, ch->width);
+}
+
+// peak and area of the flyback window, a low side driver kicks the pin up, a high side one down
+static void flyback_scan(struct out_context *outc, const float *x, const uint64_t n)
+{
+    struct inj_channel *ch = &outc->ch;
+    const float sign = outc->low_side ? 1 : -1;
+    const float idle = isfinite(ch->idle) ? ch->idle : 0;
+    uint64_t i, len = MIN(n, ch->fly_left);
+    float v;
+
+    for (i = 0; i < len; i++) {
+        if (!isfinite(x[i]))
+            continue;
+        if (outc->low_side ? x[i] > ch->peak : x[i] < ch->peak)
+            ch->peak = x[i];
+        v = sign * (x[i] - idle);
+        ch->area += v > 0 ? v : 0;
+    }
+    ch->fly_left -= len;
+    if (!ch->fly_left)
+        pulse_emit(outc);
+}
+
+static float word_mean(const float *x)
+{
+    v4sf acc = v4sf_set1(0);
+    int i;
+
+    for (i = 0; i < INJ_IDLE; i += V4SF_LANES)
+        acc += v4sf_load(x + i);
+
+    return v4sf_hsum(acc) / INJ_IDLE;
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct inj_channel *ch = &outc->ch;
+    uint64_t word, act, edges, mask, pos, k, len;
+    ssize_t i;
+
+    for (i = 0; i < num_samples; i += len) {
+        len = MIN(64, num_samples - i);
+        mask = len < 64 ? (UINT64_C(1) << len) - 1 : UINT64_MAX;
+        word = dsp_threshold_word(data + i, len, outc->low, outc->high, &ch->state);
+        act = (outc->low_side ? ~word : word) & mask;
+        // a pulse that is already on at the start of the channel has no known start
+        if (!ch->samples)
+            ch->active = act & 1;
+        edges = (act ^ ((act << 1) | ch->active)) & mask;
+
+        if (!edges && !act && !ch->fly_left && (len == INJ_IDLE))
+            ch->idle = word_mean(data + i);
+
+        // samples pos..k-1 keep the state of the sample before pos
+        for (pos = 0; pos < len; pos = k) {
+            k = edges ? (uint64_t) __builtin_ctzll(edges) : len;
+            if (ch->fly_left)
+                flyback_scan(outc, data + i + pos, k - pos);
+            if (k == len)
+                break;
+            edges &= edges - 1;
+            if ((act >> k) & 1) {
+                // a new pulse cuts the flyback of the previous one short
+                if (ch->fly_left)
+                    pulse_emit(outc);
+                ch->start = ch->samples + i + k;
+                ch->valid = true;
+            } else if (ch->valid) {
+                ch->width = ch->samples + i + k - ch->start;
+                ch->valid = false;
+                if (ch->width < outc->min_len) {
+                    ch->glitches++;
+                } else {
+                    ch->fly_left = outc->fly_len;
+                    ch->peak = data[i + k];
+                    ch->area = 0;
+                }
+            }
+        }
+        ch->active = (act >> (len - 1)) & 1;
+    }
+    ch->samples += num_samples;
+}
+
+static void channel_end(struct out_context *outc)
+{
+    struct inj_channel *ch = &outc->ch;
+    const double ms = 1000.0 / (outc->samplerate ? outc->samplerate : 1);
+
+    // the capture ended inside the flyback window
+    if (ch->fly_left)
+        pulse_emit(outc);
+
+    fprintf(stdout, "injector ch %d %s: %lu pulses", outc->id, outc->name, ch->pulses);
+    if (ch->pulses)
+        fprintf(stdout, ", width %.3f / %.3f / %.3f ms", ch->width_min * ms, ch->width_sum / ch->pulses * ms,
+                ch->width_max * ms);
+    if (ch->glitches)
+        fprintf(stdout, ", %lu shorter ones skipped", ch->glitches);
+    fprintf(stdout, "\n");
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        if (outc->selected)
+            receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        if (outc->selected)
+            channel_end(outc);
+        outc->selected = false;
+        break;
+    case SR_DF_END:
+        if (fflush(outc->fp)) {
+            err_msg("%s:%d during fflush()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"channels", "channels", "comma separated list of injector channels, CH[@LEVEL], all channels if empty", NULL, NULL},
+    {"level", "level", "threshold level in volts", NULL, NULL},
+    {"hyst", "hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"polarity", "polarity", "'low' for a low side driver that pulls the pin down, 'high' for a high side one", NULL, NULL},
+    {"flyback", "flyback", "length of the flyback window after every pulse in seconds", NULL, NULL},
+    {"min_width", "min width", "shorter pulses are skipped, in seconds", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(6.0));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(1.0));
+        options[3].def = g_variant_ref_sink(g_variant_new_string("low"));
+        options[4].def = g_variant_ref_sink(g_variant_new_double(0.002));
+        options[5].def = g_variant_ref_sink(g_variant_new_double(0));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    int ret = SR_OK;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp && fclose(outc->fp)) {
+            err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+        }
+        sat_levels_free(&outc->lv);
+        g_free(outc->name);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return ret;
+}
+
+struct sr_output_module output_injector = {
+    .id = "injector",
+    .name = "injector",
+    .desc = "table of injector drive pulses with their width, flyback peak and energy",
+    .exts = (const char *[]) {"csv", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_INJECTOR_H__
+#define __OUTPUT_INJECTOR_H__
+
+extern struct sr_output_module output_injector;
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "mask.h"
+#include "output.h"
+
+/*
+ * build an envelope mask out of a known good capture.
+ *
+ * every bin of resolution samples gets the minimum and maximum of its
+ * samples. once a channel is complete the limits are widened to the ones
+ * of the neighbouring jitter bins and moved apart by margin. a mask given
+ * via merge is loaded first and the new envelope is added to it, so a
+ * mask that covers several good captures is built by running the export
+ * once for each one of them.
+ */
+
+struct out_context {
+    struct sat_mask *mask;
+    float margin;
+    uint32_t jitter;
+    uint64_t samples;           // of the current channel
+    float bin_min;              // of the bin being filled
+    float bin_max;
+    uint32_t num_bins;
+    uint32_t alloc_bins;
+    float *lower;
+    float *upper;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    struct sat_mask *mask = NULL;
+    const char *merge;
+    uint32_t resolution;
+    double margin;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    resolution = g_variant_get_uint32(g_hash_table_lookup(options, "resolution"));
+    margin = g_variant_get_double(g_hash_table_lookup(options, "margin"));
+    merge = g_variant_get_string(g_hash_table_lookup(options, "merge"), NULL);
+
+    // the checker handles four samples at a time
+    if (!resolution || (resolution % V4SF_LANES)) {
+        err_msg("%s:%d the resolution must be a multiple of %d samples", __FILE__, __LINE__, V4SF_LANES);
+        return SR_ERR_ARG;
+    }
+    if (!(margin >= 0)) {
+        err_msg("%s:%d the margin can't be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (merge[0]) {
+        if (!(mask = sat_mask_load(merge)))
+            return SR_ERR_ARG;
+        if (mask->resolution != resolution) {
+            err_msg("%s:%d %s has a resolution of %u samples, not %u", __FILE__, __LINE__, merge, mask->resolution, resolution);
+            sat_mask_free(mask);
+            return SR_ERR_ARG;
+        }
+    } else {
+        mask = g_malloc0(sizeof(struct sat_mask));
+        mask->resolution = resolution;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+    outc->mask = mask;
+    outc->margin = margin;
+    outc->jitter = g_variant_get_uint32(g_hash_table_lookup(options, "jitter"));
+
+    return SR_OK;
+}
+
+static void bin_add(struct out_context *outc)
+{
+    if (outc->num_bins == outc->alloc_bins) {
+        outc->alloc_bins = MAX(1024, outc->alloc_bins * 2);
+        outc->lower = g_realloc(outc->lower, outc->alloc_bins * sizeof(float));
+        outc->upper = g_realloc(outc->upper, outc->alloc_bins * sizeof(float));
+    }
+    outc->lower[outc->num_bins] = outc->bin_min;
+    outc->upper[outc->num_bins] = outc->bin_max;
+    outc->num_bins++;
+}
+
+/*
+ * NaN samples are skipped. the accumulators start out at +-INFINITY, so a bin
+ * without a single number in it keeps a minimum above its maximum.
+ */
+static void minmax(const float *x, const uint32_t n, float *min, float *max)
+{
+    v4sf vmin = v4sf_set1(*min);
+    v4sf vmax = v4sf_set1(*max);
+    v4sf v;
+    uint32_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        vmin = v4sf_min(v, vmin);
+        vmax = v4sf_max(v, vmax);
+    }
+    *min = v4sf_hmin(vmin);
+    *max = v4sf_hmax(vmax);
+    for (; i < n; i++) {
+        *min = x[i] < *min ? x[i] : *min;
+        *max = x[i] > *max ? x[i] : *max;
+    }
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    const uint32_t resolution = outc->mask->resolution;
+    ssize_t i = 0;
+    uint32_t fill, len;
+
+    while (i < num_samples) {
+        fill = outc->samples % resolution;
+        len = MIN(resolution - fill, num_samples - i);
+        if (!fill) {
+            outc->bin_min = INFINITY;
+            outc->bin_max = -INFINITY;
+        }
+        minmax(data + i, len, &outc->bin_min, &outc->bin_max);
+        i += len;
+        outc->samples += len;
+        if (fill + len == resolution)
+            bin_add(outc);
+    }
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+
+    outc->samples = 0;
+    outc->num_bins = 0;
+}
+
+// widen the envelope of the channel and add it to the mask
+static int channel_end(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    struct sat_mask *mask = outc->mask;
+    struct sat_mask_channel *ch;
+    ch_data_t *ch_data_ptr = NULL;
+    float *lower, *upper;
+    uint32_t i, j, first, last;
+    char *name;
+    GSList *l;
+
+    if (outc->samples % mask->resolution)
+        bin_add(outc);
+
+    if (mask->sample_rate && (mask->sample_rate != frame->samplerate)) {
+        err_msg("%s:%d the mask was built at %lu Hz, the channel is sampled at %lu Hz", __FILE__, __LINE__,
+                mask->sample_rate, frame->samplerate);
+        return SR_ERR_ARG;
+    }
+    mask->sample_rate = frame->samplerate;
+
+    lower = g_malloc(outc->num_bins * sizeof(float));
+    upper = g_malloc(outc->num_bins * sizeof(float));
+    for (i = 0; i < outc->num_bins; i++) {
+        first = i > outc->jitter ? i - outc->jitter : 0;
+        last = MIN(i + outc->jitter, outc->num_bins - 1);
+        lower[i] = outc->lower[i];
+        upper[i] = outc->upper[i];
+        for (j = first; j <= last; j++) {
+            lower[i] = MIN(lower[i], outc->lower[j]);
+            upper[i] = MAX(upper[i], outc->upper[j]);
+        }
+        lower[i] -= outc->margin;
+        upper[i] += outc->margin;
+    }
+
+    if (!(ch = sat_mask_channel_get(mask, frame->ch))) {
+        mask->ch = g_realloc(mask->ch, (mask->num_channels + 1) * sizeof(struct sat_mask_channel));
+        ch = &mask->ch[mask->num_channels++];
+        memset(ch, 0, sizeof(struct sat_mask_channel));
+        ch->id = frame->ch;
+        for (l = o->sdi->channels; l; l = l->next) {
+            ch_data_ptr = l->data;
+            if (ch_data_ptr->id == frame->ch)
+                break;
+        }
+        if (l) {
+            name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+            g_strlcpy(ch->name, name, sizeof(ch->name));
+            g_free(name);
+        }
+    }
+
+    // the union of the old and the new envelope, bins only one of them has are taken over
+    if (outc->num_bins > ch->num_bins) {
+        ch->lower = g_realloc(ch->lower, outc->num_bins * sizeof(float));
+        ch->upper = g_realloc(ch->upper, outc->num_bins * sizeof(float));
+        for (i = ch->num_bins; i < outc->num_bins; i++) {
+            ch->lower[i] = lower[i];
+            ch->upper[i] = upper[i];
+        }
+    }
+    for (i = 0; i < MIN(ch->num_bins, outc->num_bins); i++) {
+        ch->lower[i] = MIN(ch->lower[i], lower[i]);
+        ch->upper[i] = MAX(ch->upper[i], upper[i]);
+    }
+    ch->num_bins = MAX(ch->num_bins, outc->num_bins);
+    ch->num_samples = MAX(ch->num_samples, outc->samples);
+
+    g_free(lower);
+    g_free(upper);
+
+    return SR_OK;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        return channel_end(o);
+    case SR_DF_END:
+        return sat_mask_save(outc->mask, o->filename);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"resolution", "resolution", "samples per mask bin, a multiple of 4", NULL, NULL},
+    {"margin", "margin", "distance in volts between the signal and the envelope", NULL, NULL},
+    {"jitter", "jitter", "neighbouring bins on each side that are added to the envelope of a bin", NULL, NULL},
+    {"merge", "merge", "existing mask file the new envelope is added to", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(64));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(0.1));
+        options[2].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[3].def = g_variant_ref_sink(g_variant_new_string(""));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        sat_mask_free(outc->mask);
+        g_free(outc->lower);
+        g_free(outc->upper);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_mask = {
+    .id = "mask",
+    .name = "mask",
+    .desc = "envelope mask built from a known good capture",
+    .exts = (const char *[]) {"mask", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,325 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "mask.h"
+#include "fail_range.h"
+#include "output.h"
+
+/*
+ * check every exported sample against the envelope of a mask built by the
+ * mask output. all samples of a bin share the same limits, so four of them
+ * are tested with two vector comparisons and only groups that leave the
+ * envelope are looked at one by one. the first sample of every channel is
+ * checked against the first bin, a trigger can be used to line up the
+ * capture with the one the mask was built from.
+ */
+
+struct check_channel {
+    char *name;
+    uint16_t id;
+    bool in_mask;
+    uint64_t checked;
+    uint64_t outside;           // samples past the end of the mask
+    struct sat_fail_tracker fails;  // samples out of the envelope, peak is the distance to it
+};
+
+struct out_context {
+    struct sat_mask *mask;
+    bool stop;
+    uint32_t max_ranges;
+    uint64_t samplerate;
+    GArray *channels;           // struct check_channel
+    const struct sat_mask_channel *mch;
+    uint64_t samples;           // of the current channel
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    struct sat_mask *mask;
+    const char *file;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    file = g_variant_get_string(g_hash_table_lookup(options, "mask"), NULL);
+    if (!file[0]) {
+        err_msg("%s:%d the mask file is not defined", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(mask = sat_mask_load(file)))
+        return SR_ERR_ARG;
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+    outc->mask = mask;
+    outc->stop = g_variant_get_boolean(g_hash_table_lookup(options, "stop"));
+    outc->max_ranges = g_variant_get_uint32(g_hash_table_lookup(options, "ranges"));
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct check_channel));
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct check_channel ch = { 0 };
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    if (l)
+        ch.name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        ch.name = g_strdup_printf("ch%d", frame->ch);
+    ch.id = frame->ch;
+    sat_fail_init(&ch.fails, outc->max_ranges, 0, 1);
+
+    outc->mch = sat_mask_channel_get(outc->mask, frame->ch);
+    ch.in_mask = outc->mch != NULL;
+    if (!ch.in_mask)
+        err_msg("warning: the mask has no envelope for channel %d (%s)\n", frame->ch, ch.name);
+    if (outc->mask->sample_rate && (outc->mask->sample_rate != frame->samplerate) && (outc->channels->len == 0))
+        err_msg("warning: the mask was built at %lu Hz, the capture is sampled at %lu Hz\n", outc->mask->sample_rate, frame->samplerate);
+    outc->samplerate = frame->samplerate;
+    outc->samples = 0;
+
+    g_array_append_val(outc->channels, ch);
+}
+
+// look at a group that left the envelope sample by sample
+static void violations(struct check_channel *ch, const float *x, const uint32_t n, const float lo, const float hi,
+                       const ssize_t s)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        if ((x[i] >= lo) && (x[i] <= hi))
+            continue;
+        // NaN counts as the largest possible distance
+        sat_fail_add(&ch->fails, s + i, x[i] < lo ? lo - x[i] : x[i] > hi ? x[i] - hi : INFINITY);
+    }
+}
+
+// returns the number of samples that were checked
+static uint32_t check_bin(struct out_context *outc, struct check_channel *ch, const float *x, const uint32_t n,
+                          const float lo, const float hi)
+{
+    const v4sf vlo = v4sf_set1(lo);
+    const v4sf vhi = v4sf_set1(hi);
+    v4sf v;
+    uint32_t i;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        // a NaN fails both comparisons
+        if (v4si_any(~((v >= vlo) & (v <= vhi)))) {
+            violations(ch, x + i, V4SF_LANES, lo, hi, outc->samples + i);
+            if (outc->stop)
+                return i + V4SF_LANES;
+        }
+    }
+    if (i < n)
+        violations(ch, x + i, n - i, lo, hi, outc->samples + i);
+
+    return n;
+}
+
+static int receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct check_channel *ch = &g_array_index(outc->channels, struct check_channel, outc->channels->len - 1);
+    const struct sat_mask_channel *mch = outc->mch;
+    const uint32_t resolution = outc->mask->resolution;
+    ssize_t i = 0;
+    uint64_t bin;
+    uint32_t len, done;
+
+    if (!mch)
+        return SR_OK;
+
+    while (i < num_samples) {
+        bin = outc->samples / resolution;
+        if (bin >= mch->num_bins) {
+            ch->outside += num_samples - i;
+            outc->samples += num_samples - i;
+            break;
+        }
+        len = MIN(resolution - outc->samples % resolution, num_samples - i);
+        done = check_bin(outc, ch, data + i, len, mch->lower[bin], mch->upper[bin]);
+        ch->checked += done;
+        outc->samples += done;
+        i += done;
+        if (outc->stop && ch->fails.samples)
+            return SR_ERR_DATA;
+    }
+
+    return SR_OK;
+}
+
+static int write_report(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct check_channel *ch;
+    const double rate = outc->samplerate ? outc->samplerate : 1;
+    uint32_t i, failed = 0;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    fprintf(fp, "%3s %-16s %10s %10s %10s %12s %s\n", "ch", "name", "checked", "outside", "violations", "first_s", "result");
+    for (i = 0; i < outc->channels->len; i++) {
+        ch = &g_array_index(outc->channels, struct check_channel, i);
+        fprintf(fp, "%3d %-16s %10lu %10lu %10lu ", ch->id, ch->name, ch->checked, ch->outside, ch->fails.samples);
+        if (ch->fails.first >= 0)
+            fprintf(fp, "%12.6f", ch->fails.first / rate);
+        else
+            fprintf(fp, "%12s", "-");
+        fprintf(fp, " %s\n", !ch->in_mask ? "skipped" : ch->fails.samples ? "FAIL" : "pass");
+        sat_fail_print(fp, &ch->fails, rate, "", " V outside", 6);
+        failed += ch->fails.samples ? 1 : 0;
+    }
+
+    fprintf(fp, "%u of %u channels failed\n", failed, outc->channels->len);
+    fprintf(stdout, "mask check: %u of %u channels failed\n", failed, outc->channels->len);
+
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    if ((ret == SR_OK) && failed)
+        ret = SR_ERR_DATA;
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    struct check_channel *ch;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        if (receive_analog(outc, analog->data, analog->num_samples) != SR_OK) {
+            /*
+             * stop at the first violation. the session ends the export after
+             * this chunk and the report written at SR_DF_END covers what was
+             * checked so far.
+             */
+            ch = &g_array_index(outc->channels, struct check_channel, outc->channels->len - 1);
+            sat_fail_close(&ch->fails);
+            fprintf(stdout, "mask violation on %s at %.6f s, stopping\n", ch->name, ch->fails.first / (double) MAX(1, outc->samplerate));
+            frame->stop = true;
+        }
+        break;
+    case SR_DF_FRAME_END:
+        if (outc->channels->len) {
+            ch = &g_array_index(outc->channels, struct check_channel, outc->channels->len - 1);
+            sat_fail_close(&ch->fails);
+        }
+        break;
+    case SR_DF_END:
+        return write_report(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"mask", "mask", "mask file built by the mask output", NULL, NULL},
+    {"stop", "stop", "stop at the first sample outside the envelope", NULL, NULL},
+    {"ranges", "ranges", "number of violating ranges listed for every channel", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+        options[2].def = g_variant_ref_sink(g_variant_new_uint32(10));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    struct check_channel *ch;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        for (i = 0; i < outc->channels->len; i++) {
+            ch = &g_array_index(outc->channels, struct check_channel, i);
+            g_free(ch->name);
+            sat_fail_free(&ch->fails);
+        }
+        g_array_free(outc->channels, TRUE);
+        sat_mask_free(outc->mask);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_mask_check = {
+    .id = "mask_check",
+    .name = "mask_check",
+    .desc = "check the capture against the envelope of a mask, writes a report",
+    .exts = (const char *[]) {"txt", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
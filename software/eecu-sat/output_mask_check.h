@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_MASK_CHECK_H__
+#define __OUTPUT_MASK_CHECK_H__
+
+extern struct sr_output_module output_mask_check;
+
+#endif
@@ -0,0 +1,356 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "model.h"
+#include "fail_range.h"
+#include "output.h"
+
+/*
+ * score every exported sample against a statistical model built from good
+ * captures via --golden. the z-score of a sample is its distance to the
+ * mean of its bin in standard deviations, the deviation is never taken to
+ * be smaller than floor so flat parts of a signal do not turn noise into
+ * huge scores. all samples of a bin share mean and deviation, so four of
+ * them are scored at a time and only groups above the threshold are looked
+ * at one by one.
+ */
+
+struct score_channel {
+    char *name;
+    uint16_t id;
+    bool in_model;
+    uint64_t scored;
+    uint64_t outside;           // samples past the end of the model
+    struct sat_fail_tracker fails;  // samples above the threshold, peak is the z-score
+    double sum_z2;
+    float max_z;
+    ssize_t max_at;
+};
+
+struct out_context {
+    struct sat_model *model;
+    float threshold;
+    float floor;
+    uint32_t max_ranges;
+    uint64_t samplerate;
+    GArray *channels;           // struct score_channel
+    const struct sat_model_channel *mch;
+    uint64_t samples;           // of the current channel
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    struct sat_model *model;
+    const char *file;
+    double threshold, floor;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    file = g_variant_get_string(g_hash_table_lookup(options, "model"), NULL);
+    threshold = g_variant_get_double(g_hash_table_lookup(options, "threshold"));
+    floor = g_variant_get_double(g_hash_table_lookup(options, "floor"));
+
+    if (!file[0]) {
+        err_msg("%s:%d the model file is not defined", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(threshold > 0)) {
+        err_msg("%s:%d the threshold has to be positive", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(floor > 0)) {
+        err_msg("%s:%d the deviation floor has to be positive", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (!(model = sat_model_load(file)))
+        return SR_ERR_ARG;
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+    outc->model = model;
+    outc->threshold = threshold;
+    outc->floor = floor;
+    outc->max_ranges = g_variant_get_uint32(g_hash_table_lookup(options, "ranges"));
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct score_channel));
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct score_channel ch = { 0 };
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    if (l)
+        ch.name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        ch.name = g_strdup_printf("ch%d", frame->ch);
+    ch.id = frame->ch;
+    sat_fail_init(&ch.fails, outc->max_ranges, 0, 1);
+    ch.max_at = -1;
+
+    outc->mch = sat_model_channel_get(outc->model, frame->ch);
+    ch.in_model = outc->mch != NULL;
+    if (!ch.in_model)
+        err_msg("warning: the model has no statistics for channel %d (%s)\n", frame->ch, ch.name);
+    if (outc->model->sample_rate && (outc->model->sample_rate != frame->samplerate) && (outc->channels->len == 0))
+        err_msg("warning: the model was built at %lu Hz, the capture is sampled at %lu Hz\n", outc->model->sample_rate, frame->samplerate);
+    outc->samplerate = frame->samplerate;
+    outc->samples = 0;
+
+    g_array_append_val(outc->channels, ch);
+}
+
+// look at a group with a sample above the threshold one by one
+static void outliers(struct out_context *outc, struct score_channel *ch, const float *x, const uint32_t n,
+                     const float mean, const float inv_std, const ssize_t s)
+{
+    uint32_t i;
+    float z;
+
+    for (i = 0; i < n; i++) {
+        z = fabsf((x[i] - mean) * inv_std);
+        if (z <= outc->threshold)
+            continue;
+        // NaN counts as the largest possible score
+        sat_fail_add(&ch->fails, s + i, isnan(z) ? INFINITY : z);
+    }
+}
+
+static void score_bin(struct out_context *outc, struct score_channel *ch, const float *x, const uint32_t n,
+                      const float mean, const float std)
+{
+    const float inv_std = 1.0f / MAX(std, outc->floor);
+    const v4sf vmean = v4sf_set1(mean);
+    const v4sf vinv = v4sf_set1(inv_std);
+    const v4sf vthr = v4sf_set1(outc->threshold);
+    v4sf v, z, vmax = v4sf_set1(0);
+    v4sf vz2 = v4sf_set1(0);
+    float zmax, z2 = 0, az;
+    uint32_t i, k;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        z = v4sf_abs((v - vmean) * vinv);
+        // NaN lanes are left out of the sums and fail the comparison
+        vz2 += v4sf_select(z == z, z * z, v4sf_set1(0));
+        vmax = v4sf_max(z, vmax);
+        if (v4si_any(~(z <= vthr)))
+            outliers(outc, ch, x + i, V4SF_LANES, mean, inv_std, outc->samples + i);
+    }
+    zmax = v4sf_hmax(vmax);
+    z2 = v4sf_hsum(vz2);
+    for (k = i; k < n; k++) {
+        az = fabsf((x[k] - mean) * inv_std);
+        if (!isnan(az)) {
+            z2 += az * az;
+            zmax = MAX(zmax, az);
+        }
+    }
+    if (i < n)
+        outliers(outc, ch, x + i, n - i, mean, inv_std, outc->samples + i);
+
+    ch->sum_z2 += z2;
+    if (zmax > ch->max_z) {
+        ch->max_z = zmax;
+        for (k = 0; k < n; k++) {
+            if (fabsf((x[k] - mean) * inv_std) == zmax) {
+                ch->max_at = outc->samples + k;
+                break;
+            }
+        }
+    }
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct score_channel *ch = &g_array_index(outc->channels, struct score_channel, outc->channels->len - 1);
+    const struct sat_model_channel *mch = outc->mch;
+    const uint32_t resolution = outc->model->resolution;
+    ssize_t i = 0;
+    uint64_t bin;
+    uint32_t len;
+
+    if (!mch)
+        return;
+
+    while (i < num_samples) {
+        bin = outc->samples / resolution;
+        if (bin >= mch->num_bins) {
+            ch->outside += num_samples - i;
+            outc->samples += num_samples - i;
+            break;
+        }
+        len = MIN(resolution - outc->samples % resolution, num_samples - i);
+        score_bin(outc, ch, data + i, len, mch->mean[bin], mch->std[bin]);
+        ch->scored += len;
+        outc->samples += len;
+        i += len;
+    }
+}
+
+static int write_report(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct score_channel *ch;
+    const double rate = outc->samplerate ? outc->samplerate : 1;
+    uint32_t i, failed = 0;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    fprintf(fp, "model of %u captures, threshold %.3f, deviation floor %.6f V\n", outc->model->num_captures,
+            outc->threshold, outc->floor);
+    fprintf(fp, "%3s %-16s %10s %10s %9s %9s %12s %10s %s\n", "ch", "name", "scored", "outside", "rms_z", "max_z",
+            "max_at_s", "over", "result");
+    for (i = 0; i < outc->channels->len; i++) {
+        ch = &g_array_index(outc->channels, struct score_channel, i);
+        fprintf(fp, "%3d %-16s %10lu %10lu %9.3f %9.3f ", ch->id, ch->name, ch->scored, ch->outside,
+                ch->scored ? sqrt(ch->sum_z2 / ch->scored) : 0, ch->max_z);
+        if (ch->max_at >= 0)
+            fprintf(fp, "%12.6f", ch->max_at / rate);
+        else
+            fprintf(fp, "%12s", "-");
+        fprintf(fp, " %10lu %s\n", ch->fails.samples, !ch->in_model ? "skipped" : ch->fails.samples ? "FAIL" : "pass");
+        sat_fail_print(fp, &ch->fails, rate, "peak z ", "", 3);
+        failed += ch->fails.samples ? 1 : 0;
+    }
+
+    fprintf(fp, "%u of %u channels failed\n", failed, outc->channels->len);
+    fprintf(stdout, "model score: %u of %u channels failed\n", failed, outc->channels->len);
+
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    if ((ret == SR_OK) && failed)
+        ret = SR_ERR_DATA;
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        if (outc->channels->len)
+            sat_fail_close(&g_array_index(outc->channels, struct score_channel, outc->channels->len - 1).fails);
+        break;
+    case SR_DF_END:
+        return write_report(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"model", "model", "model file built via --golden", NULL, NULL},
+    {"threshold", "threshold", "largest z-score that still passes", NULL, NULL},
+    {"floor", "floor", "smallest standard deviation in volts a sample is scored against", NULL, NULL},
+    {"ranges", "ranges", "number of failing ranges listed for every channel", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(6));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0.01));
+        options[3].def = g_variant_ref_sink(g_variant_new_uint32(10));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    struct score_channel *ch;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        for (i = 0; i < outc->channels->len; i++) {
+            ch = &g_array_index(outc->channels, struct score_channel, i);
+            g_free(ch->name);
+            sat_fail_free(&ch->fails);
+        }
+        g_array_free(outc->channels, TRUE);
+        sat_model_free(outc->model);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_model_score = {
+    .id = "model_score",
+    .name = "model_score",
+    .desc = "z-score the capture against a statistical model, writes a report",
+    .exts = (const char *[]) {"txt", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
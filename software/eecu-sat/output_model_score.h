@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_MODEL_SCORE_H__
+#define __OUTPUT_MODEL_SCORE_H__
+
+extern struct sr_output_module output_model_score;
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <float.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "input.h"
+#include "input_q16.h"
+#include "output.h"
+
+// volts per code used when a channel gives no hint about its ADC step
+#define  Q16_DEFAULT_SCALE  0.0005
+
+struct out_context {
+    double scale_opt;
+    double offset_opt;
+    // current channel
+    FILE *fp;
+    struct q16_hdr hdr;
+    float scale;
+    float offset;
+    int16_t *codes;
+    ssize_t codes_sz;
+    float max_err;              // largest reconstruction error
+    float lsb;                  // ADC step estimated from the first chunk, 0 if unknown
+    ssize_t clipped;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    if (g_variant_get_double(g_hash_table_lookup(options, "scale")) < 0) {
+        err_msg("%s:%d the scale must be positive", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->scale_opt = g_variant_get_double(g_hash_table_lookup(options, "scale"));
+    outc->offset_opt = g_variant_get_double(g_hash_table_lookup(options, "offset"));
+
+    return SR_OK;
+}
+
+/*
+ * pick scale and offset from the first chunk of a channel. the scale is the
+ * ADC step and the offset is a sample value near the middle of the range,
+ * so the codes land on the same grid as the ADC samples and the error stays
+ * close to 0.
+ */
+static void auto_scale(struct out_context *outc, const float *x, const ssize_t n)
+{
+    float min = FLT_MAX, max = -FLT_MAX;
+    ssize_t i, mid = 0;
+
+    if (!n) {
+        outc->scale = Q16_DEFAULT_SCALE;
+        outc->offset = 0;
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (x[i] < min)
+            min = x[i];
+        if (x[i] > max)
+            max = x[i];
+    }
+
+    for (i = 0; i < n; i++) {
+        if (fabsf(x[i] - (min + max) / 2) < fabsf(x[mid] - (min + max) / 2))
+            mid = i;
+    }
+    outc->offset = x[mid];
+
+    if (!outc->lsb) {
+        // constant signal, nothing to learn the step from
+        outc->scale = Q16_DEFAULT_SCALE;
+    } else if ((max - min) / outc->lsb > 65000) {
+        outc->scale = (max - min) / 65000;
+    } else {
+        outc->scale = outc->lsb;
+    }
+}
+
+static void quantize(struct out_context *outc, const float *x, const ssize_t n)
+{
+    const v4sf inv = v4sf_set1(1.0f / outc->scale);
+    const v4sf vscale = v4sf_set1(outc->scale);
+    const v4sf voffset = v4sf_set1(outc->offset);
+    const v4sf lo = v4sf_set1(-32768.0f);
+    const v4sf hi = v4sf_set1(32767.0f);
+    const v4sf half = v4sf_set1(0.5f);
+    const v4sf bias = v4sf_set1(32768.0f);
+    v4sf v, t, err = v4sf_set1(0);
+    v4si codes, clip = { 0, 0, 0, 0 };
+    float st, serr = 0;
+    ssize_t i;
+    int j;
+
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        t = (v - voffset) * inv;
+        clip -= (t < lo - half) | (t > hi + half);
+        t = v4sf_min(v4sf_max(t, lo), hi);
+        // round half up on the positive range, where truncation equals floor
+        codes = __builtin_convertvector(t + bias + half, v4si) - 32768;
+        for (j = 0; j < V4SF_LANES; j++)
+            outc->codes[i + j] = codes[j];
+        t = __builtin_convertvector(codes, v4sf) * vscale + voffset;
+        err = v4sf_max(err, v4sf_abs(t - v));
+    }
+    for (; i < n; i++) {
+        st = (x[i] - outc->offset) / outc->scale;
+        if ((st < -32768.5f) || (st > 32767.5f))
+            outc->clipped++;
+        st = MIN(MAX(st, -32768.0f), 32767.0f);
+        outc->codes[i] = (int32_t) (st + 32768.5f) - 32768;
+        st = fabsf(x[i] - q16_decode(outc->codes[i], outc->scale, outc->offset));
+        serr = MAX(serr, st);
+    }
+
+    outc->clipped += clip[0] + clip[1] + clip[2] + clip[3];
+    outc->max_err = MAX(outc->max_err, MAX(serr, v4sf_hmax(err)));
+}
+
+static int channel_begin(const struct sr_output *o, const float *x, const ssize_t n)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    char *filename;
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    outc->lsb = dsp_adc_step(x, n);
+    if (outc->scale_opt > 0) {
+        outc->scale = outc->scale_opt;
+        outc->offset = outc->offset_opt;
+    } else {
+        auto_scale(outc, x, n);
+    }
+
+    memset(&outc->hdr, 0, Q16_HDR_SIZE);
+    memcpy(outc->hdr.identifier, Q16_MAGIC, 8);
+    outc->hdr.scale = outc->scale;
+    outc->hdr.offset = outc->offset;
+    outc->hdr.sample_rate = frame->samplerate;
+    outc->hdr.downsample = 1;
+    if (l && sat_input_has_header(ch_data_ptr)) {
+        outc->hdr.begin_time = ch_data_ptr->header.begin_time;
+        // keep the original rate description unless a transform changed the rate
+        if (frame->samplerate == ch_data_ptr->samplerate) {
+            outc->hdr.sample_rate = ch_data_ptr->header.sample_rate;
+            outc->hdr.downsample = ch_data_ptr->header.downsample;
+        }
+    }
+
+    outc->max_err = 0;
+    outc->clipped = 0;
+
+    filename = g_strdup_printf("%s%d.q16", o->filename, frame->ch);
+    outc->fp = fopen(filename, "wb");
+    g_free(filename);
+    if (!outc->fp) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    if (fwrite(&outc->hdr, 1, Q16_HDR_SIZE, outc->fp) != Q16_HDR_SIZE) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+static int channel_end(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    int ret = SR_OK;
+
+    if (!outc->fp)
+        return SR_OK;
+
+    if ((fseek(outc->fp, Q16_HDR_SC_POS, SEEK_SET) < 0) ||
+        (fwrite(&outc->hdr.num_samples, 1, sizeof(uint64_t), outc->fp) != sizeof(uint64_t))) {
+        err_msg("%s:%d while updating the header", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+    fclose(outc->fp);
+    outc->fp = NULL;
+
+    if (outc->clipped)
+        err_msg("warning: %ld samples of channel %d were clipped to the int16 range\n", outc->clipped, frame->ch);
+    // a small margin covers the rounding of the float arithmetic
+    if (outc->lsb && (outc->max_err > outc->lsb * 0.501f))
+        err_msg("warning: channel %d has a quantization error of %g, more than half of its %g LSB step\n",
+                frame->ch, outc->max_err, outc->lsb);
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o, analog->data, analog->num_samples)) != SR_OK))
+            return ret;
+
+        if (outc->codes_sz < analog->num_samples) {
+            outc->codes = g_realloc(outc->codes, analog->num_samples * sizeof(int16_t));
+            outc->codes_sz = analog->num_samples;
+        }
+
+        quantize(outc, analog->data, analog->num_samples);
+
+        if (fwrite(outc->codes, sizeof(int16_t), analog->num_samples, outc->fp) != analog->num_samples) {
+            err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        outc->hdr.num_samples += analog->num_samples;
+        break;
+    case SR_DF_FRAME_END:
+        return channel_end(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"scale", "scale", "volts per code, 0 picks the observed ADC step of every channel", NULL, NULL},
+    {"offset", "offset", "voltage of code 0, only used together with scale", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_double(0));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(0));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp)
+            fclose(outc->fp);
+        g_free(outc->codes);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_q16 = {
+    .id = "q16",
+    .name = "q16",
+    .desc = "one channel per file, int16 codes with a per-channel scale and offset",
+    .exts = (const char *[]) {"q16", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
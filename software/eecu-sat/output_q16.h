@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_Q16_H__
+#define __OUTPUT_Q16_H__
+
+extern struct sr_output_module output_q16;
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "crank.h"
+#include "output.h"
+
+/*
+ * engine speed versus time as a table, decoded from the crank channel while
+ * it streams by. the rows are either every tooth or only the tooth after the
+ * gap, which marks a new revolution.
+ */
+
+struct out_context {
+    uint16_t id;                // crank channel
+    bool per_tooth;
+    struct sat_crank *crank;
+    FILE *fp;
+
+    // current channel
+    bool selected;
+    char *name;
+    uint64_t samplerate;
+    double t0;                  // time of the first exported sample in the capture
+    uint64_t edges;
+    uint64_t rows;
+    float rpm_min;
+    float rpm_max;
+    double rpm_sum;
+    uint64_t rpm_cnt;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    const char *rows;
+    uint32_t id, teeth, missing;
+    double hyst;
+    FILE *fp;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    id = g_variant_get_uint32(g_hash_table_lookup(options, "channel"));
+    hyst = g_variant_get_double(g_hash_table_lookup(options, "hyst"));
+    rows = g_variant_get_string(g_hash_table_lookup(options, "rows"), NULL);
+
+    if ((id < 1) || (id > g_slist_length(o->sdi->channels))) {
+        err_msg("%s:%d crank channel %u does not exist", __FILE__, __LINE__, id);
+        return SR_ERR_ARG;
+    }
+    if (!(hyst >= 0)) {
+        err_msg("%s:%d the hysteresis can't be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (strcmp(rows, "tooth") && strcmp(rows, "revolution")) {
+        err_msg("%s:%d rows must be 'tooth' or 'revolution'", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+    if (sat_crank_parse_wheel(g_variant_get_string(g_hash_table_lookup(options, "wheel"), NULL), &teeth, &missing) != SR_OK)
+        return SR_ERR_ARG;
+
+    // rows are written as they are found
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    fprintf(fp, "time_s,rev,tooth,rpm,rpm_avg\n");
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->id = id;
+    outc->per_tooth = !strcmp(rows, "tooth");
+    outc->crank = sat_crank_new(teeth, missing, g_variant_get_double(g_hash_table_lookup(options, "level")), hyst);
+    outc->fp = fp;
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    GSList *l;
+
+    outc->selected = (frame->ch == outc->id);
+    if (!outc->selected)
+        return;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+    g_free(outc->name);
+    if (l)
+        outc->name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        outc->name = g_strdup_printf("ch%d", frame->ch);
+
+    outc->samplerate = frame->samplerate;
+    // the trigger crop seeks in samples of the input file
+    outc->t0 = (l && ch_data_ptr->samplerate) ? (double) frame->seek / ch_data_ptr->samplerate : 0;
+    outc->edges = 0;
+    outc->rows = 0;
+    outc->rpm_min = INFINITY;
+    outc->rpm_max = -INFINITY;
+    outc->rpm_sum = 0;
+    outc->rpm_cnt = 0;
+    sat_crank_reset(outc->crank, frame->samplerate);
+}
+
+static void row_emit(struct out_context *outc, const struct sat_crank_tooth *t)
+{
+    const double rate = outc->samplerate ? outc->samplerate : 1;
+
+    fprintf(outc->fp, "%.9f,%lu,%d,", outc->t0 + t->at / rate, t->rev, t->tooth);
+    if (isfinite(t->rpm))
+        fprintf(outc->fp, "%.3f", t->rpm);
+    fprintf(outc->fp, ",");
+    if (isfinite(t->rpm_avg))
+        fprintf(outc->fp, "%.3f", t->rpm_avg);
+    fprintf(outc->fp, "\n");
+    outc->rows++;
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    const struct sat_crank *c = outc->crank;
+    const struct sat_crank_tooth *t;
+    uint32_t e;
+    bool rev;
+
+    sat_crank_receive(outc->crank, data, num_samples);
+    for (e = 0; e < c->events->len; e++) {
+        t = &g_array_index(c->events, struct sat_crank_tooth, e);
+        // a wheel without a gap starts a revolution every c->teeth edges
+        rev = c->missing ? t->gap : !(outc->edges % c->teeth);
+        outc->edges++;
+        if (outc->per_tooth || rev)
+            row_emit(outc, t);
+        if (isfinite(t->rpm_avg)) {
+            outc->rpm_min = MIN(outc->rpm_min, t->rpm_avg);
+            outc->rpm_max = MAX(outc->rpm_max, t->rpm_avg);
+            outc->rpm_sum += t->rpm_avg;
+            outc->rpm_cnt++;
+        }
+    }
+}
+
+static void channel_end(struct out_context *outc)
+{
+    fprintf(stdout, "rpm ch %d %s: %lu teeth, %lu revolutions", outc->id, outc->name, outc->edges, outc->crank->revs);
+    if (outc->rpm_cnt)
+        fprintf(stdout, ", rpm %.1f / %.1f / %.1f", outc->rpm_min, outc->rpm_sum / outc->rpm_cnt, outc->rpm_max);
+    if (outc->crank->sync_lost)
+        fprintf(stdout, ", %lu sync losses", outc->crank->sync_lost);
+    fprintf(stdout, "\n");
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        if (outc->selected)
+            receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        if (outc->selected)
+            channel_end(outc);
+        outc->selected = false;
+        break;
+    case SR_DF_END:
+        if (fflush(outc->fp)) {
+            err_msg("%s:%d during fflush()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"channel", "channel", "id of the crank channel", NULL, NULL},
+    {"level", "level", "threshold level in volts", NULL, NULL},
+    {"hyst", "hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"wheel", "wheel", "crank trigger wheel as TEETH-MISSING", NULL, NULL},
+    {"rows", "rows", "'tooth' for a row per tooth, 'revolution' for a row per revolution", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0.2));
+        options[3].def = g_variant_ref_sink(g_variant_new_string("60-2"));
+        options[4].def = g_variant_ref_sink(g_variant_new_string("revolution"));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    int ret = SR_OK;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp && fclose(outc->fp)) {
+            err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+        }
+        sat_crank_free(outc->crank);
+        g_free(outc->name);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return ret;
+}
+
+struct sr_output_module output_rpm = {
+    .id = "rpm",
+    .name = "rpm",
+    .desc = "engine speed versus time decoded from a crank trigger wheel",
+    .exts = (const char *[]) {"csv", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_RPM_H__
+#define __OUTPUT_RPM_H__
+
+extern struct sr_output_module output_rpm;
+
+#endif
@@ -19,18 +19,467 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <math.h>
 #include <zip.h>
 #include "proj.h"
 #include "error.h"
+#include "ini.h"
+#include "dsp.h"
+#include "crank.h"
 #include "output.h"
 
+#define  LOGIC_MAX_CHANNELS  64
+
 struct out_context {
     char *target_filename;      // filename within the archive
     char *metadata_file;
+    // channels that are exported as logic signals
+    uint32_t logic_cnt;
+    uint32_t unitsize;          // bytes per logic sample
+    int16_t *logic_bit;         // indexed by channel id, -1 for analog channels
+    uint16_t *analog_idx;       // indexed by channel id, probe index in the archive
+    float logic_high[LOGIC_MAX_CHANNELS];
+    float logic_low[LOGIC_MAX_CHANNELS];
+    uint16_t logic_last;        // id of the last logic channel, its chunks complete the logic samples
+    uint8_t *logic;             // packed samples of the current chunk
+    ssize_t logic_alloc;        // in samples
+    ssize_t ch_samples;         // samples of the current channel received so far
+    // the logic channels before the last one are packed into a spool file
+    FILE *spool;
+    ssize_t spool_samples;
+    ssize_t logic_written;      // samples added to the archive
+    int logic_chunk;
+    uint64_t state;             // hysteresis state of the current channel
+    // crank channel decoded into the derived RPM and RPM_avg channels
+    uint16_t rpm_ch;            // 0 if disabled
+    uint16_t rpm_idx;           // probe index of RPM in the archive, RPM_avg follows it
+    struct sat_crank *crank;
+    float rpm[2];               // held since the last tooth
+    float *rpm_buf;
+    ssize_t rpm_alloc;          // in samples
+};
+
+// read back what the logic channels before this one packed for num_samples samples from offset on
+static int logic_load(struct out_context *outc, const ssize_t offset, const ssize_t num_samples)
+{
+    ssize_t cnt;
+
+    if (num_samples > outc->logic_alloc) {
+        outc->logic = g_realloc(outc->logic, num_samples * outc->unitsize);
+        outc->logic_alloc = num_samples;
+    }
+    memset(outc->logic, 0, num_samples * outc->unitsize);
+
+    cnt = MIN(num_samples, outc->spool_samples - offset);
+    if (!outc->spool || (cnt <= 0))
+        return SR_OK;
+
+    if ((fseeko(outc->spool, offset * outc->unitsize, SEEK_SET) < 0) ||
+        (fread(outc->logic, outc->unitsize, cnt, outc->spool) != (size_t) cnt)) {
+        err_msg("%s:%d while reading the spool file", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+static int logic_store(const struct sr_output *o, const ssize_t num_samples)
+{
+    struct out_context *outc = o->priv;
+    char *spool_name;
+
+    if (!outc->spool) {
+        // the spool file is unlinked right away, it goes away together with the descriptor
+        spool_name = g_strdup_printf("%s.spool", o->filename);
+        outc->spool = fopen(spool_name, "w+b");
+        if (outc->spool)
+            unlink(spool_name);
+        g_free(spool_name);
+        if (!outc->spool) {
+            err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    }
+
+    if ((fseeko(outc->spool, outc->ch_samples * outc->unitsize, SEEK_SET) < 0) ||
+        (fwrite(outc->logic, outc->unitsize, num_samples, outc->spool) != (size_t) num_samples)) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    if (outc->ch_samples + num_samples > outc->spool_samples)
+        outc->spool_samples = outc->ch_samples + num_samples;
+
+    return SR_OK;
+}
+
+// add the packed samples in outc->logic as the next logic-1-N member
+static int logic_write(const struct sr_output *o, const ssize_t num_samples)
+{
+    struct out_context *outc = o->priv;
+    struct zip *archive;
+    struct zip_source *src;
+
+    if (!(archive = zip_open(o->filename, 0, NULL)))
+        return SR_ERR_IO;
+
+    src = zip_source_buffer(archive, outc->logic, num_samples * outc->unitsize, 0);
+    snprintf(outc->target_filename, PATH_MAX - 1, "logic-1-%d", ++outc->logic_chunk);
+    if (zip_file_add(archive, outc->target_filename, src, ZIP_FL_ENC_UTF_8) < 0) {
+        err_msg("%s:%d Failed to add chunk: %s", __FILE__, __LINE__, zip_strerror(archive));
+        zip_source_free(src);
+        zip_discard(archive);
+        return SR_ERR_IO;
+    }
+
+    if (zip_close(archive) < 0) {
+        err_msg("%s:%d Error saving session file: %s", __FILE__, __LINE__, zip_strerror(archive));
+        zip_discard(archive);
+        return SR_ERR_IO;
+    }
+
+    outc->logic_written += num_samples;
+
+    return SR_OK;
+}
+
+/*
+ * threshold a chunk of the current channel into its bit of the logic samples.
+ * the logic channels before the last one are packed into the spool file, the
+ * chunks of the last one complete the samples and are added to the archive.
+ */
+static int logic_receive(const struct sr_output *o, const float *samples, const ssize_t num_samples)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const uint16_t bit = outc->logic_bit[frame->ch];
+    const uint8_t bmask = 1 << (bit % 8);
+    uint8_t *dst;
+    uint64_t word;
+    ssize_t i;
+    int n, ret;
+
+    if (!num_samples)
+        return SR_OK;
+
+    if ((ret = logic_load(outc, outc->ch_samples, num_samples)) != SR_OK)
+        return ret;
+
+    // the first sample decides the initial state
+    if (!outc->ch_samples)
+        outc->state = samples[0] > (outc->logic_low[bit] + outc->logic_high[bit]) / 2;
+
+    dst = outc->logic + bit / 8;
+    for (i = 0; i < num_samples; i += 64) {
+        n = MIN(64, num_samples - i);
+        word = dsp_threshold_word(samples + i, n, outc->logic_low[bit], outc->logic_high[bit], &outc->state);
+        while (word) {
+            dst[(i + __builtin_ctzll(word)) * outc->unitsize] |= bmask;
+            word &= word - 1;
+        }
+    }
+
+    if (frame->ch == outc->logic_last)
+        ret = logic_write(o, num_samples);
+    else
+        ret = logic_store(o, num_samples);
+    outc->ch_samples += num_samples;
+
+    return ret;
+}
+
+// samples the last logic channel did not reach, or all of them if the export ended before it
+static int logic_flush(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    ssize_t cnt;
+    int ret;
+
+    if (outc->spool && (fflush(outc->spool) || ferror(outc->spool))) {
+        err_msg("%s:%d while writing the spool file", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    while (outc->logic_written < outc->spool_samples) {
+        cnt = MIN(CHUNK_SIZE / sizeof(float), outc->spool_samples - outc->logic_written);
+        if (((ret = logic_load(outc, outc->logic_written, cnt)) != SR_OK) || ((ret = logic_write(o, cnt)) != SR_OK))
+            return ret;
+    }
+
+    return SR_OK;
+}
+
+/*
+ * parse a comma separated list of channel ids, each one optionally followed
+ * by @LEVEL to override the default threshold level of that channel
+ */
+static int logic_parse(const struct sr_output *o, const char *spec, const double level, const double hyst)
+{
+    struct out_context *outc = o->priv;
+    uint32_t ch_cnt = g_slist_length(o->sdi->channels);
+    gchar **tokens, *at;
+    double ch_level;
+    uint32_t i, id, analog_cnt;
+    int ret = SR_OK;
+
+    outc->logic_bit = g_malloc0((ch_cnt + 1) * sizeof(int16_t));
+    outc->analog_idx = g_malloc0((ch_cnt + 1) * sizeof(uint16_t));
+    for (i = 0; i <= ch_cnt; i++)
+        outc->logic_bit[i] = -1;
+
+    tokens = g_strsplit(spec, ",", 0);
+    for (i = 0; tokens[i]; i++) {
+        if (!tokens[i][0])
+            continue;
+        ch_level = level;
+        if ((at = strchr(tokens[i], '@'))) {
+            *at = 0;
+            ch_level = strtod(at + 1, NULL);
+        }
+        id = strtoul(tokens[i], NULL, 10);
+        if ((id < 1) || (id > ch_cnt)) {
+            err_msg("%s:%d logic channel '%s' does not exist", __FILE__, __LINE__, tokens[i]);
+            ret = SR_ERR_ARG;
+            break;
+        }
+        if (outc->logic_bit[id] >= 0)
+            continue;
+        if (outc->logic_cnt == LOGIC_MAX_CHANNELS) {
+            err_msg("%s:%d at most %d logic channels are supported", __FILE__, __LINE__, LOGIC_MAX_CHANNELS);
+            ret = SR_ERR_ARG;
+            break;
+        }
+        outc->logic_high[outc->logic_cnt] = ch_level + hyst / 2;
+        outc->logic_low[outc->logic_cnt] = ch_level - hyst / 2;
+        outc->logic_bit[id] = outc->logic_cnt++;
+        outc->logic_last = MAX(outc->logic_last, id);
+    }
+    g_strfreev(tokens);
+
+    // logic probes are numbered first, the analog channels follow them
+    analog_cnt = 0;
+    for (id = 1; id <= ch_cnt; id++) {
+        if (outc->logic_bit[id] < 0)
+            outc->analog_idx[id] = outc->logic_cnt + ++analog_cnt;
+    }
+
+    outc->unitsize = (outc->logic_cnt + 7) / 8;
+
+    return ret;
+}
+
+// CH[@LEVEL] of the crank channel, the derived channels are placed after all the others
+static int rpm_parse(const struct sr_output *o, const char *spec, const char *wheel, const double level, const double hyst)
+{
+    struct out_context *outc = o->priv;
+    uint32_t ch_cnt = g_slist_length(o->sdi->channels);
+    uint32_t teeth, missing;
+    double ch_level = level;
+    char *at;
+
+    if (!spec[0])
+        return SR_OK;
+
+    if (sat_crank_parse_wheel(wheel, &teeth, &missing) != SR_OK)
+        return SR_ERR_ARG;
+
+    if ((at = strchr(spec, '@')))
+        ch_level = strtod(at + 1, NULL);
+    outc->rpm_ch = strtoul(spec, NULL, 10);
+    if ((outc->rpm_ch < 1) || (outc->rpm_ch > ch_cnt)) {
+        err_msg("%s:%d crank channel '%s' does not exist", __FILE__, __LINE__, spec);
+        outc->rpm_ch = 0;
+        return SR_ERR_ARG;
+    }
+
+    outc->rpm_idx = ch_cnt + 1;
+    outc->crank = sat_crank_new(teeth, missing, ch_level, hyst);
+
+    return SR_OK;
+}
+
+/*
+ * decode the next chunk of the crank channel and add the matching chunks of
+ * RPM and RPM_avg. both are held between teeth and read 0 until known.
+ */
+static int rpm_receive(const struct sr_output *o, const struct sr_datafeed_analog *analog)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const ssize_t n = analog->num_samples;
+    const struct sat_crank_tooth *t;
+    struct zip *archive;
+    struct zip_source *src;
+    uint64_t base;
+    ssize_t i, end;
+    uint32_t e;
+    int k;
+
+    if (frame->chunk == 1) {
+        sat_crank_reset(outc->crank, frame->samplerate);
+        outc->rpm[0] = 0;
+        outc->rpm[1] = 0;
+    }
+
+    if (n > outc->rpm_alloc) {
+        outc->rpm_buf = g_realloc(outc->rpm_buf, 2 * n * sizeof(float));
+        outc->rpm_alloc = n;
+    }
+
+    base = outc->crank->samples;
+    sat_crank_receive(outc->crank, analog->data, n);
+    i = 0;
+    for (e = 0; e < outc->crank->events->len; e++) {
+        t = &g_array_index(outc->crank->events, struct sat_crank_tooth, e);
+        end = MIN(n, (ssize_t) ceil(t->at - base));
+        for (; i < end; i++) {
+            outc->rpm_buf[i] = outc->rpm[0];
+            outc->rpm_buf[n + i] = outc->rpm[1];
+        }
+        if (isfinite(t->rpm))
+            outc->rpm[0] = t->rpm;
+        if (isfinite(t->rpm_avg))
+            outc->rpm[1] = t->rpm_avg;
+    }
+    for (; i < n; i++) {
+        outc->rpm_buf[i] = outc->rpm[0];
+        outc->rpm_buf[n + i] = outc->rpm[1];
+    }
+
+    if (!(archive = zip_open(o->filename, 0, NULL)))
+        return SR_ERR_IO;
+
+    for (k = 0; k < 2; k++) {
+        src = zip_source_buffer(archive, outc->rpm_buf + k * n, n * sizeof(float), 0);
+        snprintf(outc->target_filename, PATH_MAX - 1, "analog-1-%d-%d", outc->rpm_idx + k, frame->chunk);
+        if (zip_file_add(archive, outc->target_filename, src, ZIP_FL_ENC_UTF_8) < 0) {
+            err_msg("%s:%d Failed to add chunk: %s", __FILE__, __LINE__, zip_strerror(archive));
+            zip_source_free(src);
+            zip_discard(archive);
+            return SR_ERR_IO;
+        }
+    }
+
+    if (zip_close(archive) < 0) {
+        err_msg("%s:%d Error saving session file: %s", __FILE__, __LINE__, zip_strerror(archive));
+        zip_discard(archive);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+struct meta_import {
+    uint32_t ch_cnt;
+    gchar **labels;             // indexed by channel id
+    GString *other;             // sections other than [device 1]
+    GString *dev;               // keys of [device 1] that are kept
+    char section[LINE_MAX_SZ];  // last section copied into other
 };
 
+static int metadata_import_handler(void *data, const char *section, const char *name, const char *value)
+{
+    struct meta_import *mi = data;
+    uint32_t id;
+    char *end;
+
+    if (strcmp(section, "device 1")) {
+        if (strcmp(section, mi->section)) {
+            g_string_append_printf(mi->other, "%s[%s]\n", mi->other->len ? "\n" : "", section);
+            g_strlcpy(mi->section, section, LINE_MAX_SZ);
+        }
+        g_string_append_printf(mi->other, "%s=%s\n", name, value);
+        return 1;
+    }
+
+    if (!strncmp(name, "analog", 6)) {
+        id = strtoul(name + 6, &end, 10);
+        if (!*end && (id >= 1) && (id <= mi->ch_cnt)) {
+            g_free(mi->labels[id]);
+            mi->labels[id] = g_strdup(value);
+        }
+        return 1;
+    }
+
+    // these describe the layout of the archive and are written out again
+    if (!strcmp(name, "capturefile") || !strcmp(name, "total probes") ||
+        !strcmp(name, "total analog") || !strcmp(name, "unitsize"))
+        return 1;
+
+    g_string_append_printf(mi->dev, "%s=%s\n", name, value);
+    return 1;
+}
+
+/*
+ * the channels of a custom metadata file are labeled analogN by their input
+ * number. the logic probes and the renumbered analog channels take over these
+ * labels and the derived RPM channels are added after them.
+ */
+static char *metadata_import(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    struct meta_import mi = { 0 };
+    GString *buff;
+    uint32_t id;
+
+    mi.ch_cnt = g_slist_length(o->sdi->channels);
+    mi.labels = g_malloc0((mi.ch_cnt + 1) * sizeof(gchar *));
+    mi.other = g_string_new(NULL);
+    mi.dev = g_string_new(NULL);
+
+    if (ini_parse(outc->metadata_file, metadata_import_handler, &mi) < 0) {
+        err_msg("%s:%d unable to read metadata file %s", __FILE__, __LINE__, outc->metadata_file);
+        buff = NULL;
+        goto cleanup;
+    }
+
+    buff = g_string_new(mi.other->str);
+    g_string_append_printf(buff, "%s[device 1]\n", buff->len ? "\n" : "");
+    if (outc->logic_cnt)
+        g_string_append_printf(buff, "capturefile=logic-1\ntotal probes=%d\n", outc->logic_cnt);
+    g_string_append(buff, mi.dev->str);
+    g_string_append_printf(buff, "total analog=%d\n", mi.ch_cnt - outc->logic_cnt + (outc->rpm_ch ? 2 : 0));
+    for (id = 1; id <= mi.ch_cnt; id++) {
+        if (outc->logic_bit[id] >= 0)
+            g_string_append_printf(buff, "probe%d=", outc->logic_bit[id] + 1);
+        else
+            g_string_append_printf(buff, "analog%d=", outc->analog_idx[id]);
+        if (mi.labels[id])
+            g_string_append_printf(buff, "%s\n", mi.labels[id]);
+        else
+            g_string_append_printf(buff, "CH%d\n", id);
+    }
+    if (outc->rpm_ch)
+        g_string_append_printf(buff, "analog%d=RPM\nanalog%d=RPM_avg\n", outc->rpm_idx, outc->rpm_idx + 1);
+    if (outc->logic_cnt)
+        g_string_append_printf(buff, "unitsize=%d\n", outc->unitsize);
+
+ cleanup:
+    for (id = 0; id <= mi.ch_cnt; id++)
+        g_free(mi.labels[id]);
+    g_free(mi.labels);
+    g_string_free(mi.other, TRUE);
+    g_string_free(mi.dev, TRUE);
+
+    return buff ? g_string_free(buff, FALSE) : NULL;
+}
+
+static void context_free(struct out_context *outc)
+{
+    g_free(outc->target_filename);
+    g_free(outc->metadata_file);
+    g_free(outc->logic_bit);
+    g_free(outc->analog_idx);
+    g_free(outc->logic);
+    if (outc->spool)
+        fclose(outc->spool);
+    sat_crank_free(outc->crank);
+    g_free(outc->rpm_buf);
+    g_free(outc);
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
     struct zip_source *src;
@@ -41,7 +490,8 @@ static int init(struct sr_output *o, GHashTable *options)
     char *buff = NULL;
     char buffl[LINE_MAX_SZ];
     ssize_t i;
-    ch_data_t *ch_data_ptr;
+    const struct dev_frame *frame = o->sdi->priv;
+    int ret = SR_ERR_IO;
 
     unlink(o->filename);
 
@@ -50,13 +500,23 @@ static int init(struct sr_output *o, GHashTable *options)
 
     /* Options */
     outc->metadata_file = g_strdup(g_variant_get_string(g_hash_table_lookup(options, "metadata_file"), NULL));
+    if ((logic_parse(o, g_variant_get_string(g_hash_table_lookup(options, "logic"), NULL),
+                     g_variant_get_double(g_hash_table_lookup(options, "logic_level")),
+                     g_variant_get_double(g_hash_table_lookup(options, "logic_hyst"))) != SR_OK) ||
+        (rpm_parse(o, g_variant_get_string(g_hash_table_lookup(options, "rpm"), NULL),
+                   g_variant_get_string(g_hash_table_lookup(options, "rpm_wheel"), NULL),
+                   g_variant_get_double(g_hash_table_lookup(options, "logic_level")),
+                   g_variant_get_double(g_hash_table_lookup(options, "logic_hyst"))) != SR_OK)) {
+        ret = SR_ERR_ARG;
+        goto err;
+    }
 
     outc->target_filename = (char *)g_malloc0(PATH_MAX);
 
     archive = zip_open(o->filename, ZIP_CREATE, NULL);
     if (!archive) {
         err_msg("%s:%d error: zip_open() has failed", __FILE__, __LINE__);
-        return SR_ERR_IO;
+        goto err;
     }
 
     src = zip_source_buffer(archive, "2", 1, 0);
@@ -64,34 +524,58 @@ static int init(struct sr_output *o, GHashTable *options)
         err_msg("%s:%d Error adding file into archive: %s", __FILE__, __LINE__, zip_strerror(archive));
         zip_source_free(src);
         zip_discard(archive);
-        return SR_ERR_IO;
+        goto err;
     }
 
     if (outc->metadata_file && (outc->metadata_file[0] != 0)) {
-        metadata = zip_source_file(archive, outc->metadata_file, 0, -1);
+        if (outc->logic_cnt || outc->rpm_ch) {
+            if (!(buff = metadata_import(o))) {
+                zip_discard(archive);
+                goto err;
+            }
+            metadata = zip_source_buffer(archive, buff, strlen(buff), 0);
+        } else {
+            metadata = zip_source_file(archive, outc->metadata_file, 0, -1);
+        }
         if (!metadata) {
             err_msg("%s:%d Error adding file into archive: %s", __FILE__, __LINE__, zip_strerror(archive));
-            return SR_ERR_IO;
+            zip_discard(archive);
+            goto err;
         }
         if (zip_file_add(archive, "metadata", metadata, ZIP_FL_ENC_UTF_8) < 0) {
             err_msg("%s:%d Error adding file into archive: %s", __FILE__, __LINE__, zip_strerror(archive));
             zip_source_free(metadata);
             zip_discard(archive);
-            return SR_ERR_IO;
+            goto err;
         }
     } else {
         buff = g_malloc0(4096);
         strcat(buff, "[global]\nsigrok version=0.5.2\n\n[device 1]\n");
-        l = o->sdi->channels;
-        ch_data_ptr = l->data;
-        snprintf(buffl, LINE_MAX_SZ, "samplerate=%ld Hz\n", ch_data_ptr->header.sample_rate / ch_data_ptr->header.downsample);
-        strcat(buff, buffl);
-        snprintf(buffl, LINE_MAX_SZ, "total analog=%d\n", g_slist_length(o->sdi->channels));
+        if (outc->logic_cnt) {
+            snprintf(buffl, LINE_MAX_SZ, "capturefile=logic-1\ntotal probes=%d\n", outc->logic_cnt);
+            strcat(buff, buffl);
+        }
+        if (frame->samplerate) {
+            snprintf(buffl, LINE_MAX_SZ, "samplerate=%ld Hz\n", frame->samplerate);
+            strcat(buff, buffl);
+        }
+        snprintf(buffl, LINE_MAX_SZ, "total analog=%d\n", g_slist_length(o->sdi->channels) - outc->logic_cnt + (outc->rpm_ch ? 2 : 0));
         strcat(buff, buffl);
         i=0;
         for (l = o->sdi->channels; l; l = l->next) {
             i++;
-            snprintf(buffl, LINE_MAX_SZ, "analog%ld=CH%ld\n", i, i);
+            if (outc->logic_bit[i] >= 0)
+                snprintf(buffl, LINE_MAX_SZ, "probe%d=CH%ld\n", outc->logic_bit[i] + 1, i);
+            else
+                snprintf(buffl, LINE_MAX_SZ, "analog%d=CH%ld\n", outc->analog_idx[i], i);
+            strcat(buff, buffl);
+        }
+        if (outc->rpm_ch) {
+            snprintf(buffl, LINE_MAX_SZ, "analog%d=RPM\nanalog%d=RPM_avg\n", outc->rpm_idx, outc->rpm_idx + 1);
+            strcat(buff, buffl);
+        }
+        if (outc->logic_cnt) {
+            snprintf(buffl, LINE_MAX_SZ, "unitsize=%d\n", outc->unitsize);
             strcat(buff, buffl);
         }
         metadata = zip_source_buffer(archive, buff, strlen(buff), 0);
@@ -99,21 +583,25 @@ static int init(struct sr_output *o, GHashTable *options)
             err_msg("%s:%d Error adding file into archive: %s", __FILE__, __LINE__, zip_strerror(archive));
             zip_source_free(metadata);
             zip_discard(archive);
-            g_free(buff);
-            return SR_ERR_IO;
+            goto err;
         }
     }
 
     if (zip_close(archive) < 0) {
         err_msg("%s:%d Error saving zipfile: %s", __FILE__, __LINE__, zip_strerror(archive));
         zip_discard(archive);
-        return SR_ERR_IO;
+        goto err;
     }
 
-    if (buff)
-        g_free(buff);
+    g_free(buff);
 
     return SR_OK;
+
+ err:
+    g_free(buff);
+    context_free(outc);
+    o->priv = NULL;
+    return ret;
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
@@ -127,6 +615,24 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
     UNUSED(out);
 
+    switch (pkt->type) {
+    case SR_DF_FRAME_BEGIN:
+        outc->ch_samples = 0;
+        return SR_OK;
+    case SR_DF_ANALOG:
+        if (outc->rpm_ch && (frame->ch == outc->rpm_ch) && (rpm_receive(o, pkt->payload) != SR_OK))
+            return SR_ERR_IO;
+        if (outc->logic_bit[frame->ch] >= 0) {
+            analog = pkt->payload;
+            return logic_receive(o, analog->data, analog->num_samples);
+        }
+        break;
+    case SR_DF_END:
+        return logic_flush(o);
+    default:
+        break;
+    }
+
     if (!(archive = zip_open(o->filename, 0, NULL)))
         return SR_ERR_IO;
 
@@ -139,7 +645,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
     case SR_DF_ANALOG:
         analog = pkt->payload;
         src = zip_source_buffer(archive, analog->data, analog->num_samples * sizeof(float), 0);
-        snprintf(outc->target_filename, PATH_MAX - 1, "analog-1-%d-%d", frame->ch, frame->chunk);
+        snprintf(outc->target_filename, PATH_MAX - 1, "analog-1-%d-%d", outc->analog_idx[frame->ch], frame->chunk);
         break;
     default:
         goto cleanup;
@@ -164,6 +670,11 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
     {"metadata_file", "metadata file", "custom metadata file to include in the output srzip archive", NULL, NULL},
+    {"logic", "logic channels", "comma separated list of channels to store as logic signals, CH[@LEVEL]", NULL, NULL},
+    {"logic_level", "logic level", "default threshold level of the logic channels in volts", NULL, NULL},
+    {"logic_hyst", "logic hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"rpm", "rpm", "crank channel, CH[@LEVEL], to derive the RPM and RPM_avg channels from", NULL, NULL},
+    {"rpm_wheel", "rpm wheel", "crank trigger wheel as TEETH-MISSING", NULL, NULL},
 	ALL_ZERO
 };
 
@@ -171,6 +682,11 @@ static const struct sr_option *get_options(void)
 {
     if (!options[0].def) {
         options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0.2));
+        options[4].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[5].def = g_variant_ref_sink(g_variant_new_string("60-2"));
     }
 
 	return options;
@@ -178,19 +694,12 @@ static const struct sr_option *get_options(void)
 
 static int cleanup(struct sr_output *o)
 {
-    struct out_context *outc;
-
     if (o == NULL)
         return SR_ERR_BUG;
 
     if (o->priv) {
-        outc = o->priv;
-        if (outc->target_filename)
-            g_free(outc->target_filename);
-        if (outc->metadata_file)
-            g_free(outc->metadata_file);
-
-        g_free(o->priv);
+        context_free(o->priv);
+        o->priv = NULL;
     }
 
     return SR_OK;
@@ -0,0 +1,535 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "calib.h"
+#include "output.h"
+
+/*
+ * per channel statistics in a single pass.
+ *
+ * samples are taken in blocks of STATS_BLOCK. the first pass over a block
+ * finds its range, sum and clipping counts, the second one sums the
+ * deviations from the block mean (the corrected two-pass algorithm), both
+ * four lanes at a time while the block sits in L1. the block moments are
+ * then merged into the channel with the pairwise update of Chan et al.
+ * blocks are kept short so that the float lane sums stay accurate, the
+ * channel totals are kept in double. blocks start at multiples of
+ * STATS_BLOCK within the channel so the results do not depend on the chunk
+ * size either.
+ *
+ * histogram bins are cells of a power of two width aligned to multiples of
+ * that width. once a sample falls outside of the bins the width doubles
+ * until the range seen so far fits again, old cells map onto exactly one
+ * new cell. the final histogram is the one for the full range and does not
+ * depend on how the samples were chunked.
+ */
+
+#define  STATS_BLOCK      256
+#define  STATS_MAX_BINS   65536
+#define  STATS_MIN_WIDTH  (1.0 / (1 << 20))
+
+struct stats_channel {
+    char *name;
+    uint64_t samples;
+    uint64_t non_finite;
+    uint64_t n;                 // finite samples
+    float min;
+    float max;
+    double mean;
+    double m2;                  // sum of squared deviations from the mean
+    uint64_t below;
+    uint64_t above;
+    double hist_low;
+    double hist_width;          // 0 until the first finite sample
+    uint64_t *hist;
+};
+
+struct out_context {
+    bool csv;
+    uint32_t bins;
+    float floor;                // NaN if not known
+    float ceil;
+    GArray *channels;           // struct stats_channel
+    float pending[STATS_BLOCK]; // samples of a block not complete at the end of a chunk
+    ssize_t pending_len;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    calib_globals_t globals = { 0 };
+    const char *format, *calib_file;
+    double floor = NAN, ceil = NAN;
+    uint32_t bins;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+    if (strcmp(format, "auto") && strcmp(format, "json") && strcmp(format, "csv")) {
+        err_msg("%s:%d the format must be 'auto', 'json' or 'csv'", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    bins = g_variant_get_uint32(g_hash_table_lookup(options, "bins"));
+    if ((bins < 1) || (bins > STATS_MAX_BINS)) {
+        err_msg("%s:%d the number of bins must be between 1 and %d", __FILE__, __LINE__, STATS_MAX_BINS);
+        return SR_ERR_ARG;
+    }
+
+    // the out of bounds limits of the calibration, unless they are given directly
+    calib_file = g_variant_get_string(g_hash_table_lookup(options, "calib_file"), NULL);
+    if (calib_file[0]) {
+        if (calib_read_params_from_file((char *)calib_file, &globals, CALIB_INI_GLOBALS) != SR_OK) {
+            err_msg("%s:%d error during calib_read_params_from_file()", __FILE__, __LINE__);
+            return SR_ERR_ARG;
+        }
+        floor = globals.r_oob_floor;
+        ceil = globals.r_oob_ceil;
+    }
+    if (!isnan(g_variant_get_double(g_hash_table_lookup(options, "floor"))))
+        floor = g_variant_get_double(g_hash_table_lookup(options, "floor"));
+    if (!isnan(g_variant_get_double(g_hash_table_lookup(options, "ceil"))))
+        ceil = g_variant_get_double(g_hash_table_lookup(options, "ceil"));
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    if (!strcmp(format, "auto"))
+        outc->csv = g_str_has_suffix(o->filename, ".csv");
+    else
+        outc->csv = !strcmp(format, "csv");
+    outc->bins = bins;
+    outc->floor = floor;
+    outc->ceil = ceil;
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct stats_channel));
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct stats_channel ch = { 0 };
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    if (l)
+        ch.name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        ch.name = g_strdup_printf("ch%d", frame->ch);
+    ch.hist = g_malloc0(outc->bins * sizeof(uint64_t));
+    g_array_append_val(outc->channels, ch);
+}
+
+// widen the histogram until it covers the range seen so far plus [lo, hi]
+static void hist_cover(struct stats_channel *ch, const uint32_t bins, double lo, double hi)
+{
+    uint64_t *old;
+    double w, low;
+    uint32_t k;
+
+    if (ch->hist_width && (lo >= ch->hist_low) && (hi < ch->hist_low + bins * ch->hist_width))
+        return;
+
+    if (ch->n) {
+        lo = MIN(lo, ch->min);
+        hi = MAX(hi, ch->max);
+    }
+    w = ch->hist_width ? ch->hist_width : STATS_MIN_WIDTH;
+    while (floor(hi / w) - floor(lo / w) >= bins)
+        w *= 2;
+    low = floor(lo / w) * w;
+
+    if (ch->hist_width) {
+        // the cells are aligned, so an old cell lies inside a single new one
+        old = g_memdup2(ch->hist, bins * sizeof(uint64_t));
+        memset(ch->hist, 0, bins * sizeof(uint64_t));
+        for (k = 0; k < bins; k++) {
+            if (old[k])
+                ch->hist[(uint32_t) floor((ch->hist_low + k * ch->hist_width - low) / w)] += old[k];
+        }
+        g_free(old);
+    }
+    ch->hist_low = low;
+    ch->hist_width = w;
+}
+
+static void hist_add(struct stats_channel *ch, const uint32_t bins, const float *x, const ssize_t n)
+{
+    const double inv_w = 1 / ch->hist_width;
+    const double low = ch->hist_low;
+    uint32_t k;
+    ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        if (!isfinite(x[i]))
+            continue;
+        k = (x[i] - low) * inv_w;
+        ch->hist[MIN(k, bins - 1)]++;
+    }
+}
+
+// merge the moments of a block into the channel
+static void merge(struct stats_channel *ch, const uint64_t n, const double mean, const double m2)
+{
+    const uint64_t total = ch->n + n;
+    const double delta = mean - ch->mean;
+
+    if (!n)
+        return;
+    ch->m2 += m2 + delta * delta * ((double) ch->n * n / total);
+    ch->mean += delta * n / total;
+    ch->n = total;
+}
+
+// blocks with NaN or infinite samples, those only add to the non_finite count
+static void block_scalar(struct out_context *outc, struct stats_channel *ch, const float *x, const ssize_t n)
+{
+    double mean = 0, m2 = 0, d;
+    float lo = INFINITY, hi = -INFINITY;
+    uint64_t cnt = 0;
+    ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        if (!isfinite(x[i])) {
+            ch->non_finite++;
+            continue;
+        }
+        lo = MIN(lo, x[i]);
+        hi = MAX(hi, x[i]);
+        ch->below += x[i] < outc->floor;
+        ch->above += x[i] > outc->ceil;
+        cnt++;
+        d = x[i] - mean;
+        mean += d / cnt;
+        m2 += d * (x[i] - mean);
+    }
+    if (!cnt)
+        return;
+
+    hist_cover(ch, outc->bins, lo, hi);
+    hist_add(ch, outc->bins, x, n);
+    ch->min = ch->n ? MIN(ch->min, lo) : lo;
+    ch->max = ch->n ? MAX(ch->max, hi) : hi;
+    merge(ch, cnt, mean, m2);
+}
+
+static void block(struct out_context *outc, struct stats_channel *ch, const float *x, const ssize_t n)
+{
+    const v4sf vfloor = v4sf_set1(outc->floor);
+    const v4sf vceil = v4sf_set1(outc->ceil);
+    v4sf v, vmin, vmax, vsum, vd, vd2;
+    v4si vbelow = { 0 }, vabove = { 0 };
+    float lo, hi, sum, s1, s2, m;
+    ssize_t i;
+
+    vmin = vmax = v4sf_set1(x[0]);
+    vsum = v4sf_set1(0);
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i);
+        vmin = v4sf_min(vmin, v);
+        vmax = v4sf_max(vmax, v);
+        vsum += v;
+        // comparison masks are -1 in the lanes that are set
+        vbelow -= (v < vfloor);
+        vabove -= (v > vceil);
+    }
+    lo = v4sf_hmin(vmin);
+    hi = v4sf_hmax(vmax);
+    sum = v4sf_hsum(vsum);
+    for (; i < n; i++) {
+        lo = MIN(lo, x[i]);
+        hi = MAX(hi, x[i]);
+        sum += x[i];
+    }
+
+    // NaN and infinity end up in the sum
+    if (!isfinite(sum)) {
+        block_scalar(outc, ch, x, n);
+        return;
+    }
+
+    // the sum of the deviations corrects the rounding of the block mean
+    m = sum / n;
+    vd = vd2 = v4sf_set1(0);
+    for (i = 0; i + V4SF_LANES <= n; i += V4SF_LANES) {
+        v = v4sf_load(x + i) - v4sf_set1(m);
+        vd += v;
+        vd2 += v * v;
+    }
+    s1 = v4sf_hsum(vd);
+    s2 = v4sf_hsum(vd2);
+    for (; i < n; i++) {
+        s1 += x[i] - m;
+        s2 += (x[i] - m) * (x[i] - m);
+    }
+
+    // squares of huge samples overflow a float
+    if (!isfinite(s2)) {
+        block_scalar(outc, ch, x, n);
+        return;
+    }
+
+    for (i = n - n % V4SF_LANES; i < n; i++) {
+        vbelow[0] += x[i] < outc->floor;
+        vabove[0] += x[i] > outc->ceil;
+    }
+    ch->below += vbelow[0] + vbelow[1] + vbelow[2] + vbelow[3];
+    ch->above += vabove[0] + vabove[1] + vabove[2] + vabove[3];
+
+    hist_cover(ch, outc->bins, lo, hi);
+    hist_add(ch, outc->bins, x, n);
+    ch->min = ch->n ? MIN(ch->min, lo) : lo;
+    ch->max = ch->n ? MAX(ch->max, hi) : hi;
+    merge(ch, n, m + (double) s1 / n, MAX(0, s2 - (double) s1 * s1 / n));
+}
+
+static void receive_analog(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct stats_channel *ch = &g_array_index(outc->channels, struct stats_channel, outc->channels->len - 1);
+    ssize_t i = 0, len;
+
+    ch->samples += num_samples;
+
+    // complete the block left over from the previous chunk
+    if (outc->pending_len) {
+        len = MIN(STATS_BLOCK - outc->pending_len, num_samples);
+        memcpy(outc->pending + outc->pending_len, data, len * sizeof(float));
+        outc->pending_len += len;
+        i = len;
+        if (outc->pending_len < STATS_BLOCK)
+            return;
+        block(outc, ch, outc->pending, STATS_BLOCK);
+        outc->pending_len = 0;
+    }
+
+    for (; i + STATS_BLOCK <= num_samples; i += STATS_BLOCK)
+        block(outc, ch, data + i, STATS_BLOCK);
+
+    if (i < num_samples) {
+        outc->pending_len = num_samples - i;
+        memcpy(outc->pending, data + i, outc->pending_len * sizeof(float));
+    }
+}
+
+static void channel_end(struct out_context *outc)
+{
+    struct stats_channel *ch;
+
+    if (!outc->pending_len)
+        return;
+    ch = &g_array_index(outc->channels, struct stats_channel, outc->channels->len - 1);
+    block(outc, ch, outc->pending, outc->pending_len);
+    outc->pending_len = 0;
+}
+
+// a double as JSON/CSV number, null (JSON) or an empty cell (CSV) if it is unknown
+static void put_double(FILE *fp, const double v, const bool csv)
+{
+    if (isfinite(v))
+        fprintf(fp, "%.9g", v);
+    else if (!csv)
+        fprintf(fp, "null");
+}
+
+static void put_name(FILE *fp, const char *name, const bool csv)
+{
+    const char *p;
+
+    fputc('"', fp);
+    for (p = name; *p; p++) {
+        if (*p == '"')
+            fputc(csv ? '"' : '\\', fp);
+        else if (!csv && (*p == '\\'))
+            fputc('\\', fp);
+        fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+static int write_stats(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct stats_channel *ch;
+    const char *sep;
+    double nan = NAN;
+    uint32_t i, k;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    if (outc->csv) {
+        fprintf(fp, "name,samples,non_finite,min,max,mean,rms,stddev,below_floor,above_ceil,hist_low,hist_width");
+        for (k = 0; k < outc->bins; k++)
+            fprintf(fp, ",bin_%u", k);
+        fprintf(fp, "\n");
+    } else {
+        fprintf(fp, "{\n  \"floor\": ");
+        put_double(fp, outc->floor, false);
+        fprintf(fp, ",\n  \"ceil\": ");
+        put_double(fp, outc->ceil, false);
+        fprintf(fp, ",\n  \"channels\": [\n");
+    }
+
+    for (i = 0; i < outc->channels->len; i++) {
+        ch = &g_array_index(outc->channels, struct stats_channel, i);
+        sep = outc->csv ? "," : ", ";
+        if (!outc->csv)
+            fprintf(fp, "    {\"name\": ");
+        put_name(fp, ch->name, outc->csv);
+        fprintf(fp, outc->csv ? ",%lu,%lu," : ", \"samples\": %lu, \"non_finite\": %lu, \"min\": ", ch->samples, ch->non_finite);
+        put_double(fp, ch->n ? ch->min : nan, outc->csv);
+        fprintf(fp, outc->csv ? "," : ", \"max\": ");
+        put_double(fp, ch->n ? ch->max : nan, outc->csv);
+        fprintf(fp, outc->csv ? "," : ", \"mean\": ");
+        put_double(fp, ch->n ? ch->mean : nan, outc->csv);
+        fprintf(fp, outc->csv ? "," : ", \"rms\": ");
+        put_double(fp, ch->n ? sqrt(ch->mean * ch->mean + ch->m2 / ch->n) : nan, outc->csv);
+        fprintf(fp, outc->csv ? "," : ", \"stddev\": ");
+        put_double(fp, ch->n ? sqrt(ch->m2 / ch->n) : nan, outc->csv);
+        fprintf(fp, outc->csv ? ",%lu,%lu," : ",\n     \"below_floor\": %lu, \"above_ceil\": %lu, \"hist_low\": ", ch->below, ch->above);
+        put_double(fp, ch->n ? ch->hist_low : nan, outc->csv);
+        fprintf(fp, outc->csv ? "," : ", \"hist_width\": ");
+        put_double(fp, ch->n ? ch->hist_width : nan, outc->csv);
+        if (!outc->csv)
+            fprintf(fp, ",\n     \"hist\": [");
+        for (k = 0; k < outc->bins; k++)
+            fprintf(fp, "%s%lu", (outc->csv || k) ? sep : "", ch->hist[k]);
+        if (outc->csv)
+            fprintf(fp, "\n");
+        else
+            fprintf(fp, "]}%s\n", (i + 1 < outc->channels->len) ? "," : "");
+    }
+
+    if (!outc->csv)
+        fprintf(fp, "  ]\n}\n");
+
+    if (fclose(fp)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        receive_analog(outc, analog->data, analog->num_samples);
+        break;
+    case SR_DF_FRAME_END:
+        channel_end(outc);
+        break;
+    case SR_DF_END:
+        return write_stats(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"format", "format", "'json', 'csv' or 'auto' to pick csv for .csv file names", NULL, NULL},
+    {"bins", "bins", "number of histogram bins", NULL, NULL},
+    {"calib_file", "Calibration file", "ini file with the r_oob_floor and r_oob_ceil clipping limits", NULL, NULL},
+    {"floor", "floor", "clipping floor in volts, overrides the calibration file", NULL, NULL},
+    {"ceil", "ceil", "clipping ceiling in volts, overrides the calibration file", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string("auto"));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(64));
+        options[2].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(NAN));
+        options[4].def = g_variant_ref_sink(g_variant_new_double(NAN));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    struct stats_channel *ch;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        for (i = 0; i < outc->channels->len; i++) {
+            ch = &g_array_index(outc->channels, struct stats_channel, i);
+            g_free(ch->name);
+            g_free(ch->hist);
+        }
+        g_array_free(outc->channels, TRUE);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_stats = {
+    .id = "stats",
+    .name = "stats",
+    .desc = "per channel statistics and histogram as JSON or CSV",
+    .exts = (const char *[]) {"json", "csv", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_STATS_H__
+#define __OUTPUT_STATS_H__
+
+extern struct sr_output_module output_stats;
+
+#endif
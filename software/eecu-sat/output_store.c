@@ -0,0 +1,308 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "input.h"
+#include "store.h"
+#include "output.h"
+
+#define  STORE_MAX_BLOCK_SAMPLES  (16 * 1024 * 1024)
+
+struct out_context {
+    uint32_t block_samples;
+    FILE *fp;
+    uint64_t offset;            // end of the data written so far
+    GArray *channels;           // struct store_channel
+    GArray *blocks;             // struct store_block
+    float *block;               // samples waiting for a full block
+    ssize_t block_cnt;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    uint32_t block_samples;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    block_samples = g_variant_get_uint32(g_hash_table_lookup(options, "block"));
+    if ((block_samples < 1) || (block_samples > STORE_MAX_BLOCK_SAMPLES)) {
+        err_msg("%s:%d the block size must be between 1 and %d samples", __FILE__, __LINE__, STORE_MAX_BLOCK_SAMPLES);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->block_samples = block_samples;
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct store_channel));
+    outc->blocks = g_array_new(FALSE, TRUE, sizeof(struct store_block));
+    outc->block = g_malloc(outc->block_samples * sizeof(float));
+
+    return SR_OK;
+}
+
+// pad the file with zeroes up to the next STORE_ALIGN boundary
+static int pad(struct out_context *outc)
+{
+    static const uint8_t zero[STORE_ALIGN] = { 0 };
+    size_t len = (STORE_ALIGN - outc->offset % STORE_ALIGN) % STORE_ALIGN;
+
+    if (fwrite(zero, 1, len, outc->fp) != len) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    outc->offset += len;
+
+    return SR_OK;
+}
+
+static void block_range(const float *x, const ssize_t n, float *min, float *max)
+{
+    float lo = x[0], hi = x[0];
+    bool nan = false;
+    ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        nan |= isnan(x[i]);
+        lo = (x[i] < lo) ? x[i] : lo;
+        hi = (x[i] > hi) ? x[i] : hi;
+    }
+
+    // a NaN is neither above nor below a level, so such blocks are never skipped
+    *min = nan ? NAN : lo;
+    *max = nan ? NAN : hi;
+}
+
+static int write_block(struct out_context *outc)
+{
+    struct store_channel *ch;
+    struct store_block b;
+    float min, max;
+    int ret;
+
+    if (!outc->block_cnt)
+        return SR_OK;
+
+    if ((ret = pad(outc)) != SR_OK)
+        return ret;
+
+    ch = &g_array_index(outc->channels, struct store_channel, outc->channels->len - 1);
+    b.offset = outc->offset;
+    b.first_sample = ch->num_samples;
+    b.num_samples = outc->block_cnt;
+    b.channel = outc->channels->len - 1;
+    block_range(outc->block, outc->block_cnt, &min, &max);
+    b.min = min;
+    b.max = max;
+
+    if (fwrite(outc->block, sizeof(float), outc->block_cnt, outc->fp) != outc->block_cnt) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    outc->offset += outc->block_cnt * sizeof(float);
+    g_array_append_val(outc->blocks, b);
+
+    ch->num_blocks++;
+    ch->num_samples += outc->block_cnt;
+    outc->block_cnt = 0;
+
+    return SR_OK;
+}
+
+static int channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct store_channel ch = { 0 };
+    struct store_hdr hdr = { 0 };
+    char *name;
+    GSList *l;
+
+    if (!outc->fp) {
+        if (!(outc->fp = fopen(o->filename, "wb"))) {
+            err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        // the real header is written once the index is known
+        if (fwrite(&hdr, 1, STORE_HDR_SIZE, outc->fp) != STORE_HDR_SIZE) {
+            err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+        outc->offset = STORE_HDR_SIZE;
+    }
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    ch.first_block = outc->blocks->len;
+    ch.sample_rate = frame->samplerate;
+    ch.downsample = 1;
+    if (l) {
+        name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+        // not terminated if the name fills the field
+        memcpy(ch.name, name, MIN(strlen(name), sizeof(ch.name)));
+        g_free(name);
+        if (sat_input_has_header(ch_data_ptr)) {
+            ch.begin_time = ch_data_ptr->header.begin_time;
+            // keep the original rate description unless a transform changed the rate
+            if (frame->samplerate == ch_data_ptr->samplerate) {
+                ch.sample_rate = ch_data_ptr->header.sample_rate;
+                ch.downsample = ch_data_ptr->header.downsample;
+            }
+        }
+    }
+    g_array_append_val(outc->channels, ch);
+    outc->block_cnt = 0;
+
+    return SR_OK;
+}
+
+// write the index and point the header at it
+static int finish(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    struct store_hdr hdr = { 0 };
+    int ret;
+
+    if (!outc->fp)
+        return SR_OK;
+
+    if ((ret = pad(outc)) != SR_OK)
+        return ret;
+
+    memcpy(hdr.identifier, STORE_MAGIC, 8);
+    hdr.block_samples = outc->block_samples;
+    hdr.num_channels = outc->channels->len;
+    hdr.num_blocks = outc->blocks->len;
+    hdr.index_offset = outc->offset;
+
+    if ((fwrite(outc->channels->data, STORE_CHANNEL_SIZE, hdr.num_channels, outc->fp) != hdr.num_channels) ||
+        (fwrite(outc->blocks->data, STORE_BLOCK_SIZE, hdr.num_blocks, outc->fp) != hdr.num_blocks) ||
+        (fseek(outc->fp, 0, SEEK_SET) < 0) || (fwrite(&hdr, 1, STORE_HDR_SIZE, outc->fp) != STORE_HDR_SIZE)) {
+        err_msg("%s:%d while writing the index", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+
+    if (fclose(outc->fp) && (ret == SR_OK)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+    outc->fp = NULL;
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    const float *data;
+    ssize_t i, n;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        data = analog->data;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o)) != SR_OK))
+            return ret;
+
+        for (i = 0; i < analog->num_samples; i += n) {
+            n = MIN(analog->num_samples - i, outc->block_samples - outc->block_cnt);
+            memcpy(outc->block + outc->block_cnt, data + i, n * sizeof(float));
+            outc->block_cnt += n;
+            if ((outc->block_cnt == outc->block_samples) && ((ret = write_block(outc)) != SR_OK))
+                return ret;
+        }
+        break;
+    case SR_DF_FRAME_END:
+        // a partial block is left at the end of the channel
+        return write_block(outc);
+    case SR_DF_END:
+        return finish(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"block", "block", "number of samples in a column block", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(65536));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp)
+            fclose(outc->fp);
+        g_array_free(outc->channels, TRUE);
+        g_array_free(outc->blocks, TRUE);
+        g_free(outc->block);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_store = {
+    .id = "store",
+    .name = "store",
+    .desc = "columnar capture store with a block index",
+    .exts = (const char *[]) {"sts", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
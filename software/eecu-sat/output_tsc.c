@@ -0,0 +1,240 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include "proj.h"
+#include "error.h"
+#include "input.h"
+#include "tsc.h"
+#include "output.h"
+
+struct out_context {
+    uint32_t block_samples;
+    struct tsc_coder *coder;
+    float *block;               // samples waiting for a full block
+    ssize_t block_cnt;
+    uint8_t *coded;
+    // current channel
+    FILE *fp;
+    struct tsc_hdr hdr;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    uint32_t block_samples;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    block_samples = g_variant_get_uint32(g_hash_table_lookup(options, "block"));
+    if ((block_samples < 1) || (block_samples > TSC_BLOCK_SAMPLES_MAX)) {
+        err_msg("%s:%d the block size must be between 1 and %d samples", __FILE__, __LINE__, TSC_BLOCK_SAMPLES_MAX);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->block_samples = block_samples;
+    outc->coder = tsc_coder_new(block_samples);
+    outc->block = g_malloc(outc->block_samples * sizeof(float));
+    outc->coded = g_malloc(TSC_MAX_BYTES(outc->block_samples));
+
+    return SR_OK;
+}
+
+static int write_block(struct out_context *outc)
+{
+    struct tsc_block_hdr bh;
+    ssize_t len;
+
+    if (!outc->block_cnt)
+        return SR_OK;
+
+    if ((len = tsc_encode(outc->coder, outc->block, outc->block_cnt, outc->coded)) < 0)
+        return len;
+
+    bh.num_samples = outc->block_cnt;
+    bh.byte_len = len;
+    if ((fwrite(&bh, 1, TSC_BLOCK_HDR_SIZE, outc->fp) != TSC_BLOCK_HDR_SIZE) ||
+        (fwrite(outc->coded, 1, len, outc->fp) != len)) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    outc->hdr.num_samples += outc->block_cnt;
+    outc->hdr.num_blocks++;
+    outc->block_cnt = 0;
+
+    return SR_OK;
+}
+
+static int channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    char *filename;
+    GSList *l;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    memset(&outc->hdr, 0, TSC_HDR_SIZE);
+    memcpy(outc->hdr.identifier, TSC_MAGIC, 8);
+    outc->hdr.block_samples = outc->block_samples;
+    outc->hdr.sample_rate = frame->samplerate;
+    outc->hdr.downsample = 1;
+    if (l && sat_input_has_header(ch_data_ptr)) {
+        outc->hdr.begin_time = ch_data_ptr->header.begin_time;
+        // keep the original rate description unless a transform changed the rate
+        if (frame->samplerate == ch_data_ptr->samplerate) {
+            outc->hdr.sample_rate = ch_data_ptr->header.sample_rate;
+            outc->hdr.downsample = ch_data_ptr->header.downsample;
+        }
+    }
+    outc->block_cnt = 0;
+
+    filename = g_strdup_printf("%s%d.tsc", o->filename, frame->ch);
+    outc->fp = fopen(filename, "wb");
+    g_free(filename);
+    if (!outc->fp) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    if (fwrite(&outc->hdr, 1, TSC_HDR_SIZE, outc->fp) != TSC_HDR_SIZE) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    return SR_OK;
+}
+
+static int channel_end(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    int ret;
+
+    if (!outc->fp)
+        return SR_OK;
+
+    // a partial block is left at the end of the channel
+    if ((ret = write_block(outc)) == SR_OK) {
+        if ((fseek(outc->fp, TSC_HDR_SC_POS, SEEK_SET) < 0) ||
+            (fwrite(&outc->hdr.num_samples, 1, 2 * sizeof(uint64_t), outc->fp) != 2 * sizeof(uint64_t))) {
+            err_msg("%s:%d while updating the header", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+        }
+    }
+    fclose(outc->fp);
+    outc->fp = NULL;
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    const float *data;
+    ssize_t i, n;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        data = analog->data;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o)) != SR_OK))
+            return ret;
+
+        for (i = 0; i < analog->num_samples; i += n) {
+            n = MIN(analog->num_samples - i, outc->block_samples - outc->block_cnt);
+            memcpy(outc->block + outc->block_cnt, data + i, n * sizeof(float));
+            outc->block_cnt += n;
+            if ((outc->block_cnt == outc->block_samples) && ((ret = write_block(outc)) != SR_OK))
+                return ret;
+        }
+        break;
+    case SR_DF_FRAME_END:
+        return channel_end(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"block", "block", "number of samples in an independently decodable block", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(8192));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->fp)
+            fclose(outc->fp);
+        tsc_coder_free(outc->coder);
+        g_free(outc->block);
+        g_free(outc->coded);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_tsc = {
+    .id = "tsc",
+    .name = "tsc",
+    .desc = "one channel per file, lossless time-series codec",
+    .exts = (const char *[]) {"tsc", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
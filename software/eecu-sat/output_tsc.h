@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_TSC_H__
+#define __OUTPUT_TSC_H__
+
+extern struct sr_output_module output_tsc;
+
+#endif
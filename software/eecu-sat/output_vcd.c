@@ -0,0 +1,566 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include "proj.h"
+#include "error.h"
+#include "dsp.h"
+#include "fmt.h"
+#include "threshold.h"
+#include "output.h"
+
+/*
+ * value change dump of thresholded channels.
+ *
+ * every channel is reduced to its list of transitions while it streams by,
+ * an entry holds the sample index shifted left by one and the new level in
+ * bit 0. the lists of all channels are appended to one buffer, once the
+ * buffer is full its content is spilled into a temporary file next to the
+ * output. at the end of the session the lists, each one sorted by time, are
+ * merged through a binary heap into the time ordered VCD body.
+ */
+
+#define  VCD_READ_BLOCK  4096   // entries read ahead per channel during the merge
+#define  VCD_BUF_SIZE    (1024 * 1024)
+#define  VCD_ID_MAX      4      // enough for 94^4 channels
+#define  VCD_MAX_DECIMALS  15   // femtoseconds
+
+struct vcd_channel {
+    char *name;
+    uint64_t samplerate;
+    uint64_t first;             // first entry of the channel
+    uint64_t cnt;               // number of entries
+    ssize_t samples;
+};
+
+struct out_context {
+    struct sat_levels lv;
+    uint32_t ch_cnt;
+    uint64_t state;             // hysteresis state of the current channel
+    bool active;                // the current channel is exported
+    GArray *channels;           // struct vcd_channel
+    uint64_t *mem;              // entries that were not spilled yet
+    size_t mem_cnt;
+    size_t mem_max;
+    int spool_fd;
+    uint64_t spilled;           // entries in the spool file
+};
+
+struct vcd_time {
+    uint64_t samplerate;
+    uint64_t mul;               // time units per sample, 0 if the rate does not divide 10^decimals
+};
+
+struct vcd_stream {
+    uint32_t ch;
+    uint64_t next;              // next entry to fetch
+    uint64_t end;
+    uint64_t *buf;
+    uint32_t pos;
+    uint32_t cnt;
+    struct vcd_time t;
+    uint64_t time;              // of the current entry
+    uint8_t value;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    struct sat_levels lv;
+    double hyst;
+    uint32_t buffer;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    hyst = g_variant_get_double(g_hash_table_lookup(options, "hyst"));
+    if (hyst < 0) {
+        err_msg("%s:%d the hysteresis can not be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    buffer = g_variant_get_uint32(g_hash_table_lookup(options, "buffer"));
+    if (buffer < 1) {
+        err_msg("%s:%d the transition buffer needs at least 1 KiB", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (sat_levels_parse(&lv, g_slist_length(o->sdi->channels), g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL),
+                     g_variant_get_double(g_hash_table_lookup(options, "level")), hyst) != SR_OK) {
+        sat_levels_free(&lv);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->lv = lv;
+    outc->ch_cnt = g_slist_length(o->sdi->channels);
+    outc->spool_fd = -1;
+    outc->mem_max = (size_t) buffer * 1024 / sizeof(uint64_t);
+    outc->mem = g_malloc(outc->mem_max * sizeof(uint64_t));
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct vcd_channel));
+
+    return SR_OK;
+}
+
+// move the buffered entries into the spool file
+static int spill(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    char *spool_name;
+    size_t len, done;
+    ssize_t ret;
+
+    if (outc->spool_fd < 0) {
+        // the spool file is unlinked right away, it goes away together with the descriptor
+        spool_name = g_strdup_printf("%s.spool", o->filename);
+        outc->spool_fd = open(spool_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (outc->spool_fd >= 0)
+            unlink(spool_name);
+        g_free(spool_name);
+        if (outc->spool_fd < 0) {
+            err_msg("%s:%d opening the spool file", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    }
+
+    len = outc->mem_cnt * sizeof(uint64_t);
+    for (done = 0; done < len; done += ret) {
+        if ((ret = write(outc->spool_fd, (uint8_t *) outc->mem + done, len - done)) <= 0) {
+            err_msg("%s:%d during write()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    }
+    outc->spilled += outc->mem_cnt;
+    outc->mem_cnt = 0;
+
+    return SR_OK;
+}
+
+static int add_entry(const struct sr_output *o, const uint64_t sample, const uint64_t value)
+{
+    struct out_context *outc = o->priv;
+    int ret;
+
+    if ((outc->mem_cnt == outc->mem_max) && ((ret = spill(o)) != SR_OK))
+        return ret;
+    outc->mem[outc->mem_cnt++] = (sample << 1) | value;
+    g_array_index(outc->channels, struct vcd_channel, outc->channels->len - 1).cnt++;
+
+    return SR_OK;
+}
+
+static void channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    ch_data_t *ch_data_ptr = NULL;
+    struct vcd_channel ch = { 0 };
+    GSList *l;
+    char *p;
+
+    outc->active = (frame->ch <= outc->ch_cnt) && outc->lv.selected[frame->ch];
+    if (!outc->active)
+        return;
+
+    for (l = o->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == frame->ch)
+            break;
+    }
+
+    if (l)
+        ch.name = ch_data_ptr->channel_name ? g_strdup(ch_data_ptr->channel_name) : g_path_get_basename(ch_data_ptr->input_file_name);
+    else
+        ch.name = g_strdup_printf("ch%d", frame->ch);
+    // VCD references end at the first whitespace
+    for (p = ch.name; *p; p++) {
+        if ((*p == ' ') || (*p == '\t'))
+            *p = '_';
+    }
+    ch.samplerate = frame->samplerate;
+    ch.first = outc->spilled + outc->mem_cnt;
+    g_array_append_val(outc->channels, ch);
+}
+
+static int threshold(const struct sr_output *o, const float *samples, const ssize_t num_samples)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    struct vcd_channel *ch = &g_array_index(outc->channels, struct vcd_channel, outc->channels->len - 1);
+    const float high = outc->lv.high[frame->ch];
+    const float low = outc->lv.low[frame->ch];
+    uint64_t word, prev, changes;
+    ssize_t i, pos;
+    int n, b, ret;
+
+    for (i = 0; i < num_samples; i += 64) {
+        n = MIN(64, num_samples - i);
+        pos = ch->samples + i;
+        if (!pos)
+            outc->state = samples[0] > (low + high) / 2;
+        prev = outc->state;
+        word = dsp_threshold_word(samples + i, n, low, high, &outc->state);
+        // the level at the first sample is always recorded
+        if (!pos) {
+            if ((ret = add_entry(o, 0, word & 1)) != SR_OK)
+                return ret;
+            prev = word & 1;
+        }
+        changes = word ^ ((word << 1) | prev);
+        if (n < 64)
+            changes &= (UINT64_C(1) << n) - 1;
+        while (changes) {
+            b = __builtin_ctzll(changes);
+            if ((ret = add_entry(o, pos + b, (word >> b) & 1)) != SR_OK)
+                return ret;
+            changes &= changes - 1;
+        }
+    }
+    ch->samples += num_samples;
+
+    return SR_OK;
+}
+
+static uint64_t to_time(const struct vcd_time *t, const uint64_t sample)
+{
+    if (t->mul)
+        return sample * t->mul;
+
+    // nanoseconds
+    return (sample / t->samplerate) * 1000000000 + ((sample % t->samplerate) * 1000000000 + t->samplerate / 2) / t->samplerate;
+}
+
+// the shortest time unit that holds every sample period exactly, or 1ns
+static uint32_t time_decimals(struct out_context *outc)
+{
+    struct vcd_channel *ch;
+    uint64_t p = 1;
+    uint32_t d, i;
+
+    for (d = 0; d <= VCD_MAX_DECIMALS; d++, p *= 10) {
+        for (i = 0; i < outc->channels->len; i++) {
+            ch = &g_array_index(outc->channels, struct vcd_channel, i);
+            if (ch->samplerate && (p % ch->samplerate))
+                break;
+        }
+        if (i == outc->channels->len)
+            return d;
+    }
+
+    return 9;
+}
+
+static void time_init(struct vcd_time *t, const uint64_t samplerate, const uint32_t decimals)
+{
+    uint64_t p = 1;
+    uint32_t d;
+
+    for (d = 0; d < decimals; d++)
+        p *= 10;
+
+    // without a sample rate the samples are counted in time units
+    t->samplerate = samplerate ? samplerate : p;
+    t->mul = p % t->samplerate ? 0 : p / t->samplerate;
+}
+
+static int stream_fill(struct out_context *outc, struct vcd_stream *s)
+{
+    uint64_t cnt = MIN(VCD_READ_BLOCK, s->end - s->next);
+    ssize_t len;
+
+    if (s->next < outc->spilled) {
+        cnt = MIN(cnt, outc->spilled - s->next);
+        len = pread(outc->spool_fd, s->buf, cnt * sizeof(uint64_t), s->next * sizeof(uint64_t));
+        if (len != cnt * sizeof(uint64_t)) {
+            err_msg("%s:%d during pread()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    } else {
+        memcpy(s->buf, outc->mem + (s->next - outc->spilled), cnt * sizeof(uint64_t));
+    }
+    s->next += cnt;
+    s->pos = 0;
+    s->cnt = cnt;
+
+    return SR_OK;
+}
+
+// load the next entry of a stream, *more is cleared at its end
+static int stream_next(struct out_context *outc, struct vcd_stream *s, bool *more)
+{
+    uint64_t e;
+    int ret;
+
+    *more = false;
+    if (s->pos == s->cnt) {
+        if (s->next == s->end)
+            return SR_OK;
+        if ((ret = stream_fill(outc, s)) != SR_OK)
+            return ret;
+    }
+    e = s->buf[s->pos++];
+    s->time = to_time(&s->t, e >> 1);
+    s->value = e & 1;
+    *more = true;
+
+    return SR_OK;
+}
+
+static bool stream_before(const struct vcd_stream *a, const struct vcd_stream *b)
+{
+    return (a->time < b->time) || ((a->time == b->time) && (a->ch < b->ch));
+}
+
+static void heap_down(struct vcd_stream **heap, const uint32_t n, uint32_t i)
+{
+    struct vcd_stream *tmp;
+    uint32_t c;
+
+    while ((c = 2 * i + 1) < n) {
+        if ((c + 1 < n) && stream_before(heap[c + 1], heap[c]))
+            c++;
+        if (!stream_before(heap[c], heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[c];
+        heap[c] = tmp;
+        i = c;
+    }
+}
+
+static size_t put_id(char *dst, uint32_t idx)
+{
+    size_t n = 0;
+
+    do {
+        dst[n++] = '!' + idx % 94;
+        idx /= 94;
+    } while (idx);
+
+    return n;
+}
+
+static int flush(FILE *fp, const char *buf, size_t *len)
+{
+    if (fwrite(buf, 1, *len, fp) != *len) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    *len = 0;
+
+    return SR_OK;
+}
+
+static int write_vcd(const struct sr_output *o)
+{
+    static const char *units[] = { "s", "ms", "us", "ns", "ps", "fs" };
+    struct out_context *outc = o->priv;
+    const uint32_t num_ch = outc->channels->len;
+    struct vcd_stream *streams, **heap, *s;
+    struct vcd_channel *ch;
+    uint32_t decimals, i, n = 0, mag;
+    uint64_t now = 0, end = 0;
+    size_t len = 0;
+    bool more, dumpvars = true;
+    char *buf;
+    FILE *fp;
+    int ret = SR_OK;
+
+    if (!(fp = fopen(o->filename, "w"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    decimals = time_decimals(outc);
+    for (mag = 1, i = 0; i < (3 - decimals % 3) % 3; i++)
+        mag *= 10;
+    fprintf(fp, "$timescale %u %s $end\n$scope module capture $end\n", mag, units[(decimals + 2) / 3]);
+
+    buf = g_malloc(VCD_BUF_SIZE);
+    streams = g_malloc0(num_ch * sizeof(struct vcd_stream));
+    heap = g_malloc(num_ch * sizeof(struct vcd_stream *));
+    for (i = 0; i < num_ch; i++) {
+        ch = &g_array_index(outc->channels, struct vcd_channel, i);
+        len = put_id(buf, i);
+        buf[len] = 0;
+        fprintf(fp, "$var wire 1 %s %s $end\n", buf, ch->name);
+
+        s = &streams[i];
+        s->ch = i;
+        s->next = ch->first;
+        s->end = ch->first + ch->cnt;
+        s->buf = g_malloc(VCD_READ_BLOCK * sizeof(uint64_t));
+        time_init(&s->t, ch->samplerate, decimals);
+        end = MAX(end, to_time(&s->t, ch->samples));
+        if ((ret = stream_next(outc, s, &more)) != SR_OK)
+            goto cleanup;
+        if (more)
+            heap[n++] = s;
+    }
+    fprintf(fp, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    len = 0;
+
+    for (i = n / 2; i-- > 0;)
+        heap_down(heap, n, i);
+
+    // every channel starts with an entry at time 0, those form the initial values
+    while (n) {
+        if (VCD_BUF_SIZE - len < FMT_INT_MAX + VCD_ID_MAX + 8) {
+            if ((ret = flush(fp, buf, &len)) != SR_OK)
+                goto cleanup;
+        }
+        s = heap[0];
+        if (s->time != now) {
+            if (dumpvars) {
+                memcpy(buf + len, "$end\n", 5);
+                len += 5;
+                dumpvars = false;
+            }
+            buf[len++] = '#';
+            len += fmt_uint(buf + len, s->time);
+            buf[len++] = '\n';
+            now = s->time;
+        }
+        buf[len++] = '0' + s->value;
+        len += put_id(buf + len, s->ch);
+        buf[len++] = '\n';
+
+        if ((ret = stream_next(outc, s, &more)) != SR_OK)
+            goto cleanup;
+        if (!more)
+            heap[0] = heap[--n];
+        heap_down(heap, n, 0);
+    }
+    if (dumpvars) {
+        memcpy(buf + len, "$end\n", 5);
+        len += 5;
+    }
+
+    // mark the end of the capture
+    if (end > now) {
+        buf[len++] = '#';
+        len += fmt_uint(buf + len, end);
+        buf[len++] = '\n';
+    }
+    ret = flush(fp, buf, &len);
+
+ cleanup:
+    if (fclose(fp) && (ret == SR_OK)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+    for (i = 0; i < num_ch; i++)
+        g_free(streams[i].buf);
+    g_free(streams);
+    g_free(heap);
+    g_free(buf);
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if (frame->chunk == 1)
+            channel_begin(o);
+        if (!outc->active)
+            break;
+        return threshold(o, analog->data, analog->num_samples);
+    case SR_DF_END:
+        if (!outc->channels->len)
+            return SR_OK;
+        return write_vcd(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"channels", "channels", "comma separated list of channels to export, CH[@LEVEL], all channels if empty", NULL, NULL},
+    {"level", "level", "default threshold level in volts", NULL, NULL},
+    {"hyst", "hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"buffer", "buffer", "KiB of transitions kept in memory before they are spilled to disk", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0.2));
+        options[3].def = g_variant_ref_sink(g_variant_new_uint32(65536));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+    uint32_t i;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->spool_fd >= 0)
+            close(outc->spool_fd);
+        for (i = 0; i < outc->channels->len; i++)
+            g_free(g_array_index(outc->channels, struct vcd_channel, i).name);
+        g_array_free(outc->channels, TRUE);
+        g_free(outc->mem);
+        sat_levels_free(&outc->lv);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_vcd = {
+    .id = "vcd",
+    .name = "vcd",
+    .desc = "value change dump of thresholded channels",
+    .exts = (const char *[]) {"vcd", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_VCD_H__
+#define __OUTPUT_VCD_H__
+
+extern struct sr_output_module output_vcd;
+
+#endif
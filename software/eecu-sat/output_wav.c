@@ -0,0 +1,468 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "output.h"
+
+/*
+ * multichannel WAV file, one interleaved frame per sample period.
+ *
+ * the session delivers one channel after the other, so the exported
+ * channels are spooled into a temporary file next to the output. once all
+ * of them are known they are read back WAV_PASS_FRAMES at a time and
+ * transposed into frames in tiles of WAV_TILE_FRAMES, which keeps both the
+ * source columns and the destination frames of a tile in the L1 cache.
+ * files with more than 4GiB of samples are written as RF64 (EBU Tech 3306).
+ */
+
+#define  WAV_PASS_FRAMES  16384
+#define  WAV_TILE_FRAMES  64
+#define  WAV_FORMAT_PCM   0x0001
+#define  WAV_FORMAT_FLOAT 0x0003
+#define  WAV_FORMAT_EXTENSIBLE  0xfffe
+
+struct __attribute__((packed)) wav_fmt {
+    uint16_t format_tag;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint16_t ext_size;
+    uint16_t valid_bits;
+    uint32_t channel_mask;
+    uint16_t sub_format;        // followed by the rest of the KSDATAFORMAT_SUBTYPE guid
+    uint8_t guid[14];
+}; // 40bytes
+
+struct __attribute__((packed)) wav_ds64 {
+    uint64_t riff_size;
+    uint64_t data_size;
+    uint64_t sample_count;
+    uint32_t table_length;
+}; // 28bytes
+
+struct wav_channel {
+    uint64_t samplerate;
+    off_t offset;               // first sample in the spool file
+    ssize_t samples;
+};
+
+struct out_context {
+    bool *selected;             // indexed by channel id
+    uint32_t ch_cnt;
+    bool pcm16;
+    double fullscale;           // volts that map onto the largest PCM code, 0 for auto
+    bool active;                // the current channel is exported
+    GArray *channels;           // struct wav_channel
+    FILE *spool;
+    off_t spool_len;
+    float peak;                 // largest magnitude of all exported samples
+};
+
+static int channels_parse(bool *selected, const uint32_t ch_cnt, const char *spec)
+{
+    gchar **tokens;
+    uint32_t i, id;
+    int ret = SR_OK;
+
+    // all channels unless a list is given
+    if (!spec[0]) {
+        for (id = 1; id <= ch_cnt; id++)
+            selected[id] = true;
+        return SR_OK;
+    }
+
+    tokens = g_strsplit(spec, ",", 0);
+    for (i = 0; tokens[i]; i++) {
+        if (!tokens[i][0])
+            continue;
+        id = strtoul(tokens[i], NULL, 10);
+        if ((id < 1) || (id > ch_cnt)) {
+            err_msg("%s:%d channel '%s' does not exist", __FILE__, __LINE__, tokens[i]);
+            ret = SR_ERR_ARG;
+            break;
+        }
+        selected[id] = true;
+    }
+    g_strfreev(tokens);
+
+    return ret;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+    struct out_context *outc;
+    const char *format;
+    uint32_t ch_cnt;
+    double fullscale;
+    bool *selected;
+
+    if (!o || !options)
+        return SR_ERR_ARG;
+
+    format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+    if (strcmp(format, "float") && strcmp(format, "pcm16")) {
+        err_msg("%s:%d the sample format must be either 'float' or 'pcm16'", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    fullscale = g_variant_get_double(g_hash_table_lookup(options, "fullscale"));
+    if (fullscale < 0) {
+        err_msg("%s:%d the full scale can not be negative", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    ch_cnt = g_slist_length(o->sdi->channels);
+    selected = g_malloc0((ch_cnt + 1) * sizeof(bool));
+    if (channels_parse(selected, ch_cnt, g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL)) != SR_OK) {
+        g_free(selected);
+        return SR_ERR_ARG;
+    }
+
+    outc = (struct out_context *)g_malloc0(sizeof(struct out_context));
+    o->priv = outc;
+
+    outc->selected = selected;
+    outc->ch_cnt = ch_cnt;
+    outc->pcm16 = !strcmp(format, "pcm16");
+    outc->fullscale = fullscale;
+    outc->channels = g_array_new(FALSE, TRUE, sizeof(struct wav_channel));
+
+    return SR_OK;
+}
+
+static int channel_begin(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    struct wav_channel ch = { 0 };
+    char *spool_name;
+
+    outc->active = (frame->ch <= outc->ch_cnt) && outc->selected[frame->ch];
+    if (!outc->active)
+        return SR_OK;
+
+    if (!outc->spool) {
+        // the spool file is unlinked right away, it goes away together with the descriptor
+        spool_name = g_strdup_printf("%s.spool", o->filename);
+        outc->spool = fopen(spool_name, "w+b");
+        if (outc->spool)
+            unlink(spool_name);
+        g_free(spool_name);
+        if (!outc->spool) {
+            err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+            return SR_ERR_IO;
+        }
+    }
+
+    ch.samplerate = frame->samplerate;
+    ch.offset = outc->spool_len;
+    if (outc->channels->len && (g_array_index(outc->channels, struct wav_channel, 0).samplerate != ch.samplerate))
+        err_msg("warning: channel %d has a different sample rate, the file uses the rate of the first channel\n", frame->ch);
+    g_array_append_val(outc->channels, ch);
+
+    return SR_OK;
+}
+
+static int spool(struct out_context *outc, const float *data, const ssize_t num_samples)
+{
+    struct wav_channel *ch = &g_array_index(outc->channels, struct wav_channel, outc->channels->len - 1);
+    float peak = outc->peak;
+    ssize_t i;
+
+    if (fwrite(data, sizeof(float), num_samples, outc->spool) != num_samples) {
+        err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+    ch->samples += num_samples;
+    outc->spool_len += num_samples * sizeof(float);
+
+    // the automatic PCM scale needs the peak of all channels
+    if (outc->pcm16 && !outc->fullscale) {
+        for (i = 0; i < num_samples; i++)
+            peak = (fabsf(data[i]) > peak) ? fabsf(data[i]) : peak;
+        outc->peak = peak;
+    }
+
+    return SR_OK;
+}
+
+// RIFF or RF64 header up to the start of the sample data
+static int write_header(const struct out_context *outc, FILE *fp, const uint64_t frames)
+{
+    // KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT only differ in the first two bytes
+    static const uint8_t guid[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+    const uint32_t num_ch = outc->channels->len;
+    const uint32_t bps = outc->pcm16 ? sizeof(int16_t) : sizeof(float);
+    const uint64_t data_size = frames * num_ch * bps;
+    struct wav_fmt fmt = { 0 };
+    struct wav_ds64 ds64 = { 0 };
+    uint32_t fmt_size, fact_size, hdr_size, u32;
+    bool rf64;
+
+    fmt.channels = num_ch;
+    fmt.sample_rate = g_array_index(outc->channels, struct wav_channel, 0).samplerate;
+    fmt.block_align = num_ch * bps;
+    fmt.byte_rate = fmt.sample_rate * fmt.block_align;
+    fmt.bits_per_sample = bps * 8;
+    fmt.format_tag = outc->pcm16 ? WAV_FORMAT_PCM : WAV_FORMAT_FLOAT;
+    // non-PCM formats have the extension size field
+    fmt_size = outc->pcm16 ? 16 : 18;
+    // more than two channels need the extensible format
+    if (num_ch > 2) {
+        fmt.sub_format = fmt.format_tag;
+        fmt.format_tag = WAV_FORMAT_EXTENSIBLE;
+        fmt.ext_size = 22;
+        fmt.valid_bits = fmt.bits_per_sample;
+        memcpy(fmt.guid, guid, sizeof(guid));
+        fmt_size = sizeof(struct wav_fmt);
+    }
+    // float files carry the number of frames in a fact chunk
+    fact_size = outc->pcm16 ? 0 : 8 + 4;
+
+    hdr_size = 12 + 8 + sizeof(ds64) + 8 + fmt_size + fact_size + 8;
+    rf64 = (data_size + hdr_size - 8 > UINT32_MAX);
+
+    ds64.riff_size = data_size + hdr_size - 8;
+    ds64.data_size = data_size;
+    ds64.sample_count = frames;
+
+    // a plain RIFF file keeps the room of the ds64 chunk as a JUNK chunk
+    u32 = rf64 ? UINT32_MAX : ds64.riff_size;
+    if (!rf64)
+        memset(&ds64, 0, sizeof(ds64));
+    if ((fwrite(rf64 ? "RF64" : "RIFF", 1, 4, fp) != 4) || (fwrite(&u32, 4, 1, fp) != 1) ||
+        (fwrite("WAVE", 1, 4, fp) != 4) || (fwrite(rf64 ? "ds64" : "JUNK", 1, 4, fp) != 4))
+        goto err;
+    u32 = sizeof(ds64);
+    if ((fwrite(&u32, 4, 1, fp) != 1) || (fwrite(&ds64, sizeof(ds64), 1, fp) != 1))
+        goto err;
+
+    if ((fwrite("fmt ", 1, 4, fp) != 4) || (fwrite(&fmt_size, 4, 1, fp) != 1) || (fwrite(&fmt, 1, fmt_size, fp) != fmt_size))
+        goto err;
+
+    if (fact_size) {
+        u32 = 4;
+        if ((fwrite("fact", 1, 4, fp) != 4) || (fwrite(&u32, 4, 1, fp) != 1))
+            goto err;
+        u32 = MIN(frames, UINT32_MAX);
+        if (fwrite(&u32, 4, 1, fp) != 1)
+            goto err;
+    }
+
+    u32 = rf64 ? UINT32_MAX : data_size;
+    if ((fwrite("data", 1, 4, fp) != 4) || (fwrite(&u32, 4, 1, fp) != 1))
+        goto err;
+
+    return SR_OK;
+
+ err:
+    err_msg("%s:%d while writing the WAV header", __FILE__, __LINE__);
+    return SR_ERR_IO;
+}
+
+// transpose a pass of columns into interleaved frames
+static void interleave(const struct out_context *outc, const float *cols, const ssize_t frames, const double scale, uint8_t *dst, ssize_t *clipped)
+{
+    const uint32_t num_ch = outc->channels->len;
+    float *f32 = (float *)dst;
+    int16_t *i16 = (int16_t *)dst;
+    const float *src;
+    ssize_t t, f, end;
+    uint32_t c;
+    double v;
+
+    for (t = 0; t < frames; t += WAV_TILE_FRAMES) {
+        end = MIN(t + WAV_TILE_FRAMES, frames);
+        for (c = 0; c < num_ch; c++) {
+            src = cols + (size_t) c * WAV_PASS_FRAMES;
+            if (!outc->pcm16) {
+                for (f = t; f < end; f++)
+                    f32[f * num_ch + c] = src[f];
+                continue;
+            }
+            for (f = t; f < end; f++) {
+                v = isnan(src[f]) ? 0 : rint(src[f] * scale);
+                if ((v > INT16_MAX) || (v < INT16_MIN)) {
+                    v = (v > 0) ? INT16_MAX : INT16_MIN;
+                    (*clipped)++;
+                }
+                i16[f * num_ch + c] = v;
+            }
+        }
+    }
+}
+
+static int write_wav(const struct sr_output *o)
+{
+    struct out_context *outc = o->priv;
+    const uint32_t num_ch = outc->channels->len;
+    const uint32_t bps = outc->pcm16 ? sizeof(int16_t) : sizeof(float);
+    struct wav_channel *ch;
+    ssize_t frames = 0, frame, pass, cnt, clipped = 0;
+    double scale = 1;
+    float *cols;
+    uint8_t *buf;
+    uint32_t i;
+    FILE *fp;
+    int ret;
+
+    for (i = 0; i < num_ch; i++)
+        frames = MAX(frames, g_array_index(outc->channels, struct wav_channel, i).samples);
+
+    if (outc->pcm16)
+        scale = INT16_MAX / (outc->fullscale ? outc->fullscale : (outc->peak ? outc->peak : 1));
+
+    if (!(fp = fopen(o->filename, "wb"))) {
+        err_msg("%s:%d during fopen()", __FILE__, __LINE__);
+        return SR_ERR_IO;
+    }
+
+    if ((ret = write_header(outc, fp, frames)) != SR_OK) {
+        fclose(fp);
+        return ret;
+    }
+
+    // channels that end early are padded with silence
+    cols = g_malloc0((size_t) num_ch * WAV_PASS_FRAMES * sizeof(float));
+    buf = g_malloc((size_t) num_ch * WAV_PASS_FRAMES * bps);
+
+    for (frame = 0; frame < frames; frame += pass) {
+        pass = MIN(WAV_PASS_FRAMES, frames - frame);
+        for (i = 0; i < num_ch; i++) {
+            ch = &g_array_index(outc->channels, struct wav_channel, i);
+            cnt = CLAMP(ch->samples - frame, 0, pass);
+            if (cnt < pass)
+                memset(cols + (size_t) i * WAV_PASS_FRAMES + cnt, 0, (pass - cnt) * sizeof(float));
+            if (cnt && ((fseeko(outc->spool, ch->offset + frame * sizeof(float), SEEK_SET) < 0) ||
+                        (fread(cols + (size_t) i * WAV_PASS_FRAMES, sizeof(float), cnt, outc->spool) != cnt))) {
+                err_msg("%s:%d while reading the spool file", __FILE__, __LINE__);
+                ret = SR_ERR_IO;
+                goto cleanup;
+            }
+        }
+
+        interleave(outc, cols, pass, scale, buf, &clipped);
+        if (fwrite(buf, num_ch * bps, pass, fp) != pass) {
+            err_msg("%s:%d during fwrite()", __FILE__, __LINE__);
+            ret = SR_ERR_IO;
+            goto cleanup;
+        }
+    }
+
+    if (clipped)
+        err_msg("warning: %ld samples were clipped to the 16bit range\n", clipped);
+
+ cleanup:
+    if (fclose(fp) && (ret == SR_OK)) {
+        err_msg("%s:%d during fclose()", __FILE__, __LINE__);
+        ret = SR_ERR_IO;
+    }
+    g_free(cols);
+    g_free(buf);
+
+    return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *pkt, GString **out)
+{
+    struct out_context *outc = o->priv;
+    const struct dev_frame *frame = o->sdi->priv;
+    const struct sr_datafeed_analog *analog;
+    int ret;
+
+    UNUSED(out);
+
+    switch (pkt->type) {
+    case SR_DF_ANALOG:
+        analog = pkt->payload;
+        if ((frame->chunk == 1) && ((ret = channel_begin(o)) != SR_OK))
+            return ret;
+        if (!outc->active)
+            break;
+        return spool(outc, analog->data, analog->num_samples);
+    case SR_DF_END:
+        if (!outc->channels->len)
+            return SR_OK;
+        return write_wav(o);
+    default:
+        break;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"channels", "channels", "comma separated list of channels to export, all channels if empty", NULL, NULL},
+    {"format", "sample format", "either 'float' or 'pcm16'", NULL, NULL},
+    {"fullscale", "full scale", "volts that map onto the largest pcm16 code, 0 for the peak of the exported channels", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[1].def = g_variant_ref_sink(g_variant_new_string("float"));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0));
+    }
+
+    return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+    struct out_context *outc;
+
+    if (o == NULL)
+        return SR_ERR_BUG;
+
+    if (o->priv) {
+        outc = o->priv;
+        if (outc->spool)
+            fclose(outc->spool);
+        g_array_free(outc->channels, TRUE);
+        g_free(outc->selected);
+        g_free(outc);
+        o->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+struct sr_output_module output_wav = {
+    .id = "wav",
+    .name = "wav",
+    .desc = "multichannel WAV or RF64 audio file",
+    .exts = (const char *[]) {"wav", NULL},
+    .flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
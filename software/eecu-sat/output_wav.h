@@ -0,0 +1,6 @@
+#ifndef __OUTPUT_WAV_H__
+#define __OUTPUT_WAV_H__
+
+extern struct sr_output_module output_wav;
+
+#endif
@@ -97,7 +97,7 @@ int parse_triggerstring(const struct sr_dev_inst *sdi, const char *s,
             ch = NULL;
             for (l = channels; l; l = l->next) {
                 ch = l->data;
-                if (strstr(ch->input_file_name, val)) {
+                if (strstr(ch->channel_name ? ch->channel_name : ch->input_file_name, val)) {
                     ch->trigger = *trigger;
                     //printf("trigger set on channel %d\n", ch->id);
                     break;
@@ -9,6 +9,7 @@
 #include "saleae.h"
 
 #define                  CHUNK_SIZE  (8 * 1024 * 1024)
+#define        TRANSFORM_BLOCK_SIZE  (64 * 1024)
 #define                 LINE_MAX_SZ  64
 #define  DEFAULT_OUTPUT_FORMAT_FILE  "srzip"
 
@@ -17,10 +18,17 @@
 struct cmdline_opt {
     char *input_prefix;
     char *input_format;
-    char *output_file;
-    char *output_format;
-    char *transform_module;
+    GSList *output_files;       // the n-th file belongs to the n-th format
+    GSList *output_formats;
+    GSList *transform_modules;
     char *triggers;
+    char *reference_prefix;     // known good capture the input is compared against
+    char *compare;              // options of the comparison
+    GSList *batch_prefixes;     // captures compared against the reference in a batch
+    GSList *golden_prefixes;    // known good captures a model is built from
+    char *model;                // options of the model
+    char *query;                // fingerprint of the capture looked up with --search
+    GSList *search_patterns;    // archived fingerprints that are ranked against the query
     bool skip_header;
     uint32_t action;
     uint32_t loglevel;
@@ -46,7 +54,11 @@ struct ch_data {
     ssize_t input_file_size;
     uint8_t sample_size;
     ssize_t sample_count;
+    uint64_t samplerate;
     struct saleae_ana_bh0 header;
+    uint16_t column;            // channel within an input file that holds several
+    uint16_t column_count;
+    char *channel_name;         // set by input files that name their channels
 };
 typedef struct ch_data ch_data_t;
 
@@ -58,6 +70,9 @@ struct sat_generic_pkt {
 struct dev_frame {
     uint16_t ch;
     uint16_t chunk;
+    uint64_t samplerate;        // of the current channel, transforms that change it update this field at SR_DF_FRAME_BEGIN
+    ssize_t seek;               // first sample of the input channel that is exported
+    bool stop;                  // set by an output to end the export after the current chunk
 };
 
 #endif
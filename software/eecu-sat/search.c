@@ -0,0 +1,156 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glob.h>
+#include "proj.h"
+#include "error.h"
+#include "fingerprint.h"
+#include "search.h"
+
+/*
+ * rank archived fingerprints by their similarity to the fingerprint of a
+ * new capture. channels are paired by id, a channel missing from either
+ * side counts as the largest distance of 1. the distance of a capture is
+ * the mean distance of its channels.
+ */
+
+struct search_hit {
+    char *file_name;
+    float distance;
+    int32_t closest;            // index of the query channel, -1 if none
+    int32_t farthest;
+};
+
+static int cmp_hits(gconstpointer a, gconstpointer b)
+{
+    const struct search_hit *left = *(struct search_hit * const *)a;
+    const struct search_hit *right = *(struct search_hit * const *)b;
+
+    if (left->distance != right->distance)
+        return left->distance < right->distance ? -1 : 1;
+    return strcmp(left->file_name, right->file_name);
+}
+
+static void hit_free(gpointer data)
+{
+    struct search_hit *hit = data;
+
+    g_free(hit->file_name);
+    g_free(hit);
+}
+
+static struct search_hit *score(const struct sat_fp *query, const struct sat_fp *fp, const char *file_name)
+{
+    struct search_hit *hit;
+    const struct sat_fp_channel *match;
+    float d, best = 2, worst = -1;
+    double sum = 0;
+    uint32_t i, k, paired = 0;
+
+    hit = g_malloc0(sizeof(struct search_hit));
+    hit->file_name = g_strdup(file_name);
+    hit->closest = hit->farthest = -1;
+
+    for (i = 0; i < query->num_channels; i++) {
+        match = NULL;
+        for (k = 0; k < fp->num_channels; k++) {
+            if (fp->ch[k].id == query->ch[i].id) {
+                match = &fp->ch[k];
+                break;
+            }
+        }
+        d = match ? sat_fp_distance(&query->ch[i], match, query->num_bands, query->num_segments) : 1;
+        paired += match ? 1 : 0;
+        sum += d;
+        if (d < best) {
+            best = d;
+            hit->closest = i;
+        }
+        if (d > worst) {
+            worst = d;
+            hit->farthest = i;
+        }
+    }
+
+    // archived channels the query lacks
+    sum += fp->num_channels - paired;
+    hit->distance = sum / MAX(1, query->num_channels + fp->num_channels - paired);
+
+    return hit;
+}
+
+int run_search(const struct cmdline_opt *opt)
+{
+    struct sat_fp *query, *fp;
+    struct search_hit *hit;
+    GPtrArray *hits;
+    glob_t g;
+    uint32_t i;
+    GSList *l;
+    int ret = SR_OK;
+
+    if (!(query = sat_fp_load(opt->query)))
+        return SR_ERR_IO;
+
+    hits = g_ptr_array_new_with_free_func(hit_free);
+    for (l = opt->search_patterns; l; l = l->next) {
+        if (glob(l->data, 0, NULL, &g))
+            continue;
+        for (i = 0; i < g.gl_pathc; i++) {
+            if (!(fp = sat_fp_load(g.gl_pathv[i])))
+                continue;
+            if ((fp->num_bands != query->num_bands) || (fp->num_segments != query->num_segments)) {
+                err_msg("warning: %s was made with %u bands and %u segments, skipped\n", g.gl_pathv[i], fp->num_bands,
+                        fp->num_segments);
+            } else {
+                if (fp->sample_rate != query->sample_rate)
+                    err_msg("warning: %s was sampled at %lu Hz, the query at %lu Hz\n", g.gl_pathv[i], fp->sample_rate,
+                            query->sample_rate);
+                g_ptr_array_add(hits, score(query, fp, g.gl_pathv[i]));
+            }
+            sat_fp_free(fp);
+        }
+        globfree(&g);
+    }
+
+    if (!hits->len) {
+        err_msg("%s:%d no fingerprints found to search", __FILE__, __LINE__);
+        ret = SR_ERR_ARG;
+        goto cleanup;
+    }
+
+    g_ptr_array_sort(hits, cmp_hits);
+    fprintf(stdout, "%4s %8s %-16s %-16s %s\n", "#", "distance", "closest", "farthest", "capture");
+    for (i = 0; i < hits->len; i++) {
+        hit = hits->pdata[i];
+        fprintf(stdout, "%4u %8.4f %-16s %-16s %s\n", i + 1, hit->distance,
+                hit->closest < 0 ? "-" : query->ch[hit->closest].name,
+                hit->farthest < 0 ? "-" : query->ch[hit->farthest].name, hit->file_name);
+    }
+
+ cleanup:
+    g_ptr_array_free(hits, TRUE);
+    sat_fp_free(query);
+
+    return ret;
+}
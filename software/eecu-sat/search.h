@@ -0,0 +1,6 @@
+#ifndef __SAT_SEARCH_H__
+#define __SAT_SEARCH_H__
+
+int run_search(const struct cmdline_opt *opt);
+
+#endif
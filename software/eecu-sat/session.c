@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <glib.h>
@@ -27,6 +28,7 @@
 #include "proj.h"
 #include "error.h"
 #include "parsers.h"
+#include "input.h"
 #include "output.h"
 #include "transform.h"
 #include "trigger.h"
@@ -111,15 +113,505 @@ const struct sr_transform *setup_transform_module(const struct sr_dev_inst *sdi,
     return t;
 }
 
-int run_session(const struct sr_dev_inst *sdi, const struct cmdline_opt *opt)
+/**
+ * Create one transform instance for every -T argument.
+ *
+ * The instances are returned as a list in command line order, which is
+ * the order in which packets are sent through them. Returns NULL if any
+ * of the modules fails to initialize.
+ */
+GSList *setup_transform_chain(const struct sr_dev_inst *sdi, GSList *opt_transform_modules)
+{
+    const struct sr_transform *t;
+    GSList *l, *chain = NULL;
+
+    for (l = opt_transform_modules; l; l = l->next) {
+        if (!(t = setup_transform_module(sdi, l->data))) {
+            sat_transform_chain_free(chain);
+            return NULL;
+        }
+        chain = g_slist_append(chain, (gpointer) t);
+    }
+
+    return chain;
+}
+
+static gboolean mixed_samplerates(const struct sr_dev_inst *sdi)
+{
+    ch_data_t *ch_data_ptr;
+    uint64_t samplerate;
+    GSList *l;
+
+    ch_data_ptr = sdi->channels->data;
+    samplerate = ch_data_ptr->samplerate;
+    for (l = sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->samplerate != samplerate)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gboolean chain_has_flag(GSList *chain, const uint64_t flag)
+{
+    const struct sr_transform *t;
+    GSList *l;
+
+    for (l = chain; l; l = l->next) {
+        t = l->data;
+        if (sat_transform_test_flag(t->module, flag))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Convert a sample count of the trigger channel into one of another
+ * channel, in case they were recorded at different sample rates.
+ */
+static ssize_t trigger_to_channel(const ssize_t samples, const ch_data_t *ch, const uint64_t trigger_rate)
+{
+    if (!trigger_rate || !ch->samplerate || (trigger_rate == ch->samplerate))
+        return samples;
+
+    return samples * ch->samplerate / trigger_rate;
+}
+
+/**
+ * Feed the channel the trigger is set on through the trigger module.
+ *
+ * buf has to hold CHUNK_SIZE bytes. trigger_rate is set to the sample
+ * rate of the trigger channel.
+ */
+int scan_trigger(const struct sr_dev_inst *sdi, const struct sat_trigger *trigger, float *buf, uint64_t *trigger_rate)
 {
+    ch_data_t *ch_data_ptr;
+    struct sat_input *in;
+    struct sr_datafeed_packet pkt = { 0 };
+    struct sr_datafeed_analog analog = { 0 };
+    ssize_t read_len, pos, range_len;
+    float min, max;
+    GSList *l;
     int ret = SR_OK;
-    const struct sr_output *o = NULL;
-    const struct sr_transform *t = NULL;
+
+    analog.data = buf;
+    pkt.payload = &analog;
+
+    for (l = sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->trigger) {
+            *trigger_rate = ch_data_ptr->samplerate;
+            if (!(in = sat_input_open(ch_data_ptr)))
+                return SR_ERR_IO;
+
+            // blocks of an indexed input that lie on one side of the level are skipped
+            pos = 0;
+            for (;;) {
+                if ((range_len = sat_input_range(in, &min, &max)) < 0) {
+                    ret = range_len;
+                    break;
+                }
+                if (range_len && sat_trigger_skip(ch_data_ptr->trigger, range_len, min, max)) {
+                    pos += range_len;
+                    if ((ret = sat_input_seek(in, pos)) != SR_OK)
+                        break;
+                    continue;
+                }
+                read_len = CHUNK_SIZE / sizeof(float);
+                if (range_len)
+                    read_len = MIN(read_len, range_len);
+                // a damaged input is an error, not the end of the channel
+                if ((read_len = sat_input_read(in, analog.data, read_len)) < 0)
+                    ret = read_len;
+                if (read_len <= 0)
+                    break;
+                pos += read_len;
+                pkt.type = SR_DF_ANALOG;
+                analog.num_samples = read_len;
+                sat_trigger_receive(ch_data_ptr->trigger, &pkt);
+            }
+            sat_input_close(in);
+            if (ret != SR_OK) {
+                err_msg("%s:%d failed to read %s", __FILE__, __LINE__, ch_data_ptr->input_file_name);
+                return ret;
+            }
+
+            if (! trigger->matches) {
+                fprintf(stdout, "warning, trigger #%d '%s' did not activate\n", trigger->id, trigger->name);
+            }
+            //sat_trigger_show(trigger);
+        }
+    }
+
+    return SR_OK;
+}
+
+/**
+ * Find the part of a channel that is exported around the trigger.
+ *
+ * Without a trigger, or if the trigger did not activate, the whole channel
+ * is used.
+ */
+void trigger_crop(const ch_data_t *ch_data_ptr, const struct sat_trigger *trigger, const uint64_t trigger_rate,
+                  ssize_t *seek, ssize_t *samples)
+{
+    ssize_t trigger_at_sample, ch_before, ch_after;
+
+    *seek = 0;
+    if (trigger && trigger->b && sat_trigger_activated(trigger)) {
+        trigger_at_sample = trigger_to_channel(sat_trigger_loc(trigger), ch_data_ptr, trigger_rate);
+        ch_before = trigger_to_channel(trigger->b, ch_data_ptr, trigger_rate);
+        ch_after = trigger_to_channel(trigger->a, ch_data_ptr, trigger_rate);
+
+        if (ch_before > trigger_at_sample) {
+            err_msg("warning: cannot read %ld samples before trigger %d at sample %ld,\n", ch_before, trigger->id, trigger_at_sample);
+            err_msg("cropping will begin at sample #0 instead!\n");
+            *samples = trigger_at_sample;
+        } else {
+            *samples = ch_before;
+            *seek = trigger_at_sample - ch_before;
+            //printf("seek to %ld - %ld\n", trigger_at_sample, ch_before);
+        }
+
+        if (trigger_at_sample + ch_after > ch_data_ptr->sample_count) {
+            err_msg("warning: cannot read %ld samples after trigger %d at sample %ld/%ld,\n", ch_after, trigger->id, trigger_at_sample, ch_data_ptr->sample_count);
+            err_msg("cropping will end at sample %ld instead!\n", ch_data_ptr->sample_count);
+            *samples += ch_data_ptr->sample_count - trigger_at_sample;
+        } else {
+            *samples += ch_after;
+        }
+        //printf("attempting to save %ld samples after sample %ld\n", after_trigger, trigger_at_sample);
+    } else {
+        *samples = ch_data_ptr->sample_count;
+    }
+}
+
+/*
+ * all outputs are fed from a single pass over the inputs. with more than one
+ * output and more than one cpu every output but the first gets a thread of
+ * its own. a packet and its buffer are shared read-only by all of them, the
+ * session waits until every output is done with a packet before the buffer
+ * is refilled.
+ */
+struct output_set;
+
+struct output_worker {
+    const struct sr_output *o;
+    struct output_set *set;
+    GThread *thread;
+    int ret;
+};
+
+struct output_set {
+    GSList *outputs;            // const struct sr_output
+    struct output_worker *workers;
+    guint worker_cnt;
+    GMutex lock;
+    GCond go;
+    GCond done;
+    const struct sr_datafeed_packet *pkt;
+    uint64_t seq;               // incremented for every packet handed out
+    guint busy;                 // workers not done with the current packet
+    bool quit;
+};
+
+static gpointer output_worker_run(gpointer data)
+{
+    struct output_worker *w = data;
+    struct output_set *set = w->set;
+    const struct sr_datafeed_packet *pkt;
+    uint64_t seq = 0;
+    int ret;
+
+    g_mutex_lock(&set->lock);
+    while (1) {
+        while (!set->quit && (set->seq == seq))
+            g_cond_wait(&set->go, &set->lock);
+        if (set->quit)
+            break;
+        seq = set->seq;
+        pkt = set->pkt;
+        g_mutex_unlock(&set->lock);
+
+        ret = w->o->module->receive(w->o, pkt, NULL);
+
+        g_mutex_lock(&set->lock);
+        w->ret = ret;
+        if (!--set->busy)
+            g_cond_signal(&set->done);
+    }
+    g_mutex_unlock(&set->lock);
+
+    return NULL;
+}
+
+static void output_set_start(struct output_set *set)
+{
+    guint i, cnt = g_slist_length(set->outputs);
+    GSList *l;
+
+    if ((cnt < 2) || (g_get_num_processors() < 2))
+        return;
+
+    g_mutex_init(&set->lock);
+    g_cond_init(&set->go);
+    g_cond_init(&set->done);
+    set->workers = g_malloc0((cnt - 1) * sizeof(struct output_worker));
+    for (i = 0, l = set->outputs->next; l; i++, l = l->next) {
+        set->workers[i].o = l->data;
+        set->workers[i].set = set;
+        set->workers[i].thread = g_thread_new("output", output_worker_run, &set->workers[i]);
+    }
+    set->worker_cnt = cnt - 1;
+}
+
+static void output_set_free(struct output_set *set)
+{
+    GSList *l;
+    guint i;
+
+    if (set->workers) {
+        g_mutex_lock(&set->lock);
+        set->quit = true;
+        g_cond_broadcast(&set->go);
+        g_mutex_unlock(&set->lock);
+        for (i = 0; i < set->worker_cnt; i++)
+            g_thread_join(set->workers[i].thread);
+        g_free(set->workers);
+        g_cond_clear(&set->done);
+        g_cond_clear(&set->go);
+        g_mutex_clear(&set->lock);
+    }
+
+    for (l = set->outputs; l; l = l->next)
+        sat_output_free(l->data);
+    g_slist_free(set->outputs);
+}
+
+/*
+ * hand a packet to every output, returns once all of them are done with it.
+ * an output that fails does not keep the packet from the others, the first
+ * error is returned.
+ */
+static int outputs_receive(struct output_set *set, const struct sr_datafeed_packet *pkt)
+{
+    const struct sr_output *o;
+    GSList *l;
+    guint i;
+    int ret = SR_OK, err;
+
+    if (!set->workers) {
+        for (l = set->outputs; l; l = l->next) {
+            o = l->data;
+            err = o->module->receive(o, pkt, NULL);
+            ret = (ret == SR_OK) ? err : ret;
+        }
+        return ret;
+    }
+
+    g_mutex_lock(&set->lock);
+    set->pkt = pkt;
+    set->seq++;
+    set->busy = set->worker_cnt;
+    g_cond_broadcast(&set->go);
+    g_mutex_unlock(&set->lock);
+
+    o = set->outputs->data;
+    ret = o->module->receive(o, pkt, NULL);
+
+    g_mutex_lock(&set->lock);
+    while (set->busy)
+        g_cond_wait(&set->done, &set->lock);
+    g_mutex_unlock(&set->lock);
+
+    for (i = 0; i < set->worker_cnt; i++) {
+        if (ret == SR_OK)
+            ret = set->workers[i].ret;
+    }
+
+    return ret;
+}
+
+struct frame_tail {
+    struct output_set *outputs;
+    struct dev_frame *frame;
+};
+
+// a chunk that a transform held back until the end of the channel
+static int tail_receive(const struct sr_datafeed_packet *pkt, void *cb_data)
+{
+    struct frame_tail *tail = cb_data;
+    int ret;
+
+    ret = outputs_receive(tail->outputs, pkt);
+    tail->frame->chunk++;
+
+    return ret;
+}
+
+static int add_output(const struct sr_dev_inst *sdi, struct output_set *set, char *file, char *format)
+{
+    const struct sr_output *o;
+
+    if (!(o = setup_output_format(sdi, file, format))) {
+        err_msg("%s:%d Failed to initialize output module '%s'", __FILE__, __LINE__, format);
+        return SR_ERR_ARG;
+    }
+    set->outputs = g_slist_append(set->outputs, (gpointer) o);
+
+    return SR_OK;
+}
+
+// every --output-format is paired with the --output of the same position
+static int setup_outputs(const struct sr_dev_inst *sdi, const struct cmdline_opt *opt, struct output_set *set)
+{
+    GSList *f, *l;
+    int ret;
+
+    if (!opt->output_formats) {
+        err_msg("%s:%d output format not selected", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (!opt->output_files) {
+        err_msg("%s:%d output file not defined", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if (g_slist_length(opt->output_formats) != g_slist_length(opt->output_files)) {
+        err_msg("%s:%d every output format needs its own output file", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    for (l = opt->output_formats, f = opt->output_files; l; l = l->next, f = f->next) {
+        if ((ret = add_output(sdi, set, f->data, l->data)) != SR_OK)
+            return ret;
+    }
+
+    return SR_OK;
+}
+
+// move the outputs that take all channels at once out of the set
+static GSList *split_block_outputs(struct output_set *set)
+{
+    const struct sr_output *o;
+    GSList *l, *next, *blocks = NULL;
+
+    for (l = set->outputs; l; l = next) {
+        next = l->next;
+        o = l->data;
+        if (sat_output_test_flag(o->module, SAT_OUTPUT_BLOCKS)) {
+            blocks = g_slist_append(blocks, (gpointer) o);
+            set->outputs = g_slist_delete_link(set->outputs, l);
+        }
+    }
+
+    return blocks;
+}
+
+// same as outputs_receive() for the outputs that read all channels at once
+static int blocks_receive(GSList *blocks, const struct sr_datafeed_packet *pkt)
+{
+    const struct sr_output *o;
+    GSList *l;
+    int ret = SR_OK, err;
+
+    for (l = blocks; l; l = l->next) {
+        o = l->data;
+        err = o->module->receive(o, pkt, NULL);
+        ret = (ret == SR_OK) ? err : ret;
+    }
+
+    return ret;
+}
+
+/*
+ * second pass for the outputs that need every channel at the same time.
+ * aligned windows of all channels are read at once, cropped the same way
+ * as the channel by channel pass. transforms work on a single channel
+ * stream, so they are not applied here.
+ */
+static int run_blocks(const struct sr_dev_inst *sdi, GSList *blocks, const struct sat_trigger *trigger,
+                      const uint64_t trigger_rate)
+{
+    struct dev_frame *frame = sdi->priv;
+    struct sat_block_reader *br = NULL;
+    struct sr_datafeed_packet pkt = { 0 };
+    struct sr_datafeed_analog analog = { 0 };
+    const ch_data_t **ch;
+    ssize_t *seek, samples, len, block_len;
+    uint32_t i, cnt = g_slist_length(sdi->channels);
+    GSList *l;
+    int ret = SR_OK;
+
+    if (mixed_samplerates(sdi)) {
+        err_msg("%s:%d outputs that read all channels at once need a single sample rate", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    ch = g_malloc0(cnt * sizeof(ch_data_t *));
+    seek = g_malloc0(cnt * sizeof(ssize_t));
+    samples = -1;
+    for (i = 0, l = sdi->channels; l; i++, l = l->next) {
+        ch[i] = l->data;
+        trigger_crop(ch[i], trigger, trigger_rate, &seek[i], &len);
+        samples = (samples < 0) ? len : MIN(samples, len);
+    }
+
+    // a block takes as much memory as a chunk of the channel by channel pass
+    block_len = MAX(64, (CHUNK_SIZE / sizeof(float) / cnt) & ~63);
+    if (!(br = sat_block_open(ch, cnt, seek, samples, block_len))) {
+        ret = SR_ERR_IO;
+        goto cleanup;
+    }
+    analog.data = g_malloc(cnt * block_len * sizeof(float));
+    pkt.payload = &analog;
+
+    frame->ch = 0;
+    frame->chunk = 0;
+    frame->samplerate = ch[0]->samplerate;
+    pkt.type = SR_DF_FRAME_BEGIN;
+    if ((ret = blocks_receive(blocks, &pkt)) != SR_OK)
+        goto cleanup;
+    while ((len = sat_block_read(br, analog.data)) > 0) {
+        frame->chunk++;
+        pkt.type = SR_DF_ANALOG;
+        analog.num_samples = len;
+        if ((ret = blocks_receive(blocks, &pkt)) != SR_OK)
+            goto cleanup;
+    }
+    if (len < 0) {
+        ret = len;
+        goto cleanup;
+    }
+    pkt.type = SR_DF_FRAME_END;
+    if ((ret = blocks_receive(blocks, &pkt)) != SR_OK)
+        goto cleanup;
+
+    pkt.type = SR_DF_END;
+    ret = blocks_receive(blocks, &pkt);
+
+ cleanup:
+    sat_block_close(br);
+    g_free(analog.data);
+    g_free(seek);
+    g_free(ch);
+
+    return ret;
+}
+
+int run_session(const struct sr_dev_inst *sdi, const struct cmdline_opt *opt)
+{
+    int ret = SR_OK, err;
+    struct output_set outputs = { 0 };
+    GSList *blocks = NULL;
+    GSList *transforms = NULL;
     ch_data_t *ch_data_ptr;
     ssize_t read_len;
     int i, j;
-    int fd;
+    struct sat_input *in;
     struct sr_datafeed_packet pkt = { 0 };
     struct sr_datafeed_packet *tpkt;
     struct sr_datafeed_analog analog = { 0 };
@@ -127,197 +619,165 @@ int run_session(const struct sr_dev_inst *sdi, const struct cmdline_opt *opt)
     struct sr_analog_meaning meaning = { 0 };
     struct sr_analog_spec spec = { 0 };
     struct sat_trigger *trigger = NULL;
-    bool transform_initialized = 0;
     GSList *l;
     struct dev_frame *frame = sdi->priv;
-    ssize_t after_trigger = 0;
-    ssize_t before_trigger = 0;
+    struct frame_tail tail = { &outputs, frame };
     ssize_t seek = 0;
-    ssize_t trigger_at_sample = 0;
-    ssize_t bytes_remaining = 0;
+    uint64_t trigger_rate = 0;
     ssize_t samples_remaining = 0;
 
     analog.encoding = &encoding;
     analog.meaning = &meaning;
     analog.spec = &spec;
 
-    if (!opt->output_format) {
-        err_msg("%s:%d output format not selected", __FILE__, __LINE__);
+    if (!sdi->channels) {
+        err_msg("%s:%d no input files found", __FILE__, __LINE__);
         return SR_ERR_ARG;
     }
 
-    if (opt->output_file) {
-        if (!(o = setup_output_format(sdi, opt->output_file, opt->output_format))) {
-            err_msg("%s:%d Failed to initialize output module.", __FILE__, __LINE__);
+    ch_data_ptr = sdi->channels->data;
+    frame->samplerate = ch_data_ptr->samplerate;
+    frame->stop = false;
+
+    // transforms are set up first since they might change the sample rate the output gets to see
+    if (opt->transform_modules) {
+        if (!(transforms = setup_transform_chain(sdi, opt->transform_modules))) {
+            err_msg("%s:%d Failed to initialize transform module", __FILE__, __LINE__);
             return SR_ERR_ARG;
         }
-    } else {
-        err_msg("%s:%d output file not defined", __FILE__, __LINE__);
-        return SR_ERR_ARG;
     }
 
-	if (opt->triggers) {
-		if (!parse_triggerstring(sdi, opt->triggers, &trigger)) {
-            err_msg("%s:%d Failed to initialize trigger module", __FILE__, __LINE__);
-			return SR_ERR_ARG;
-		}
-        after_trigger = trigger->a;
-        before_trigger = trigger->b;
-	}
+    if (mixed_samplerates(sdi) && !chain_has_flag(transforms, SAT_TRANSFORM_UNIFORM_RATE))
+        err_msg("warning: the input channels have different sample rates, consider adding a resample transform\n");
 
-    if (opt->transform_module) {
-        if (!(t = setup_transform_module(sdi, opt->transform_module))) {
-            err_msg("%s:%d Failed to initialize transform module", __FILE__, __LINE__);
-            return SR_ERR_ARG;
+    if ((ret = setup_outputs(sdi, opt, &outputs)) != SR_OK)
+        goto cleanup;
+    blocks = split_block_outputs(&outputs);
+    if (blocks && transforms)
+        err_msg("warning: transforms are not applied to outputs that read all channels at once\n");
+    output_set_start(&outputs);
+
+    if (opt->triggers) {
+        if (!parse_triggerstring(sdi, opt->triggers, &trigger)) {
+            err_msg("%s:%d Failed to initialize trigger module", __FILE__, __LINE__);
+            ret = SR_ERR_ARG;
+            goto cleanup;
         }
-        transform_initialized = 1;
     }
 
+
     analog.data = (uint8_t *) g_malloc0(CHUNK_SIZE);
 
     i = 0;
     pkt.payload = &analog;
 
     // send data to trigger module
-    if (trigger) {
-        for (l = sdi->channels; l; l = l->next) {
-            ch_data_ptr = l->data;
-            if (ch_data_ptr->trigger) {
-                if ((fd = open(ch_data_ptr->input_file_name, O_RDONLY)) < 0) {
-                    err_msg("%s:%d Failed to open input file", __FILE__, __LINE__);
-                    ret = SR_ERR_IO;
-                    goto cleanup;
-                }
-
-                seek = 0;
-
-                if (ch_data_ptr->file_type == SALEAE_ANALOG)
-                    seek += SALEAE_ANALOG_HDR_SIZE;
-
-                if (lseek(fd, seek, SEEK_SET) < 0) {
-                    err_msg("%s:%d failed during lseek()", __FILE__, __LINE__);
-                    close(fd);
-                    ret = SR_ERR_IO;
-                    goto cleanup;
-                }
-
-                while ((read_len = read(fd, analog.data, CHUNK_SIZE)) > 0) {
-                    pkt.type = SR_DF_ANALOG;
-                    analog.num_samples = read_len / ch_data_ptr->sample_size;
-                    sat_trigger_receive(ch_data_ptr->trigger, &pkt);
-                }
-                close(fd);
-
-                if (! trigger->matches) {
-                    fprintf(stdout, "warning, trigger #%d '%s' did not activate\n", trigger->id, trigger->name);
-                }
-                //sat_trigger_show(trigger);
-            }
-        }
-        //goto cleanup;
-    }
+    if (trigger && ((ret = scan_trigger(sdi, trigger, (float *)analog.data, &trigger_rate)) != SR_OK))
+        goto cleanup;
 
     // send data to transform and output modules
-    for (l = sdi->channels; l; l = l->next) {
+    for (l = outputs.outputs ? sdi->channels : NULL; l; l = l->next) {
         ch_data_ptr = l->data;
         i++;
 
-        if ((fd = open(ch_data_ptr->input_file_name, O_RDONLY)) < 0) {
-            err_msg("%s:%d failed to open input file", __FILE__, __LINE__);
+        if (!(in = sat_input_open(ch_data_ptr))) {
             ret = SR_ERR_IO;
             goto cleanup;
         }
 
         // crop based on after,before_trigger
-        seek = 0;
-        if (before_trigger && sat_trigger_activated(trigger)) {
-            trigger_at_sample = sat_trigger_loc(trigger);
-
-            if (before_trigger > trigger_at_sample) {
-                err_msg("warning: cannot read %ld samples before trigger %d at sample %ld,\n", before_trigger, trigger->id, trigger_at_sample);
-                err_msg("cropping will begin at sample #0 instead!\n");
-                samples_remaining = trigger_at_sample;
-            } else {
-                samples_remaining = before_trigger;
-                seek = (trigger_at_sample - before_trigger) * ch_data_ptr->sample_size;
-                //printf("seek to %ld - %ld\n", trigger_at_sample, before_trigger);
-            }
-
-            if (trigger_at_sample + after_trigger > ch_data_ptr->sample_count) {
-                err_msg("warning: cannot read %ld samples after trigger %d at sample %ld/%ld,\n", after_trigger, trigger->id, trigger_at_sample, ch_data_ptr->sample_count);
-                err_msg("cropping will end at sample %ld instead!\n", ch_data_ptr->sample_count);
-                samples_remaining += ch_data_ptr->sample_count - trigger_at_sample;
-            } else {
-                samples_remaining += after_trigger;
-            }
+        trigger_crop(ch_data_ptr, trigger, trigger_rate, &seek, &samples_remaining);
 
-            bytes_remaining = samples_remaining * ch_data_ptr->sample_size;
-            //printf("attempting to save %ld samples after sample %ld\n", after_trigger, trigger_at_sample);
-        } else {
-            bytes_remaining = ch_data_ptr->input_file_size;
-        }
-
-        // skip saleae header if present
-        if (ch_data_ptr->file_type == SALEAE_ANALOG)
-            seek += SALEAE_ANALOG_HDR_SIZE;
-
-        if (lseek(fd, seek, SEEK_SET) < 0) {
-            err_msg("%s:%d failed during lseek()", __FILE__, __LINE__);
-            close(fd);
+        if (seek && (sat_input_seek(in, seek) != SR_OK)) {
+            sat_input_close(in);
             ret = SR_ERR_IO;
             goto cleanup;
         }
 
         j = 1;
-        while ((read_len = read(fd, analog.data, CHUNK_SIZE)) > 0) {
+        while ((read_len = sat_input_read(in, analog.data, CHUNK_SIZE / sizeof(float))) > 0) {
             frame->ch = i;
             frame->chunk = j;
+            frame->seek = seek;
             if (j == 1) {
+                // transforms that change the rate of the channel update it as the frame passes them
+                frame->samplerate = ch_data_ptr->samplerate;
                 pkt.type = SR_DF_FRAME_BEGIN;
-                if (transform_initialized)
-                    t->module->receive(t, &pkt, &tpkt);
-                if (o->module->receive(o, &pkt, NULL) != SR_OK) {
-                    close(fd);
+                if (transforms && (ret = sat_transform_chain_receive(transforms, &pkt, &tpkt)) != SR_OK) {
+                    sat_input_close(in);
+                    goto cleanup;
+                }
+                if ((ret = outputs_receive(&outputs, &pkt)) != SR_OK) {
+                    sat_input_close(in);
                     goto cleanup;
                 }
             }
             pkt.type = SR_DF_ANALOG;
-            if (read_len > bytes_remaining)
-                read_len = bytes_remaining;
-            analog.num_samples = read_len / ch_data_ptr->sample_size;
-            if (transform_initialized) {
-                t->module->receive(t, &pkt, &tpkt);
-                if (o->module->receive(o, tpkt, NULL) != SR_OK) {
-                    close(fd);
+            if (read_len > samples_remaining)
+                read_len = samples_remaining;
+            analog.num_samples = read_len;
+            if (transforms) {
+                if ((ret = sat_transform_chain_receive(transforms, &pkt, &tpkt)) != SR_OK) {
+                    sat_input_close(in);
+                    goto cleanup;
+                }
+                if (tpkt && ((ret = outputs_receive(&outputs, tpkt)) != SR_OK)) {
+                    sat_input_close(in);
                     goto cleanup;
                 }
             } else {
-                if (o->module->receive(o, &pkt, NULL) != SR_OK) {
-                    close(fd);
+                if ((ret = outputs_receive(&outputs, &pkt)) != SR_OK) {
+                    sat_input_close(in);
                     goto cleanup;
                 }
             }
             j++;
-            bytes_remaining -= read_len;
-            //printf("bytes_remaining %ld\n", bytes_remaining);
-            if (bytes_remaining <= 0)
+            samples_remaining -= read_len;
+            if ((samples_remaining <= 0) || frame->stop)
                 break;
         }
-        close(fd);
+        sat_input_close(in);
+        // a damaged input is an error, not the end of the channel
+        if (read_len < 0) {
+            err_msg("%s:%d failed to read %s", __FILE__, __LINE__, ch_data_ptr->input_file_name);
+            ret = read_len;
+            goto cleanup;
+        }
 
-        pkt.type = SR_DF_FRAME_END;
-        if (transform_initialized) {
-            t->module->receive(t, &pkt, &tpkt);
+        // samples the transforms held back follow as the next chunks
+        if (transforms && (j > 1)) {
+            frame->chunk = j;
+            if ((ret = sat_transform_chain_end(transforms, tail_receive, &tail)) != SR_OK)
+                goto cleanup;
         }
-        o->module->receive(o, &pkt, NULL);
+        pkt.type = SR_DF_FRAME_END;
+        if ((ret = outputs_receive(&outputs, &pkt)) != SR_OK)
+            goto cleanup;
+
+        // an output asked to end the export, all of them still get SR_DF_END
+        if (frame->stop)
+            break;
+    }
+
+    // outputs that buffer data across channels write it out now
+    if (outputs.outputs) {
+        pkt.type = SR_DF_END;
+        ret = outputs_receive(&outputs, &pkt);
     }
     //printf("%d channels exported\n", i);
 
+    if (blocks) {
+        err = run_blocks(sdi, blocks, trigger, trigger_rate);
+        ret = (ret == SR_OK) ? err : ret;
+    }
+
  cleanup:
-    if (o)
-        sat_output_free(o);
-    if (t)
-        sat_transform_free(t);
+    for (l = blocks; l; l = l->next)
+        sat_output_free(l->data);
+    g_slist_free(blocks);
+    output_set_free(&outputs);
+    if (transforms)
+        sat_transform_chain_free(transforms);
     if (analog.data)
         g_free(analog.data);
 
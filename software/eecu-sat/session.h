@@ -3,6 +3,10 @@
 
 const struct sat_output *setup_output_format(const struct sr_dev_inst *sdi, char *opt_output_file, char *opt_output_format);
 const struct sat_transform *setup_transform_module(const struct sr_dev_inst *sdi, char *mod);
+GSList *setup_transform_chain(const struct sr_dev_inst *sdi, GSList *opt_transform_modules);
+int scan_trigger(const struct sr_dev_inst *sdi, const struct sat_trigger *trigger, float *buf, uint64_t *trigger_rate);
+void trigger_crop(const ch_data_t *ch_data_ptr, const struct sat_trigger *trigger, const uint64_t trigger_rate,
+                  ssize_t *seek, ssize_t *samples);
 int run_session(const struct sr_dev_inst *sdi, const struct cmdline_opt *opt);
 
 #endif
@@ -340,6 +340,13 @@ struct sr_transform_module {
      */
     const char *desc;
 
+    /**
+     * Bitfield containing flags that describe certain properties
+     * this transform module may or may not have.
+     * @see sat_transform_flag
+     */
+    const uint64_t flags;
+
     /**
      * Returns a NULL-terminated list of options this transform module
      * can take. Can be NULL, if the transform module has no options.
@@ -0,0 +1,82 @@
+#ifndef __SAT_SIMD_H__
+#define __SAT_SIMD_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * four lane single precision vectors based on the gcc/clang vector extension.
+ * they map onto SSE or NEON registers without any -m flags and do not depend
+ * on the auto-vectorizer, which is not active in the -O1 debug builds.
+ */
+typedef float v4sf __attribute__ ((vector_size(16)));
+typedef int32_t v4si __attribute__ ((vector_size(16)));
+
+#define  V4SF_LANES  4
+
+// unaligned load and store, the memcpy is optimized into a single movups/ld1
+static inline v4sf v4sf_load(const float *p)
+{
+    v4sf v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void v4sf_store(float *p, v4sf v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline v4sf v4sf_set1(float x)
+{
+    v4sf v = { x, x, x, x };
+
+    return v;
+}
+
+// lanes of a where mask is set, lanes of b otherwise. masks come from vector comparisons
+static inline v4sf v4sf_select(v4si mask, v4sf a, v4sf b)
+{
+    return (v4sf) (((v4si) a & mask) | ((v4si) b & ~mask));
+}
+
+static inline v4sf v4sf_min(v4sf a, v4sf b)
+{
+    return v4sf_select(a < b, a, b);
+}
+
+static inline v4sf v4sf_max(v4sf a, v4sf b)
+{
+    return v4sf_select(a > b, a, b);
+}
+
+static inline v4sf v4sf_abs(v4sf v)
+{
+    return (v4sf) ((v4si) v & (v4si) { 0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff });
+}
+
+// true if any lane of a comparison mask is set
+static inline int v4si_any(v4si mask)
+{
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+static inline float v4sf_hsum(v4sf v)
+{
+    return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+static inline float v4sf_hmin(v4sf v)
+{
+    v = v4sf_min(v, (v4sf) { v[2], v[3], v[0], v[1] });
+    return v[0] < v[1] ? v[0] : v[1];
+}
+
+static inline float v4sf_hmax(v4sf v)
+{
+    v = v4sf_max(v, (v4sf) { v[2], v[3], v[0], v[1] });
+    return v[0] > v[1] ? v[0] : v[1];
+}
+
+#endif
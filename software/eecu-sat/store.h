@@ -0,0 +1,50 @@
+#ifndef __SAT_STORE_H__
+#define __SAT_STORE_H__
+
+#include <stdint.h>
+
+/*
+ * columnar capture store, all channels of a capture in a single file.
+ * every channel is cut into blocks of block_samples little-endian floats
+ * (the last block of a channel can be shorter). blocks start on a
+ * STORE_ALIGN boundary, so a mapping of the file can be used as a plain
+ * float array. the index at the end of the file holds one struct
+ * store_channel per channel followed by one struct store_block per block.
+ * the blocks of a channel are consecutive in the index.
+ */
+struct __attribute__((packed)) store_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    uint32_t block_samples;
+    uint32_t num_channels;
+    uint32_t num_blocks;
+    uint64_t index_offset;
+    uint8_t reserved[32];
+}; // 64bytes
+
+struct __attribute__((packed)) store_channel {
+    char name[24];              // input file name, used to pick trigger channels
+    uint32_t first_block;
+    uint32_t num_blocks;
+    double begin_time;
+    uint64_t sample_rate;
+    uint64_t downsample;
+    uint64_t num_samples;
+}; // 64bytes
+
+struct __attribute__((packed)) store_block {
+    uint64_t offset;
+    uint64_t first_sample;
+    uint32_t num_samples;
+    uint32_t channel;
+    float min;                  // both NaN if the block holds a NaN
+    float max;
+}; // 32bytes
+
+#define         STORE_HDR_SIZE  0x40
+#define     STORE_CHANNEL_SIZE  0x40
+#define       STORE_BLOCK_SIZE  0x20
+#define            STORE_MAGIC  "<SATSTO>"
+#define            STORE_ALIGN  4096
+
+#endif
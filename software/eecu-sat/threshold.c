@@ -0,0 +1,86 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "proj.h"
+#include "error.h"
+#include "threshold.h"
+
+void sat_levels_free(struct sat_levels *lv)
+{
+    g_free(lv->selected);
+    g_free(lv->high);
+    g_free(lv->low);
+    lv->selected = NULL;
+    lv->high = NULL;
+    lv->low = NULL;
+}
+
+/**
+ * Parse a comma separated list of channel ids, each one optionally followed
+ * by @LEVEL to override the default threshold level of that channel. An
+ * empty list selects all channels at the default level. The hysteresis
+ * band is centred on the level. lv is to be released with sat_levels_free()
+ * whatever the outcome.
+ */
+int sat_levels_parse(struct sat_levels *lv, const uint32_t ch_cnt, const char *spec, const double level, const double hyst)
+{
+    gchar **tokens, *at;
+    double ch_level;
+    uint32_t i, id;
+    int ret = SR_OK;
+
+    lv->selected = g_malloc0((ch_cnt + 1) * sizeof(bool));
+    lv->high = g_malloc0((ch_cnt + 1) * sizeof(float));
+    lv->low = g_malloc0((ch_cnt + 1) * sizeof(float));
+
+    // all channels at the default level unless a list is given
+    if (!spec[0]) {
+        for (id = 1; id <= ch_cnt; id++) {
+            lv->selected[id] = true;
+            lv->high[id] = level + hyst / 2;
+            lv->low[id] = level - hyst / 2;
+        }
+        return SR_OK;
+    }
+
+    tokens = g_strsplit(spec, ",", 0);
+    for (i = 0; tokens[i]; i++) {
+        if (!tokens[i][0])
+            continue;
+        ch_level = level;
+        if ((at = strchr(tokens[i], '@'))) {
+            *at = 0;
+            ch_level = strtod(at + 1, NULL);
+        }
+        id = strtoul(tokens[i], NULL, 10);
+        if ((id < 1) || (id > ch_cnt)) {
+            err_msg("%s:%d channel '%s' does not exist", __FILE__, __LINE__, tokens[i]);
+            ret = SR_ERR_ARG;
+            break;
+        }
+        lv->selected[id] = true;
+        lv->high[id] = ch_level + hyst / 2;
+        lv->low[id] = ch_level - hyst / 2;
+    }
+    g_strfreev(tokens);
+
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef __SAT_THRESHOLD_H__
+#define __SAT_THRESHOLD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+
+// thresholds of the selected channels, the arrays are indexed by channel id
+struct sat_levels {
+    bool *selected;
+    float *high;
+    float *low;
+};
+
+int sat_levels_parse(struct sat_levels *lv, const uint32_t ch_cnt, const char *spec, const double level, const double hyst);
+void sat_levels_free(struct sat_levels *lv);
+
+#endif
@@ -22,9 +22,19 @@
 #include "error.h"
 #include "transform.h"
 #include "transform_calibrate_linear_3p.h"
+#include "transform_filter.h"
+#include "transform_decimate.h"
+#include "transform_despike.h"
+#include "transform_resample.h"
+#include "transform_crank_angle.h"
 
 static const struct sr_transform_module *transform_module_list[] = {
     &transform_calibrate_linear_3p,
+    &transform_filter,
+    &transform_decimate,
+    &transform_despike,
+    &transform_resample,
+    &transform_crank_angle,
     NULL,
 };
 
@@ -75,6 +85,16 @@ const char *sat_transform_description_get(const struct sr_transform_module *tmod
     return tmod->desc;
 }
 
+/*
+ * Checks whether a given flag is set.
+ *
+ * @see sat_transform_flag
+ */
+gboolean sat_transform_test_flag(const struct sr_transform_module *tmod, uint64_t flag)
+{
+    return (flag & tmod->flags);
+}
+
 /**
  * Return the transform module with the specified ID, or NULL if no module
  * with that ID is found.
@@ -239,3 +259,125 @@ int sat_transform_free(const struct sr_transform *t)
 
     return ret;
 }
+
+/**
+ * Send a packet through a list of transform instances, in list order.
+ *
+ * Runs of adjacent SAT_TRANSFORM_ELEMENTWISE modules are fused: the chunk
+ * is walked in TRANSFORM_BLOCK_SIZE blocks and every module of the run is
+ * applied to a block while it is still in cache, instead of each module
+ * sweeping the whole chunk on its own. The result is identical to applying
+ * the modules one after the other.
+ *
+ * packet_out is set to the packet produced by the last module, or to NULL
+ * if one of the modules did not output a packet.
+ */
+int sat_transform_chain_receive(GSList *chain, struct sr_datafeed_packet *packet_in,
+                                struct sr_datafeed_packet **packet_out)
+{
+    const struct sr_transform *t;
+    const struct sr_datafeed_analog *analog;
+    struct sr_datafeed_analog block;
+    struct sr_datafeed_packet bpkt;
+    struct sr_datafeed_packet *pkt, *tpkt;
+    GSList *l, *run, *end;
+    ssize_t offset, block_samples;
+    int ret;
+
+    if (!packet_out)
+        return SR_ERR_ARG;
+
+    pkt = packet_in;
+    l = chain;
+    while (l && pkt) {
+        t = l->data;
+        if ((pkt->type != SR_DF_ANALOG) || !sat_transform_test_flag(t->module, SAT_TRANSFORM_ELEMENTWISE)) {
+            if ((ret = t->module->receive(t, pkt, &tpkt)) != SR_OK)
+                return ret;
+            pkt = tpkt;
+            l = l->next;
+            continue;
+        }
+
+        // find the end of the run of elementwise modules
+        for (end = l; end; end = end->next) {
+            t = end->data;
+            if (!sat_transform_test_flag(t->module, SAT_TRANSFORM_ELEMENTWISE))
+                break;
+        }
+
+        analog = pkt->payload;
+        block = *analog;
+        bpkt.type = SR_DF_ANALOG;
+        bpkt.payload = &block;
+        for (offset = 0; offset < analog->num_samples; offset += block_samples) {
+            block_samples = MIN(analog->num_samples - offset, (ssize_t) (TRANSFORM_BLOCK_SIZE / sizeof(float)));
+            block.data = (float *)analog->data + offset;
+            block.num_samples = block_samples;
+            for (run = l; run != end; run = run->next) {
+                t = run->data;
+                if ((ret = t->module->receive(t, &bpkt, &tpkt)) != SR_OK)
+                    return ret;
+                if (tpkt != &bpkt) {
+                    err_msg("%s:%d transform module '%s' did not work in place", __FILE__, __LINE__, t->module->id);
+                    return SR_ERR_BUG;
+                }
+            }
+        }
+        l = end;
+    }
+
+    *packet_out = pkt;
+
+    return SR_OK;
+}
+
+/**
+ * Send SR_DF_FRAME_END through a list of transform instances, in list order.
+ *
+ * A module that holds samples back (a centred window, the delay line of a
+ * filter, an incomplete group) replies to SR_DF_FRAME_END with an
+ * SR_DF_ANALOG packet that carries them. That packet passes through the
+ * rest of the chain and the result is handed to emit, before the following
+ * modules see SR_DF_FRAME_END themselves. The caller sends SR_DF_FRAME_END
+ * to the outputs once this returns.
+ */
+int sat_transform_chain_end(GSList *chain, int (*emit)(const struct sr_datafeed_packet *pkt, void *cb_data),
+                            void *cb_data)
+{
+    const struct sr_transform *t;
+    struct sr_datafeed_packet pkt = { 0 };
+    struct sr_datafeed_packet *tpkt, *opkt;
+    GSList *l;
+    int ret;
+
+    if (!emit)
+        return SR_ERR_ARG;
+
+    for (l = chain; l; l = l->next) {
+        t = l->data;
+        pkt.type = SR_DF_FRAME_END;
+        if ((ret = t->module->receive(t, &pkt, &tpkt)) != SR_OK)
+            return ret;
+        if (!tpkt || (tpkt->type != SR_DF_ANALOG))
+            continue;
+        if ((ret = sat_transform_chain_receive(l->next, tpkt, &opkt)) != SR_OK)
+            return ret;
+        if (opkt && ((ret = emit(opkt, cb_data)) != SR_OK))
+            return ret;
+    }
+
+    return SR_OK;
+}
+
+/**
+ * Free a list of transform instances and the list itself.
+ */
+void sat_transform_chain_free(GSList *chain)
+{
+    GSList *l;
+
+    for (l = chain; l; l = l->next)
+        sat_transform_free(l->data);
+    g_slist_free(chain);
+}
@@ -5,6 +5,21 @@
 #include <glib.h>
 #include "proj.h"
 
+enum sat_transform_flag {
+    /**
+     * The module rewrites every sample in place and its result does not
+     * depend on how a chunk is split (any state is carried from one block
+     * to the next), so it can be fused with adjacent modules that have the
+     * same property.
+     */
+    SAT_TRANSFORM_ELEMENTWISE = 0x01,
+    /**
+     * Every channel leaves the module at the sample rate found in
+     * dev_frame, whatever rate it was recorded at.
+     */
+    SAT_TRANSFORM_UNIFORM_RATE = 0x02,
+};
+
 const struct sr_transform_module **sat_transform_list(void);
 const char *sat_transform_id_get(const struct sr_transform_module *tmod);
 const char *sat_transform_name_get(const struct sr_transform_module *tmod);
@@ -15,5 +30,11 @@ void sat_transform_options_free(const struct sr_option **options);
 const struct sr_transform *sat_transform_new(const struct sr_transform_module *tmod,
 		GHashTable *options, const struct sr_dev_inst *sdi);
 int sat_transform_free(const struct sr_transform *t);
+gboolean sat_transform_test_flag(const struct sr_transform_module *tmod, uint64_t flag);
+int sat_transform_chain_receive(GSList *chain, struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out);
+int sat_transform_chain_end(GSList *chain, int (*emit)(const struct sr_datafeed_packet *pkt, void *cb_data),
+		void *cb_data);
+void sat_transform_chain_free(GSList *chain);
 
 #endif
@@ -143,6 +143,7 @@ struct sr_transform_module transform_calibrate_linear_3p = {
     .id = "calibrate_linear_3p",
     .name = "calibrate_linear_3p",
     .desc = "linear calibration in 3 points",
+    .flags = SAT_TRANSFORM_ELEMENTWISE,
     .options = get_options,
     .init = init,
     .receive = receive,
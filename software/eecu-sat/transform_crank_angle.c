@@ -0,0 +1,195 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "proj.h"
+#include "error.h"
+#include "crank.h"
+#include "transform.h"
+
+/*
+ * every channel is resampled onto a fixed grid of crank angles. the crank
+ * channel is decoded once when the transform is set up, the map of its
+ * teeth then gives the time of every grid point of every channel. only
+ * whole cycles are exported, one after the other, and samples between the
+ * teeth are interpolated linearly.
+ */
+struct context {
+    struct sat_crank_grid *grid;
+    struct sr_datafeed_packet pkt;
+    struct sr_datafeed_analog analog;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+    struct context *ctx;
+    struct dev_frame *frame;
+    const ch_data_t *crank = NULL;
+    ch_data_t *ch_data_ptr;
+    struct sat_crank_map *map;
+    struct sat_crank_opt copt = { 0 };
+    uint32_t id;
+    double step;
+    GSList *l;
+
+    if (!t || !t->sdi || !options)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+
+    /* Options */
+    id = g_variant_get_uint32(g_hash_table_lookup(options, "channel"));
+
+    for (l = t->sdi->channels; l; l = l->next) {
+        ch_data_ptr = l->data;
+        if (ch_data_ptr->id == id)
+            crank = ch_data_ptr;
+    }
+    if (!crank) {
+        err_msg("%s:%d crank channel %u does not exist", __FILE__, __LINE__, id);
+        return SR_ERR_ARG;
+    }
+    if (sat_crank_opt_get(options, &copt, &step) != SR_OK)
+        return SR_ERR_ARG;
+
+    if (!(map = sat_crank_map_build(crank, NULL, &copt))) {
+        err_msg("%s:%d unable to read crank channel %u", __FILE__, __LINE__, id);
+        return SR_ERR_IO;
+    }
+    if (!map->cycles->len)
+        err_msg("warning: no whole %u degree cycle was found on crank channel %u\n", copt.cycle, id);
+    else if (map->sync_lost)
+        err_msg("warning: crank channel %u lost sync %lu times, the cycles around it are left out\n", id, map->sync_lost);
+
+    t->priv = ctx = g_malloc0(sizeof(struct context));
+    ctx->grid = sat_crank_grid_new(map, step);
+
+    // one second of the exported signal is one cycle
+    frame->samplerate = ctx->grid->points;
+    ctx->pkt.payload = &ctx->analog;
+
+    return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+                   struct sr_datafeed_packet *packet_in, struct sr_datafeed_packet **packet_out)
+{
+    struct context *ctx;
+    const struct sr_datafeed_analog *analog;
+    struct dev_frame *frame;
+    ch_data_t *ch_data_ptr;
+    GSList *l;
+
+    if (!t || !packet_in || !packet_out)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+    ctx = t->priv;
+
+    switch (packet_in->type) {
+    case SR_DF_FRAME_BEGIN:
+        for (l = t->sdi->channels; l; l = l->next) {
+            ch_data_ptr = l->data;
+            if (ch_data_ptr->id == frame->ch)
+                break;
+        }
+        if (!l) {
+            err_msg("%s:%d unable to resample channel %d", __FILE__, __LINE__, frame->ch);
+            return SR_ERR_ARG;
+        }
+        if (sat_crank_grid_channel(ctx->grid, frame->samplerate, ch_data_ptr->samplerate, frame->seek) != SR_OK) {
+            err_msg("%s:%d unable to resample channel %d", __FILE__, __LINE__, frame->ch);
+            return SR_ERR_ARG;
+        }
+        frame->samplerate = ctx->grid->points;
+        break;
+    case SR_DF_ANALOG:
+        analog = packet_in->payload;
+        if (!analog->num_samples)
+            break;
+        memcpy(&ctx->analog, analog, sizeof(struct sr_datafeed_analog));
+        ctx->analog.num_samples = sat_crank_grid_resample(ctx->grid, analog->data, analog->num_samples);
+        ctx->analog.data = ctx->grid->out;
+
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    default:
+        break;
+    }
+
+    *packet_out = packet_in;
+
+    return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+    struct context *ctx;
+
+    if (!t)
+        return SR_ERR_ARG;
+
+    if (t->priv) {
+        ctx = t->priv;
+        sat_crank_grid_free(ctx->grid);
+        g_free(ctx);
+        t->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"channel", "Channel", "id of the crank channel", NULL, NULL},
+    {"level", "Level", "threshold level of the teeth in volts", NULL, NULL},
+    {"hyst", "Hysteresis", "width of the hysteresis band around the threshold level in volts", NULL, NULL},
+    {"wheel", "Wheel", "crank trigger wheel as TEETH-MISSING", NULL, NULL},
+    {"step", "Step", "distance of two grid points in degrees", NULL, NULL},
+    {"cycle", "Cycle", "length of a cycle in degrees, 360 or 720", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[1].def = g_variant_ref_sink(g_variant_new_double(2.5));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0.2));
+        options[3].def = g_variant_ref_sink(g_variant_new_string("60-2"));
+        options[4].def = g_variant_ref_sink(g_variant_new_double(0.5));
+        options[5].def = g_variant_ref_sink(g_variant_new_uint32(720));
+    }
+
+    return options;
+}
+
+struct sr_transform_module transform_crank_angle = {
+    .id = "crank_angle",
+    .name = "crank_angle",
+    .desc = "resample every channel onto a grid of crank angles",
+    .flags = SAT_TRANSFORM_UNIFORM_RATE,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -0,0 +1,6 @@
+#ifndef __TRANSFORM_CRANK_ANGLE_H__
+#define __TRANSFORM_CRANK_ANGLE_H__
+
+extern struct sr_transform_module transform_crank_angle;
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <float.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "transform.h"
+
+#define  DECIMATE_MAX_TAPS  1023
+
+enum decimate_mode {
+    DECIMATE_AVERAGE = 0,
+    DECIMATE_MINMAX,
+    DECIMATE_ANTIALIAS,
+};
+
+struct context {
+    enum decimate_mode mode;
+    uint32_t factor;
+    uint32_t taps;
+    // group of input samples that is still being accumulated
+    uint32_t cnt;
+    double sum;
+    float min;
+    float max;
+    // anti-aliasing filter
+    float *h;                   // taps in reverse order
+    float *work;                // history followed by the current chunk
+    ssize_t work_sz;
+    ssize_t skip;               // input samples until the next output
+    bool primed;
+    // decimated chunk
+    float *out;
+    ssize_t out_sz;
+    struct sr_datafeed_packet pkt;
+    struct sr_datafeed_analog analog;
+};
+
+static void group_reset(struct context *ctx)
+{
+    ctx->cnt = 0;
+    ctx->sum = 0;
+    ctx->min = FLT_MAX;
+    ctx->max = -FLT_MAX;
+}
+
+// add len samples to the group that is being accumulated
+static void group_add(struct context *ctx, const float *samples, const ssize_t len)
+{
+    v4sf vsum, vmin, vmax, x;
+    float sum = 0;
+    ssize_t i = 0;
+
+    if (len >= V4SF_LANES) {
+        vsum = v4sf_set1(0);
+        vmin = v4sf_set1(FLT_MAX);
+        vmax = v4sf_set1(-FLT_MAX);
+        for (; i + V4SF_LANES <= len; i += V4SF_LANES) {
+            x = v4sf_load(samples + i);
+            vsum += x;
+            vmin = v4sf_min(vmin, x);
+            vmax = v4sf_max(vmax, x);
+        }
+        sum = v4sf_hsum(vsum);
+        if (v4sf_hmin(vmin) < ctx->min)
+            ctx->min = v4sf_hmin(vmin);
+        if (v4sf_hmax(vmax) > ctx->max)
+            ctx->max = v4sf_hmax(vmax);
+    }
+
+    for (; i < len; i++) {
+        sum += samples[i];
+        if (samples[i] < ctx->min)
+            ctx->min = samples[i];
+        if (samples[i] > ctx->max)
+            ctx->max = samples[i];
+    }
+
+    ctx->sum += sum;
+    ctx->cnt += len;
+}
+
+// average and min/max modes, groups can span chunks
+static ssize_t decimate_groups(struct context *ctx, const float *samples, const ssize_t num_samples)
+{
+    ssize_t i = 0, len, out = 0;
+
+    while (i < num_samples) {
+        len = ctx->factor - ctx->cnt;
+        if (len > num_samples - i)
+            len = num_samples - i;
+        group_add(ctx, samples + i, len);
+        i += len;
+
+        if (ctx->cnt == ctx->factor) {
+            if (ctx->mode == DECIMATE_AVERAGE) {
+                ctx->out[out++] = ctx->sum / ctx->factor;
+            } else {
+                ctx->out[out++] = ctx->min;
+                ctx->out[out++] = ctx->max;
+            }
+            group_reset(ctx);
+        }
+    }
+
+    return out;
+}
+
+// rate of the channel after decimation, min/max mode outputs two samples for each group
+static uint64_t rate_out(const struct context *ctx, const uint64_t rate)
+{
+    if (ctx->mode == DECIMATE_MINMAX)
+        return rate * 2 / ctx->factor;
+
+    return rate / ctx->factor;
+}
+
+// lowpass filter that is only evaluated on the samples that are kept
+static ssize_t decimate_antialias(struct context *ctx, const float *samples, const ssize_t num_samples)
+{
+    ssize_t hist = ctx->taps - 1;
+    ssize_t pos, out = 0;
+
+    if (ctx->work_sz < num_samples + hist) {
+        ctx->work = g_realloc(ctx->work, (num_samples + hist) * sizeof(float));
+        ctx->work_sz = num_samples + hist;
+    }
+
+    // the history starts out as a copy of the first sample
+    if (!ctx->primed) {
+        for (pos = 0; pos < hist; pos++)
+            ctx->work[pos] = samples[0];
+        ctx->primed = true;
+    }
+
+    memcpy(ctx->work + hist, samples, num_samples * sizeof(float));
+
+    for (pos = ctx->skip; pos < num_samples; pos += ctx->factor)
+        ctx->out[out++] = dsp_dot(ctx->h, ctx->work + pos, ctx->taps);
+
+    ctx->skip = pos - num_samples;
+    memmove(ctx->work, ctx->work + num_samples, hist * sizeof(float));
+
+    return out;
+}
+
+// the incomplete last group, or the inputs the fir still holds back, end the channel
+static ssize_t decimate_flush(struct context *ctx)
+{
+    ssize_t pad, i, out = 0;
+    float *edge;
+
+    if (ctx->mode != DECIMATE_ANTIALIAS) {
+        if (!ctx->cnt)
+            return 0;
+        if (ctx->mode == DECIMATE_AVERAGE) {
+            ctx->out[out++] = ctx->sum / ctx->cnt;
+        } else {
+            ctx->out[out++] = ctx->min;
+            ctx->out[out++] = ctx->max;
+        }
+        group_reset(ctx);
+        return out;
+    }
+
+    // the last sample is repeated for the group delay, this brings out the outputs centred on the last inputs
+    pad = (ctx->taps - 1) / 2;
+    if (!ctx->primed || !pad)
+        return 0;
+    edge = g_malloc(pad * sizeof(float));
+    for (i = 0; i < pad; i++)
+        edge[i] = ctx->work[ctx->taps - 2];
+    out = decimate_antialias(ctx, edge, pad);
+    g_free(edge);
+
+    return out;
+}
+
+static void out_reserve(struct context *ctx, const ssize_t out_sz)
+{
+    if (ctx->out_sz < out_sz) {
+        ctx->out = g_realloc(ctx->out, out_sz * sizeof(float));
+        ctx->out_sz = out_sz;
+    }
+}
+
+static void antialias_design(struct context *ctx)
+{
+    double *h;
+    uint32_t i;
+
+    h = g_malloc0(ctx->taps * sizeof(double));
+    // cut off at the new Nyquist frequency
+    dsp_sinc_lowpass(h, ctx->taps, 0.5 / ctx->factor);
+    dsp_hamming(h, ctx->taps);
+    dsp_normalize(h, ctx->taps, 1.0);
+
+    ctx->h = g_malloc0(ctx->taps * sizeof(float));
+    for (i = 0; i < ctx->taps; i++)
+        ctx->h[i] = h[ctx->taps - 1 - i];
+
+    g_free(h);
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+    struct context *ctx;
+    struct dev_frame *frame;
+    enum decimate_mode mode;
+    uint32_t factor;
+    const char *s;
+
+    if (!t || !t->sdi || !options)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+
+    /* Options */
+    s = g_variant_get_string(g_hash_table_lookup(options, "mode"), NULL);
+    if (!strcmp(s, "average")) {
+        mode = DECIMATE_AVERAGE;
+    } else if (!strcmp(s, "minmax")) {
+        mode = DECIMATE_MINMAX;
+    } else if (!strcmp(s, "antialias")) {
+        mode = DECIMATE_ANTIALIAS;
+    } else {
+        err_msg("%s:%d unknown decimation mode '%s'", __FILE__, __LINE__, s);
+        return SR_ERR_ARG;
+    }
+
+    factor = g_variant_get_uint32(g_hash_table_lookup(options, "factor"));
+    if (factor < 2) {
+        err_msg("%s:%d the decimation factor must be at least 2", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    // the options are valid, nothing is allocated before this point
+    t->priv = ctx = g_malloc0(sizeof(struct context));
+    ctx->mode = mode;
+    ctx->factor = factor;
+    ctx->taps = g_variant_get_uint32(g_hash_table_lookup(options, "taps"));
+
+    if (ctx->mode == DECIMATE_ANTIALIAS) {
+        if (!ctx->taps)
+            ctx->taps = 8 * ctx->factor + 1;
+        ctx->taps |= 1;
+        if (ctx->taps > DECIMATE_MAX_TAPS)
+            ctx->taps = DECIMATE_MAX_TAPS;
+        antialias_design(ctx);
+    }
+
+    frame->samplerate = rate_out(ctx, frame->samplerate);
+
+    ctx->pkt.payload = &ctx->analog;
+
+    return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+                   struct sr_datafeed_packet *packet_in, struct sr_datafeed_packet **packet_out)
+{
+    struct context *ctx;
+    const struct sr_datafeed_analog *analog;
+    struct dev_frame *frame;
+
+    if (!t || !packet_in || !packet_out)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+    ctx = t->priv;
+
+    switch (packet_in->type) {
+    case SR_DF_FRAME_BEGIN:
+        // every channel starts with a fresh state
+        group_reset(ctx);
+        ctx->skip = ctx->factor - 1;
+        // output k of the fir is centred on input k * factor, this compensates the group delay
+        if (ctx->mode == DECIMATE_ANTIALIAS)
+            ctx->skip = (ctx->taps - 1) / 2;
+        ctx->primed = false;
+        frame->samplerate = rate_out(ctx, frame->samplerate);
+        break;
+    case SR_DF_ANALOG:
+        analog = packet_in->payload;
+        // worst case is one min/max pair per input sample
+        out_reserve(ctx, analog->num_samples + 2);
+
+        memcpy(&ctx->analog, analog, sizeof(struct sr_datafeed_analog));
+        ctx->analog.data = ctx->out;
+        if (ctx->mode == DECIMATE_ANTIALIAS)
+            ctx->analog.num_samples = decimate_antialias(ctx, analog->data, analog->num_samples);
+        else
+            ctx->analog.num_samples = decimate_groups(ctx, analog->data, analog->num_samples);
+
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    case SR_DF_FRAME_END:
+        // the channel gives ceil(n / factor) outputs, the rest follows as one more packet
+        out_reserve(ctx, ctx->taps + 2);
+        ctx->analog.data = ctx->out;
+        ctx->analog.num_samples = decimate_flush(ctx);
+        if (!ctx->analog.num_samples)
+            break;
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    default:
+        break;
+    }
+
+    *packet_out = packet_in;
+
+    return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+    struct context *ctx;
+
+    if (!t)
+        return SR_ERR_ARG;
+
+    if (t->priv) {
+        ctx = t->priv;
+        g_free(ctx->h);
+        g_free(ctx->work);
+        g_free(ctx->out);
+        g_free(ctx);
+        t->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"mode", "Mode", "average, minmax (a min/max pair per group) or antialias (fir lowpass)", NULL, NULL},
+    {"factor", "Factor", "number of input samples that are reduced to one output sample", NULL, NULL},
+    {"taps", "Taps", "number of antialias fir taps, 8 * factor + 1 by default", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string("minmax"));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(10));
+        options[2].def = g_variant_ref_sink(g_variant_new_uint32(0));
+    }
+
+    return options;
+}
+
+struct sr_transform_module transform_decimate = {
+    .id = "decimate",
+    .name = "decimate",
+    .desc = "reduce the sample rate by an integer factor",
+    // changes the number of samples, so it is never fused into blocks
+    .flags = 0,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
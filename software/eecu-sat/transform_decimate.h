@@ -0,0 +1,6 @@
+#ifndef __TRANSFORM_DECIMATE_H__
+#define __TRANSFORM_DECIMATE_H__
+
+extern struct sr_transform_module transform_decimate;
+
+#endif
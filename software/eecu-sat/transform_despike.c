@@ -0,0 +1,454 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "transform.h"
+
+#define  DESPIKE_MAX_WINDOW  255
+// windows up to this size use sorting networks
+#define  DESPIKE_NET_WINDOW  7
+// scales the median absolute deviation to the standard deviation of a gaussian
+#define        MAD_TO_SIGMA  1.4826f
+
+enum despike_mode {
+    DESPIKE_MEDIAN = 0,
+    DESPIKE_HAMPEL,
+};
+
+struct context {
+    enum despike_mode mode;
+    uint32_t window;
+    float threshold;
+    float min_dev;
+    bool primed;
+    ssize_t skip;               // outputs still to drop at the start of the channel
+    float last;                 // last input sample of the channel
+    float tail[DESPIKE_MAX_WINDOW / 2];
+    // generic path, the window in time order and the same samples kept sorted
+    float ring[DESPIKE_MAX_WINDOW];
+    float sorted[DESPIKE_MAX_WINDOW];
+    uint32_t pos;               // oldest sample in ring
+    // sorting network path, the last window - 1 samples followed by the current block
+    float *work;
+    ssize_t work_sz;
+    struct sr_datafeed_packet pkt;
+    struct sr_datafeed_analog analog;
+};
+
+/*
+ * replace one value of a sorted array with another and restore the order.
+ * this is one step of an insertion sort, it only moves the elements that lie
+ * between the two values which for a slowly changing signal are very few.
+ */
+static void sorted_replace(float *s, const uint32_t len, const float old, const float x)
+{
+    uint32_t lo = 0, hi = len - 1, mid;
+
+    // binary search for old
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (s[mid] < old)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (x > old) {
+        while ((lo + 1 < len) && (s[lo + 1] < x)) {
+            s[lo] = s[lo + 1];
+            lo++;
+        }
+    } else {
+        while ((lo > 0) && (s[lo - 1] > x)) {
+            s[lo] = s[lo - 1];
+            lo--;
+        }
+    }
+    s[lo] = x;
+}
+
+// median absolute deviation, the k-th smallest distance to the median of a sorted window
+static float sorted_mad(const float *s, const uint32_t len)
+{
+    uint32_t k = len / 2;
+    int32_t l = k - 1;
+    uint32_t r = k + 1;
+    uint32_t cnt;
+    float m = s[k];
+    float d = 0;
+
+    // the two sides are already ordered by distance, merge them
+    for (cnt = 0; cnt < k; cnt++) {
+        if ((l >= 0) && ((r >= len) || (m - s[l] <= s[r] - m)))
+            d = m - s[l--];
+        else
+            d = s[r++] - m;
+    }
+
+    return d;
+}
+
+static void despike_generic(struct context *ctx, float *samples, const ssize_t num_samples)
+{
+    const uint32_t w = ctx->window;
+    const uint32_t k = w / 2;
+    uint32_t center;
+    float m, x, mad;
+    ssize_t i;
+
+    for (i = 0; i < num_samples; i++) {
+        x = samples[i];
+        sorted_replace(ctx->sorted, w, ctx->ring[ctx->pos], x);
+        ctx->ring[ctx->pos] = x;
+        ctx->pos++;
+        if (ctx->pos == w)
+            ctx->pos = 0;
+
+        m = ctx->sorted[k];
+        if (ctx->mode == DESPIKE_MEDIAN) {
+            samples[i] = m;
+        } else {
+            // the sample in the middle of the window is the one being judged
+            center = ctx->pos + k;
+            if (center >= w)
+                center -= w;
+            x = ctx->ring[center];
+            // a quantized flat signal has a MAD of zero, small deviations are never spikes
+            if (fabsf(x - m) > ctx->min_dev) {
+                mad = sorted_mad(ctx->sorted, w);
+                if (fabsf(x - m) > ctx->threshold * MAD_TO_SIGMA * mad)
+                    x = m;
+            }
+            samples[i] = x;
+        }
+    }
+}
+
+#define  SORT2(a, b)  { v4sf t = a; a = v4sf_min(t, b); b = v4sf_max(t, b); }
+
+/*
+ * medians of three, five and seven samples as sorting networks, evaluated
+ * for four consecutive windows at a time. p points to the oldest sample.
+ */
+static inline v4sf median_net(const float *p, const uint32_t window)
+{
+    v4sf p0, p1, p2, p3, p4, p5, p6;
+
+    p0 = v4sf_load(p);
+    p1 = v4sf_load(p + 1);
+    p2 = v4sf_load(p + 2);
+
+    if (window == 3) {
+        SORT2(p0, p1);
+        p1 = v4sf_min(p1, p2);
+        return v4sf_max(p0, p1);
+    }
+
+    p3 = v4sf_load(p + 3);
+    p4 = v4sf_load(p + 4);
+
+    if (window == 5) {
+        SORT2(p0, p1);
+        SORT2(p3, p4);
+        p3 = v4sf_max(p0, p3);
+        p1 = v4sf_min(p1, p4);
+        SORT2(p1, p2);
+        p2 = v4sf_min(p2, p3);
+        return v4sf_max(p1, p2);
+    }
+
+    p5 = v4sf_load(p + 5);
+    p6 = v4sf_load(p + 6);
+
+    SORT2(p0, p5);
+    SORT2(p0, p3);
+    SORT2(p1, p6);
+    SORT2(p2, p4);
+    SORT2(p0, p1);
+    SORT2(p3, p5);
+    SORT2(p2, p6);
+    SORT2(p2, p3);
+    SORT2(p3, p6);
+    SORT2(p4, p5);
+    SORT2(p1, p4);
+    SORT2(p1, p3);
+    SORT2(p3, p4);
+    return p3;
+}
+
+// hampel decision for a single window, p points to the oldest sample
+static float hampel_one(const struct context *ctx, const float *p, const float m)
+{
+    float s[DESPIKE_NET_WINDOW];
+    float c = p[ctx->window / 2];
+    float x;
+    uint32_t i, j;
+
+    // insertion sort
+    for (i = 0; i < ctx->window; i++) {
+        x = p[i];
+        for (j = i; (j > 0) && (s[j - 1] > x); j--)
+            s[j] = s[j - 1];
+        s[j] = x;
+    }
+
+    if (fabsf(c - m) > ctx->threshold * MAD_TO_SIGMA * sorted_mad(s, ctx->window))
+        return m;
+
+    return c;
+}
+
+// windows of up to DESPIKE_NET_WINDOW samples
+static void despike_network(struct context *ctx, float *samples, const ssize_t num_samples)
+{
+    const ssize_t hist = ctx->window - 1;
+    const uint32_t k = ctx->window / 2;
+    const v4sf min_dev = v4sf_set1(ctx->min_dev);
+    v4sf m, c;
+    v4si spike;
+    float *w;
+    ssize_t i;
+    int j;
+
+    if (ctx->work_sz < num_samples + hist) {
+        ctx->work = g_realloc(ctx->work, (num_samples + hist + V4SF_LANES) * sizeof(float));
+        ctx->work_sz = num_samples + hist;
+    }
+
+    w = ctx->work;
+    memcpy(w + hist, samples, num_samples * sizeof(float));
+
+    // the vector loop can overrun the block by up to three samples, these outputs are ignored
+    memset(w + hist + num_samples, 0, V4SF_LANES * sizeof(float));
+
+    for (i = 0; i < num_samples; i += V4SF_LANES) {
+        m = median_net(w + i, ctx->window);
+        if (ctx->mode == DESPIKE_HAMPEL) {
+            // the full test is only needed where the center is far enough from the median
+            c = v4sf_load(w + i + k);
+            spike = v4sf_abs(c - m) > min_dev;
+            if (v4si_any(spike)) {
+                for (j = 0; j < V4SF_LANES; j++)
+                    if (spike[j])
+                        c[j] = hampel_one(ctx, w + i + j, m[j]);
+            }
+            m = c;
+        }
+        if (i + V4SF_LANES <= num_samples)
+            v4sf_store(samples + i, m);
+        else
+            memcpy(samples + i, &m, (num_samples - i) * sizeof(float));
+    }
+
+    memmove(w, w + num_samples, hist * sizeof(float));
+}
+
+static void despike(struct context *ctx, float *samples, const ssize_t num_samples)
+{
+    if (ctx->window <= DESPIKE_NET_WINDOW)
+        despike_network(ctx, samples, num_samples);
+    else
+        despike_generic(ctx, samples, num_samples);
+}
+
+// the window starts out filled with the first sample of the channel
+static void despike_prime(struct context *ctx, const float x)
+{
+    uint32_t i;
+
+    for (i = 0; i < ctx->window; i++) {
+        ctx->ring[i] = x;
+        ctx->sorted[i] = x;
+    }
+    ctx->pos = 0;
+
+    if (!ctx->work) {
+        ctx->work = g_malloc0((ctx->window + V4SF_LANES) * sizeof(float));
+        ctx->work_sz = ctx->window;
+    }
+    for (i = 0; i < ctx->window - 1; i++)
+        ctx->work[i] = x;
+
+    ctx->primed = true;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+    struct context *ctx;
+    const char *s;
+
+    if (!t || !options)
+        return SR_ERR_ARG;
+
+    t->priv = ctx = g_malloc0(sizeof(struct context));
+    ctx->pkt.payload = &ctx->analog;
+
+    /* Options */
+    s = g_variant_get_string(g_hash_table_lookup(options, "mode"), NULL);
+    if (!strcmp(s, "median")) {
+        ctx->mode = DESPIKE_MEDIAN;
+    } else if (!strcmp(s, "hampel")) {
+        ctx->mode = DESPIKE_HAMPEL;
+    } else {
+        err_msg("%s:%d unknown despike mode '%s'", __FILE__, __LINE__, s);
+        goto err;
+    }
+
+    ctx->window = g_variant_get_uint32(g_hash_table_lookup(options, "window"));
+    ctx->threshold = g_variant_get_double(g_hash_table_lookup(options, "threshold"));
+    ctx->min_dev = g_variant_get_double(g_hash_table_lookup(options, "min_dev"));
+
+    ctx->window |= 1;
+    if ((ctx->window < 3) || (ctx->window > DESPIKE_MAX_WINDOW)) {
+        err_msg("%s:%d the despike window must be between 3 and %d samples", __FILE__, __LINE__, DESPIKE_MAX_WINDOW);
+        goto err;
+    }
+
+    return SR_OK;
+
+ err:
+    g_free(ctx);
+    t->priv = NULL;
+    return SR_ERR_ARG;
+}
+
+static int receive(const struct sr_transform *t,
+                   struct sr_datafeed_packet *packet_in, struct sr_datafeed_packet **packet_out)
+{
+    struct context *ctx;
+    const struct sr_datafeed_analog *analog;
+    float *samples;
+    ssize_t drop, k;
+
+    if (!t || !packet_in || !packet_out)
+        return SR_ERR_ARG;
+
+    ctx = t->priv;
+
+    switch (packet_in->type) {
+    case SR_DF_FRAME_BEGIN:
+        ctx->primed = false;
+        // output i is the window centred on input i + window / 2, this compensates the delay
+        ctx->skip = ctx->window / 2;
+        break;
+    case SR_DF_ANALOG:
+        analog = packet_in->payload;
+        samples = analog->data;
+        if (!analog->num_samples)
+            break;
+        if (!ctx->primed)
+            despike_prime(ctx, samples[0]);
+        ctx->last = samples[analog->num_samples - 1];
+        memcpy(&ctx->analog, analog, sizeof(struct sr_datafeed_analog));
+        despike(ctx, samples, analog->num_samples);
+        if (ctx->skip) {
+            drop = MIN(ctx->skip, analog->num_samples);
+            memmove(samples, samples + drop, (analog->num_samples - drop) * sizeof(float));
+            ctx->skip -= drop;
+            ctx->analog.num_samples -= drop;
+            ctx->pkt.type = SR_DF_ANALOG;
+            *packet_out = &ctx->pkt;
+            return SR_OK;
+        }
+        break;
+    case SR_DF_FRAME_END:
+        if (!ctx->primed)
+            break;
+        // the last sample is repeated for half a window, the channel keeps its length
+        k = ctx->window / 2;
+        for (drop = 0; drop < k; drop++)
+            ctx->tail[drop] = ctx->last;
+        despike(ctx, ctx->tail, k);
+        drop = MIN(ctx->skip, k);
+        ctx->skip -= drop;
+        ctx->analog.data = ctx->tail + drop;
+        ctx->analog.num_samples = k - drop;
+        ctx->primed = false;
+        if (!ctx->analog.num_samples)
+            break;
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    default:
+        break;
+    }
+
+    /* Return the in-place-modified packet. */
+    *packet_out = packet_in;
+
+    return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+    struct context *ctx;
+
+    if (!t)
+        return SR_ERR_ARG;
+
+    if (t->priv) {
+        ctx = t->priv;
+        g_free(ctx->work);
+        g_free(ctx);
+        t->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"mode", "Mode", "median (replace every sample) or hampel (replace outliers only)", NULL, NULL},
+    {"window", "Window", "number of samples in the sliding window, rounded up to an odd number", NULL, NULL},
+    {"threshold", "Threshold", "hampel outlier threshold in standard deviations", NULL, NULL},
+    {"min_dev", "Minimum deviation", "hampel deviations from the median up to this value are kept", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string("hampel"));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(7));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(3.0));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0.05));
+    }
+
+    return options;
+}
+
+struct sr_transform_module transform_despike = {
+    .id = "despike",
+    .name = "despike",
+    .desc = "sliding window median or hampel filter against transient spikes",
+    // drops the first window / 2 outputs of a channel, so it is never fused into blocks
+    .flags = 0,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
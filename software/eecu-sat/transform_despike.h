@@ -0,0 +1,6 @@
+#ifndef __TRANSFORM_DESPIKE_H__
+#define __TRANSFORM_DESPIKE_H__
+
+extern struct sr_transform_module transform_despike;
+
+#endif
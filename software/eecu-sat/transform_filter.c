@@ -0,0 +1,524 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <math.h>
+#include "proj.h"
+#include "error.h"
+#include "simd.h"
+#include "dsp.h"
+#include "transform.h"
+
+#define  FILTER_MAX_TAPS  1024
+#define  FILTER_MAX_SECT  8
+
+enum filter_type {
+    FILTER_LOWPASS = 0,
+    FILTER_BANDPASS,
+    FILTER_NOTCH,
+};
+
+enum filter_design {
+    FILTER_IIR = 0,
+    FILTER_FIR,
+};
+
+/*
+ * a biquad in transposed direct form II has a two element state. four
+ * outputs and the state four samples later are linear combinations of the
+ * current state and of the next four inputs, so the recursion only has to
+ * advance once every four samples and the outputs are computed in parallel.
+ */
+struct biquad {
+    v4sf ys[2];                 // output contribution of z1, z2
+    v4sf yx[V4SF_LANES];        // output contribution of x[n+j]
+    float ss[2][2];             // state contribution of z1, z2
+    float sx[2][V4SF_LANES];    // state contribution of x[n+j]
+    double b0, b1, b2, a1, a2;
+    float z1, z2;
+};
+
+struct context {
+    enum filter_type type;
+    enum filter_design design;
+    double freq;
+    double width;
+    double q;
+    uint32_t sections;
+    uint32_t taps;
+    gchar *coeffs;
+    uint64_t samplerate_opt;
+    uint64_t samplerate;        // of the current channel as it reaches the filter
+    struct biquad bq[FILTER_MAX_SECT];
+    float *h;                   // FIR taps in reverse order
+    float *work;                // FIR history followed by the current block
+    ssize_t work_sz;
+};
+
+static int parse_type(const char *s, enum filter_type *type)
+{
+    if (!strcmp(s, "lowpass"))
+        *type = FILTER_LOWPASS;
+    else if (!strcmp(s, "bandpass"))
+        *type = FILTER_BANDPASS;
+    else if (!strcmp(s, "notch"))
+        *type = FILTER_NOTCH;
+    else
+        return SR_ERR_ARG;
+
+    return SR_OK;
+}
+
+static void biquad_prepare(struct biquad *bq)
+{
+    double f[2][2], fk[2][2], t[2][2], g[2];
+    double c[V4SF_LANES][2];    // c * F^k
+    int i, j, k;
+
+    // s' = F s + g x, y = z1 + b0 x
+    f[0][0] = -bq->a1;
+    f[0][1] = 1.0;
+    f[1][0] = -bq->a2;
+    f[1][1] = 0.0;
+    g[0] = bq->b1 - bq->a1 * bq->b0;
+    g[1] = bq->b2 - bq->a2 * bq->b0;
+
+    // fk = F^0
+    fk[0][0] = 1.0;
+    fk[0][1] = 0.0;
+    fk[1][0] = 0.0;
+    fk[1][1] = 1.0;
+
+    for (k = 0; k < V4SF_LANES; k++) {
+        c[k][0] = fk[0][0];
+        c[k][1] = fk[0][1];
+        // fk = F^(k+1)
+        for (i = 0; i < 2; i++)
+            for (j = 0; j < 2; j++)
+                t[i][j] = f[i][0] * fk[0][j] + f[i][1] * fk[1][j];
+        memcpy(fk, t, sizeof(fk));
+    }
+
+    for (k = 0; k < V4SF_LANES; k++) {
+        bq->ys[0][k] = c[k][0];
+        bq->ys[1][k] = c[k][1];
+        for (j = 0; j < V4SF_LANES; j++) {
+            if (j < k)
+                bq->yx[j][k] = c[k - 1 - j][0] * g[0] + c[k - 1 - j][1] * g[1];
+            else if (j == k)
+                bq->yx[j][k] = bq->b0;
+            else
+                bq->yx[j][k] = 0;
+        }
+    }
+
+    // fk is F^4 at this point, t is reused for F^(3-j) g
+    for (i = 0; i < 2; i++)
+        for (j = 0; j < 2; j++)
+            bq->ss[i][j] = fk[i][j];
+
+    t[0][0] = g[0];
+    t[1][0] = g[1];
+    for (j = V4SF_LANES - 1; j >= 0; j--) {
+        bq->sx[0][j] = t[0][0];
+        bq->sx[1][j] = t[1][0];
+        t[0][1] = f[0][0] * t[0][0] + f[0][1] * t[1][0];
+        t[1][1] = f[1][0] * t[0][0] + f[1][1] * t[1][0];
+        t[0][0] = t[0][1];
+        t[1][0] = t[1][1];
+    }
+}
+
+// RBJ audio EQ cookbook designs, normalized to a0 = 1
+static int iir_design(struct context *ctx)
+{
+    double w0, alpha, cs, a0, q;
+    struct biquad bq = { 0 };
+    uint32_t i;
+
+    w0 = 2.0 * M_PI * ctx->freq / (double) ctx->samplerate;
+    cs = cos(w0);
+    if (ctx->type == FILTER_LOWPASS)
+        q = ctx->q;
+    else
+        q = ctx->freq / ctx->width;
+    alpha = sin(w0) / (2.0 * q);
+    a0 = 1.0 + alpha;
+
+    switch (ctx->type) {
+    case FILTER_LOWPASS:
+        bq.b0 = (1.0 - cs) / 2.0;
+        bq.b1 = 1.0 - cs;
+        bq.b2 = (1.0 - cs) / 2.0;
+        break;
+    case FILTER_BANDPASS:
+        bq.b0 = alpha;
+        bq.b1 = 0;
+        bq.b2 = -alpha;
+        break;
+    case FILTER_NOTCH:
+        bq.b0 = 1.0;
+        bq.b1 = -2.0 * cs;
+        bq.b2 = 1.0;
+        break;
+    }
+    bq.b0 /= a0;
+    bq.b1 /= a0;
+    bq.b2 /= a0;
+    bq.a1 = -2.0 * cs / a0;
+    bq.a2 = (1.0 - alpha) / a0;
+
+    biquad_prepare(&bq);
+    for (i = 0; i < ctx->sections; i++)
+        ctx->bq[i] = bq;
+
+    return SR_OK;
+}
+
+// windowed sinc designs, fc is normalized to the sample rate
+static int fir_design(struct context *ctx)
+{
+    double *h, *hl;
+    double f1, f2;
+    uint32_t i, taps;
+    char **tokens;
+
+    if (ctx->coeffs && ctx->coeffs[0]) {
+        tokens = g_strsplit(ctx->coeffs, ",", -1);
+        taps = g_strv_length(tokens);
+        if (!taps || (taps > FILTER_MAX_TAPS)) {
+            err_msg("%s:%d between 1 and %d FIR coefficients are accepted", __FILE__, __LINE__, FILTER_MAX_TAPS);
+            g_strfreev(tokens);
+            return SR_ERR_ARG;
+        }
+        ctx->taps = taps;
+        ctx->h = g_malloc0(taps * sizeof(float));
+        for (i = 0; i < taps; i++)
+            ctx->h[taps - 1 - i] = strtod(tokens[i], NULL);
+        g_strfreev(tokens);
+        return SR_OK;
+    }
+
+    taps = ctx->taps | 1;
+    if (taps > FILTER_MAX_TAPS) {
+        err_msg("%s:%d at most %d FIR taps are accepted", __FILE__, __LINE__, FILTER_MAX_TAPS);
+        return SR_ERR_ARG;
+    }
+    ctx->taps = taps;
+
+    h = g_malloc0(taps * sizeof(double));
+    hl = g_malloc0(taps * sizeof(double));
+    f1 = (ctx->freq - ctx->width / 2.0) / (double) ctx->samplerate;
+    f2 = (ctx->freq + ctx->width / 2.0) / (double) ctx->samplerate;
+
+    switch (ctx->type) {
+    case FILTER_LOWPASS:
+        dsp_sinc_lowpass(h, taps, ctx->freq / (double) ctx->samplerate);
+        break;
+    case FILTER_BANDPASS:
+    case FILTER_NOTCH:
+        dsp_sinc_lowpass(h, taps, f2);
+        dsp_sinc_lowpass(hl, taps, f1);
+        for (i = 0; i < taps; i++)
+            h[i] -= hl[i];
+        break;
+    }
+
+    dsp_hamming(h, taps);
+
+    if (ctx->type == FILTER_LOWPASS) {
+        // unity gain at DC
+        dsp_normalize(h, taps, 1.0);
+    } else if (ctx->type == FILTER_NOTCH) {
+        // band-stop is the complement of the band-pass
+        for (i = 0; i < taps; i++)
+            h[i] = -h[i];
+        h[(taps - 1) / 2] += 1.0;
+    }
+
+    ctx->h = g_malloc0(taps * sizeof(float));
+    for (i = 0; i < taps; i++)
+        ctx->h[taps - 1 - i] = h[i];
+
+    g_free(h);
+    g_free(hl);
+
+    return SR_OK;
+}
+
+static void iir_run(struct biquad *bq, float *samples, ssize_t num_samples)
+{
+    ssize_t i;
+    v4sf x, y;
+    float z1 = bq->z1;
+    float z2 = bq->z2;
+    float n1, n2;
+    double y1;
+
+    for (i = 0; i + V4SF_LANES <= num_samples; i += V4SF_LANES) {
+        x = v4sf_load(samples + i);
+        y = bq->ys[0] * z1 + bq->ys[1] * z2 + bq->yx[0] * x[0] + bq->yx[1] * x[1] + bq->yx[2] * x[2] + bq->yx[3] * x[3];
+        n1 = bq->ss[0][0] * z1 + bq->ss[0][1] * z2
+            + bq->sx[0][0] * x[0] + bq->sx[0][1] * x[1] + bq->sx[0][2] * x[2] + bq->sx[0][3] * x[3];
+        n2 = bq->ss[1][0] * z1 + bq->ss[1][1] * z2
+            + bq->sx[1][0] * x[0] + bq->sx[1][1] * x[1] + bq->sx[1][2] * x[2] + bq->sx[1][3] * x[3];
+        z1 = n1;
+        z2 = n2;
+        v4sf_store(samples + i, y);
+    }
+
+    // tail of the block, one sample at a time
+    for (; i < num_samples; i++) {
+        y1 = z1 + bq->b0 * samples[i];
+        n1 = bq->b1 * samples[i] - bq->a1 * y1 + z2;
+        z2 = bq->b2 * samples[i] - bq->a2 * y1;
+        z1 = n1;
+        samples[i] = y1;
+    }
+
+    bq->z1 = z1;
+    bq->z2 = z2;
+}
+
+static void fir_run(struct context *ctx, float *samples, ssize_t num_samples)
+{
+    ssize_t i, k;
+    ssize_t hist = ctx->taps - 1;
+    float *w;
+    v4sf acc;
+    float sacc;
+
+    if (hist + num_samples > ctx->work_sz) {
+        // the history starts out as silence
+        if (!ctx->work)
+            ctx->work = g_malloc0((hist + num_samples) * sizeof(float));
+        else
+            ctx->work = g_realloc(ctx->work, (hist + num_samples) * sizeof(float));
+        ctx->work_sz = hist + num_samples;
+    }
+    w = ctx->work;
+    memcpy(w + hist, samples, num_samples * sizeof(float));
+
+    // out[i] = sum h_rev[k] * w[i + k], four outputs per pass over the taps
+    for (i = 0; i + V4SF_LANES <= num_samples; i += V4SF_LANES) {
+        acc = v4sf_set1(0);
+        for (k = 0; k <= hist; k++)
+            acc += v4sf_set1(ctx->h[k]) * v4sf_load(w + i + k);
+        v4sf_store(samples + i, acc);
+    }
+    for (; i < num_samples; i++) {
+        sacc = 0;
+        for (k = 0; k <= hist; k++)
+            sacc += ctx->h[k] * w[i + k];
+        samples[i] = sacc;
+    }
+
+    // keep the last taps - 1 input samples for the next block
+    memmove(w, w + num_samples, hist * sizeof(float));
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+    struct context *ctx;
+    const char *s;
+
+    if (!t || !t->sdi || !options)
+        return SR_ERR_ARG;
+
+    t->priv = ctx = g_malloc0(sizeof(struct context));
+
+    /* Options */
+    s = g_variant_get_string(g_hash_table_lookup(options, "type"), NULL);
+    if (parse_type(s, &ctx->type) != SR_OK) {
+        err_msg("%s:%d unknown filter type '%s'", __FILE__, __LINE__, s);
+        goto err;
+    }
+
+    s = g_variant_get_string(g_hash_table_lookup(options, "design"), NULL);
+    if (!strcmp(s, "iir")) {
+        ctx->design = FILTER_IIR;
+    } else if (!strcmp(s, "fir")) {
+        ctx->design = FILTER_FIR;
+    } else {
+        err_msg("%s:%d unknown filter design '%s'", __FILE__, __LINE__, s);
+        goto err;
+    }
+
+    ctx->freq = g_variant_get_double(g_hash_table_lookup(options, "freq"));
+    ctx->width = g_variant_get_double(g_hash_table_lookup(options, "width"));
+    ctx->q = g_variant_get_double(g_hash_table_lookup(options, "q"));
+    ctx->sections = g_variant_get_uint32(g_hash_table_lookup(options, "sections"));
+    ctx->taps = g_variant_get_uint32(g_hash_table_lookup(options, "taps"));
+    ctx->coeffs = g_strdup(g_variant_get_string(g_hash_table_lookup(options, "coeffs"), NULL));
+    ctx->samplerate_opt = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
+
+    if (ctx->coeffs[0])
+        ctx->design = FILTER_FIR;
+
+    if (!ctx->coeffs[0] && (ctx->freq <= 0)) {
+        err_msg("%s:%d the filter needs a 'freq' option", __FILE__, __LINE__);
+        goto err;
+    }
+
+    if ((ctx->type != FILTER_LOWPASS) && (ctx->width <= 0))
+        ctx->width = ctx->freq / 10.0;
+
+    if ((ctx->sections < 1) || (ctx->sections > FILTER_MAX_SECT)) {
+        err_msg("%s:%d between 1 and %d filter sections are accepted", __FILE__, __LINE__, FILTER_MAX_SECT);
+        goto err;
+    }
+
+    return SR_OK;
+
+ err:
+    // a module that fails to initialize is freed without its cleanup
+    g_free(ctx->coeffs);
+    g_free(ctx);
+    t->priv = NULL;
+
+    return SR_ERR_ARG;
+}
+
+static int receive(const struct sr_transform *t,
+                   struct sr_datafeed_packet *packet_in, struct sr_datafeed_packet **packet_out)
+{
+    struct context *ctx;
+    const struct sr_datafeed_analog *analog;
+    struct dev_frame *frame;
+    uint64_t samplerate;
+    uint32_t i;
+    int ret;
+
+    if (!t || !packet_in || !packet_out)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+    ctx = t->priv;
+
+    switch (packet_in->type) {
+    case SR_DF_FRAME_BEGIN:
+        // (re)design the filter for every channel since sample rates might differ
+        samplerate = frame->samplerate ? frame->samplerate : ctx->samplerate_opt;
+        if (!samplerate && !ctx->coeffs[0]) {
+            err_msg("%s:%d unknown sample rate for channel %d, use the 'samplerate' option", __FILE__, __LINE__, frame->ch);
+            return SR_ERR_ARG;
+        }
+        if (ctx->freq * 2.0 >= samplerate && !ctx->coeffs[0]) {
+            err_msg("%s:%d filter frequency is above the Nyquist frequency", __FILE__, __LINE__);
+            return SR_ERR_ARG;
+        }
+        ctx->samplerate = samplerate;
+
+        if (ctx->design == FILTER_IIR) {
+            ret = iir_design(ctx);
+        } else {
+            g_free(ctx->h);
+            g_free(ctx->work);
+            ctx->h = NULL;
+            ctx->work = NULL;
+            ctx->work_sz = 0;
+            ret = fir_design(ctx);
+        }
+        if (ret != SR_OK)
+            return ret;
+        break;
+    case SR_DF_ANALOG:
+        analog = packet_in->payload;
+        if (ctx->design == FILTER_IIR) {
+            for (i = 0; i < ctx->sections; i++)
+                iir_run(&ctx->bq[i], analog->data, analog->num_samples);
+        } else {
+            fir_run(ctx, analog->data, analog->num_samples);
+        }
+        break;
+    default:
+        break;
+    }
+
+    /* Return the in-place-modified packet. */
+    *packet_out = packet_in;
+
+    return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+    struct context *ctx;
+
+    if (!t)
+        return SR_ERR_ARG;
+
+    if (t->priv) {
+        ctx = t->priv;
+        g_free(ctx->coeffs);
+        g_free(ctx->h);
+        g_free(ctx->work);
+        g_free(ctx);
+        t->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"type", "Type", "filter type: lowpass, bandpass or notch", NULL, NULL},
+    {"design", "Design", "iir (cascaded biquads) or fir (windowed sinc)", NULL, NULL},
+    {"freq", "Frequency", "cutoff frequency for lowpass, center frequency otherwise, in Hz", NULL, NULL},
+    {"width", "Width", "bandwidth of the bandpass and notch filters in Hz", NULL, NULL},
+    {"q", "Q", "quality factor of the iir lowpass", NULL, NULL},
+    {"sections", "Sections", "number of cascaded iir biquad sections", NULL, NULL},
+    {"taps", "Taps", "number of fir taps, rounded up to an odd number", NULL, NULL},
+    {"coeffs", "Coefficients", "comma separated list of fir coefficients, overrides the design", NULL, NULL},
+    {"samplerate", "Sample rate", "sample rate in Hz for input files without a header", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_string("lowpass"));
+        options[1].def = g_variant_ref_sink(g_variant_new_string("iir"));
+        options[2].def = g_variant_ref_sink(g_variant_new_double(0));
+        options[3].def = g_variant_ref_sink(g_variant_new_double(0));
+        options[4].def = g_variant_ref_sink(g_variant_new_double(M_SQRT1_2));
+        options[5].def = g_variant_ref_sink(g_variant_new_uint32(1));
+        options[6].def = g_variant_ref_sink(g_variant_new_uint32(63));
+        options[7].def = g_variant_ref_sink(g_variant_new_string(""));
+        options[8].def = g_variant_ref_sink(g_variant_new_uint64(0));
+    }
+
+    return options;
+}
+
+struct sr_transform_module transform_filter = {
+    .id = "filter",
+    .name = "filter",
+    .desc = "lowpass, bandpass or notch fir/iir filter",
+    // the filter state is carried from one block to the next
+    .flags = SAT_TRANSFORM_ELEMENTWISE,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
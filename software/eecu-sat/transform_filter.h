@@ -0,0 +1,6 @@
+#ifndef __TRANSFORM_FILTER_H__
+#define __TRANSFORM_FILTER_H__
+
+extern struct sr_transform_module transform_filter;
+
+#endif
@@ -0,0 +1,345 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include "proj.h"
+#include "error.h"
+#include "dsp.h"
+#include "transform.h"
+
+#define  RESAMPLE_MAX_PHASES  1024
+#define    RESAMPLE_MAX_TAPS  256
+
+/*
+ * the rate is changed by L/M. conceptually the input is upsampled by L
+ * (zero stuffing), lowpass filtered and every M-th sample is kept. the
+ * polyphase form only evaluates the filter taps that hit non-zero inputs
+ * for the samples that are kept: output j is at position u = j * M in the
+ * upsampled stream, it uses phase u % L of the filter bank and the input
+ * samples ending at u / L.
+ */
+struct context {
+    uint64_t rate;
+    uint32_t taps;              // per phase
+    uint32_t l;
+    uint32_t m;
+    bool bypass;
+    float *bank;                // l phases of taps coefficients, each in reverse order
+    float *work;                // history followed by the current chunk
+    ssize_t work_sz;
+    ssize_t n;                  // input sample of the next output, relative to the current chunk
+    uint32_t phase;             // phase of the next output
+    bool primed;
+    uint64_t in_cnt;            // samples of the current channel
+    uint64_t out_cnt;
+    float *out;
+    ssize_t out_sz;
+    struct sr_datafeed_packet pkt;
+    struct sr_datafeed_analog analog;
+};
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    uint64_t t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// length of the prototype filter, odd so that its group delay is a whole number of samples
+static uint32_t proto_len(const struct context *ctx)
+{
+    return (ctx->l * ctx->taps - 1) | 1;
+}
+
+static void bank_design(struct context *ctx)
+{
+    uint32_t n = proto_len(ctx);
+    uint32_t p, t;
+    double *h;
+
+    // the last coefficient stays zero if the bank is one longer than the prototype
+    h = g_malloc0(ctx->l * ctx->taps * sizeof(double));
+    // pass band up to 90% of the lower of the two Nyquist frequencies
+    dsp_sinc_lowpass(h, n, 0.45 / MAX(ctx->l, ctx->m));
+    dsp_hamming(h, n);
+    // zero stuffing divides the signal by l
+    dsp_normalize(h, n, ctx->l);
+
+    g_free(ctx->bank);
+    ctx->bank = g_malloc0(ctx->l * ctx->taps * sizeof(float));
+    for (p = 0; p < ctx->l; p++)
+        for (t = 0; t < ctx->taps; t++)
+            ctx->bank[p * ctx->taps + ctx->taps - 1 - t] = h[p + t * ctx->l];
+
+    g_free(h);
+}
+
+static int channel_setup(struct context *ctx, const uint64_t in_rate)
+{
+    uint64_t g, delay;
+    uint32_t l, m;
+
+    if (!in_rate)
+        return SR_ERR_ARG;
+
+    g = gcd(ctx->rate, in_rate);
+    if (ctx->rate / g > RESAMPLE_MAX_PHASES) {
+        err_msg("%s:%d cannot resample from %ld Hz to %ld Hz, the ratio needs more than %d phases", __FILE__, __LINE__,
+                in_rate, ctx->rate, RESAMPLE_MAX_PHASES);
+        return SR_ERR_ARG;
+    }
+    l = ctx->rate / g;
+    m = in_rate / g;
+
+    ctx->bypass = (l == m);
+    if (ctx->bypass)
+        return SR_OK;
+
+    if (!ctx->bank || (l != ctx->l) || (m != ctx->m)) {
+        ctx->l = l;
+        ctx->m = m;
+        bank_design(ctx);
+    }
+
+    // start half a filter length in, this compensates the group delay
+    delay = (proto_len(ctx) - 1) / 2;
+    ctx->n = delay / ctx->l;
+    ctx->phase = delay % ctx->l;
+    ctx->primed = false;
+    ctx->in_cnt = 0;
+    ctx->out_cnt = 0;
+
+    return SR_OK;
+}
+
+static void out_reserve(struct context *ctx, const ssize_t out_sz)
+{
+    if (ctx->out_sz < out_sz) {
+        ctx->out = g_realloc(ctx->out, out_sz * sizeof(float));
+        ctx->out_sz = out_sz;
+    }
+}
+
+static ssize_t resample(struct context *ctx, const float *samples, const ssize_t num_samples)
+{
+    ssize_t hist = ctx->taps - 1;
+    ssize_t out = 0;
+    uint32_t i;
+
+    if (ctx->work_sz < num_samples + hist) {
+        ctx->work = g_realloc(ctx->work, (num_samples + hist) * sizeof(float));
+        ctx->work_sz = num_samples + hist;
+    }
+
+    // the history starts out as a copy of the first sample
+    if (!ctx->primed) {
+        for (i = 0; i < hist; i++)
+            ctx->work[i] = samples[0];
+        ctx->primed = true;
+    }
+
+    memcpy(ctx->work + hist, samples, num_samples * sizeof(float));
+
+    while (ctx->n < num_samples) {
+        ctx->out[out++] = dsp_dot(ctx->bank + ctx->phase * ctx->taps, ctx->work + ctx->n, ctx->taps);
+        ctx->phase += ctx->m;
+        ctx->n += ctx->phase / ctx->l;
+        ctx->phase %= ctx->l;
+    }
+
+    ctx->n -= num_samples;
+    memmove(ctx->work, ctx->work + num_samples, hist * sizeof(float));
+
+    return out;
+}
+
+// the last sample is repeated until the outputs centred on the last inputs are out
+static ssize_t resample_flush(struct context *ctx)
+{
+    uint64_t total;
+    ssize_t pad, i, out;
+    float *edge;
+
+    if (ctx->bypass || !ctx->primed)
+        return 0;
+
+    // the channel gives ceil(n * l / m) outputs
+    total = (ctx->in_cnt * ctx->l + ctx->m - 1) / ctx->m;
+    if (ctx->out_cnt >= total)
+        return 0;
+
+    pad = (proto_len(ctx) - 1) / 2 / ctx->l + 2;
+    out_reserve(ctx, pad * ctx->l / ctx->m + 2);
+    edge = g_malloc(pad * sizeof(float));
+    for (i = 0; i < pad; i++)
+        edge[i] = ctx->work[ctx->taps - 2];
+    out = resample(ctx, edge, pad);
+    g_free(edge);
+
+    return MIN(out, (ssize_t) (total - ctx->out_cnt));
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+    struct context *ctx;
+    struct dev_frame *frame;
+    uint64_t rate;
+    uint32_t taps;
+
+    if (!t || !t->sdi || !options)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+
+    /* Options */
+    rate = g_variant_get_uint64(g_hash_table_lookup(options, "rate"));
+    taps = g_variant_get_uint32(g_hash_table_lookup(options, "taps"));
+
+    if (!rate) {
+        err_msg("%s:%d the resampler needs a target 'rate' option", __FILE__, __LINE__);
+        return SR_ERR_ARG;
+    }
+
+    if ((taps < 2) || (taps > RESAMPLE_MAX_TAPS)) {
+        err_msg("%s:%d between 2 and %d taps per phase are accepted", __FILE__, __LINE__, RESAMPLE_MAX_TAPS);
+        return SR_ERR_ARG;
+    }
+
+    // the options are valid, nothing is allocated before this point
+    t->priv = ctx = g_malloc0(sizeof(struct context));
+    ctx->rate = rate;
+    ctx->taps = taps;
+    frame->samplerate = ctx->rate;
+    ctx->pkt.payload = &ctx->analog;
+
+    return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+                   struct sr_datafeed_packet *packet_in, struct sr_datafeed_packet **packet_out)
+{
+    struct context *ctx;
+    const struct sr_datafeed_analog *analog;
+    struct dev_frame *frame;
+
+    if (!t || !packet_in || !packet_out)
+        return SR_ERR_ARG;
+
+    frame = t->sdi->priv;
+    ctx = t->priv;
+
+    switch (packet_in->type) {
+    case SR_DF_FRAME_BEGIN:
+        if (channel_setup(ctx, frame->samplerate) != SR_OK) {
+            err_msg("%s:%d unable to resample channel %d", __FILE__, __LINE__, frame->ch);
+            return SR_ERR_ARG;
+        }
+        frame->samplerate = ctx->rate;
+        break;
+    case SR_DF_ANALOG:
+        if (ctx->bypass)
+            break;
+        analog = packet_in->payload;
+        if (!analog->num_samples)
+            break;
+        out_reserve(ctx, analog->num_samples * ctx->l / ctx->m + 2);
+
+        memcpy(&ctx->analog, analog, sizeof(struct sr_datafeed_analog));
+        ctx->analog.data = ctx->out;
+        ctx->analog.num_samples = resample(ctx, analog->data, analog->num_samples);
+        ctx->in_cnt += analog->num_samples;
+        ctx->out_cnt += ctx->analog.num_samples;
+
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    case SR_DF_FRAME_END:
+        ctx->analog.num_samples = resample_flush(ctx);
+        if (!ctx->analog.num_samples)
+            break;
+        ctx->analog.data = ctx->out;
+        ctx->out_cnt += ctx->analog.num_samples;
+        ctx->pkt.type = SR_DF_ANALOG;
+        *packet_out = &ctx->pkt;
+        return SR_OK;
+    default:
+        break;
+    }
+
+    *packet_out = packet_in;
+
+    return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+    struct context *ctx;
+
+    if (!t)
+        return SR_ERR_ARG;
+
+    if (t->priv) {
+        ctx = t->priv;
+        g_free(ctx->bank);
+        g_free(ctx->work);
+        g_free(ctx->out);
+        g_free(ctx);
+        t->priv = NULL;
+    }
+
+    return SR_OK;
+}
+
+static struct sr_option options[] = {
+    {"rate", "Rate", "target sample rate in Hz", NULL, NULL},
+    {"taps", "Taps", "number of fir taps per polyphase branch", NULL, NULL},
+    ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+    if (!options[0].def) {
+        options[0].def = g_variant_ref_sink(g_variant_new_uint64(0));
+        options[1].def = g_variant_ref_sink(g_variant_new_uint32(32));
+    }
+
+    return options;
+}
+
+struct sr_transform_module transform_resample = {
+    .id = "resample",
+    .name = "resample",
+    .desc = "convert every channel to a common sample rate",
+    .flags = SAT_TRANSFORM_UNIFORM_RATE,
+    .options = get_options,
+    .init = init,
+    .receive = receive,
+    .cleanup = cleanup,
+};
@@ -175,3 +175,59 @@ int sat_trigger_receive(struct sat_trigger *t, struct sr_datafeed_packet *packet
     return ret;
 }
 
+static void add_match(struct sat_trigger *t, const ssize_t sample)
+{
+    struct trigger_match *match;
+
+    match = g_malloc0(sizeof(struct trigger_match));
+    match->sample_cnt = sample;
+    t->matches = g_slist_append(t->matches, match);
+}
+
+/**
+ * Account for n samples that are only known by their min and max, as if
+ * they went through sat_trigger_receive(). This is possible if all of them
+ * lie on the same side of the level.
+ *
+ * @return true if the samples were handled, false if they need to be read.
+ */
+bool sat_trigger_skip(struct sat_trigger *t, const ssize_t n, const float min, const float max)
+{
+    struct trigger_context *ctx;
+
+    if (!t || (n < 1))
+        return false;
+
+    ctx = t->priv;
+
+    // NaN limits fail all comparisons, so these blocks are always read
+    if (t->type == SR_TRIGGER_OVER) {
+        if (max < t->level) {
+            ctx->last_state = TRIGGER_BELLOW;
+        } else if (min >= t->level) {
+            // only the first sample can complete a rising edge
+            if (ctx->last_state == TRIGGER_BELLOW) {
+                ctx->last_state = TRIGGER_ABOVE;
+                add_match(t, ctx->cur_sample);
+            }
+        } else {
+            return false;
+        }
+    } else if (t->type == SR_TRIGGER_UNDER) {
+        if (min > t->level) {
+            ctx->last_state = TRIGGER_ABOVE;
+        } else if (max <= t->level) {
+            if (ctx->last_state == TRIGGER_ABOVE) {
+                ctx->last_state = TRIGGER_BELLOW;
+                add_match(t, ctx->cur_sample);
+            }
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    ctx->cur_sample += n;
+    return true;
+}
@@ -0,0 +1,775 @@
+/*
+ * This file is part of the eecu-sat project.
+ *
+ * Copyright (C) 2024 Petre Rodan <2b4eda@subdimension.ro>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <glib.h>
+#include "proj.h"
+#include "dsp.h"
+#include "tsc.h"
+
+/*
+ * dictionary block:
+ *   mode (8 bits), number of dictionary values (16), first value key (32),
+ *   float bits of the ADC step (32), exp-golomb order of the residuals (5)
+ *   for every other value: gap to the previous value in ADC steps as exp-golomb,
+ *     0 escapes to a raw 32bit key, otherwise the residual between the key and
+ *     the predicted key as zigzag exp-golomb
+ *   index of the first sample (16)
+ *   then the index changes as a change stream
+ *
+ * xor block:
+ *   mode (8 bits), first sample (32)
+ *   for every other sample the XOR with the previous one as
+ *     '0' - identical
+ *     '10' + meaningful bits - same leading/trailing zero window as before
+ *     '11' + leading zeros (5) + length - 1 (5) + meaningful bits
+ *
+ * lossy block:
+ *   mode (8 bits), predictor order (2), float bits of the quantization step
+ *   (32), first sample (32)
+ *   the quantized prediction residuals as a change stream, TSC_Q_RAW marks a
+ *   sample that could not be reconstructed within the bound
+ *   the raw bits of those samples (32 each)
+ *
+ * a change stream codes the values of samples 1 to n - 1 as runs of zeroes
+ * in exp-golomb, each followed by the next value as zigzag - 1 in an
+ * adaptive rice code.
+ */
+
+#define        TSC_MODE_DICT  0
+#define         TSC_MODE_XOR  1
+#define       TSC_MODE_LOSSY  2
+
+// dictionary gaps and residuals beyond these are stored as raw keys
+#define          TSC_GAP_MAX  (1 << 20)
+#define     TSC_RESIDUAL_MAX  (1 << 20)
+// longest unary prefix of a rice code before the value is stored raw
+#define        TSC_UNARY_MAX  24
+// largest exp-golomb order tried for the dictionary residuals
+#define        TSC_EGK_ORDER  20
+// quantized residuals of lossy blocks are smaller, this value marks a raw sample
+#define           TSC_Q_RAW  (1 << 22)
+// keeps the quantization step a little below twice the error bound, so the
+// float rounding of the reconstruction does not push samples past the bound
+#define     TSC_STEP_MARGIN  0.999
+
+struct tsc_coder {
+    ssize_t block_samples;
+    uint32_t table_bits;
+    uint32_t *table_key;
+    int32_t *table_val;         // -1 marks an empty slot
+    uint32_t *slot;             // hash table slot of every sample
+    uint32_t *dict;             // dictionary keys
+    uint32_t *gap;              // dictionary gaps in ADC steps, 0 for an escape
+    uint32_t *res;              // zigzag coded dictionary residuals
+    float *val;                 // dictionary values, also used for the step estimate
+    int32_t *chg;               // index changes or quantized residuals
+    int32_t *alt;               // residuals of the second lossy predictor
+};
+
+struct bit_writer {
+    uint8_t *p;
+    uint64_t acc;
+    uint32_t nbits;
+};
+
+struct bit_reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;               // next bit is the msb
+    uint32_t nbits;
+    uint64_t used;
+    bool error;
+};
+
+// order preserving map of the float bits onto unsigned integers
+static inline uint32_t float_key(const float f)
+{
+    uint32_t u;
+
+    memcpy(&u, &f, sizeof(u));
+    return (u & 0x80000000) ? ~u : u | 0x80000000;
+}
+
+static inline float key_float(const uint32_t k)
+{
+    uint32_t u = (k & 0x80000000) ? k & 0x7fffffff : ~k;
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint64_t zigzag(const int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(const uint64_t z)
+{
+    return (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+}
+
+/*
+ * next dictionary key predicted from the previous one. the sum is evaluated
+ * in double precision, gap * step is exact there, so the result does not
+ * depend on whether the compiler contracts it into a fused multiply-add.
+ */
+static inline uint32_t predict(const uint32_t prev, const uint32_t gap, const float step)
+{
+    return float_key((float)((double)key_float(prev) + (double)gap * (double)step));
+}
+
+// rice parameter of the index changes, adapted to their running mean
+static inline uint32_t rice_k(const uint32_t a, const uint32_t n)
+{
+    uint32_t k;
+
+    for (k = 0; ((n << k) < a) && (k < 16); k++) ;
+    return k;
+}
+
+static inline void rice_update(uint32_t *a, uint32_t *n, const uint32_t z)
+{
+    *a += z;
+    (*n)++;
+    if (*n >= 32) {
+        *a >>= 1;
+        *n >>= 1;
+    }
+}
+
+// n <= 32, v must not have bits set above n
+static inline void put_bits(struct bit_writer *w, const uint32_t v, const uint32_t n)
+{
+    uint32_t word;
+
+    w->acc = (w->acc << n) | v;
+    w->nbits += n;
+    if (w->nbits >= 32) {
+        w->nbits -= 32;
+        word = w->acc >> w->nbits;
+        w->p[0] = word >> 24;
+        w->p[1] = word >> 16;
+        w->p[2] = word >> 8;
+        w->p[3] = word;
+        w->p += 4;
+    }
+}
+
+static void put_flush(struct bit_writer *w)
+{
+    while (w->nbits >= 8) {
+        w->nbits -= 8;
+        *w->p++ = w->acc >> w->nbits;
+    }
+    if (w->nbits) {
+        *w->p++ = w->acc << (8 - w->nbits);
+        w->nbits = 0;
+    }
+}
+
+// exp-golomb code of order 0, v < 2^31
+static inline void put_eg(struct bit_writer *w, const uint32_t v)
+{
+    uint32_t len = 32 - __builtin_clz(v + 1);
+
+    put_bits(w, 0, len - 1);
+    put_bits(w, v + 1, len);
+}
+
+static inline void put_egk(struct bit_writer *w, const uint32_t v, const uint32_t k)
+{
+    put_eg(w, v >> k);
+    put_bits(w, v & ((1u << k) - 1), k);
+}
+
+static inline uint32_t egk_len(const uint32_t v, const uint32_t k)
+{
+    return 2 * (32 - __builtin_clz((v >> k) + 1)) - 1 + k;
+}
+
+static inline void put_rice(struct bit_writer *w, const uint32_t z, const uint32_t k)
+{
+    uint32_t q = z >> k;
+
+    if (q < TSC_UNARY_MAX) {
+        // q ones and a zero
+        put_bits(w, (1u << (q + 1)) - 2, q + 1);
+        put_bits(w, z & ((1u << k) - 1), k);
+    } else {
+        put_bits(w, (1u << TSC_UNARY_MAX) - 1, TSC_UNARY_MAX);
+        put_bits(w, z, 32);
+    }
+}
+
+// keep at least 57 bits in the accumulator, zeroes are shifted in past the end
+static inline void refill(struct bit_reader *r)
+{
+    while (r->nbits <= 56) {
+        if (r->p < r->end)
+            r->acc |= (uint64_t) * r->p++ << (56 - r->nbits);
+        r->nbits += 8;
+    }
+}
+
+// n <= 32
+static inline uint32_t get_bits(struct bit_reader *r, const uint32_t n)
+{
+    uint32_t v;
+
+    if (!n)
+        return 0;
+    if (r->nbits < n)
+        refill(r);
+    v = r->acc >> (64 - n);
+    r->acc <<= n;
+    r->nbits -= n;
+    r->used += n;
+
+    return v;
+}
+
+static inline uint32_t get_eg(struct bit_reader *r)
+{
+    uint32_t lz;
+
+    refill(r);
+    lz = r->acc ? __builtin_clzll(r->acc) : 64;
+    if (lz > 31) {
+        r->error = true;
+        return 0;
+    }
+    get_bits(r, lz);
+
+    return get_bits(r, lz + 1) - 1;
+}
+
+static inline uint32_t get_egk(struct bit_reader *r, const uint32_t k)
+{
+    uint32_t q = get_eg(r);
+
+    return (q << k) | get_bits(r, k);
+}
+
+static inline uint32_t get_rice(struct bit_reader *r, const uint32_t k)
+{
+    uint32_t q;
+
+    refill(r);
+    q = ~r->acc ? __builtin_clzll(~r->acc) : 64;
+    if (q >= TSC_UNARY_MAX) {
+        get_bits(r, TSC_UNARY_MAX);
+        return get_bits(r, 32);
+    }
+    get_bits(r, q + 1);
+
+    return (q << k) | get_bits(r, k);
+}
+
+static void put_changes(struct bit_writer *w, const int32_t *d, const ssize_t n)
+{
+    uint32_t run = 0, z, a = 2, an = 1;
+    ssize_t i;
+
+    for (i = 1; i < n; i++) {
+        if (!d[i]) {
+            run++;
+            continue;
+        }
+        put_eg(w, run);
+        run = 0;
+        // the value is never 0, so zigzag - 1 saves a code
+        z = zigzag(d[i]) - 1;
+        put_rice(w, z, rice_k(a, an));
+        rice_update(&a, &an, z);
+    }
+    put_eg(w, run);
+}
+
+static int get_changes(struct bit_reader *r, int32_t *d, const ssize_t n)
+{
+    uint32_t run, z, a = 2, an = 1;
+    ssize_t i;
+
+    for (i = 1; !r->error;) {
+        run = get_eg(r);
+        if (run > n - i)
+            return SR_ERR_DATA;
+        for (; run; run--)
+            d[i++] = 0;
+        if (i == n)
+            break;
+        z = get_rice(r, rice_k(a, an));
+        rice_update(&a, &an, z);
+        d[i++] = unzigzag((uint64_t) z + 1);
+    }
+
+    return r->error ? SR_ERR_DATA : SR_OK;
+}
+
+/**
+ * Allocate a coder for blocks of up to block_samples samples.
+ */
+struct tsc_coder *tsc_coder_new(const ssize_t block_samples)
+{
+    struct tsc_coder *c;
+
+    if ((block_samples < 1) || (block_samples > TSC_BLOCK_SAMPLES_MAX))
+        return NULL;
+
+    c = g_malloc0(sizeof(struct tsc_coder));
+    c->block_samples = block_samples;
+    // a load factor of at most 1/4, the dictionary holds up to block_samples / 2 keys
+    for (c->table_bits = 4; (1 << c->table_bits) < 2 * block_samples; c->table_bits++) ;
+    c->table_key = g_malloc((1 << c->table_bits) * sizeof(uint32_t));
+    c->table_val = g_malloc((1 << c->table_bits) * sizeof(int32_t));
+    c->slot = g_malloc(block_samples * sizeof(uint32_t));
+    c->dict = g_malloc(block_samples * sizeof(uint32_t));
+    c->gap = g_malloc(block_samples * sizeof(uint32_t));
+    c->res = g_malloc(block_samples * sizeof(uint32_t));
+    c->val = g_malloc(block_samples * sizeof(float));
+    c->chg = g_malloc(block_samples * sizeof(int32_t));
+    c->alt = g_malloc(block_samples * sizeof(int32_t));
+
+    return c;
+}
+
+void tsc_coder_free(struct tsc_coder *c)
+{
+    if (!c)
+        return;
+
+    g_free(c->table_key);
+    g_free(c->table_val);
+    g_free(c->slot);
+    g_free(c->dict);
+    g_free(c->gap);
+    g_free(c->res);
+    g_free(c->val);
+    g_free(c->chg);
+    g_free(c->alt);
+    g_free(c);
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+    const uint32_t ka = *(const uint32_t *)a;
+    const uint32_t kb = *(const uint32_t *)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+static inline uint32_t table_find(const struct tsc_coder *c, const uint32_t key)
+{
+    const uint32_t mask = (1 << c->table_bits) - 1;
+    uint32_t s = (key * 0x9e3779b1u) >> (32 - c->table_bits);
+
+    while ((c->table_val[s] >= 0) && (c->table_key[s] != key))
+        s = (s + 1) & mask;
+
+    return s;
+}
+
+/*
+ * collect the distinct keys of a block into c->dict, sorted. returns the
+ * number of keys or 0 if there are more than n / 2 of them.
+ */
+static ssize_t build_dict(struct tsc_coder *c, const float *x, const ssize_t n)
+{
+    ssize_t i, cnt = 0;
+    uint32_t key, s;
+
+    memset(c->table_val, 0xff, (1 << c->table_bits) * sizeof(int32_t));
+
+    for (i = 0; i < n; i++) {
+        key = float_key(x[i]);
+        s = table_find(c, key);
+        if (c->table_val[s] < 0) {
+            if (cnt >= n / 2)
+                return 0;
+            c->table_key[s] = key;
+            c->table_val[s] = 0;
+            c->dict[cnt++] = key;
+        }
+        c->slot[i] = s;
+    }
+
+    qsort(c->dict, cnt, sizeof(uint32_t), cmp_key);
+    for (i = 0; i < cnt; i++)
+        c->table_val[table_find(c, c->dict[i])] = i;
+
+    return cnt;
+}
+
+static void encode_dict(struct tsc_coder *c, struct bit_writer *w, const ssize_t n, const ssize_t cnt)
+{
+    ssize_t i, steps = 0;
+    uint32_t k, best_k = 0, step_bits;
+    uint64_t len, best_len = UINT64_MAX;
+    double g;
+    int64_t r;
+    float step;
+
+    // the dictionary of an ADC capture sits on a grid of one step
+    for (i = 1; i < cnt; i++) {
+        c->val[steps] = key_float(c->dict[i]) - key_float(c->dict[i - 1]);
+        if (isfinite(c->val[steps]) && (c->val[steps] > 0))
+            steps++;
+    }
+    step = dsp_common_step(c->val, steps);
+    memcpy(&step_bits, &step, sizeof(step_bits));
+
+    for (i = 1; i < cnt; i++) {
+        c->gap[i] = 0;
+        g = ((double)key_float(c->dict[i]) - key_float(c->dict[i - 1])) / step;
+        if ((g >= 0.5) && (g < TSC_GAP_MAX)) {
+            c->gap[i] = lround(g);
+            r = (int64_t) c->dict[i] - predict(c->dict[i - 1], c->gap[i], step);
+            if (zigzag(r) < TSC_RESIDUAL_MAX)
+                c->res[i] = zigzag(r);
+            else
+                c->gap[i] = 0;
+        }
+    }
+
+    for (k = 0; k <= TSC_EGK_ORDER; k++) {
+        for (i = 1, len = 0; i < cnt; i++) {
+            if (c->gap[i])
+                len += egk_len(c->res[i], k);
+        }
+        if (len < best_len) {
+            best_len = len;
+            best_k = k;
+        }
+    }
+
+    put_bits(w, TSC_MODE_DICT, 8);
+    put_bits(w, cnt, 16);
+    put_bits(w, c->dict[0], 32);
+    put_bits(w, step_bits, 32);
+    put_bits(w, best_k, 5);
+    for (i = 1; i < cnt; i++) {
+        put_eg(w, c->gap[i]);
+        if (c->gap[i])
+            put_egk(w, c->res[i], best_k);
+        else
+            put_bits(w, c->dict[i], 32);
+    }
+
+    put_bits(w, c->table_val[c->slot[0]], 16);
+    for (i = 1; i < n; i++)
+        c->chg[i] = c->table_val[c->slot[i]] - c->table_val[c->slot[i - 1]];
+    put_changes(w, c->chg, n);
+}
+
+static void encode_xor(struct bit_writer *w, const float *x, const ssize_t n)
+{
+    uint32_t prev, u, v, lz, tz, len;
+    uint32_t win_lz = 0, win_tz = 0;
+    bool win = false;
+    ssize_t i;
+
+    memcpy(&prev, &x[0], sizeof(prev));
+    put_bits(w, TSC_MODE_XOR, 8);
+    put_bits(w, prev, 32);
+
+    for (i = 1; i < n; i++) {
+        memcpy(&u, &x[i], sizeof(u));
+        v = u ^ prev;
+        prev = u;
+        if (!v) {
+            put_bits(w, 0, 1);
+            continue;
+        }
+        lz = __builtin_clz(v);
+        tz = __builtin_ctz(v);
+        if (win && (lz >= win_lz) && (tz >= win_tz)) {
+            put_bits(w, 2, 2);
+            put_bits(w, v >> win_tz, 32 - win_lz - win_tz);
+        } else {
+            len = 32 - lz - tz;
+            put_bits(w, 3, 2);
+            put_bits(w, lz, 5);
+            put_bits(w, len - 1, 5);
+            put_bits(w, v >> tz, len);
+            win_lz = lz;
+            win_tz = tz;
+            win = true;
+        }
+    }
+}
+
+/**
+ * Code a block of n samples into out, which must hold TSC_MAX_BYTES(n) bytes.
+ *
+ * @return the number of bytes written or SR_ERR_ARG if the block does not
+ * fit the coder.
+ */
+ssize_t tsc_encode(struct tsc_coder *c, const float *x, const ssize_t n, uint8_t *out)
+{
+    struct bit_writer w = { 0 };
+    ssize_t cnt;
+
+    if ((n < 1) || (n > c->block_samples))
+        return SR_ERR_ARG;
+
+    w.p = out;
+    if ((cnt = build_dict(c, x, n)))
+        encode_dict(c, &w, n, cnt);
+    else
+        encode_xor(&w, x, n);
+    put_flush(&w);
+
+    return w.p - out;
+}
+
+/*
+ * quantize the prediction residuals of order 1 (previous sample) or order 2
+ * (linear extrapolation of the last two) against the reconstructed samples
+ * the decoder will see. returns a rough estimate of the coded size in bits.
+ */
+static uint64_t quantize(const float *x, const ssize_t n, const float step,
+                         const double error, const uint32_t order, int32_t *q)
+{
+    float y, y1 = x[0], y2 = x[0];
+    double p, d;
+    uint64_t bits = 0;
+    ssize_t i;
+
+    for (i = 1; i < n; i++) {
+        p = (order == 1) ? y1 : 2.0 * y1 - y2;
+        d = ((double)x[i] - p) / step;
+        q[i] = TSC_Q_RAW;
+        y = x[i];
+        // one below the marker, lround() could otherwise round up onto it
+        if (fabs(d) < TSC_Q_RAW - 1) {
+            q[i] = lround(d);
+            y = (float)(p + (double)q[i] * step);
+            if (!(fabs((double)x[i] - y) <= error)) {
+                q[i] = TSC_Q_RAW;
+                y = x[i];
+            }
+        }
+        if (q[i] == TSC_Q_RAW)
+            bits += 88;
+        else if (q[i])
+            bits += 2 * (64 - __builtin_clzll(zigzag(q[i]))) + 2;
+        y2 = y1;
+        y1 = y;
+    }
+
+    return bits;
+}
+
+/**
+ * Code a block of n samples into out, which must hold TSC_MAX_BYTES(n) bytes,
+ * so that no decoded sample differs by more than error from the original.
+ *
+ * @return the number of bytes written or SR_ERR_ARG if the block does not
+ * fit the coder or the error bound is not a usable positive number.
+ */
+ssize_t tsc_encode_lossy(struct tsc_coder *c, const float *x, const ssize_t n, const double error, uint8_t *out)
+{
+    struct bit_writer w = { 0 };
+    float step = (float)(2.0 * error * TSC_STEP_MARGIN);
+    uint32_t order = 1, u;
+    int32_t *q = c->chg;
+    ssize_t i;
+
+    if ((n < 1) || (n > c->block_samples))
+        return SR_ERR_ARG;
+    if (!(step >= FLT_MIN) || isinf(step))
+        return SR_ERR_ARG;
+
+    if (quantize(x, n, step, error, 2, c->alt) < quantize(x, n, step, error, 1, c->chg)) {
+        order = 2;
+        q = c->alt;
+    }
+
+    w.p = out;
+    put_bits(&w, TSC_MODE_LOSSY, 8);
+    put_bits(&w, order, 2);
+    memcpy(&u, &step, sizeof(u));
+    put_bits(&w, u, 32);
+    memcpy(&u, &x[0], sizeof(u));
+    put_bits(&w, u, 32);
+    put_changes(&w, q, n);
+    for (i = 1; i < n; i++) {
+        if (q[i] == TSC_Q_RAW) {
+            memcpy(&u, &x[i], sizeof(u));
+            put_bits(&w, u, 32);
+        }
+    }
+    put_flush(&w);
+
+    return w.p - out;
+}
+
+static int decode_dict(struct tsc_coder *c, struct bit_reader *r, float *x, const ssize_t n)
+{
+    ssize_t i, j, cnt;
+    uint32_t key, k, gap, step_bits;
+    int64_t idx;
+    float step;
+    int ret;
+
+    cnt = get_bits(r, 16);
+    if ((cnt < 1) || (cnt > n))
+        return SR_ERR_DATA;
+
+    key = get_bits(r, 32);
+    step_bits = get_bits(r, 32);
+    memcpy(&step, &step_bits, sizeof(step));
+    k = get_bits(r, 5);
+
+    c->val[0] = key_float(key);
+    for (j = 1; j < cnt; j++) {
+        if ((gap = get_eg(r)))
+            key = predict(key, gap, step) + unzigzag(get_egk(r, k));
+        else
+            key = get_bits(r, 32);
+        c->val[j] = key_float(key);
+    }
+
+    idx = get_bits(r, 16);
+    if (idx >= cnt)
+        return SR_ERR_DATA;
+    x[0] = c->val[idx];
+
+    if ((ret = get_changes(r, c->chg, n)) != SR_OK)
+        return ret;
+    for (i = 1; i < n; i++) {
+        idx += c->chg[i];
+        if ((idx < 0) || (idx >= cnt))
+            return SR_ERR_DATA;
+        x[i] = c->val[idx];
+    }
+
+    return SR_OK;
+}
+
+static int decode_xor(struct bit_reader *r, float *x, const ssize_t n)
+{
+    uint32_t prev, v, lz, len;
+    uint32_t win_lz = 0, win_tz = 0;
+    bool win = false;
+    ssize_t i;
+
+    prev = get_bits(r, 32);
+    memcpy(&x[0], &prev, sizeof(float));
+
+    for (i = 1; i < n; i++) {
+        if (get_bits(r, 1)) {
+            if (get_bits(r, 1)) {
+                lz = get_bits(r, 5);
+                len = get_bits(r, 5) + 1;
+                if (lz + len > 32)
+                    return SR_ERR_DATA;
+                win_lz = lz;
+                win_tz = 32 - lz - len;
+                win = true;
+            } else if (!win) {
+                return SR_ERR_DATA;
+            }
+            v = get_bits(r, 32 - win_lz - win_tz) << win_tz;
+            prev ^= v;
+        }
+        memcpy(&x[i], &prev, sizeof(float));
+    }
+
+    return SR_OK;
+}
+
+static int decode_lossy(struct tsc_coder *c, struct bit_reader *r, float *x, const ssize_t n)
+{
+    uint32_t order, u;
+    float step, y1, y2;
+    double p;
+    ssize_t i;
+    int ret;
+
+    order = get_bits(r, 2);
+    if ((order < 1) || (order > 2))
+        return SR_ERR_DATA;
+    u = get_bits(r, 32);
+    memcpy(&step, &u, sizeof(step));
+    u = get_bits(r, 32);
+    memcpy(&x[0], &u, sizeof(float));
+
+    if ((ret = get_changes(r, c->chg, n)) != SR_OK)
+        return ret;
+
+    // the raw samples follow the change stream in the order they are needed
+    y1 = y2 = x[0];
+    for (i = 1; i < n; i++) {
+        if (c->chg[i] == TSC_Q_RAW) {
+            u = get_bits(r, 32);
+            memcpy(&x[i], &u, sizeof(float));
+        } else {
+            p = (order == 1) ? y1 : 2.0 * y1 - y2;
+            x[i] = (float)(p + (double)c->chg[i] * step);
+        }
+        y2 = y1;
+        y1 = x[i];
+    }
+
+    return SR_OK;
+}
+
+/**
+ * Decode a block of n samples from len bytes of coded data.
+ *
+ * @return SR_OK or SR_ERR_DATA if the block is damaged.
+ */
+int tsc_decode(struct tsc_coder *c, const uint8_t *in, const ssize_t len, float *x, const ssize_t n)
+{
+    struct bit_reader r = { 0 };
+    int ret;
+
+    if ((n < 1) || (n > c->block_samples))
+        return SR_ERR_ARG;
+
+    r.p = in;
+    r.end = in + len;
+
+    switch (get_bits(&r, 8)) {
+    case TSC_MODE_DICT:
+        ret = decode_dict(c, &r, x, n);
+        break;
+    case TSC_MODE_XOR:
+        ret = decode_xor(&r, x, n);
+        break;
+    case TSC_MODE_LOSSY:
+        ret = decode_lossy(c, &r, x, n);
+        break;
+    default:
+        return SR_ERR_DATA;
+    }
+
+    if ((ret == SR_OK) && (r.used > (uint64_t) len * 8))
+        ret = SR_ERR_DATA;
+
+    return ret;
+}
@@ -0,0 +1,60 @@
+#ifndef __SAT_TSC_H__
+#define __SAT_TSC_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * lossless time-series codec for float samples. a channel is split into
+ * blocks that can be decoded on their own. every block is coded either as
+ * a sorted dictionary of the distinct sample values plus a stream of
+ * dictionary indices (captures that come from an ADC only use a few hundred
+ * values per block), or Gorilla-style as the XOR of consecutive samples when
+ * the values are too diverse for a dictionary.
+ *
+ * archives can also be written with a lossy block mode that quantizes the
+ * residuals of a linear prediction, every decoded sample is guaranteed to
+ * stay within a given absolute error of the original.
+ */
+
+/*
+ * file layout, all integers are little endian:
+ * struct tsc_hdr, then for every block a struct tsc_block_hdr followed by
+ * byte_len bytes of coded data.
+ */
+struct __attribute__((packed)) tsc_hdr {
+    uint8_t identifier[8];
+    int32_t version;
+    uint32_t block_samples;
+    double begin_time;
+    uint64_t sample_rate;
+    uint64_t downsample;
+    uint64_t num_samples;
+    uint64_t num_blocks;
+    double error;               // error bound of lossy blocks, 0 if lossless
+}; // 64bytes
+
+struct __attribute__((packed)) tsc_block_hdr {
+    uint32_t num_samples;
+    uint32_t byte_len;
+};
+
+#define          TSC_HDR_SIZE  0x40
+#define        TSC_HDR_SC_POS  0x28
+#define    TSC_BLOCK_HDR_SIZE  0x08
+#define             TSC_MAGIC  "<SATTSC>"
+
+#define   TSC_BLOCK_SAMPLES_MAX  65536
+
+// worst case size of a coded block of n samples
+#define   TSC_MAX_BYTES(n)  (24 * (n) + 64)
+
+struct tsc_coder;
+
+struct tsc_coder *tsc_coder_new(const ssize_t block_samples);
+void tsc_coder_free(struct tsc_coder *c);
+ssize_t tsc_encode(struct tsc_coder *c, const float *x, const ssize_t n, uint8_t *out);
+ssize_t tsc_encode_lossy(struct tsc_coder *c, const float *x, const ssize_t n, const double error, uint8_t *out);
+int tsc_decode(struct tsc_coder *c, const uint8_t *in, const ssize_t len, float *x, const ssize_t n);
+
+#endif
@@ -0,0 +1,108 @@
+#!/bin/sh
+
+# compare the deflate compressed srzip output against the lossless tsc and
+# the lossy archive codec output on a set of captures: size, compression
+# ratio, encode and decode time
+
+bin_file='../eecu-sat/eecu-sat'
+input='../unit_tests/sample_files/analog_[0-9]*.bin'
+runs=3
+
+usage()
+{
+    echo "$(basename "${0}") options:"
+    echo " -b FILE"
+    echo "     eecu-sat binary (default ${bin_file})"
+    echo " -i FILENAME_MATCH"
+    echo "     input captures (default ${input})"
+    echo " -n INT"
+    echo "     number of runs per measurement, the fastest one is shown (default ${runs})"
+    echo " -h"
+    echo "     short usage message"
+}
+
+# print the fastest wall time of a command in ms
+time_ms()
+{
+    best=''
+    i=0
+    while [ "${i}" -lt "${runs}" ]; do
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1 || {
+            echo "error running $*" >&2
+            exit 1
+        }
+        end=$(date +%s%N)
+        t=$(( (end - start) / 1000000 ))
+        if [ -z "${best}" ] || [ "${t}" -lt "${best}" ]; then
+            best="${t}"
+        fi
+        i=$((i + 1))
+    done
+    echo "${best}"
+}
+
+size_of()
+{
+    cat "$@" | wc -c
+}
+
+ratio()
+{
+    awk -v a="${1}" -v b="${2}" 'BEGIN { printf "%.1f", a / b }'
+}
+
+while [ "$#" -gt 0 ]; do
+    if [ "$1" = "-b" ]; then
+        bin_file="${2}"
+        shift; shift;
+    elif [ "$1" = "-i" ]; then
+        input="${2}"
+        shift; shift;
+    elif [ "$1" = "-n" ]; then
+        runs="${2}"
+        shift; shift;
+    else
+        usage
+        exit 1
+    fi
+done
+
+bin_file=$(realpath "${bin_file}")
+tmp_dir=$(mktemp -d)
+trap 'rm -rf "${tmp_dir}"' EXIT
+
+# shellcheck disable=SC2086
+raw=$(size_of ${input})
+
+enc_analog=$(time_ms "${bin_file}" -i "${input}" -o "${tmp_dir}/analog_" -O analog)
+enc_srzip=$(time_ms "${bin_file}" -i "${input}" -o "${tmp_dir}/bench.sr" -O srzip)
+enc_tsc=$(time_ms "${bin_file}" -i "${input}" -o "${tmp_dir}/bench_" -O tsc)
+enc_archive=$(time_ms "${bin_file}" -i "${input}" -o "${tmp_dir}/bench_" -O archive)
+
+size_srzip=$(size_of "${tmp_dir}/bench.sr")
+size_tsc=$(size_of "${tmp_dir}"/bench_*.tsc)
+size_archive=$(size_of "${tmp_dir}"/bench_*.tsa)
+
+mkdir "${tmp_dir}/decoded"
+dec_tsc=$(time_ms "${bin_file}" -i "${tmp_dir}/bench_[0-9]*.tsc" -o "${tmp_dir}/decoded/analog_" -O analog)
+dec_archive=$(time_ms "${bin_file}" -i "${tmp_dir}/bench_[0-9]*.tsa" -o "${tmp_dir}/decoded/archive_" -O analog)
+dec_srzip='n/a'
+if command -v unzip > /dev/null; then
+    dec_srzip=$(time_ms unzip -o -q "${tmp_dir}/bench.sr" -d "${tmp_dir}/unzipped")
+fi
+
+# the decoded tsc files must match the plain analog export
+lossless='yes'
+for f in "${tmp_dir}"/analog_*.bin; do
+    cmp -s "${f}" "${tmp_dir}/decoded/$(basename "${f}")" || lossless='NO'
+done
+
+echo "input: ${raw} bytes, best of ${runs} runs, the analog export takes ${enc_analog} ms"
+printf '%-8s %12s %8s %12s %12s\n' 'format' 'bytes' 'ratio' 'encode ms' 'decode ms'
+printf '%-8s %12s %8s %12s %12s\n' 'srzip' "${size_srzip}" "$(ratio "${raw}" "${size_srzip}")" "${enc_srzip}" "${dec_srzip}"
+printf '%-8s %12s %8s %12s %12s\n' 'tsc' "${size_tsc}" "$(ratio "${raw}" "${size_tsc}")" "${enc_tsc}" "${dec_tsc}"
+printf '%-8s %12s %8s %12s %12s\n' 'archive' "${size_archive}" "$(ratio "${raw}" "${size_archive}")" "${enc_archive}" "${dec_archive}"
+echo "tsc roundtrip lossless: ${lossless}"
+
+[ "${lossless}" = 'yes' ]
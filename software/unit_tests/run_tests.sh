@@ -33,7 +33,7 @@ eend() {
     echo -e "${ENDCOL} ${msg}"
 }
 
-tests="ut_calibration_init ut_calibration ut_output_analog ut_output_srzip ut_output_srzip_metadata_import ut_trigger"
+tests="ut_calibration_init ut_calibration ut_output_analog ut_output_srzip ut_output_srzip_metadata_import ut_output_srzip_logic ut_output_q16 ut_output_tsc ut_output_archive ut_output_store ut_output_csv ut_output_vcd ut_output_wav ut_output_stats ut_output_fanout ut_compare ut_compare_batch ut_correlation ut_ensemble ut_fingerprint ut_injector ut_mask ut_model ut_rpm ut_trigger ut_transform_filter ut_transform_decimate ut_transform_despike ut_transform_resample ut_transform_crank_angle"
 
 run_test() {
     ebegin "     ${1}"
@@ -0,0 +1,38 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# self.txt - the samples against themselves
+# crop.txt - a slice cut out by a trigger has to be found 27587 samples into the reference and match it exactly
+# filt.txt - lowpass filtered samples are delayed by 14 samples and fail around the steep edges
+cat << EOF > manifest
+cd10b1e1783e02ed4f57cbddad0def795efcdbf5c1a8764627b9fc7f1dc9d19d  self.txt
+cbb7f3ec26f0371b8b6fa2cd6b444aef4a52cb5313a304cf38d9263bd8573db7  crop.txt
+1b1c91b14c9e1a5208a30d9a34366ad9a662249ce07bdf79951fb513a2610c17  filt.txt
+EOF
+
+mkdir -p crop filt
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=500:a=30000" --output ./crop/analog_ --output-format analog 2>/dev/null
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=100" --output ./filt/analog_ --output-format analog
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --reference "${sample_dir}/analog_[0-9]*.bin" > self.txt
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./crop/analog_[0-9]*.bin" --reference "${sample_dir}/analog_[0-9]*.bin" --compare "max_lag=30000" > crop.txt
+ret=$(($? + ret))
+
+# failing channels make for a non-zero exit status
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --reference "${sample_dir}/analog_[0-9]*.bin" --compare "align=channel:tolerance=1:min_fail=3:gap=10:ranges=2" > filt.txt
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
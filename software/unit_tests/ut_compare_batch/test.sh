@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# batch.txt - four captures against the samples: an exact copy, a slice cut out by a trigger
+#             and two lowpass filtered copies that fail around the steep edges
+cat << EOF > manifest
+69fc2104bca2bdf79bcda3c0796cc9f91ed8a7482482096d4b2d9214a25903ea  batch.txt
+EOF
+
+mkdir -p fleet/ecu01 fleet/ecu02 fleet/ecu03 fleet/ecu04
+cp "${sample_dir}"/analog_[0-9]*.bin fleet/ecu01/
+ret=$?
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=500:a=20000" --output ./fleet/ecu02/analog_ --output-format analog >/dev/null 2>&1
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=100" --output ./fleet/ecu03/analog_ --output-format analog
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=2500" --output ./fleet/ecu04/analog_ --output-format analog
+ret=$(($? + ret))
+
+# failing captures make for a non-zero exit status
+${wrapper} ./eecu-sat --reference "${sample_dir}/analog_[0-9]*.bin" --batch "./fleet/*/analog_[0-9]*.bin" --compare "max_lag=30000" > batch.txt
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+# the verdicts match the ones of separate runs
+${wrapper} ./eecu-sat --input "./fleet/ecu02/analog_[0-9]*.bin" --reference "${sample_dir}/analog_[0-9]*.bin" --compare "max_lag=30000" >/dev/null
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "./fleet/ecu03/analog_[0-9]*.bin" --reference "${sample_dir}/analog_[0-9]*.bin" --compare "max_lag=30000" > ecu03.txt
+[ $? -ne 0 ]
+ret=$(($? + ret))
+grep -q '16 of 16 channels failed' ecu03.txt
+ret=$(($? + ret))
+
+# a batch needs a reference
+${wrapper} ./eecu-sat --batch "./fleet/*/analog_[0-9]*.bin" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
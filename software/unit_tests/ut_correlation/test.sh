@@ -0,0 +1,57 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# every channel of the samples carries the same signal
+# levels.txt     - correlation of the samples
+# harness.txt    - the samples with analog_3.bin shifted by one second, as if it was wired to another signal
+# derivative.txt - the shifted samples, correlating the changes of the signals
+cat << EOF > manifest
+a66edeeeb01a56396d8bfdc23d2feb136af281f3e18ac73996c16b8e0d555053  levels.txt
+07ce3729d4672fbea3bf5ab17adab2ebb6f02d491f99b9212a7c34ac38cef255  harness.txt
+9f97233eae990ea4b2ec76e25ccbd70fcd5897ab15b2e14d62e5be52e9d1afa7  derivative.txt
+EOF
+
+all="1-2-3-4-5-6-7-8-9-10-11-12-13-14-15-16"
+
+# pairs that track each other without being expected to are flagged
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./levels.txt --output-format correlation > levels.log
+[ $? -ne 0 ]
+ret=$?
+grep -q '120 of 120 channel pairs flagged' levels.log
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./expected.txt --output-format "correlation:pairs=${all}"
+ret=$(($? + ret))
+
+# move the samples of one channel around by 6250 samples, keeping the header
+mkdir -p harness
+cp "${sample_dir}"/analog_[0-9]*.bin harness/
+f="${sample_dir}/analog_3.bin"
+{ head -c 48 "${f}"; tail -c +25049 "${f}"; head -c 25048 "${f}" | tail -c 25000; } > harness/analog_3.bin
+${wrapper} ./eecu-sat --input "./harness/analog_[0-9]*.bin" --output ./harness.txt --output-format "correlation:pairs=${all}" > harness.log
+[ $? -ne 0 ]
+ret=$(($? + ret))
+grep -q '15 of 120 channel pairs flagged' harness.log
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "./harness/analog_[0-9]*.bin" --output ./derivative.txt --output-format "correlation:derivative=true:threshold=0.5" >/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+# next to an export, the correlation covers the slice cut out by the trigger
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=500:a=20000" --output ./analog_ --output-format analog --side-output "correlation:pairs=${all}@./crop.txt" >/dev/null 2>&1
+ret=$(($? + ret))
+grep -q '^correlation of 16 channels over 20500 samples' crop.txt
+ret=$(($? + ret))
+
+# groups name known channels
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./bad.txt --output-format "correlation:pairs=1-17" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
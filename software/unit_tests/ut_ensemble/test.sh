@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# crank/analog_1.bin is a 60-2 wheel that turns at 625 RPM for 42 revolutions and
+# at 781.25 RPM for 52 more, crank/analog_2.bin is a cam that is high during every
+# other revolution, starting with the first one. channel 1 is a copy of the first
+# sample file, which is not tied to the engine at all.
+#
+# cam.csv     - mean and spread of every channel over the 720 degree cycles that
+#               start where the cam is high
+# index.csv   - the cycle boundaries of every channel
+# summary.txt - the number of cycles per channel
+# nocam.csv   - cycles counted from the first gap instead, on a 1 degree grid
+cat << EOF > manifest
+28177d1678986523cf9f4d2ddfa8a49cc62110e93c57b97f6e5ea57783b548f9  cam.csv
+6a78d890127fbf7a145528bf7b8f61796d9243e66ddd1171854d172d89c09c72  index.csv
+fd7b05a77a921b72b0c39988abbc00c386bedc79ca63f9ab4cb544ad317aabf8  summary.txt
+a92c4da1cdc0f82d1006a5f4b9e26f197aec9c3d1201544dff6e8e6eca98e14b  nocam.csv
+EOF
+
+rep()
+{
+    i=0
+    while [ "${i}" -lt "$2" ]; do
+        cat "$1"
+        i=$((i + 1))
+    done
+}
+
+mkdir -p crank
+printf '\000\000\240\100' > hi.bin
+printf '\000\000\000\000' > lo.bin
+rep hi.bin 60 > hi60.bin
+rep lo.bin 60 > lo60.bin
+for h in 5 4; do
+    { rep hi.bin ${h}; rep lo.bin ${h}; } > tooth.bin
+    { rep tooth.bin 58; rep lo.bin $((4 * h)); } > rev_${h}.bin
+    rep hi60.bin $((2 * h)) > cam_hi_${h}.bin
+    rep lo60.bin $((2 * h)) > cam_lo_${h}.bin
+done
+{ head -c 48 "${sample_dir}/analog_0.bin"; rep rev_5.bin 42; rep rev_4.bin 52; rep lo.bin 426; } > crank/analog_1.bin
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    for h in 5 4; do
+        n=$((h == 5 ? 21 : 26))
+        j=0
+        while [ "${j}" -lt "${n}" ]; do
+            cat cam_hi_${h}.bin cam_lo_${h}.bin
+            j=$((j + 1))
+        done
+    done
+    rep lo.bin 426
+} > crank/analog_2.bin
+cp "${sample_dir}/analog_0.bin" crank/analog_0.bin
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./cam.csv --output-format "ensemble:crank=2:cam=3:index=index.csv" > summary.txt
+ret=$?
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./nocam.csv --output-format "ensemble:crank=2:step=1" >/dev/null
+ret=$(($? + ret))
+
+# the crank wheel looks the same in every cycle, so its spread stays at 0 between the teeth
+[ "$(sed -n '3p' cam.csv | cut -d, -f4,5)" = "5.000000,0.000000" ]
+ret=$(($? + ret))
+[ "$(wc -l < cam.csv)" -eq 1441 ]
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./bad.csv --output-format "ensemble:crank=2:cam=9" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# self.fp  - fingerprint of the samples
+# rank.txt - the archive ranked against the fingerprint of the samples: an exact copy,
+#            two lowpass filtered copies and a slice cut out by a trigger
+cat << EOF > manifest
+57c477092a55c65d4229e409a3c5c9c01cd7cd71ffef288ef94213e0825d522f  archive/self.fp
+fc50dc517bd6a46e621f04fae5ef03198cb47bc867c442e81cffbbaa0d31c4a8  rank.txt
+EOF
+
+mkdir -p archive
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./archive/self.fp --output-format fingerprint
+ret=$?
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=100" --output ./archive/filter_100.fp --output-format fingerprint
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=2500" --output ./archive/filter_2500.fp --output-format fingerprint
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=500:a=20000" --output ./archive/crop.fp --output-format fingerprint >/dev/null 2>&1
+ret=$(($? + ret))
+
+# an export can leave a fingerprint behind, identical to the one of a separate run
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./analog_ --output-format analog --side-output "fingerprint@./query.fp"
+ret=$(($? + ret))
+cmp query.fp archive/self.fp
+ret=$(($? + ret))
+
+# fingerprints with a different number of bands can't be compared and are skipped
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./archive/bands_8.fp --output-format "fingerprint:bands=8"
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --query ./query.fp --search "./archive/*.fp" > rank.txt 2>/dev/null
+ret=$(($? + ret))
+head -n 2 rank.txt | tail -n 1 | grep -q ' 0.0000 .*self.fp$'
+ret=$(($? + ret))
+grep -q bands_8 rank.txt
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+# nothing to search
+${wrapper} ./eecu-sat --query ./query.fp --search "./nowhere/*.fp" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# low.csv     - the samples read as pins of low side drivers, pulled from 8V down to 0V
+# high.csv    - two channels read as high side drivers, the second one at its own level
+# summary.txt - the pulse count and widths of every channel printed by the first run
+cat << EOF > manifest
+1425c32d082a49ba9fcc3c760b2e0b41be9a3130e38b3da5ca8d13ea45cf19c7  low.csv
+346472df40b9c6d388d1cf74adde666969079f003c755bdb6e9586fd53edb188  high.csv
+77cec4c22e6cce7e8791538fe88c8ddd5647da98b8c6e8e4dbac1252d1f2bdc5  summary.txt
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./low.csv --output-format "injector:level=3" > summary.txt
+ret=$?
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./high.csv --output-format "injector:channels=1,2@4:level=3:polarity=high:flyback=0.01" >/dev/null
+ret=$(($? + ret))
+
+# the table is the same when it is made next to an export
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./analog_ --output-format analog --side-output "injector:level=3@./side.csv" >/dev/null
+ret=$(($? + ret))
+cmp low.csv side.csv
+ret=$(($? + ret))
+
+# short pulses are left out of the table
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./long.csv --output-format "injector:channels=1:level=3:polarity=high:min_width=0.005" > long.txt
+ret=$(($? + ret))
+grep -q 'shorter ones skipped' long.txt
+ret=$(($? + ret))
+[ "$(wc -l < long.csv)" -lt "$(grep -c '^1,' high.csv)" ]
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./bad.csv --output-format "injector:polarity=up" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,75 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# good.mask   - envelope built from the samples
+# merged.mask - the same envelope merged with the one of the lowpass filtered samples
+# self.txt    - the samples checked against their own mask
+# filt.txt    - filtered samples fail around the steep edges
+# merged.txt  - the filtered samples pass the merged mask
+cat << EOF > manifest
+72a81e0cfea94c1026b09c5497d6d86c5b2b88fa0178e96c09a215d48afeb799  good.mask
+1341acd9ec72d883c966add0e64d68bf029ce5ab00ddff8d18a166b19ad577ac  merged.mask
+e4233fe735ab3f0555aa716e786701a7b657964fe93c5ca798e48fdc8f7238e4  self.txt
+17f1aedb6a3d37ee267a42db9b0368e6167df280a33895a9ea6cd905b4bf8ea7  filt.txt
+c87a09125881f485d5d8ed0a37bdabbf19a276b1e2e4c9b0a5642488523e9915  merged.txt
+EOF
+
+mkdir -p filt
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=100" --output ./filt/analog_ --output-format analog
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./good.mask --output-format mask
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --output ./merged.mask --output-format "mask:merge=good.mask"
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./self.txt --output-format "mask_check:mask=good.mask" >/dev/null
+ret=$(($? + ret))
+
+# failing channels make for a non-zero exit status
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --output ./filt.txt --output-format "mask_check:mask=good.mask:ranges=2" >/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --output ./merged.txt --output-format "mask_check:mask=merged.mask" >/dev/null
+ret=$(($? + ret))
+
+# stop at the first violation, the other outputs still finish their files
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --output ./stop.txt --output-format "mask_check:mask=good.mask:stop=true" --side-output "stats@stop_stats.txt" > stop.log
+[ $? -ne 0 ]
+ret=$(($? + ret))
+grep -q 'mask violation on analog_1.bin at 4.787200 s, stopping' stop.log
+ret=$(($? + ret))
+grep -q '^1 of 1 channels failed$' stop.txt
+ret=$(($? + ret))
+[ -s stop_stats.txt ]
+ret=$(($? + ret))
+
+# a NaN at the start of a bin does not poison the envelope of the other samples
+mkdir -p nan
+printf '\000\000\300\177' > nan.bin
+printf '\000\000\200\077' > one.bin
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    cat nan.bin
+    i=1
+    while [ "${i}" -lt 64 ]; do
+        cat one.bin
+        i=$((i + 1))
+    done
+} > nan/analog_0.bin
+${wrapper} ./eecu-sat --input "./nan/analog_0.bin" --output ./nan.mask --output-format "mask:resolution=64"
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "./nan/analog_0.bin" --output ./nan.txt --output-format "mask_check:mask=nan.mask" >/dev/null
+grep -q 'analog_0.bin *64 *0 *1 ' nan.txt
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
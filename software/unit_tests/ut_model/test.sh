@@ -0,0 +1,57 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# good.model  - built from the samples and two lowpass filtered copies of them
+# crop.model  - two slices that start 500 and 2000 samples before a trigger, lined up on the trigger again
+# self.txt    - the samples scored against the model
+# filt.txt    - heavily filtered samples fail around the steep edges
+cat << EOF > manifest
+8fd48976f6d7bdf2335644d623e09148da9114a3c3dad2d6d1662141609ebdb4  good.model
+23576a11670bee05e1c038adc408796632e1a03ba271a32b77138cbbff567114  crop.model
+942a078ee9c4cc4f9a2e3f27cba6d497824f92fb477989208411f32a7bd74877  self.txt
+a68950e54661b4155e8ab9dcb1650b4efb9c9254897698ed08871f1b1a038b54  filt.txt
+EOF
+
+mkdir -p f1 f2 filt c1 c2
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=1500" --output ./f1/analog_ --output-format analog
+ret=$?
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=2500" --output ./f2/analog_ --output-format analog
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --transform-module "filter:freq=100" --output ./filt/analog_ --output-format analog
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=500:a=20000" --output ./c1/analog_ --output-format analog >/dev/null 2>&1
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --triggers "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=1:b=2000:a=20000" --output ./c2/analog_ --output-format analog >/dev/null 2>&1
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --golden "${sample_dir}/analog_[0-9]*.bin" --golden "./f1/analog_[0-9]*.bin" --golden "./f2/analog_[0-9]*.bin" --output ./good.model >/dev/null
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --golden "./c1/analog_[0-9]*.bin" --golden "./c2/analog_[0-9]*.bin" --triggers "ch=analog_1.bin:type=o:level=3.00:nth=1:b=400:a=19000" --model "resolution=32" --output ./crop.model >/dev/null
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./self.txt --output-format "model_score:model=good.model" >/dev/null
+ret=$(($? + ret))
+
+# failing channels make for a non-zero exit status
+${wrapper} ./eecu-sat --input "./filt/analog_[0-9]*.bin" --output ./filt.txt --output-format "model_score:model=good.model:ranges=2" >/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+# a damaged capture fails the model instead of leaving a gap in it
+mkdir -p t1 t2
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_1.bin" --output ./t1/c_ --output-format tsc
+ret=$(($? + ret))
+head -c $(($(wc -c < t1/c_1.tsc) - 100)) t1/c_1.tsc > t2/c_1.tsc
+${wrapper} ./eecu-sat --golden "./t1/c_[0-9]*.tsc" --golden "./t2/c_[0-9]*.tsc" --output ./cut.model >/dev/null 2>&1
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,62 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+09e5e50676d24ad0e272375cc1b3ba309897bc25f71d78383dfc7bda62b14a9a  a_1.tsa
+9bf84365762a53e32d6482571ec54a77a47ab5be00664e85688e6ad606b672df  a_10.tsa
+f7438c4011b8aaa0a73df8b1a887a2f9545e7be191cf6c328cbaec2428c55dec  a_11.tsa
+9c22bce8a0b7654b3e465c1116cf1cb41891e196313fe849d74470dbf48cf371  a_12.tsa
+95795d70267c4e1e194466791ef78b292eb5006c163a43398f5c42e5d2c737a4  a_13.tsa
+62ae1ef25f302dc146467075989f69d82b3841dc79d2ab363fd5fbcb495fa77d  a_14.tsa
+9fde1757f4befe7ec7795fbe66857e13311f4c3c8cd8e4677acc67c36b33acf8  a_15.tsa
+280f53f2942cff63cdcae69bdc6bcc4f7a92ee3b5dfdc9c8f4a26d7afaf12788  a_16.tsa
+bde84680db40bc49b57227d60883cd22b7defb397964853f630fee922af2fb52  a_2.tsa
+55e2ea1688e848ea5a0f60abe1b21787ef5d373f0bc97bbc3b835e4237369abd  a_3.tsa
+cdfedde448931efcfbd164934eda0a66a3ba9a36186b852b71b4d2644e8afec3  a_4.tsa
+0ac70aba8fc23713810077239ad4f8eeb393b629491c77151b3deb85ba1ed2dc  a_5.tsa
+f61ed17a3fd2c487eaea630f51a6fe087c32984645b1f4f5a763731626cb5741  a_6.tsa
+04d5ffce8fe9ad706b13d07d405b2e568550bdd9691331c375942937335763ed  a_7.tsa
+2ae42ca8f9be0b96324093b7b489347e0aaf9568f98ca3345552c19f6c870fde  a_8.tsa
+7de5997a7b1bd6851326c559744642a81953b392825b443d060e75be1e93472d  a_9.tsa
+EOF
+
+# decoded samples stay within one ADC step of the originals
+cat << EOF > manifest_roundtrip
+c302e919c93087b22b3e8e6e8d1839b9b9af27b48c40617d803b24937acf204e  analog_1.bin
+b2b1ccbd04aac0bee36dfb2a22536230fca4d40c677e5619312c0500d07cac19  analog_10.bin
+68167c54177e04c2f5300b853bef58ad770cd6a00a81f2dbdebcd653b9e17d79  analog_11.bin
+e3e72b235ae02dc7dd0f1bc1e1dd2490a0489484797ce2ac6f83d608d77a1c02  analog_12.bin
+fac181ab81a0cdff004fa546948d65dafe42e6d829ef3e2b69f9474a68c176ca  analog_13.bin
+cf316e2b5d5132bf7ad0c23cea53084236d63f618c185fcc5ed51db895d3efac  analog_14.bin
+d59afeeb101096582ad0433dcd7c630c80a895ab372274c06a66c4d69eb7cd4a  analog_15.bin
+f17ba2a3f9c97f01f5057fab5b6d515bd5e136d1ba010e1ec84eaf12a3682364  analog_16.bin
+61e0c563e3a101877cbade4d53f8fa646caf55fa6aa1c6cbbe499e69dbdac414  analog_2.bin
+00c7a6fa2a4c6a4a83e8c03d5e8c9b17f0a7674585a5cd26007f836feb3c8c6a  analog_3.bin
+8db40eaa639556551d8ad6a2954c54a7bbb6c33629082b5c38e0a6fb859b836a  analog_4.bin
+6a02d68fc3112b7394ef4da203bd3359f27a61244cb762f7809bdf7efde33fe2  analog_5.bin
+21db5424a91aa48782ef487dce6d7163413cdbdbfb8204272f4b246242ac8c54  analog_6.bin
+a03108b02c77f6f55b7eb6c92f6cee8332e39623048e36b2edf7ab99a3894f96  analog_7.bin
+b3533fa227f0bc8ceedda03d6268482d2d94e26f7bae89c36ca119555488522d  analog_8.bin
+62e05b0edfa124530151a7f6f2b7313dcc57b336e25bcf97e499c33f53316b0f  analog_9.bin
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./a_ --output-format "archive:verify=yes" > verify.log
+ret=$?
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+[ "$(grep -c 'max error' verify.log)" = 16 ]
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./a_[0-9]*.tsa" --output ./analog_ --output-format analog
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest_roundtrip
+ret=$(($? + ret))
+
+exit "${ret}"
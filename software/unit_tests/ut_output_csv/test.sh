@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# capture.csv holds the shortest representation of every sample, capture.tsv
+# every 7th sample with three decimals
+cat << EOF > manifest
+1e3169660e63119a78673fd7be63d3238f7eaf8b0d377eb241ce232e74533e29  capture.csv
+477cf35457cb6b3778ce9f0ad43487901f4a9f6ee4d4cd726118ba177a83eae8  capture.tsv
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./capture.csv --output-format csv
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./capture.tsv --output-format "csv:precision=3:decimate=7"
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# the spool file must not be left behind
+[ ! -e ./capture.csv.spool ]
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,30 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# three outputs from one pass, every one of them identical to a single output run
+cat << EOF > manifest
+8fc15478236654fa105b4cdc71a26440b8eb3dfcfd97a252c8c0f81a3f79d788  analog-1-1-1
+e243e401d73107b3dcd2f2efffde4e71f92f186bb4cd341075d7015775693b7c  analog-1-16-1
+6d03de2af8da5f4eedaa59bce29dad0c58e0ba2e2252a600dd343a04a321a90c  metadata
+c95866eacf17deb819140e1626997b7162f40ba522979eb1437edbae7c200c85  stats.json
+1e3169660e63119a78673fd7be63d3238f7eaf8b0d377eb241ce232e74533e29  capture.csv
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output-format srzip --output ./out.sr --output-format stats --output ./stats.json --output-format csv --output ./capture.csv
+ret=$?
+
+unzip -q out.sr
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# an output format without an output file is refused
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output-format srzip --output ./bad.sr --output-format stats 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+exit "${ret}"
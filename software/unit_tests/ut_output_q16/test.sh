@@ -0,0 +1,59 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+e17007e71dcad3f00f3933a050061963111b52f1857bfb4a1f7583e6b3df5bdc  q_1.q16
+4d8dc4ac86bf5dbe3b6ec6e51918c876d877b2983fdd6b960ca6d0a70013284b  q_10.q16
+ee8c06ee9ea10a20040c814e34da3518432086b14ecaefa89cdf82f8052498c8  q_11.q16
+4f391bf172d2ff8289b474c0903079eec32b739c25e75d1b0f8de16b83befc1b  q_12.q16
+40d8edbc4006cc2f401128548fd58c3b22bfca370cd6d6749d288ce7fe8abaf0  q_13.q16
+44e9e7f6da70b592e6d485377b6006fa0f31804f89dee54d368fb773625ec07c  q_14.q16
+ab3d346e155585dfc78f6446eb93fd58fe025b2f129856b2365b60a949a4c373  q_15.q16
+4391765c026e3744bcc9f225cda4b9209ee8f6c22d4b604ef095d3717e961ca6  q_16.q16
+a6015cc7662772fd0eb2fcadee52c2dab9d9a69756b095b67c3bd2fec48b5755  q_2.q16
+d4c501c7a248c3095495db18c68f0233c1a764cbb3d69100db31620203991c74  q_3.q16
+30109b50bcfa2b09a71fe041ce65d0683712a09f19d785b6781f50e29889f5ea  q_4.q16
+2b9f8eeaa4a99ed2163fbb4abc7ec66cd3ab38f4a72b7f1b3372fa87f1e6014e  q_5.q16
+55b928cb9c9fec8f9b086600668611a83f921131b3d420a5ebb46494e8d6663f  q_6.q16
+83ead606547e5f8313e17b1d2b7690f7e8dded2575e7a94347f99dbe9d5cfa05  q_7.q16
+85b866194274821d90176a411b4d9d8f8792eb87c2cf73604594c391323a89bb  q_8.q16
+f315bca1e7d30dd8ecf4835063061602a1bf4adba07c0f0861ad6de2d0dec809  q_9.q16
+EOF
+
+cat << EOF > manifest_roundtrip
+1d31317ad31d04bbc83363586a260524df3588fa8281f7b7303dd1958d2b40d3  rt_1.bin
+ca6fd78e0004b0eb300d7d51f2a332dfd1c70e368707dc9b5ff2b6a63baaa261  rt_10.bin
+60c6587d14a84a414d6a760ec244c75a9b0bcb2dde848461eaac71f1d0ca7b4d  rt_11.bin
+41cf171be67c27297997517b3711ee3d7af2b9fa3069b2c5280c0028082bf6d6  rt_12.bin
+72716c25b0c22d7112f1e2d0f78e725ff9a8b1dc40c04a153d043e1b79647f14  rt_13.bin
+aacb351cd2e42c5b259a6ba5883b24f660d7fa1f9e8a1258f7db41ea598bc26a  rt_14.bin
+84ff5a89ccb303b8e4a9e9f9b89ad1c9d3aa9e05f103f05fad8a109b721162d5  rt_15.bin
+a919a3729db8eedd60705c4a84abb2d0c27c6f44b952be3f72b33e455081fce2  rt_16.bin
+8a805a66baff837617829233d4278abf999d5599c64c70e6f6c4035be92274c8  rt_2.bin
+ef2b45bf3ff6616602e9b0b30fa70cf8f01ded46d67bd5455d2dd7a9a7230fe3  rt_3.bin
+dc068a7d28ef753f27780e27df19f82a5b248368c21037c61b096b6cb20ccf02  rt_4.bin
+00ddb47dbf0aabee16ebdb91e9ebcfa4556d6912a1fb029302dc5406e8379960  rt_5.bin
+7f06a5fb4b219e21207330cd03bdefb5fd9c187d00eddb95f469c075e1442478  rt_6.bin
+d5bff1ad15a4051edeec6c13fae7d83da5468589e38f4fdce4a532f20f404c76  rt_7.bin
+23fea602b354d3f017d29f87d1b8daae15df8356621d6eb6f79741b6f9041e07  rt_8.bin
+4187eed36141350a62d8028b4138b3b39a10f7eb5368e724dbf754be441facc7  rt_9.bin
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./q_ --output-format q16
+ret=$?
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# load the quantized files back and export them as raw analog
+${wrapper} ./eecu-sat --input "./q_[0-9]*.q16" --output ./rt_ --output-format analog
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest_roundtrip
+ret=$(($? + ret))
+
+exit "${ret}"
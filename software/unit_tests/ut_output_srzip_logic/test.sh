@@ -0,0 +1,67 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# channels 3, 5 and 16 are packed into logic probes, the other analog channels are renumbered after them
+
+cat << EOF > manifest
+b1af4470cb1ab58adcc0182e7f5d8ab02d4084ccc6e890a888cbf8baa2c441c7  analog-1-10-1
+ff1ca7fd59c6af3b7552fde2df846a0d209b63ac67006ad198c74552e0fd1bff  analog-1-11-1
+bf1247a380046ed1f8f8279672ffb09013d625f1028d51ce1c4776af60f245e4  analog-1-12-1
+2756c364fd60153431567c4348814c80c925f0eb671688af909259cb6fc4c941  analog-1-13-1
+75a09e2a01247af4970951762be034e8b1087db9be8ef1f2d9b5727b2b768006  analog-1-14-1
+cda149b549d10cbfed8746d925ee7f872803e4fe6c6b8af7afa009f22f6371b5  analog-1-15-1
+07b90d031b4fac873ebe7d366041283b43cb47eff2a6232e1d49c3464ae9a558  analog-1-16-1
+8fc15478236654fa105b4cdc71a26440b8eb3dfcfd97a252c8c0f81a3f79d788  analog-1-4-1
+f30a232645ac61c09c4cc9a06f8bc3d3c75161766c83f09b494c34ca6fcfb6d0  analog-1-5-1
+0d3ad7c9aab07c673cc4384052acf95aa08b47ca57d386fa22ce37c92fe3c9d7  analog-1-6-1
+fe521359e19f186c0a76af896a48527c22bf634e30e93bd00dcf2f50eed706f2  analog-1-7-1
+e7f47dd47ad28a11ccd2f0fb5af2250850798eb018c239534c576dd8ae0d3c4c  analog-1-8-1
+12624a3e9630f47096d052053d376381bd2c9ee7a473c6144031f194fa23303a  analog-1-9-1
+5962e6023b50d4ba29687c92616f6068d8b740fcd8054756df7071a15396d71e  logic-1-1
+acc587d8c84f988db473f1da18141f94c3e7efbbc2cffa5c2accebc7857b1999  metadata
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./out.sr --output-format "srzip:logic=3,5@1.0,16:logic_hyst=0.4"
+ret=$?
+
+unzip -q out.sr
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# a custom metadata file keeps its labels, the logic probes are added to it
+mkdir custom
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./custom/out.sr --output-format "srzip:logic=3,5@1.0,16:logic_hyst=0.4:metadata_file=${sample_dir}/metadata_16ch"
+ret=$(($? + ret))
+
+unzip -q -d custom custom/out.sr
+for line in 'capturefile=logic-1' 'total probes=3' 'total analog=13' 'probe2=CH5' 'analog4=CH1' 'unitsize=1'; do
+    grep -q "^${line}$" custom/metadata
+    ret=$(($? + ret))
+done
+
+# the logic samples are written chunk by chunk as the last logic channel
+# streams past, channel 1 reads low and channel 2 high in all of them
+mkdir long
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    head -c 10000000 /dev/zero
+} > long/long_0.bin
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    head -c 10000000 /dev/zero | tr '\000' '\100'
+} > long/long_1.bin
+${wrapper} ./eecu-sat --input "long/long_[0-9]*.bin" --output ./long/out.sr --output-format "srzip:logic=1,2"
+ret=$(($? + ret))
+
+unzip -q -d long long/out.sr
+[ "$(wc -c < long/logic-1-1)" -eq 2097152 ] && [ "$(wc -c < long/logic-1-2)" -eq 402848 ]
+ret=$(($? + ret))
+[ "$(cat long/logic-1-1 long/logic-1-2 | tr -d '\002' | wc -c)" -eq 0 ]
+ret=$(($? + ret))
+
+exit "${ret}"
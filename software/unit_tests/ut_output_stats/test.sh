@@ -0,0 +1,35 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# stats.csv uses the clipping floor of the calibration file and a lower ceiling
+cat << EOF > manifest
+c95866eacf17deb819140e1626997b7162f40ba522979eb1437edbae7c200c85  stats.json
+2fcf8d7a79756a8838e8cadb4829dbc197c0c0f88400c82dcc1811f2e2fe4b23  stats.csv
+8fc15478236654fa105b4cdc71a26440b8eb3dfcfd97a252c8c0f81a3f79d788  analog-1-1-1
+e243e401d73107b3dcd2f2efffde4e71f92f186bb4cd341075d7015775693b7c  analog-1-16-1
+6d03de2af8da5f4eedaa59bce29dad0c58e0ba2e2252a600dd343a04a321a90c  metadata
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./stats.json --output-format stats
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./stats.csv --output-format "stats:calib_file=${sample_dir}/calib_reference.ini:ceil=4:bins=8"
+ret=$(($? + ret))
+
+# statistics gathered as a side output of an srzip export
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./out.sr --output-format srzip --side-output "stats@./side.json"
+ret=$(($? + ret))
+
+unzip -q out.sr
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+cmp stats.json side.json
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,73 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+be1865dc3922015241fc43d72c1fce3d67a2d6e57b7ded689a406266757cbeff  capture.sts
+EOF
+
+# the store holds the original samples, so reading it back reproduces the plain analog export
+cat << EOF > manifest_roundtrip
+e170f2eb5400938f96c7cefad670e97f34f4e15726f481f79c70123ff41a83a1  analog_1.bin
+81a726045dad041ba88dccc81f2ee8bfb2c3f9a9b02de33e04afcebc40ec0012  analog_10.bin
+d67664fe8b97821aa4824eb2eb7a118aa33739a3e9b82c980d547aa5ef738e4e  analog_11.bin
+e0007cf549c0bd3a90fd500e8a033b8135f8407b11c561db8965338d1118558a  analog_12.bin
+ab26453c238cf7c1aa7d392c17b883ebb78ae74bf01a1162b8523c4d87c70063  analog_13.bin
+ec86d2597a3921d989ea93a9c86004ebeb5a292e35cbe360552081b7f545ada4  analog_14.bin
+14bb7c9fa256fec1dd78246b0c2841d0557d0ff181afed74332dad42c26c5318  analog_15.bin
+056fc43a7cc2fdd5d90b255f3f85d4a31c5c7dba7779690f1dc49d67b4fbe977  analog_16.bin
+2862e302efef2f00c757479792e6c0af46e704a35175a3c40b4432cb73f16afd  analog_2.bin
+85fe8a0bd906c5d9bbe18ba0b6d07a161f7bec4d0314d810dbbdccc86be9bca1  analog_3.bin
+963f501b2ff7a89912e93f2a1731fb04d0591dcb5f08e71545c4df9ec68667ec  analog_4.bin
+2abac5b4fdfe2774adeb94881d7226cfc118142ad414033e0b2725658d32aaef  analog_5.bin
+6e53f4b5e220e6ce23e903277fa93fc0c6929ca343bfa296bdf0baf8a2693af4  analog_6.bin
+c879dcae79937750f90439d048123abbb55b0feef2b9e052a9745179457491c9  analog_7.bin
+be34c19c24ad0108ecd40ac7b73c137217b226d96005cabb78b8d43df6b65b54  analog_8.bin
+c5de76ac06393dfc3fd4b5832f752c30a0db2924e162c6964177141a646d6b2f  analog_9.bin
+EOF
+
+# triggers on a store skip the blocks that stay on one side of the level, the crop must not change
+cat << EOF > manifest_trigger
+027dca4d099834c1454b4b85440e03fa269bf5dcb37188ad027c58a54a639c16  analog-1-1-1
+43444d5312cb5334bceec9c83586ed3490c548f1eb4fca9c45cbee26e0dd10aa  analog-1-10-1
+32e0712859477f980ba2a747907a1a0ba90e6cb54e8cd7aa0706aa91c2dbd78e  analog-1-11-1
+0356f174431e15d8a14afee04487248389bddfd318d6d2dd7173ef4d0e1f1770  analog-1-12-1
+771432747f694b4c4abd654e3eb8950fadb6749d3a364a15c6a6cd6742690246  analog-1-13-1
+814a1a5647d2000ee08b2f0e4aac174fe70be567ebe2c305d656428f9412aec2  analog-1-14-1
+b4ec6e16dde43d77a1118cfa101978ed91804f4d767a3cd12c20fa00cb1ce18a  analog-1-15-1
+ed52f39f8f6a0c506d87781a699c7191238a237a5e0fdeb0ac5d52c55d9f4d11  analog-1-16-1
+4d1299f2959963475a801d45f2738d989f00e6c48ce0d8b8027a3f3bebdb2118  analog-1-2-1
+528b6d43fb0dba246cbe725e7eaf7b242f84fc774f8fbc05621ce7565a73fb2f  analog-1-3-1
+88d1ff8d6b8978a827b4e12395dfe05f7fb4ee430c1d47fd78b3290cc21b436f  analog-1-4-1
+d3f6c9999c2951bce49ed6971b0ccb64cccf916164111f25d6a69b2f860310b0  analog-1-5-1
+ea4bf439a5021f7dbfa8dd03bdc74efaa06c09808f2563c701b20cd5a6ba0c10  analog-1-6-1
+3858b99d7da7add5fb81b909674b35de32d2a8d6faf193e4872389c4018be264  analog-1-7-1
+c527040b287e13a298f79551c1512779a76ee512b9ae2d971b816871863901d5  analog-1-8-1
+6d4ee8ba78026dddce5d5531882bcebfeaf9668343380eea7ce1f9cb6c69cbdb  analog-1-9-1
+6d03de2af8da5f4eedaa59bce29dad0c58e0ba2e2252a600dd343a04a321a90c  metadata
+d4735e3a265e16eee03f59718b9b5d03019c07d8b6c51f90da3a666eec13ab35  version
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./capture.sts --output-format "store:block=4096"
+ret=$?
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./capture.sts" --output ./analog_ --output-format analog
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest_roundtrip
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat -i "./capture.sts" -t "ch=analog_0.bin:type=o:level=3.00:name=jeff:nth=3:b=1000:a=1000" -o ./out.sr --output-format "srzip:metadata_file=${sample_dir}/metadata_16ch"
+ret=$(($? + ret))
+
+unzip -q ./out.sr
+sha256sum --quiet -c manifest_trigger
+ret=$(($? + ret))
+
+exit "${ret}"
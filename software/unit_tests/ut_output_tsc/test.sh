@@ -0,0 +1,66 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+5c3eeab86bfbc17fb4a7cb9673a4aa574f4944c8fd109005028f6516b4fea469  c_1.tsc
+5f8fb3cf00330d666a5103a0482ed5e44b930dcac5deed9e689aaea1aff65732  c_10.tsc
+210bc3eb96581dcb73bca8a3aec0dbfc4ad619d11828e0cce94c5512862dcac6  c_11.tsc
+fd075b52b811f45dfe514d81612b86dfcc8cc73816aff7b99ed41f5b608fe5b6  c_12.tsc
+8dd75fc4c6c5919e0acd9c75a83f883a55f828653dc0dc8954c36ef6be862baf  c_13.tsc
+c20dcc35b1c193268a0d8c1d19c9fd290029c6f5a1e363cd65f29ad58301d719  c_14.tsc
+bb7c531cf7ec343ba6fdc72166498dde9a8ec3498620b52d5231d3d0ca9adfba  c_15.tsc
+8428e0e9e0c1106c8e5e8ab81396c5da27898b11ced36e483b597b5258c84ea1  c_16.tsc
+ac3885887ad61792d03b694e1ceb451386dec54fc540e67c1c66a0eef6bd41a5  c_2.tsc
+d39a487f6fe172e8537adb79507585362383987ae0b40a512f7437e13d2d7cb1  c_3.tsc
+06e640db9ee33c681e5659d0a17ceeda4cd18b758ee1ed3d2ca1e9df0ba632f8  c_4.tsc
+e254d6f29880b673abbef040a8c746fd428dd12cb85c9b9088f71f2c67cab8b7  c_5.tsc
+59cee05afa15063d2e0911c4b2b4920d3f3abe396f23d7073f8eeb15ee9f904a  c_6.tsc
+c2133e017690f78991d7f4f9135f7fd5d3f3b3197ff892fcfab34eba5b77cbbd  c_7.tsc
+c804d45507000818442b30691b5fbec124332a6c52d3cce2b3cad07fea585243  c_8.tsc
+1f81ef192aaa19d53411edcbefd1274c1766a63d968ad84cc192272aafedda2a  c_9.tsc
+EOF
+
+# the codec is lossless, so decoding must reproduce the plain analog export
+cat << EOF > manifest_roundtrip
+e170f2eb5400938f96c7cefad670e97f34f4e15726f481f79c70123ff41a83a1  analog_1.bin
+81a726045dad041ba88dccc81f2ee8bfb2c3f9a9b02de33e04afcebc40ec0012  analog_10.bin
+d67664fe8b97821aa4824eb2eb7a118aa33739a3e9b82c980d547aa5ef738e4e  analog_11.bin
+e0007cf549c0bd3a90fd500e8a033b8135f8407b11c561db8965338d1118558a  analog_12.bin
+ab26453c238cf7c1aa7d392c17b883ebb78ae74bf01a1162b8523c4d87c70063  analog_13.bin
+ec86d2597a3921d989ea93a9c86004ebeb5a292e35cbe360552081b7f545ada4  analog_14.bin
+14bb7c9fa256fec1dd78246b0c2841d0557d0ff181afed74332dad42c26c5318  analog_15.bin
+056fc43a7cc2fdd5d90b255f3f85d4a31c5c7dba7779690f1dc49d67b4fbe977  analog_16.bin
+2862e302efef2f00c757479792e6c0af46e704a35175a3c40b4432cb73f16afd  analog_2.bin
+85fe8a0bd906c5d9bbe18ba0b6d07a161f7bec4d0314d810dbbdccc86be9bca1  analog_3.bin
+963f501b2ff7a89912e93f2a1731fb04d0591dcb5f08e71545c4df9ec68667ec  analog_4.bin
+2abac5b4fdfe2774adeb94881d7226cfc118142ad414033e0b2725658d32aaef  analog_5.bin
+6e53f4b5e220e6ce23e903277fa93fc0c6929ca343bfa296bdf0baf8a2693af4  analog_6.bin
+c879dcae79937750f90439d048123abbb55b0feef2b9e052a9745179457491c9  analog_7.bin
+be34c19c24ad0108ecd40ac7b73c137217b226d96005cabb78b8d43df6b65b54  analog_8.bin
+c5de76ac06393dfc3fd4b5832f752c30a0db2924e162c6964177141a646d6b2f  analog_9.bin
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./c_ --output-format tsc
+ret=$?
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./c_[0-9]*.tsc" --output ./analog_ --output-format analog
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest_roundtrip
+ret=$(($? + ret))
+
+# a damaged file fails the export instead of ending the channel early
+mkdir -p cut
+head -c $(($(wc -c < c_1.tsc) - 100)) c_1.tsc > cut/c_1.tsc
+${wrapper} ./eecu-sat --input "./cut/c_1.tsc" --output ./cut_ --output-format analog 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+cc4564c28db73110762d416e0f33590c069ea19359befdc4cada3330d648f27f  capture.vcd
+1f1d737d510ccc6d4d7663c65d020fd17f2aa3ac2b52189914a85c7acc801d2a  select.vcd
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./capture.vcd --output-format vcd
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./select.vcd --output-format "vcd:channels=1,6@3.4,16:level=4:hyst=0.5"
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# a tiny buffer spills the transitions to disk, the merge must give the same file
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./spilled.vcd --output-format "vcd:buffer=1"
+ret=$(($? + ret))
+
+cmp ./capture.vcd ./spilled.vcd
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,23 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# capture.wav holds all 16 channels as float, pcm16.wav two of them scaled to their peak
+cat << EOF > manifest
+3bb4aead2cab1792fb310248322d69d064f46b5df84ab031c4c0f36f998052b5  capture.wav
+8ee3723229db8cea21260f60c8af0899e151fb6016df254bb2df626bc2cb8921  pcm16.wav
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./capture.wav --output-format wav
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./pcm16.wav --output-format "wav:channels=1,6:format=pcm16"
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,76 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# crank/analog_1.bin is a 60-2 wheel that turns at 625 RPM for 42 revolutions and
+# at 781.25 RPM for 52 more, a tooth is 5V for h samples and 0V for another h,
+# the gap adds 4h samples at 0V. channel 1 is a copy of the first sample file
+#
+# analog-1-3-1 - RPM, derived from channel 2 and stored after the two channels
+# analog-1-4-1 - RPM_avg over the last revolution
+# rev.csv      - a row per revolution
+# tooth.csv    - a row per tooth
+# summary.txt  - teeth, revolutions and the speed range printed by the per tooth run
+cat << EOF > manifest
+35f1a016f581126830db43a8018e3294e91dab4431d243e2aea41f6bfa08dd11  analog-1-3-1
+639adf96fe1475d3c5f53e5303216fae6807be9fc7af070a0ed02d62ca8cf3a3  analog-1-4-1
+a3f62dc66bfb1a7b4662086bf98c06fc5941ac2c9e2f8973fcdb25346f34b8d2  rev.csv
+f05e46d18eedb506cabc4c8ea4f6162ae7c8be73632cf1d26f2f8a82126708f4  tooth.csv
+8825e622d94a73fee7be600f9cfd4a2b57b3d39e8a1e3d34f7fc28f89a3f8663  summary.txt
+EOF
+
+rep()
+{
+    i=0
+    while [ "${i}" -lt "$2" ]; do
+        cat "$1"
+        i=$((i + 1))
+    done
+}
+
+mkdir -p crank
+printf '\000\000\240\100' > hi.bin
+printf '\000\000\000\000' > lo.bin
+for h in 5 4; do
+    { rep hi.bin ${h}; rep lo.bin ${h}; } > tooth.bin
+    { rep tooth.bin 58; rep lo.bin $((4 * h)); } > rev_${h}.bin
+done
+{ head -c 48 "${sample_dir}/analog_0.bin"; rep rev_5.bin 42; rep rev_4.bin 52; rep lo.bin 426; } > crank/analog_1.bin
+cp "${sample_dir}/analog_0.bin" crank/analog_0.bin
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./out.sr --output-format "srzip:rpm=2:rpm_wheel=60-2"
+ret=$?
+unzip -q out.sr
+grep -q '^analog3=RPM$' metadata
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./rev.csv --output-format "rpm:channel=2" >/dev/null
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./tooth.csv --output-format "rpm:channel=2:rows=tooth" > summary.txt
+ret=$(($? + ret))
+
+# every revolution of the two parts is seen at its own speed
+[ "$(grep -c ',625.000,625.000$' rev.csv)" -eq 41 ]
+ret=$(($? + ret))
+[ "$(grep -c ',781.250,781.250$' rev.csv)" -eq 51 ]
+ret=$(($? + ret))
+
+# a trigger crop keeps the times of the teeth
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" -t "ch=analog_1.bin:type=o:level=2.5:nth=600:b=1000:a=20000" --output ./crop.csv --output-format "rpm:channel=2:rows=tooth" >/dev/null
+ret=$(($? + ret))
+cut -d, -f1 tooth.csv > tooth.t
+tail -n +2 crop.csv | cut -d, -f1 > crop.t
+[ -s crop.t ] && ! grep -qvxFf tooth.t crop.t
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./bad.csv --output-format "rpm:channel=2:wheel=60-60" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
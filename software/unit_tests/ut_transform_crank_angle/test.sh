@@ -0,0 +1,62 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+#
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# crank/analog_1.bin is a 60-2 wheel that turns at 625 RPM for 42 revolutions and
+# at 781.25 RPM for 52 more, channel 1 is a copy of the first sample file.
+# both channels are resampled onto a 0.5 degree grid, the 92 revolutions
+# between the first and the last gap hold 46 whole 720 degree cycles of
+# 1440 points each.
+#
+# ca_1.bin     - the first sample file in the crank angle domain
+# ca_2.bin     - the crank wheel itself, the same in every cycle whatever the speed
+# turn_1.bin   - channel 1 on a 1 degree grid of 360 degree cycles
+cat << EOF > manifest
+1a0cb3d6c4d11d202bd5043ab0dc061e7f09453bae15e502cf6d2d900ebf0c11  ca_1.bin
+dbf4dd8baeff688a4d170309f7e2b3b8bd5f63c46901f01ce43cecad397e43d7  ca_2.bin
+a86e530b2fc93f0a726384af0699a490c9fb80377587b5fe45a54f2c042df72d  turn_1.bin
+EOF
+
+rep()
+{
+    i=0
+    while [ "${i}" -lt "$2" ]; do
+        cat "$1"
+        i=$((i + 1))
+    done
+}
+
+mkdir -p crank
+printf '\000\000\240\100' > hi.bin
+printf '\000\000\000\000' > lo.bin
+for h in 5 4; do
+    { rep hi.bin ${h}; rep lo.bin ${h}; } > tooth.bin
+    { rep tooth.bin 58; rep lo.bin $((4 * h)); } > rev_${h}.bin
+done
+{ head -c 48 "${sample_dir}/analog_0.bin"; rep rev_5.bin 42; rep rev_4.bin 52; rep lo.bin 426; } > crank/analog_1.bin
+cp "${sample_dir}/analog_0.bin" crank/analog_0.bin
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./ca_ --output-format analog --transform-module "crank_angle:channel=2"
+ret=$?
+[ "$(wc -c < ca_2.bin)" -eq $((48 + 46 * 1440 * 4)) ]
+ret=$(($? + ret))
+# the first and the last cycle match, even though the engine sped up in between
+cmp -n $((1440 * 4)) -i 48:$((48 + 45 * 1440 * 4)) ca_2.bin ca_2.bin
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./turn_ --output-format analog --transform-module "crank_angle:channel=2:step=1:cycle=360"
+ret=$(($? + ret))
+[ "$(wc -c < turn_2.bin)" -eq $((48 + 92 * 360 * 4)) ]
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "crank/analog_[0-9]*.bin" --output ./bad_ --output-format analog --transform-module "crank_angle:channel=2:step=0.7" 2>/dev/null
+[ $? -ne 0 ]
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
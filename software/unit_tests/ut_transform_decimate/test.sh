@@ -0,0 +1,72 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# min/max decimation only selects samples, so the output is bit exact
+
+cat << EOF > manifest
+3321d6cc19a74ba14fb24598182a95af137931c93ba4865f1ef9e77b61e90877  analog-1-1-1
+23ab09df485605c558b44e519a8750fc8301ab467ad5c629dca7825e957ff451  analog-1-10-1
+9519df300bb5058b060f56bd9f96a193973a8da77806b1627c124b3043241051  analog-1-11-1
+3c9da1944d6ae3323c517a6aee606ae346ca251b5229f77bdc2b4aa523894da4  analog-1-12-1
+dacf5d0c638d25e04f4bae7426822115e8085d5af8ce1b232873aaa015306bd4  analog-1-13-1
+01a049f29f379a94c223b0765d31dd4ea4db90ec504b1bdab15041c209c9c0b7  analog-1-14-1
+d89ed8eef0074acab37b5e05b9ac59c774c2ed3ffa7f47d095c993f712268d88  analog-1-15-1
+2e79c66ea1f10303a4b5152f3208cbc47be0800a74c25019c9f6a70c831b9a3c  analog-1-16-1
+f4e7480afe87c2405d106e3ed69f6b50d25975623e3bc25407a73772a6e0ac74  analog-1-2-1
+005da354494817cd7449863d4d5547e717e9b0049fcc35edb7eb7cec097da813  analog-1-3-1
+d4e88ae58d66acbe656ed0db18d3d6f747a847db99356d3b8f493ec7c35115a4  analog-1-4-1
+8b19f7ed1385f8718cdcaac3d437fd0b5bc16caba0c7ac9b5aeaa25e8a4351bb  analog-1-5-1
+a72d5f11903b73a3f69d9c4dcdfb531b4bd939d92597cc20c03262af02bc5130  analog-1-6-1
+a3cfe08ac31a8d078440589cfd175f7c0262867e81881e0ecf925e1f3b9b4586  analog-1-7-1
+7b87dc48adcc013497fac4a09ebd441577c40e107216d03751eb0eef81a2d723  analog-1-8-1
+86ff0e0155fc0519f2f40160d060fb82a00f4b66f8bb6b616348b9b29e9b14ce  analog-1-9-1
+418e0297342f1d304748f7043d153550d87beb43dd867b1900822ae244214c27  metadata
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./preview.sr --output-format "srzip" --transform-module "decimate:mode=minmax:factor=10"
+ret=$?
+
+unzip -q preview.sr
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+# the metadata must advertise the reduced sample rate
+grep -q '^samplerate=1250 Hz$' metadata
+ret=$(($? + ret))
+
+# a step from 0V to 5V at input sample 1000 stays between output samples 99
+# and 100 after the antialias filter, its group delay is compensated
+printf '\000\000\000\000' > lo.bin
+printf '\000\000\240\100' > hi.bin
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    for f in lo.bin hi.bin; do
+        i=0
+        while [ "${i}" -lt 1000 ]; do
+            cat "${f}"
+            i=$((i + 1))
+        done
+    done
+} > step_0.bin
+${wrapper} ./eecu-sat --input "step_0.bin" --output ./step_ --output-format analog --transform-module "decimate:mode=antialias:factor=10"
+ret=$(($? + ret))
+od -A n -t f4 -j $((48 + 99 * 4)) -N 8 step_1.bin | awk '{ exit !(($1 < 2.5) && ($2 > 2.5)) }'
+ret=$(($? + ret))
+
+# a channel of n samples gives ceil(n / factor) outputs, the delay line of
+# the filter and the incomplete last group are flushed at its end
+[ "$(wc -c < step_1.bin)" -eq $((48 + 200 * 4)) ]
+ret=$(($? + ret))
+${wrapper} ./eecu-sat --input "step_0.bin" --output ./avg_ --output-format analog --transform-module "decimate:mode=average:factor=3"
+ret=$(($? + ret))
+[ "$(wc -c < avg_1.bin)" -eq $((48 + 667 * 4)) ]
+ret=$(($? + ret))
+od -A n -t f4 -j $((48 + 666 * 4)) -N 4 avg_1.bin | awk '{ exit !($1 == 5) }'
+ret=$(($? + ret))
+
+exit "${ret}"
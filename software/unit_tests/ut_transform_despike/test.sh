@@ -0,0 +1,55 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# a median only selects samples, so the output is bit exact.
+# a window of 5 uses the sorting network, a window of 9 the running median
+
+cat << EOF > manifest
+ba4905f594599364a06aad0bde2532fa2e2a6d97101242630fac9c37c992e246  net_1.bin
+002764faf4322347206acbf3024e5c3e1eafe74b8875be855afbea716835f94b  net_10.bin
+5e6957311877e97de02b06922a34cef37ba2266baa638564d8a7144137f5bac6  net_11.bin
+f86812770cbcc79b59857f671075309978a353cb02297083c1d8c1d820661287  net_12.bin
+61a05702a5ad1eec1ad0f21e1b072ed4233ea9f91a3fb0d86df8ada64c5c5637  net_13.bin
+f6802b71b7897936d0399d598bf91add4ee2bfc03d18999776d860beeaee0289  net_14.bin
+5a02dbbea023ea7251ced62591da0578770582fe9f322fade29e60be732f605b  net_15.bin
+73200b95521febfac3c8ded76e1a85b5a857eeff3c5b25f102a5949098c8c63f  net_16.bin
+2400dd7476f388e22edcc396c9c7d85e0b528e358865cb16d5f09e9a2df469da  net_2.bin
+694fe35c408b561a8e9ccb9d29d00d07f281050f93ace008a71ee04a61c7b178  net_3.bin
+d18d1d431f802c73f723a849b959bc4cde64315f65c52239a2ed2e0b29992606  net_4.bin
+7dce635ae2e1203bda5bb7ad9556b43e68309d8e30dd3eb72372cc0134f292a3  net_5.bin
+4e6d269098f09c90e354d653223a8fb3d5df5c03118988bc691e581bd681e67d  net_6.bin
+932eb944b350d825a682726db7f80bb6211bc721aae82ff0611d1708d7e487c8  net_7.bin
+33c1b35290ae74ffc19c8cc29df63d3141f73fb4a14587c0bbbeadb6927eb01d  net_8.bin
+6c71f817403b64f261a296f5d768fd343e7cbd2510fd15d76a79c83149a6098b  net_9.bin
+583d9435abea0339991d712746a9b30f914cafadabf00391c959ad2d786cd894  run_1.bin
+10e0be1e3ee37b35e4d9d5598bd2cf053874ff37f89c96bf144a3e22f95b845e  run_10.bin
+1d3d826f4ca51916a095bd6a99f6c74f39660c0a3d525f7190a81767e5f888cb  run_11.bin
+da2de48bb567798c605afd509e3eca3151aededbc97dcf4993c7c12dffa86fc1  run_12.bin
+a35c79013acc4bba3417f12d2d357a31e39f58c60b23c45be1e2bd1d3b3a4d03  run_13.bin
+fc7ce67caf1b93b0fbd349fe0cb0ba8fad4c9dd9e3f4862a2680e36f63617cc2  run_14.bin
+533649310ce539b85c8e12ae4e4d965d9fd7e8e18839a74a810d33d283a6e386  run_15.bin
+27a979716bacfdc6269bc3be5c4e18cb54e7174fbebe70a0286c94ff64764367  run_16.bin
+96dadbd94a083e2492df7e2e24942e36dc8bb52bb98ff766dfe8860f426baabc  run_2.bin
+7c8a8ad27e6b71bd548b9640697c46d216ee1573192e2f241740ac3d1bef33ba  run_3.bin
+5ea947e1d0e89b0f1d6c2a0c3fadfc07afe5dc4325037404b2ddfde0781f09fe  run_4.bin
+e94e039cdf4a74a9562c3fdda73615100101a3290fec87e295789e61d9caf53d  run_5.bin
+332967d1170b2b09e94cc461c90ed40e29b17de193349eaa20e0615719630145  run_6.bin
+6febf2e7f92e663c8424402b6098fc50cf015cdf0c5ffcc1806a9cc6a8904486  run_7.bin
+fde96b2a0687390ba8c09ed71088019d020fe4d607dca415754d8c6e23888247  run_8.bin
+5475822efb23adc77f819ab5309814c5d2fd8af9d2349685c717fdfc1775a5f5  run_9.bin
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./net_ --output-format analog --transform-module "despike:mode=median:window=5"
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./run_ --output-format analog --transform-module "despike:mode=median:window=9"
+ret=$(($? + ret))
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,53 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+# a fused chain of transforms must give the same result as applying the transforms in separate runs
+
+filter="filter:type=notch:freq=500:width=50:sections=2"
+calib="calibrate_linear_3p:calib_file=${sample_dir}/calib_reference.ini"
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./fused_ --output-format analog --transform-module "${filter}" --transform-module "${calib}"
+ret=$?
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./filtered_ --output-format analog --transform-module "${filter}"
+ret=$(($? + ret))
+
+${wrapper} ./eecu-sat --input "./filtered_[0-9]*.bin" --output ./calibrated_ --output-format analog --transform-module "${calib}"
+ret=$(($? + ret))
+
+for i in $(seq 1 16); do
+    cmp "fused_${i}.bin" "calibrated_${i}.bin"
+    ret=$(($? + ret))
+done
+
+# the filter is designed for the rate every channel has after the resampler,
+# a 1562.5 Hz square wave recorded at 12500 Hz passes a 2000 Hz lowpass
+# while the other channel is recorded at half that rate
+printf '\000\000\200\077\000\000\200\077\000\000\200\077\000\000\200\077' > hi.bin
+printf '\000\000\200\277\000\000\200\277\000\000\200\277\000\000\200\277' > lo.bin
+head -c 48 "${sample_dir}/analog_0.bin" > hdr_0.bin
+{
+    head -c 32 hdr_0.bin
+    printf '\364\001\000\000\000\000\000\000'
+    tail -c 8 hdr_0.bin
+} > hdr_1.bin
+for n in 0 1; do
+    {
+        cat "hdr_${n}.bin"
+        i=0
+        while [ "${i}" -lt 500 ]; do
+            cat hi.bin lo.bin
+            i=$((i + 1))
+        done
+    } > "mix_${n}.bin"
+done
+${wrapper} ./eecu-sat --input "mix_[0-9]*.bin" --output ./mix_out_ --output-format analog --transform-module "resample:rate=12500" --transform-module "filter:type=lowpass:freq=2000"
+ret=$(($? + ret))
+od -A n -t f4 -v -j $((48 + 3000 * 4)) mix_out_2.bin | awk '{ for (i = 1; i <= NF; i++) if ($i > max) max = $i } END { exit !(max > 0.8) }'
+ret=$(($? + ret))
+
+exit "${ret}"
@@ -0,0 +1,59 @@
+#!/bin/sh
+
+# environment variables received by this script from caller
+# 
+# ${sample_dir}  - directory from where to get the data files
+# ${wrapper}     - an external binary that will indirectly call the unit test - like valgrind or strace
+
+cat << EOF > manifest
+aa6d76e7efa6b675ac5136535c4f654a2d31fa04ea7024d4e671b9e2cdf152a6  analog-1-1-1
+88c6f48bb5cd93f429cc161fb00b8ac0dd2601a9daa0277b238a3f3103b358af  analog-1-10-1
+44b6ae3c350681836386f20406c37b9f1655185e8154106177dd27990b70e7c3  analog-1-11-1
+31f41c0224a53e8903bf430de028723d2d51028b225ce2c97989acea4f0a677e  analog-1-12-1
+1b3e64e6b6bb1df2dc85ee2e2696c4148843452ba22773373b17c3bdc365b9d2  analog-1-13-1
+55a7bcf67b8d54a4e0026d8379d12a6e57702cc77f55688bd2e458e6c8b90835  analog-1-14-1
+0ec70ff4f3be52b9811fe448393f5280b06ceb0cfa531dcf527b7d735995e6e6  analog-1-15-1
+9c09d8cf5550a5f8feda69e53ca73cd63ddab975a160d60ca79801d39f5d3629  analog-1-16-1
+a92c7baf5fe4fc364055ec13679967f345dd0965b2f228a98a843eef53a857ad  analog-1-2-1
+e2c144fb40fb191458ee627d5306fb3932adc08299da77dc7953c351ecce3a26  analog-1-3-1
+2d09ec0647b77e769b8e1134c3b3bffa24f080aae496a5f98f936bbc24007d70  analog-1-4-1
+3bb97e0201bc922afbcff1e318f2ef06534a263cd7170400eba2716dd30e2b63  analog-1-5-1
+8adf17fd4e2445d646bcc4c7191e160916b18809a5c850d8f40d9ef1689405d2  analog-1-6-1
+4daa6bb0e075af41833624f5b2b1add2775ba0104afb01b23b452d247c48c752  analog-1-7-1
+82526a6bbeb977deddbeead073858caa3950d290f9a02d7de4b152030f38373d  analog-1-8-1
+547bc2de35120691dcf79dabca92d3b6d25cfc6665b3ab4618fee4af8bf4cc69  analog-1-9-1
+EOF
+
+${wrapper} ./eecu-sat --input "${sample_dir}/analog_[0-9]*.bin" --output ./resampled.sr --output-format "srzip" --transform-module "resample:rate=10000"
+ret=$?
+
+unzip -q resampled.sr
+
+sha256sum --quiet -c manifest
+ret=$(($? + ret))
+
+grep -q '^samplerate=10000 Hz$' metadata
+ret=$(($? + ret))
+
+# a channel of n samples gives ceil(n * 10000 / 6250) outputs, the last
+# sample is repeated to bring out the ones held back by the filter delay
+printf '\000\000\000\000' > lo.bin
+printf '\000\000\240\100' > hi.bin
+{
+    head -c 48 "${sample_dir}/analog_0.bin"
+    for f in lo.bin hi.bin; do
+        i=0
+        while [ "${i}" -lt 1001 ]; do
+            cat "${f}"
+            i=$((i + 1))
+        done
+    done
+} > step_0.bin
+${wrapper} ./eecu-sat --input "step_0.bin" --output ./step_ --output-format analog --transform-module "resample:rate=10000"
+ret=$(($? + ret))
+[ "$(wc -c < step_1.bin)" -eq $((48 + 3204 * 4)) ]
+ret=$(($? + ret))
+od -A n -t f4 -j $((48 + 3203 * 4)) -N 4 step_1.bin | awk '{ exit !(($1 > 4.99) && ($1 < 5.01)) }'
+ret=$(($? + ret))
+
+exit "${ret}"